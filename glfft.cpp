@@ -20,10 +20,20 @@
 #include <algorithm>
 #include <stdexcept>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 #include <numeric>
 #include <assert.h>
 #include <cmath>
+#include <complex>
+#include <atomic>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 #ifdef GLFFT_CLI_ASYNC
 #include "glfft_cli.hpp"
@@ -35,7 +45,12 @@
 #include "glsl/fft_radix8.inc"
 #include "glsl/fft_radix16.inc"
 #include "glsl/fft_radix64.inc"
+#include "glsl/fft_radix3.inc"
+#include "glsl/fft_radix5.inc"
+#include "glsl/fft_radix7.inc"
 #include "glsl/fft_shared.inc"
+#include "glsl/fft_radix_row.inc"
+#include "glsl/fft_tile.inc"
 #include "glsl/fft_main.inc"
 #endif
 
@@ -50,7 +65,8 @@ enum Bindings
     BindingUBO = 3,
     BindingTexture0 = 4,
     BindingTexture1 = 5,
-    BindingImage = 6
+    BindingImage = 6,
+    BindingSSBOTwiddle = 7
 };
 
 struct WorkGroupSize
@@ -66,17 +82,95 @@ struct Radix
     unsigned radix;
     unsigned vector_size;
     bool shared_banked;
+    bool twiddle_lut;
+    bool subgroup_shuffle;
+    unsigned stride;
 };
 
-static unsigned next_pow2(unsigned v)
+static const double pi = 3.14159265358979323846;
+
+// Radices above this are done with whole-row kernels, which keep all the samples of a transform in shared memory.
+static const unsigned max_shared_radix = 64;
+static const unsigned max_row_radix = 4096;
+// Shared memory GL guarantees for compute shaders.
+static const unsigned max_shared_memory = 32 * 1024;
+
+// 1D transforms of at least this many samples are done as 2D transforms with the four-step algorithm.
+static const unsigned four_step_min_size = 1 << 16;
+
+// Tiles of up to this size in either dimension are transformed by a single work group when batched.
+// A 64x64 tile fills the 32 KiB of shared memory GL guarantees.
+static const unsigned max_tile_size = 64;
+
+static bool is_tile_size(unsigned N)
+{
+    return N >= 4 && N <= max_tile_size && (N & (N - 1)) == 0;
+}
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b)
+    {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Transforms are split into radix-4, 8, 16 and 64 passes for the power-of-two part of N,
+// and radix-3, 5 and 7 passes for the rest.
+// A single factor of two cannot be expressed with these radices.
+static bool is_size_supported(unsigned N)
+{
+    if (N == 0)
+    {
+        return false;
+    }
+
+    unsigned pow2 = 0;
+    while ((N & 1) == 0)
+    {
+        N >>= 1;
+        pow2++;
+    }
+
+    if (pow2 == 1)
+    {
+        return false;
+    }
+
+    for (auto radix : { 3u, 5u, 7u })
+    {
+        while (N % radix == 0)
+        {
+            N /= radix;
+        }
+    }
+
+    return N == 1;
+}
+
+// Splits N into N1 x N2 for the four-step algorithm, with N1 the divisor closest to a square root
+// for which both factors can be planned, e.g. 70000 is 175 x 400 since 250 x 280 has single factors of two.
+// Returns 0 if there is no such split.
+static unsigned four_step_split(unsigned N)
 {
-    v--;
-    v |= v >> 16;
-    v |= v >> 8;
-    v |= v >> 4;
-    v |= v >> 2;
-    v |= v >> 1;
-    return v + 1;
+    unsigned N1 = 0;
+    for (unsigned d = 2; d * d <= N; d++)
+    {
+        if (N % d == 0 && is_size_supported(d) && is_size_supported(N / d))
+        {
+            N1 = d;
+        }
+    }
+    return N1;
+}
+
+// Size of the subgroups passes can exchange butterflies in, or 0 if the context cannot shuffle.
+static unsigned shuffle_subgroup_size(Context *context)
+{
+    return context->supports_subgroup_shuffle() ? context->get_subgroup_size() : 0;
 }
 
 static void reduce(unsigned &wg_size, unsigned &divisor)
@@ -104,14 +198,30 @@ static unsigned radix_to_wg_z(unsigned radix)
             return 8;
 
         default:
-            return 1;
+            // Whole-row kernels do four radix-4 butterflies per invocation in every stage.
+            return radix > max_shared_radix ? radix / 16 : 1;
     }
 }
 
+// Largest radix whole-row passes can do on the context, since their work groups are radix / 16 invocations deep in Z.
+static unsigned row_radix_limit(Context *context)
+{
+    unsigned limit = min(context->get_max_work_group_size_z(), context->get_max_work_group_threads());
+    unsigned radix = max_row_radix;
+    while (radix > max_shared_radix && radix_to_wg_z(radix) > limit)
+    {
+        radix >>= 1;
+    }
+    return radix;
+}
+
+// subgroup_size is the size of the subgroups radix-16 and radix-64 passes may shuffle in, or 0 to use shared memory.
+// packed_spectrum rounds the columns of vertical and depth passes up to whole work groups,
+// since Nx is N / 2 + 1 for packed half-spectra.
 static Radix build_radix(unsigned Nx, unsigned Ny,
-        Mode mode, unsigned vector_size, bool shared_banked, unsigned radix,
+        Mode mode, unsigned vector_size, bool shared_banked, bool twiddle_lut, unsigned subgroup_size, unsigned radix,
         WorkGroupSize size,
-        bool pow2_stride)
+        bool pow2_stride, bool packed_spectrum)
 {
     unsigned wg_x = 0, wg_y = 0;
 
@@ -129,46 +239,125 @@ static Radix build_radix(unsigned Nx, unsigned Ny,
     reduce(size.y, divisor);
     reduce(size.x, divisor);
 
+    bool dual = mode == VerticalDual || mode == HorizontalDual || mode == DepthDual;
+    bool horizontal = mode == Horizontal || mode == HorizontalDual;
+    unsigned components = dual ? 4 : 2;
+
+    if (dual)
+    {
+        vector_size = max(vector_size, 4u);
+    }
+
+    // Odd radix kernels only transform one complex value per thread horizontally,
+    // and have no FP16 vec8 implementation.
+    if (radix & 1)
+    {
+        vector_size = horizontal ? components : min(vector_size, 4u);
+    }
+
+    // Whole-row kernels only transform one complex value per invocation.
+    bool row = radix > max_shared_radix;
+    if (row)
+    {
+        vector_size = 2;
+    }
+
+    // For non-POT sizes, the vector size might not evenly divide the number of elements a pass works on.
+    unsigned elements_x = horizontal ? Nx / radix : Nx;
+    while (vector_size > components && (elements_x * components) % vector_size)
+    {
+        vector_size >>= 1;
+    }
+
+    unsigned threads_x = (elements_x * components) / vector_size;
+    unsigned threads_y = horizontal ? Ny : Ny / radix;
+
+    if ((horizontal ? Nx : Ny) % radix || (row && dual))
+    {
+        threads_x = 0;
+        threads_y = 0;
+    }
+
+    // Every transform in the work group needs radix samples of shared memory.
+    // The largest row only fits without the bank conflict padding.
+    if (row)
+    {
+        if (radix >= max_row_radix)
+        {
+            shared_banked = false;
+        }
+
+        unsigned transform_size = (radix + shared_banked) * 2 * sizeof(float);
+        while (size.x * size.y * transform_size > max_shared_memory)
+        {
+            if (size.y > 1)
+            {
+                size.y >>= 1;
+            }
+            else
+            {
+                size.x >>= 1;
+            }
+        }
+    }
+
+    // Non-POT dispatches might not be a multiple of the work group size, so shrink it.
+    // Packed spectra clamp excess invocations to the last column in the shader instead.
+    if (packed_spectrum && !horizontal && threads_x)
+    {
+        threads_x = ((threads_x + size.x - 1) / size.x) * size.x;
+    }
+    else if (threads_x >= size.x && threads_x % size.x)
+    {
+        size.x = gcd(size.x, threads_x);
+    }
+
+    if (threads_y >= size.y && threads_y % size.y)
+    {
+        size.y = gcd(size.y, threads_y);
+    }
+
     switch (mode)
     {
         case Vertical:
-            // If we have pow2_stride, we need to transform 2^n + 1 elements horizontally,
+            // If we have pow2_stride, we need to transform Nx + 1 elements horizontally,
             // so just add a single workgroup in X.
-            // We pad by going up to pow2 stride anyways.
+            // We pad by going up to double stride anyways.
             // We will transform some garbage,
             // but it's better than transforming close to double the amount.
-            wg_x = (2 * Nx) / (vector_size * size.x) + pow2_stride;
-            wg_y = Ny / (size.y * radix);
+            wg_x = threads_x / size.x + pow2_stride;
+            wg_y = threads_y / size.y;
             break;
 
         case VerticalDual:
-            vector_size = max(vector_size, 4u);
-            wg_x = (4 * Nx) / (vector_size * size.x);
-            wg_y = Ny / (size.y * radix);
-            break;
-
+        case Depth:
+        case DepthDual:
         case Horizontal:
-            wg_x = (2 * Nx) / (vector_size * radix * size.x);
-            wg_y = Ny / size.y;
-            break;
-
         case HorizontalDual:
-            vector_size = max(vector_size, 4u);
-            wg_x = (4 * Nx) / (vector_size * radix * size.x);
-            wg_y = Ny / size.y;
+            wg_x = threads_x / size.x;
+            wg_y = threads_y / size.y;
             break;
 
         default:
             assert(0);
     }
 
-    return { size, wg_x, wg_y, radix, vector_size, shared_banked };
+    // Row stride in units of the vector type. Only vertical and depth passes care about this.
+    unsigned stride = ((pow2_stride ? 2 : 1) * Nx * components) / vector_size;
+
+    // Shuffles can only replace the shared memory exchange if the whole work group is a single subgroup.
+    // The shaders index invocations by gl_SubgroupInvocationID, which only covers the work group if the subgroup is full.
+    bool subgroup_shuffle = (radix == 16 || radix == 64) && size.x * size.y * size.z == subgroup_size;
+
+    return { size, wg_x, wg_y, radix, vector_size, shared_banked, twiddle_lut, subgroup_shuffle, stride };
 }
 
 // Resolve radices are simpler, and don't yet support different vector sizes, etc.
-static Radix build_resolve_radix(unsigned Nx, unsigned Ny, WorkGroupSize size)
+static Radix build_resolve_radix(unsigned Nx, unsigned Ny, WorkGroupSize size, bool twiddle_lut)
 {
-    return { size, Nx / size.x, Ny / size.y, 2, 2, false };
+    size.x = gcd(size.x, Nx);
+    size.y = gcd(size.y, Ny);
+    return { size, Nx / size.x, Ny / size.y, 2, 2, false, twiddle_lut, false, Nx };
 }
 
 // Smaller FFT with larger workgroups are not always possible to create.
@@ -178,9 +367,9 @@ static bool is_radix_valid(unsigned Nx, unsigned Ny,
         bool pow2_stride)
 {
     auto res = build_radix(Nx, Ny,
-            mode, vector_size, false, radix,
+            mode, vector_size, false, false, 0, radix,
             size,
-            pow2_stride);
+            pow2_stride, false);
 
     return res.num_workgroups_x > 0 && res.num_workgroups_y > 0;
 }
@@ -222,13 +411,18 @@ struct CostPropagate
 
 static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target input_target, Target output_target,
         const FFTOptions &options,
-        bool pow2_stride, const FFTWisdom &wisdom, double &accumulate_cost)
+        bool pow2_stride, bool packed_spectrum, unsigned subgroup_size, unsigned max_radix,
+        const FFTWisdom &wisdom, double &accumulate_cost)
 {
     unsigned N;
     switch (mode)
     {
         case Vertical:
         case VerticalDual:
+        // Depth passes are vertical passes where an entire slice is flattened into one row,
+        // so Nx is the size of a slice and Ny is the depth.
+        case Depth:
+        case DepthDual:
             N = Ny;
             break;
 
@@ -247,8 +441,22 @@ static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target i
         return {};
     }
 
+    // Odd factors are done with radix-3, 5 and 7 passes after all the power-of-two passes.
+    // This way, the power-of-two kernels only ever see power-of-two P factors.
+    // The remaining power-of-two part is split optimally below.
+    unsigned full_N = N;
+    vector<unsigned> odd_radices;
+    for (auto radix : { 7u, 5u, 3u })
+    {
+        while (N % radix == 0)
+        {
+            odd_radices.push_back(radix);
+            N /= radix;
+        }
+    }
+
     // Treat cost 0.0 as invalid.
-    double cost_table[8] = {0.0};
+    double cost_table[13] = {0.0};
     CostPropagate cost_propagate[32];
 
     // Fill table with fastest known ways to do radix 4, radix 8, radix 16, and 64.
@@ -257,6 +465,11 @@ static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target i
     cost_table[3] = find_cost(Nx, Ny, mode,  8, options, wisdom);
     cost_table[4] = find_cost(Nx, Ny, mode, 16, options, wisdom);
     cost_table[6] = find_cost(Nx, Ny, mode, 64, options, wisdom);
+    // Whole-row kernels can do up to max_radix samples in one pass.
+    for (unsigned i = 8; (1u << i) <= max_radix; i++)
+    {
+        cost_table[i] = find_cost(Nx, Ny, mode, 1u << i, options, wisdom);
+    }
 
     auto is_valid = [&](unsigned radix) -> bool {
         unsigned workgroup_size_z = radix_to_wg_z(radix);
@@ -270,10 +483,10 @@ static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target i
     };
 
     // If our work-space is too small to allow certain radices, we disable them from consideration here.
-    for (unsigned i = 2; i <= 6; i++)
+    for (unsigned i = 2; (1u << i) <= max_radix; i++)
     {
-        // Don't check the composite radix.
-        if (i == 5)
+        // Don't check the composite radices.
+        if (i == 5 || i == 7)
         {
             continue;
         }
@@ -311,7 +524,18 @@ static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target i
 
     sort(begin(radices), end(radices), greater<unsigned>());
 
-    if (accumulate(begin(radices), end(radices), 1u, multiplies<unsigned>()) != N)
+    for (auto radix : odd_radices)
+    {
+        if (!is_valid(radix))
+        {
+            throw logic_error("There is no possible subdivision ...\n");
+        }
+
+        cost.cost += find_cost(Nx, Ny, mode, radix, options, wisdom);
+    }
+    radices.insert(end(radices), begin(odd_radices), end(odd_radices));
+
+    if (accumulate(begin(radices), end(radices), 1u, multiplies<unsigned>()) != full_N)
     {
         throw logic_error("Radix splits are invalid.");
     }
@@ -329,26 +553,51 @@ static vector<Radix> split_radices(unsigned Nx, unsigned Ny, Mode mode, Target i
         // We used SSBO -> SSBO cost functions to find the optimal radix splits,
         // but replace first and last options with Image -> SSBO / SSBO -> Image cost functions if appropriate.
         auto &orig_opt = wisdom.find_optimal_options_or_default(Nx, Ny, radix, mode, SSBO, SSBO, options);
+        // The fallback must outlive opts, which may refer to it.
+        const FFTOptions fallback = { orig_opt, options.type };
         auto &opts = wisdom.find_optimal_options_or_default(Nx, Ny, radix, mode,
                 first ? input_target : SSBO,
                 last ? output_target : SSBO,
-                { orig_opt, options.type });
+                fallback);
 
         radices_out.push_back(build_radix(Nx, Ny,
-                    mode, opts.vector_size, opts.shared_banked, radix,
+                    mode, opts.vector_size, opts.shared_banked, opts.twiddle_lut,
+                    opts.subgroup_shuffle ? subgroup_size : 0, radix,
                     { opts.workgroup_size_x, opts.workgroup_size_y, radix_to_wg_z(radix) },
-                    pow2_stride));
+                    pow2_stride, packed_spectrum));
     }
 
     accumulate_cost += cost.cost;
     return radices_out;
 }
 
+// With a fused resolve, the horizontal transform of a real transform is a single whole-row pass,
+// which also does the resolve.
+static Radix build_fused_radix(unsigned Nx, unsigned Ny, Target input_target, Target output_target,
+        const FFTOptions &options, const FFTWisdom &wisdom, double &accumulate_cost)
+{
+    auto &orig_opt = wisdom.find_optimal_options_or_default(Nx, Ny, Nx, Horizontal, SSBO, SSBO, options);
+    const FFTOptions fallback = { orig_opt, options.type };
+    auto &opts = wisdom.find_optimal_options_or_default(Nx, Ny, Nx, Horizontal, input_target, output_target, fallback);
+
+    // There is only one transform per row, so work groups can only span rows.
+    accumulate_cost += find_cost(Nx, Ny, Horizontal, Nx, options, wisdom);
+    return build_radix(Nx, Ny,
+            Horizontal, 2, opts.shared_banked, opts.twiddle_lut, 0, Nx,
+            { 1, gcd(opts.workgroup_size_y, Ny), radix_to_wg_z(Nx) },
+            false, false);
+}
+
 Program* ProgramCache::find_program(const Parameters &parameters) const
 {
     auto itr = programs.find(parameters);
     if (itr != end(programs))
     {
+        // Don't let later plans pick up the broken program.
+        if (is_failed(itr->second.get()))
+        {
+            throw runtime_error("Program failed to compile.\n");
+        }
         return itr->second.get();
     }
     else
@@ -362,273 +611,1144 @@ void ProgramCache::insert_program(const Parameters &parameters, std::unique_ptr<
     programs[parameters] = move(program);
 }
 
-Program* FFT::get_program(const Parameters &params)
+// FNV-1a, which unlike std::hash is stable across runs and standard libraries.
+static uint64_t fnv1a(uint64_t h, const void *data, size_t size)
 {
-    Program *prog = cache->find_program(params);
-    if (!prog)
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
     {
-        auto newprog = build_program(params);
-        if (!newprog)
-        {
-            throw runtime_error("Failed to compile shader.\n");
-        }
-        prog = newprog.get();
-        cache->insert_program(params, move(newprog));
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
     }
-    return prog;
+    return h;
 }
 
-static inline unsigned mode_to_input_components(Mode mode)
+// Every file starts with this magic, followed by the full key, to catch truncated files and name collisions.
+static const char program_binary_magic[8] = { 'G', 'L', 'F', 'F', 'T', 'P', 'B', '1' };
+
+uint64_t ProgramBinaryCache::hash(Context *context, const string &source)
 {
-    switch (mode)
-    {
-        case HorizontalDual:
-        case VerticalDual:
-            return 4;
+    const char *renderer = context->get_renderer_string();
+    uint64_t h = fnv1a(0xcbf29ce484222325ull, renderer, strlen(renderer) + 1);
+    return fnv1a(h, source.data(), source.size());
+}
 
-        case Horizontal:
-        case Vertical:
-        case ResolveComplexToReal:
-            return 2;
+string ProgramBinaryCache::get_path(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+    return directory + name;
+}
 
-        case ResolveRealToComplex:
-            return 1;
+unique_ptr<Program> ProgramBinaryCache::load(Context *context, const string &source) const
+{
+    uint64_t key = hash(context, source);
+    ifstream file(get_path(key), ios::binary);
+    if (!file)
+    {
+        return nullptr;
+    }
 
-        default:
-            return 0;
+    char magic[sizeof(program_binary_magic)];
+    uint64_t file_key = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&file_key), sizeof(file_key));
+    if (!file || memcmp(magic, program_binary_magic, sizeof(magic)) != 0 || file_key != key)
+    {
+        return nullptr;
+    }
+
+    vector<char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (binary.empty())
+    {
+        return nullptr;
     }
+
+    // This fails if the driver has changed since the binary was stored, in which case we compile again.
+    return context->load_program_binary(binary.data(), binary.size());
 }
 
-FFT::FFT(Context *context, unsigned Nx, unsigned Ny,
-        unsigned radix, unsigned p,
-        Mode mode, Target input_target, Target output_target,
-        std::shared_ptr<ProgramCache> program_cache, const FFTOptions &options)
-    : context(context), cache(move(program_cache)), size_x(Nx), size_y(Ny)
+// Unique per process and per call, so concurrent writers of the same file never share a temporary file.
+static string temporary_path(const string &path)
 {
-    set_texture_offset_scale(0.5f / Nx, 0.5f / Ny, 1.0f / Nx, 1.0f / Ny);
+    static atomic<unsigned> counter;
+    return path + "." + to_string(getpid()) + "." + to_string(counter++) + ".tmp";
+}
 
-    if (!Nx || !Ny || (Nx & (Nx - 1)) || (Ny & (Ny - 1)))
+void ProgramBinaryCache::store(Context *context, const string &source, Program *program) const
+{
+    vector<uint8_t> binary;
+    if (!context->get_program_binary(program, binary) || binary.empty())
     {
-        throw logic_error("FFT size is not POT.");
+        return;
     }
 
-    if (p != 1 && input_target != SSBO)
+    uint64_t key = hash(context, source);
+    string path = get_path(key);
+
+    // Write to a temporary file first so other processes never see a partially written binary.
+    string tmp_path = temporary_path(path);
     {
-        throw logic_error("P != 1 only supported with SSBO as input.");
+        ofstream file(tmp_path, ios::binary | ios::trunc);
+        if (!file)
+        {
+            context->log("GLFFT: Failed to open program binary %s for writing.\n", tmp_path.c_str());
+            return;
+        }
+
+        file.write(program_binary_magic, sizeof(program_binary_magic));
+        file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+        if (!file)
+        {
+            context->log("GLFFT: Failed to write program binary %s.\n", tmp_path.c_str());
+            file.close();
+            remove(tmp_path.c_str());
+            return;
+        }
     }
 
-    if (p < radix && output_target != SSBO)
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
     {
-        throw logic_error("P < radix only supported with SSBO as output.");
+        remove(tmp_path.c_str());
     }
+}
 
-    // We don't really care about transform direction since it's just a matter of sign-flipping twiddles,
-    // but we have to obey some fundamental assumptions of resolve passes.
-    Direction direction = mode == ResolveComplexToReal ? Inverse : Forward;
+static const char program_bundle_magic[8] = { 'G', 'L', 'F', 'F', 'T', 'S', 'B', '1' };
 
-    Radix res;
-    if (mode == ResolveRealToComplex || mode == ResolveComplexToReal)
+// The index of a bundle file, which is followed by the SPIR-V of all programs.
+struct ProgramBundleEntry
+{
+    uint64_t key;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Bundles built from other shader sources, or with another layout of Parameters, are rejected as a whole.
+static uint64_t program_bundle_shader_hash()
+{
+    uint64_t parameters_size = Parameters::compared_size();
+    uint64_t h = fnv1a(0xcbf29ce484222325ull, &parameters_size, sizeof(parameters_size));
+
+#ifdef GLFFT_SHADER_FROM_FILE
+    // Hash the same files build_program_source() loads.
+    static const char *paths[] = {
+        "glfft/glsl/fft_common.comp", "glfft/glsl/fft_radix4.comp", "glfft/glsl/fft_radix8.comp", "glfft/glsl/fft_radix16.comp",
+        "glfft/glsl/fft_radix64.comp", "glfft/glsl/fft_radix3.comp", "glfft/glsl/fft_radix5.comp", "glfft/glsl/fft_radix7.comp",
+        "glfft/glsl/fft_shared.comp", "glfft/glsl/fft_radix_row.comp", "glfft/glsl/fft_tile.comp", "glfft/glsl/fft_main.comp",
+    };
+
+    for (auto path : paths)
     {
-        res = build_resolve_radix(Nx, Ny, { options.performance.workgroup_size_x, options.performance.workgroup_size_y, 1 });
+        ifstream file(path);
+        string source((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        h = fnv1a(h, source.data(), source.size());
     }
-    else
+#else
+    static const char *sources[] = {
+        Blob::fft_common_source, Blob::fft_radix4_source, Blob::fft_radix8_source, Blob::fft_radix16_source,
+        Blob::fft_radix64_source, Blob::fft_radix3_source, Blob::fft_radix5_source, Blob::fft_radix7_source,
+        Blob::fft_shared_source, Blob::fft_radix_row_source, Blob::fft_tile_source, Blob::fft_main_source,
+    };
+
+    for (auto source : sources)
     {
-        res = build_radix(Nx, Ny,
-                mode, options.performance.vector_size, options.performance.shared_banked, radix,
-                { options.performance.workgroup_size_x, options.performance.workgroup_size_y, radix_to_wg_z(radix) },
-                false);
+        h = fnv1a(h, source, strlen(source));
     }
+#endif
+    return h;
+}
 
-    const Parameters params = {
-        res.size.x,
-        res.size.y,
-        res.size.z,
-        res.radix,
-        res.vector_size,
-        direction,
-        mode,
-        input_target,
-        output_target,
-        p == 1,
-        res.shared_banked,
-        options.type.fp16, options.type.input_fp16, options.type.output_fp16,
-        options.type.normalize,
-    };
+uint64_t ProgramBundle::hash(const Parameters &parameters)
+{
+    return fnv1a(0xcbf29ce484222325ull, &parameters, Parameters::compared_size());
+}
 
-    if (res.num_workgroups_x == 0 || res.num_workgroups_y == 0)
+void ProgramBundle::add(const Parameters &parameters, vector<uint32_t> spirv)
+{
+    programs[hash(parameters)] = move(spirv);
+}
+
+unique_ptr<Program> ProgramBundle::create_program(Context *context, const Parameters &parameters) const
+{
+    auto itr = programs.find(hash(parameters));
+    if (itr == end(programs))
     {
-        throw logic_error("Invalid workgroup sizes for this radix.");
+        return nullptr;
     }
 
-    unsigned uv_scale_x = res.vector_size / mode_to_input_components(mode);
-    const Pass pass = {
-        params,
-        res.num_workgroups_x, res.num_workgroups_y,
-        uv_scale_x,
-        next_pow2(res.num_workgroups_x * params.workgroup_size_x),
-        get_program(params),
-    };
-
-    passes.push_back(pass);
+    auto &spirv = itr->second;
+    return context->load_program_binary(spirv.data(), spirv.size() * sizeof(uint32_t));
 }
 
-static inline void print_radix_splits(Context *context, const vector<Radix> radices[2])
+bool ProgramBundle::load(const string &path)
 {
-    context->log("Transform #1\n");
-    for (auto &radix : radices[0])
+    ifstream file(path, ios::binary);
+    if (!file)
     {
-        context->log("  Size: (%u, %u, %u)\n",
-                radix.size.x, radix.size.y, radix.size.z);
-        context->log("  Dispatch: (%u, %u)\n",
-                radix.num_workgroups_x, radix.num_workgroups_y);
-        context->log("  Radix: %u\n",
-                radix.radix);
-        context->log("  VectorSize: %u\n\n",
-                radix.vector_size);
+        return false;
     }
 
-    context->log("Transform #2\n");
-    for (auto &radix : radices[1])
+    char magic[sizeof(program_bundle_magic)];
+    uint64_t shader_hash = 0;
+    uint64_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&shader_hash), sizeof(shader_hash));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file || memcmp(magic, program_bundle_magic, sizeof(magic)) != 0 || shader_hash != program_bundle_shader_hash())
     {
-        context->log("  Size: (%u, %u, %u)\n",
-                radix.size.x, radix.size.y, radix.size.z);
-        context->log("  Dispatch: (%u, %u)\n",
-                radix.num_workgroups_x, radix.num_workgroups_y);
-        context->log("  Radix: %u\n",
-                radix.radix);
-        context->log("  VectorSize: %u\n\n",
-                radix.vector_size);
+        return false;
     }
-}
 
-static inline unsigned type_to_input_components(Type type)
-{
-    switch (type)
+    vector<ProgramBundleEntry> index;
+    for (uint64_t i = 0; i < count; i++)
     {
-        case ComplexToComplex:
-        case ComplexToReal:
-            return 2;
+        ProgramBundleEntry entry;
+        if (!file.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+        {
+            return false;
+        }
+        index.push_back(entry);
+    }
 
-        case RealToComplex:
-            return 1;
+    vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
 
-        case ComplexToComplexDual:
-            return 4;
+    decltype(programs) loaded;
+    for (auto &entry : index)
+    {
+        if (entry.offset > data.size() || entry.size > data.size() - entry.offset || (entry.size % sizeof(uint32_t)) != 0)
+        {
+            return false;
+        }
 
-        default:
-            return 0;
+        vector<uint32_t> spirv(entry.size / sizeof(uint32_t));
+        memcpy(spirv.data(), data.data() + entry.offset, entry.size);
+        loaded[entry.key] = move(spirv);
     }
+
+    programs = move(loaded);
+    return true;
 }
 
-FFT::FFT(Context *context, unsigned Nx, unsigned Ny,
-        Type type, Direction direction, Target input_target, Target output_target,
-        std::shared_ptr<ProgramCache> program_cache, const FFTOptions &options, const FFTWisdom &wisdom)
-    : context(context), cache(move(program_cache)), size_x(Nx), size_y(Ny)
+bool ProgramBundle::save(const string &path) const
 {
-    set_texture_offset_scale(0.5f / Nx, 0.5f / Ny, 1.0f / Nx, 1.0f / Ny);
+    string tmp_path = temporary_path(path);
+    {
+        ofstream file(tmp_path, ios::binary | ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
 
-    size_t temp_buffer_size = Nx * Ny * sizeof(float) * (type == ComplexToComplexDual ? 4 : 2);
-    temp_buffer_size >>= options.type.output_fp16;
+        uint64_t shader_hash = program_bundle_shader_hash();
+        uint64_t count = programs.size();
+        file.write(program_bundle_magic, sizeof(program_bundle_magic));
+        file.write(reinterpret_cast<const char*>(&shader_hash), sizeof(shader_hash));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
 
-    temp_buffer = context->create_buffer(nullptr, temp_buffer_size, AccessStreamCopy);
-    if (output_target != SSBO)
-    {
-        temp_buffer_image = context->create_buffer(nullptr, temp_buffer_size, AccessStreamCopy);
-    }
+        uint64_t offset = 0;
+        for (auto &program : programs)
+        {
+            ProgramBundleEntry entry = { program.first, offset, program.second.size() * sizeof(uint32_t) };
+            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            offset += entry.size;
+        }
+
+        for (auto &program : programs)
+        {
+            file.write(reinterpret_cast<const char*>(program.second.data()), program.second.size() * sizeof(uint32_t));
+        }
+
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+Program* ProgramCache::load_bundled_program(Context *context, const Parameters &parameters)
+{
+    if (!bundle)
+    {
+        return nullptr;
+    }
+
+    auto program = bundle->create_program(context, parameters);
+    if (!program)
+    {
+        return nullptr;
+    }
+
+    Program *ptr = program.get();
+    insert_program(parameters, move(program));
+    return ptr;
+}
+
+vector<Parameters> ProgramCache::get_parameters() const
+{
+    vector<Parameters> parameters;
+    parameters.reserve(programs.size());
+    for (auto &program : programs)
+    {
+        parameters.push_back(program.first);
+    }
+    return parameters;
+}
+
+Program* ProgramCache::compile_program(Context *context, const Parameters &parameters, const string &source)
+{
+    unique_ptr<Program> program;
+    if (binary_cache)
+    {
+        program = binary_cache->load(context, source);
+        if (program)
+        {
+            Program *ptr = program.get();
+            insert_program(parameters, move(program));
+            return ptr;
+        }
+    }
+
+    program = context->begin_compile_compute_shader(source.c_str());
+    if (!program)
+    {
+        puts(source.c_str());
+        throw runtime_error("Failed to compile shader.\n");
+    }
+
+    Program *ptr = program.get();
+    insert_program(parameters, move(program));
+    pending.push_back({ parameters, ptr, source });
+
+    if (!deferred)
+    {
+        wait_for_programs(context);
+    }
+    return ptr;
+}
+
+void ProgramCache::finish_program(Context *context, const PendingProgram &pending_program)
+{
+    if (!context->end_compile_compute_shader(pending_program.program))
+    {
+        puts(pending_program.source.c_str());
+        // Plans which were built while the program compiled still refer to it, so it stays in the cache.
+        failed.insert(pending_program.program);
+        throw runtime_error("Failed to compile shader.\n");
+    }
+
+    if (binary_cache)
+    {
+        binary_cache->store(context, pending_program.source, pending_program.program);
+    }
+}
+
+bool ProgramCache::programs_ready(Context *context)
+{
+    for (size_t i = 0; i < pending.size(); )
+    {
+        if (context->is_program_compiled(pending[i].program))
+        {
+            auto pending_program = move(pending[i]);
+            pending.erase(begin(pending) + i);
+            finish_program(context, pending_program);
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return pending.empty();
+}
+
+void ProgramCache::wait_for_programs(Context *context)
+{
+    while (!pending.empty())
+    {
+        auto pending_program = move(pending.back());
+        pending.pop_back();
+        finish_program(context, pending_program);
+    }
+}
+
+Program* FFT::get_program(const Parameters &params)
+{
+    Program *prog = cache->find_program(params);
+    if (!prog)
+    {
+        prog = cache->load_bundled_program(context, params);
+    }
+    if (!prog)
+    {
+        prog = cache->compile_program(context, params, build_program_source(params));
+    }
+    return prog;
+}
+
+static inline unsigned mode_to_input_components(Mode mode)
+{
+    switch (mode)
+    {
+        case HorizontalDual:
+        case VerticalDual:
+        case DepthDual:
+            return 4;
+
+        case Horizontal:
+        case Vertical:
+        case Depth:
+        case ResolveComplexToReal:
+            return 2;
+
+        case ResolveRealToComplex:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+struct TwiddleRange
+{
+    unsigned offset;
+    unsigned n;
+};
+
+// Finds the table a pass reads in the layout created by init_twiddle_lut().
+static inline TwiddleRange twiddle_lut_range(Mode mode, unsigned Nx, unsigned Ny, unsigned Nz)
+{
+    switch (mode)
+    {
+        case Vertical:
+        case VerticalDual:
+            return { 2 * Nx, Ny };
+
+        case Depth:
+        case DepthDual:
+            return { 2 * (Nx + Ny), Nz };
+
+        default:
+            return { 0, Nx };
+    }
+}
+
+FFT::FFT(Context *context, unsigned Nx, unsigned Ny,
+        unsigned radix, unsigned p,
+        Mode mode, Target input_target, Target output_target,
+        std::shared_ptr<ProgramCache> program_cache, const FFTOptions &options)
+    : context(context), cache(move(program_cache)), size_x(Nx), size_y(Ny)
+{
+    set_texture_offset_scale(0.5f / Nx, 0.5f / Ny, 1.0f / Nx, 1.0f / Ny);
+
+    if (!is_size_supported(Nx) || !is_size_supported(Ny))
+    {
+        throw logic_error("FFT size is not supported.");
+    }
+
+    if (p != 1 && input_target != SSBO)
+    {
+        throw logic_error("P != 1 only supported with SSBO as input.");
+    }
+
+    if (p < radix && output_target != SSBO)
+    {
+        throw logic_error("P < radix only supported with SSBO as output.");
+    }
+
+    if (radix > max_shared_radix && radix > row_radix_limit(context))
+    {
+        throw logic_error("Radix is too large for the work group size limits of the context.");
+    }
+
+    // We don't really care about transform direction since it's just a matter of sign-flipping twiddles,
+    // but we have to obey some fundamental assumptions of resolve passes.
+    Direction direction = mode == ResolveComplexToReal ? Inverse : Forward;
+
+    Radix res;
+    if (mode == ResolveRealToComplex || mode == ResolveComplexToReal)
+    {
+        res = build_resolve_radix(Nx, Ny, { options.performance.workgroup_size_x, options.performance.workgroup_size_y, 1 },
+                options.performance.twiddle_lut);
+    }
+    else
+    {
+        res = build_radix(Nx, Ny,
+                mode, options.performance.vector_size, options.performance.shared_banked, options.performance.twiddle_lut,
+                options.performance.subgroup_shuffle ? shuffle_subgroup_size(context) : 0, radix,
+                { options.performance.workgroup_size_x, options.performance.workgroup_size_y, radix_to_wg_z(radix) },
+                false, false);
+    }
+
+    const Parameters params = {
+        res.size.x,
+        res.size.y,
+        res.size.z,
+        res.radix,
+        res.vector_size,
+        direction,
+        mode,
+        input_target,
+        output_target,
+        p == 1,
+        res.shared_banked,
+        options.type.fp16, options.type.input_fp16, options.type.output_fp16,
+        options.type.normalize,
+        res.twiddle_lut,
+        res.subgroup_shuffle,
+        false,
+        false,
+    };
+
+    if (res.num_workgroups_x == 0 || res.num_workgroups_y == 0)
+    {
+        throw logic_error("Invalid workgroup sizes for this radix.");
+    }
+
+    // Single stage depth passes transform Ny slices of Nx samples.
+    bool depth = mode == Depth || mode == DepthDual;
+    unsigned lut_y = depth ? 1 : Ny;
+    unsigned lut_z = depth ? Ny : 1;
+    auto lut_range = twiddle_lut_range(mode, Nx, lut_y, lut_z);
+
+    unsigned uv_scale_x = res.vector_size / mode_to_input_components(mode);
+    const Pass pass = {
+        params,
+        res.num_workgroups_x, res.num_workgroups_y, 1,
+        uv_scale_x,
+        res.stride,
+        0, 0,
+        lut_range.offset, lut_range.n,
+        get_program(params),
+    };
+
+    passes.push_back(pass);
+    init_twiddle_lut(Nx, lut_y, lut_z);
+    init_constant_data();
+}
+
+static inline void print_radix_splits(Context *context, const vector<Radix> radices[3])
+{
+    for (unsigned i = 0; i < 3; i++)
+    {
+        context->log("Transform #%u\n", i + 1);
+        for (auto &radix : radices[i])
+        {
+            context->log("  Size: (%u, %u, %u)\n",
+                    radix.size.x, radix.size.y, radix.size.z);
+            context->log("  Dispatch: (%u, %u)\n",
+                    radix.num_workgroups_x, radix.num_workgroups_y);
+            context->log("  Radix: %u\n",
+                    radix.radix);
+            context->log("  VectorSize: %u\n\n",
+                    radix.vector_size);
+        }
+    }
+}
+
+static inline unsigned type_to_input_components(Type type)
+{
+    switch (type)
+    {
+        case ComplexToComplex:
+        case ComplexToReal:
+            return 2;
+
+        case RealToComplex:
+            return 1;
+
+        case ComplexToComplexDual:
+            return 4;
+
+        default:
+            return 0;
+    }
+}
+
+FFT::FFT(Context *context, unsigned Nx, unsigned Ny,
+        Type type, Direction direction, Target input_target, Target output_target,
+        std::shared_ptr<ProgramCache> program_cache, const FFTOptions &options, const FFTWisdom &wisdom,
+        unsigned batch_count)
+    : FFT(context, Nx, Ny, 1, type, direction, input_target, output_target,
+            move(program_cache), options, wisdom, batch_count)
+{
+}
+
+FFT::FFT(Context *context, unsigned Nx, unsigned Ny, unsigned Nz,
+        Type type, Direction direction, Target input_target, Target output_target,
+        std::shared_ptr<ProgramCache> program_cache, const FFTOptions &options, const FFTWisdom &wisdom,
+        unsigned batch_count)
+    : context(context), cache(move(program_cache)), size_x(Nx), size_y(Ny), size_z(Nz), batch_count(batch_count)
+{
+    set_texture_offset_scale(0.5f / Nx, 0.5f / Ny, 1.0f / Nx, 1.0f / Ny);
+
+    if (batch_count == 0)
+    {
+        throw logic_error("Batch count must be at least 1.");
+    }
+
+    if (batch_count > 1 && (input_target != SSBO || output_target != SSBO))
+    {
+        throw logic_error("Batched transforms require SSBO input and output.");
+    }
+
+    if (Nz > 1 && (input_target != SSBO || output_target != SSBO))
+    {
+        throw logic_error("3D transforms require SSBO input and output.");
+    }
+
+    if (Ny == 1 && Nz == 1 && type == ComplexToComplex && !is_size_supported(Nx))
+    {
+        if (input_target != SSBO || output_target != SSBO || direction == InverseConvolve)
+        {
+            throw logic_error("Bluestein transforms only support SSBO to SSBO forward or inverse transforms.");
+        }
+
+        init_bluestein(Nx, direction, options, wisdom);
+        return;
+    }
+
+    if (Ny == 1 && Nz == 1 && type == ComplexToComplex && Nx >= four_step_min_size &&
+            input_target == SSBO && output_target == SSBO && four_step_split(Nx))
+    {
+        init_four_step(Nx, direction, options, wisdom);
+        return;
+    }
+
+    // A single tile would only occupy a single work group, so only batched transforms use tile kernels.
+    if (batch_count > 1 && Nz == 1 && type == ComplexToComplex && is_tile_size(Nx) && is_tile_size(Ny))
+    {
+        init_tile(Nx, Ny, direction, options);
+        return;
+    }
+
+    // A packed half-spectrum only needs N / 2 + 1 complex samples per row.
+    bool packed = (type == ComplexToReal || type == RealToComplex) && options.type.packed_spectrum;
+    unsigned temp_width = packed ? Nx / 2 + 1 : Nx;
+
+    size_t temp_buffer_size = temp_width * Ny * Nz * sizeof(float) * (type == ComplexToComplexDual ? 4 : 2);
+    temp_buffer_size >>= options.type.output_fp16;
+    temp_buffer_size *= batch_count;
+
+    temp_buffer = context->create_buffer(nullptr, temp_buffer_size, AccessStreamCopy);
+    if (output_target != SSBO)
+    {
+        temp_buffer_image = context->create_buffer(nullptr, temp_buffer_size, AccessStreamCopy);
+    }
+
+    bool expand = false;
+    if (type == ComplexToReal || type == RealToComplex)
+    {
+        if (Nx & 1)
+        {
+            throw logic_error("Real transforms require an even Nx.");
+        }
 
-    bool expand = false;
-    if (type == ComplexToReal || type == RealToComplex)
-    {
         // If we're doing C2R or R2C, we'll need double the scratch memory,
         // so make sure we're dividing Nx *after* allocating.
         Nx /= 2;
         expand = true;
     }
 
-    // Sanity checks.
-    if (!Nx || !Ny || (Nx & (Nx - 1)) || (Ny & (Ny - 1)))
+    // Sanity checks.
+    if (!is_size_supported(Nx) || !is_size_supported(Ny) || !is_size_supported(Nz))
+    {
+        throw logic_error("FFT size is not supported.");
+    }
+
+    if (type == ComplexToReal && direction == Forward)
+    {
+        throw logic_error("ComplexToReal transforms requires inverse transform.");
+    }
+
+    if (type == RealToComplex && direction != Forward)
+    {
+        throw logic_error("RealToComplex transforms requires forward transform.");
+    }
+
+    if (type == RealToComplex && input_target == Image)
+    {
+        throw logic_error("Input real-to-complex must use ImageReal target.");
+    }
+
+    if (type == ComplexToReal && output_target == Image)
+    {
+        throw logic_error("Output complex-to-real must use ImageReal target.");
+    }
+
+    if (packed && (type == RealToComplex ? output_target : input_target) != SSBO)
+    {
+        throw logic_error("Packed spectrum requires SSBO on the complex side.");
+    }
+
+    // A fused resolve needs the whole row in a single pass, so it is only possible for whole-row kernel sizes.
+    bool fused = expand && options.performance.fused_resolve &&
+        Nx > max_shared_radix && Nx <= row_radix_limit(context) && (Nx & (Nx - 1)) == 0;
+
+    // Dimensions are transformed one at a time, horizontal first for forward transforms, and last for inverse transforms.
+    // Real transforms are resolved right after the horizontal transform, or right before it for inverse transforms.
+    bool dual = type == ComplexToComplexDual;
+    Mode horizontal_mode = dual ? HorizontalDual : Horizontal;
+    Mode vertical_mode = dual ? VerticalDual : Vertical;
+    Mode depth_mode = dual ? DepthDual : Depth;
+
+    vector<Radix> radices[3];
+    Mode modes[3];
+    unsigned resolve_index = 0;
+
+    switch (direction)
+    {
+        case Forward:
+            modes[0] = horizontal_mode;
+            modes[1] = vertical_mode;
+            modes[2] = depth_mode;
+            resolve_index = 0;
+            break;
+
+        case Inverse:
+        case InverseConvolve:
+            modes[0] = depth_mode;
+            modes[1] = vertical_mode;
+            modes[2] = horizontal_mode;
+            resolve_index = 1;
+            break;
+    }
+
+    // On the complex side of the resolve, rows are Nx complex samples apart rather than Nx / 2,
+    // which doubles the size of a slice. Packed rows only hold the Nx / 2 + 1 samples which are used.
+    unsigned components = dual ? 4 : 2;
+    unsigned spectrum_width = packed ? Nx + 1 : 2 * Nx;
+    unsigned slice_widths[3];
+    bool expanded[3];
+    bool active[3];
+    for (unsigned index = 0; index < 3; index++)
+    {
+        Mode mode = modes[index];
+        expanded[index] = expand && (direction == Forward ? index > resolve_index : index <= resolve_index);
+        slice_widths[index] = (expanded[index] ? spectrum_width : Nx) * Ny;
+        active[index] = mode == horizontal_mode || (mode == vertical_mode ? Ny : Nz) > 1;
+    }
+
+    unsigned subgroup_size = shuffle_subgroup_size(context);
+    unsigned max_radix = row_radix_limit(context);
+    for (unsigned index = 0; index < 3; index++)
+    {
+        // Only the first and last dimensions which actually do something touch the input and output targets.
+        // We use SSBO -> SSBO cost functions for the rest.
+        bool first = none_of(active, active + index, [](bool a) { return a; });
+        bool last = none_of(active + index + 1, active + 3, [](bool a) { return a; });
+        Target in_target = first ? input_target : SSBO;
+        Target out_target = last ? output_target : SSBO;
+
+        // A depth pass transforms all columns of a slice at once, as if the slice was a single row.
+        Mode mode = modes[index];
+        if (mode == depth_mode)
+        {
+            radices[index] = split_radices(slice_widths[index], Nz, mode, in_target, out_target,
+                    options, false, packed && expanded[index], subgroup_size, max_radix, wisdom, cost);
+        }
+        else if (mode == vertical_mode && expanded[index] && packed)
+        {
+            radices[index] = split_radices(spectrum_width, Ny, mode, in_target, out_target,
+                    options, false, true, subgroup_size, max_radix, wisdom, cost);
+        }
+        else if (mode == horizontal_mode && fused)
+        {
+            radices[index] = { build_fused_radix(Nx, Ny, in_target, out_target, options, wisdom, cost) };
+        }
+        else
+        {
+            radices[index] = split_radices(Nx, Ny, mode, in_target, out_target,
+                    options, mode == vertical_mode && expanded[index], false, subgroup_size, max_radix, wisdom, cost);
+        }
+    }
+
+#if 0
+    print_radix_splits(context, radices);
+#endif
+
+    passes.reserve(radices[0].size() + radices[1].size() + radices[2].size() + (expand && !fused));
+
+    unsigned last_index = 0;
+    for (unsigned index = 0; index < 3; index++)
+    {
+        if (!radices[index].empty())
+        {
+            last_index = index;
+        }
+    }
+
+    bool resolve_last = expand && !fused && resolve_index >= last_index;
+
+    for (unsigned index = 0; index < 3; index++)
+    {
+        auto &radix_direction = radices[index];
+        bool depth = modes[index] == depth_mode;
+
+        // Batches are laid out back-to-back, and slices of a batch as well,
+        // so horizontal and vertical passes treat every slice of every batch as a separate batch.
+        unsigned batch_floats = slice_widths[index] * components * (depth ? Nz : 1);
+        unsigned workgroups_z = depth ? 1 : Nz;
+
+        // A fused resolve pass reads or writes the spectrum instead.
+        bool fused_pass = fused && modes[index] == horizontal_mode;
+        unsigned spectrum_floats = spectrum_width * Ny * components;
+        unsigned batch_floats_in = fused_pass && direction != Forward ? spectrum_floats : batch_floats;
+        unsigned batch_floats_out = fused_pass && direction == Forward ? spectrum_floats : batch_floats;
+
+        unsigned p = 1;
+        unsigned i = 0;
+        
+        for (auto &radix : radix_direction)
+        {
+            // If this is the last pass and we're writing to an image, use a special shader variant.
+            bool last_pass = index == last_index && !resolve_last && i == radix_direction.size() - 1;
+
+            bool input_fp16 = passes.empty() ? options.type.input_fp16 : options.type.output_fp16;
+            Target out_target = last_pass ? output_target : SSBO;
+            Target in_target = passes.empty() ? input_target : SSBO;
+            Direction dir = direction == InverseConvolve && !passes.empty() ? Inverse : direction;
+            unsigned uv_scale_x = radix.vector_size / type_to_input_components(type);
+            auto lut_range = twiddle_lut_range(modes[index], Nx, Ny, Nz);
+
+            const Parameters params = {
+                radix.size.x,
+                radix.size.y,
+                radix.size.z,
+                radix.radix,
+                radix.vector_size,
+                dir,
+                modes[index],
+                in_target,
+                out_target,
+                p == 1,
+                radix.shared_banked,
+                options.type.fp16, input_fp16, options.type.output_fp16,
+                options.type.normalize,
+                radix.twiddle_lut,
+                radix.subgroup_shuffle,
+                packed && (expanded[index] || fused_pass),
+                fused_pass,
+            };
+
+            const Pass pass = {
+                params,
+                radix.num_workgroups_x, radix.num_workgroups_y, workgroups_z,
+                uv_scale_x,
+                radix.stride,
+                batch_floats_in / radix.vector_size, batch_floats_out / radix.vector_size,
+                lut_range.offset, lut_range.n,
+                get_program(params),
+            };
+
+            passes.push_back(pass);
+
+            p *= radix.radix;
+            i++;
+        }
+
+        // Next to the horizontal transform, inject either a real-to-complex resolve or complex-to-real resolve.
+        // This way, we avoid having special purpose transforms for all FFT variants.
+        // A fused resolve is done by the horizontal pass itself.
+        if (index == resolve_index && expand && !fused)
+        {
+            bool input_fp16 = passes.empty() ? options.type.input_fp16 : options.type.output_fp16;
+            Direction dir = direction == InverseConvolve && !passes.empty() ? Inverse : direction;
+            Target in_target = passes.empty() ? input_target : SSBO;
+            Target out_target = resolve_last ? output_target : SSBO;
+            Mode mode = type == ComplexToReal ? ResolveComplexToReal : ResolveRealToComplex;
+            unsigned uv_scale_x = 1;
+
+            auto base_opts = options;
+            base_opts.type.input_fp16 = input_fp16;
+
+            auto &opts = wisdom.find_optimal_options_or_default(Nx, Ny, 2, mode, in_target, out_target, base_opts);
+            auto res = build_resolve_radix(Nx, Ny, { opts.workgroup_size_x, opts.workgroup_size_y, 1 }, opts.twiddle_lut);
+
+            const Parameters params = {
+                res.size.x,
+                res.size.y,
+                res.size.z,
+                res.radix,
+                res.vector_size,
+                dir,
+                mode,
+                in_target,
+                out_target,
+                true,
+                false,
+                base_opts.type.fp16, base_opts.type.input_fp16, base_opts.type.output_fp16,
+                base_opts.type.normalize,
+                res.twiddle_lut,
+                res.subgroup_shuffle,
+                packed,
+                false,
+            };
+
+            unsigned plain_floats = Nx * Ny * components;
+            unsigned expanded_floats = spectrum_width * Ny * components;
+
+            const Pass pass = {
+                params,
+                res.num_workgroups_x,
+                res.num_workgroups_y,
+                Nz,
+                uv_scale_x,
+                res.stride,
+                (direction == Forward ? plain_floats : expanded_floats) / res.vector_size,
+                (direction == Forward ? expanded_floats : plain_floats) / res.vector_size,
+                0, Nx,
+                get_program(params),
+            };
+
+            passes.push_back(pass);
+        }
+    }
+
+    init_twiddle_lut(Nx, Ny, Nz);
+    init_constant_data();
+}
+
+// Every twiddle(k, p) a pass computes has p dividing the length N of the dimension it transforms,
+// so one table of exp(-j * pi * i / N), i in [0, 2N), per dimension covers all passes.
+void FFT::init_twiddle_lut(unsigned Nx, unsigned Ny, unsigned Nz)
+{
+    if (none_of(begin(passes), end(passes), [](const Pass &pass) { return pass.parameters.twiddle_lut; }))
+    {
+        return;
+    }
+
+    vector<float> lut;
+    lut.reserve(4 * (Nx + Ny + Nz));
+    for (auto N : { Nx, Ny, Nz })
+    {
+        for (unsigned i = 0; i < 2 * N; i++)
+        {
+            double angle = -pi * double(i) / double(N);
+            lut.push_back(float(cos(angle)));
+            lut.push_back(float(sin(angle)));
+        }
+    }
+
+    twiddle_lut = context->create_buffer(lut.data(), lut.size() * sizeof(float), AccessStaticCopy);
+}
+
+// In-place radix-2 forward FFT in double precision, used to precompute Bluestein convolution kernels.
+static void host_fft(vector<complex<double>> &data)
+{
+    size_t N = data.size();
+    for (size_t i = 1, j = 0; i < N; i++)
+    {
+        size_t bit = N >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            swap(data[i], data[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= N; len <<= 1)
+    {
+        for (size_t k = 0; k < len / 2; k++)
+        {
+            auto w = polar(1.0, -2.0 * pi * double(k) / double(len));
+            for (size_t i = k; i < N; i += len)
+            {
+                auto a = data[i];
+                auto b = data[i + len / 2] * w;
+                data[i] = a + b;
+                data[i + len / 2] = a - b;
+            }
+        }
+    }
+}
+
+// Builds the constants of every pass once, so process() can push them as is.
+void FFT::init_constant_data()
+{
+    constant_data.clear();
+    constant_data.reserve(passes.size());
+
+    unsigned p = 1;
+    for (auto &pass : passes)
+    {
+        if (pass.parameters.p1)
+        {
+            p = 1;
+        }
+
+        ConstantData data = {};
+        data.p = p;
+        data.stride = pass.stride;
+        data.twiddle_offset = pass.twiddle_offset;
+        data.twiddle_n = pass.twiddle_n;
+        data.batch_stride_in = pass.batch_stride_in;
+        data.batch_stride_out = pass.batch_stride_out;
+        constant_data.push_back(data);
+
+        p *= pass.parameters.radix;
+    }
+}
+
+// Bluestein's algorithm expresses the DFT as
+// X[k] = w[k] * sum(x[n] * w[n] * conj(w[k - n])), with the chirp w[n] = exp(dir * j * pi * n^2 / N).
+// The sum is a linear convolution which we compute with a padded power-of-two FFT and an InverseConvolve FFT.
+void FFT::init_bluestein(unsigned N, Direction direction, const FFTOptions &options, const FFTWisdom &wisdom)
+{
+    // Convolution must not wrap around, so pad to at least 2N - 1.
+    unsigned M = 1;
+    while (M < 2 * N - 1)
+    {
+        M <<= 1;
+    }
+
+    double dir = direction == Forward ? -1.0 : 1.0;
+    vector<complex<double>> chirp(N);
+    for (unsigned n = 0; n < N; n++)
     {
-        throw logic_error("FFT size is not POT.");
+        // n^2 is reduced modulo 2N to keep the angle accurate for large N.
+        uint64_t k = (uint64_t(n) * n) % (2 * uint64_t(N));
+        chirp[n] = polar(1.0, dir * pi * double(k) / double(N));
     }
 
-    if (type == ComplexToReal && direction == Forward)
+    // The convolution kernel is conj(w[n]), wrapped around to cover negative n.
+    // Fold the 1 / M scale of the inverse transform and optional normalization into the kernel.
+    double scale = 1.0 / M;
+    if (options.type.normalize)
     {
-        throw logic_error("ComplexToReal transforms requires inverse transform.");
+        scale /= N;
     }
 
-    if (type == RealToComplex && direction != Forward)
+    vector<complex<double>> kernel(M);
+    for (unsigned n = 0; n < N; n++)
     {
-        throw logic_error("RealToComplex transforms requires forward transform.");
+        kernel[n] = conj(chirp[n]) * scale;
+        if (n)
+        {
+            kernel[M - n] = kernel[n];
+        }
     }
+    host_fft(kernel);
 
-    if (type == RealToComplex && input_target == Image)
+    vector<float> chirp_data(2 * N);
+    for (unsigned n = 0; n < N; n++)
     {
-        throw logic_error("Input real-to-complex must use ImageReal target.");
+        chirp_data[2 * n + 0] = float(chirp[n].real());
+        chirp_data[2 * n + 1] = float(chirp[n].imag());
     }
 
-    if (type == ComplexToReal && output_target == Image)
+    // The convolution input is batched like the signal, so every batch gets its own copy of the kernel.
+    vector<float> kernel_data(2 * M * batch_count);
+    for (unsigned n = 0; n < M * batch_count; n++)
     {
-        throw logic_error("Output complex-to-real must use ImageReal target.");
+        kernel_data[2 * n + 0] = float(kernel[n % M].real());
+        kernel_data[2 * n + 1] = float(kernel[n % M].imag());
     }
 
-    vector<Radix> radices[2];
-    Mode modes[2];
-    Target targets[4];
-
-    switch (direction)
+    bluestein = unique_ptr<Bluestein>(new Bluestein);
+    bluestein->chirp = context->create_buffer(chirp_data.data(), chirp_data.size() * sizeof(float), AccessStaticCopy);
+    bluestein->chirp_fft = context->create_buffer(kernel_data.data(), kernel_data.size() * sizeof(float), AccessStaticCopy);
+    for (auto &buffer : bluestein->buffers)
     {
-        case Forward:
-            modes[0] = type == ComplexToComplexDual ? HorizontalDual : Horizontal;
-            modes[1] = type == ComplexToComplexDual ? VerticalDual : Vertical;
-
-            targets[0] = input_target;
-            targets[1] = Ny > 1 ? SSBO : output_target;
-            targets[2] = targets[1];
-            targets[3] = output_target;
-
-            radices[0] = split_radices(Nx, Ny, modes[0], targets[0], targets[1], options, false, wisdom, cost);
-            radices[1] = split_radices(Nx, Ny, modes[1], targets[2], targets[3], options, expand, wisdom, cost);
-            break;
+        buffer = context->create_buffer(nullptr, 2 * M * sizeof(float) * batch_count, AccessStreamCopy);
+    }
 
-        case Inverse:
-        case InverseConvolve:
-            modes[0] = type == ComplexToComplexDual ? VerticalDual : Vertical;
-            modes[1] = type == ComplexToComplexDual ? HorizontalDual : Horizontal;
+    // The convolution is always done in FP32, FP16 only applies to the input and output of the chirp passes.
+    FFTOptions conv_options;
+    conv_options.performance = options.performance;
 
-            targets[0] = input_target;
-            targets[1] = Ny > 1 ? SSBO : input_target;
-            targets[2] = targets[1];
-            targets[3] = output_target;
+    bluestein->forward = unique_ptr<FFT>(new FFT(context, M, 1, ComplexToComplex, Forward, SSBO, SSBO,
+                cache, conv_options, wisdom, batch_count));
+    bluestein->inverse = unique_ptr<FFT>(new FFT(context, M, 1, ComplexToComplex, InverseConvolve, SSBO, SSBO,
+                cache, conv_options, wisdom, batch_count));
+    cost = bluestein->forward->get_cost() + bluestein->inverse->get_cost();
 
-            radices[0] = split_radices(Nx, Ny, modes[0], targets[0], targets[1], options, expand, wisdom, cost);
-            radices[1] = split_radices(Nx, Ny, modes[1], targets[2], targets[3], options, false, wisdom, cost);
-            break;
+    // Both chirp passes run over the padded length, which keeps work groups full for prime N.
+    auto res = build_resolve_radix(M, 1, { options.performance.workgroup_size_x, 1, 1 }, false);
+    const Mode modes[] = { ChirpPreMultiply, ChirpPostMultiply };
+    for (auto mode : modes)
+    {
+        const Parameters params = {
+            res.size.x,
+            res.size.y,
+            res.size.z,
+            res.radix,
+            res.vector_size,
+            direction,
+            mode,
+            SSBO,
+            SSBO,
+            true,
+            false,
+            false,
+            mode == ChirpPreMultiply ? options.type.input_fp16 : false,
+            mode == ChirpPostMultiply ? options.type.output_fp16 : false,
+            false,
+            false,
+            false,
+            false,
+            false,
+        };
+
+        const Pass pass = {
+            params,
+            res.num_workgroups_x,
+            res.num_workgroups_y,
+            1,
+            1,
+            N,
+            mode == ChirpPreMultiply ? N : M,
+            mode == ChirpPreMultiply ? M : N,
+            0, 0,
+            get_program(params),
+        };
+
+        passes.push_back(pass);
     }
+    init_constant_data();
+}
 
-#if 0
-    print_radix_splits(context, radices);
-#endif
-
-    passes.reserve(radices[0].size() + radices[1].size() + expand);
+// The four-step algorithm views x[N2 * n1 + n2] as an N1 x N2 matrix and computes
+// X[k1 + N1 * k2] = sum_n2(exp(dir * j * 2 * pi * n2 * k2 / N2) * exp(dir * j * 2 * pi * n2 * k1 / N) *
+//                   sum_n1(x[N2 * n1 + n2] * exp(dir * j * 2 * pi * n1 * k1 / N1))),
+// i.e. vertical FFTs of length N1, a twiddle multiply, and vertical FFTs of length N2.
+// Transposing in the twiddle pass puts the result in natural order.
+// Every pass is then as efficient as a pass in a 2D transform, and no dispatch dimension grows beyond N2.
+void FFT::init_four_step(unsigned N, Direction direction, const FFTOptions &options, const FFTWisdom &wisdom)
+{
+    unsigned N1 = four_step_split(N);
+    unsigned N2 = N / N1;
 
-    unsigned index = 0;
-    unsigned last_index = (radices[1].empty() && !expand) ? 0 : 1;
+    size_t temp_buffer_size = N * sizeof(float) * 2;
+    temp_buffer_size >>= options.type.output_fp16;
+    temp_buffer_size *= batch_count;
+    temp_buffer = context->create_buffer(nullptr, temp_buffer_size, AccessStreamCopy);
 
-    for (auto &radix_direction : radices)
+    const unsigned stage_sizes[2][2] = { { N2, N1 }, { N1, N2 } };
+    for (unsigned stage = 0; stage < 2; stage++)
     {
+        unsigned Nx = stage_sizes[stage][0];
+        unsigned Ny = stage_sizes[stage][1];
+        auto radices = split_radices(Nx, Ny, Vertical, SSBO, SSBO, options, false, false,
+                shuffle_subgroup_size(context), row_radix_limit(context), wisdom, cost);
+        // The tables for N1 and N2 are laid out like the horizontal and vertical tables of a 2D transform.
+        unsigned lut_offset = stage ? 2 * N1 : 0;
+
         unsigned p = 1;
-        unsigned i = 0;
-        
-        for (auto &radix : radix_direction)
+        for (auto &radix : radices)
         {
-            // If this is the last pass and we're writing to an image, use a special shader variant.
-            bool last_pass = index == last_index && i == radix_direction.size() - 1;
-
             bool input_fp16 = passes.empty() ? options.type.input_fp16 : options.type.output_fp16;
-            Target out_target = last_pass ? output_target : SSBO;
-            Target in_target = passes.empty() ? input_target : SSBO;
             Direction dir = direction == InverseConvolve && !passes.empty() ? Inverse : direction;
-            unsigned uv_scale_x = radix.vector_size / type_to_input_components(type);
 
             const Parameters params = {
                 radix.size.x,
@@ -637,77 +1757,116 @@ FFT::FFT(Context *context, unsigned Nx, unsigned Ny,
                 radix.radix,
                 radix.vector_size,
                 dir,
-                modes[index],
-                in_target,
-                out_target,
+                Vertical,
+                SSBO,
+                SSBO,
                 p == 1,
                 radix.shared_banked,
                 options.type.fp16, input_fp16, options.type.output_fp16,
                 options.type.normalize,
+                radix.twiddle_lut,
+                radix.subgroup_shuffle,
+                false,
+                false,
             };
 
             const Pass pass = {
                 params,
-                radix.num_workgroups_x, radix.num_workgroups_y,
-                uv_scale_x,
-                next_pow2(radix.num_workgroups_x * params.workgroup_size_x),
+                radix.num_workgroups_x, radix.num_workgroups_y, 1,
+                radix.vector_size / 2,
+                radix.stride,
+                2 * N / radix.vector_size, 2 * N / radix.vector_size,
+                lut_offset, Ny,
                 get_program(params),
             };
 
             passes.push_back(pass);
-
             p *= radix.radix;
-            i++;
         }
 
-        // After the first transform direction, inject either a real-to-complex resolve or complex-to-real resolve.
-        // This way, we avoid having special purpose transforms for all FFT variants.
-        if (index == 0 && (type == ComplexToReal || type == RealToComplex))
+        if (stage != 0)
         {
-            bool input_fp16 = passes.empty() ? options.type.input_fp16 : options.type.output_fp16;
-            bool last_pass = radices[1].empty();
-            Direction dir = direction == InverseConvolve && !passes.empty() ? Inverse : direction;
-            Target in_target = passes.empty() ? input_target : SSBO;
-            Target out_target = last_pass ? output_target : SSBO;
-            Mode mode = type == ComplexToReal ? ResolveComplexToReal : ResolveRealToComplex;
-            unsigned uv_scale_x = 1;
-
-            auto base_opts = options;
-            base_opts.type.input_fp16 = input_fp16;
+            break;
+        }
 
-            auto &opts = wisdom.find_optimal_options_or_default(Nx, Ny, 2, mode, in_target, out_target, base_opts);
-            auto res = build_resolve_radix(Nx, Ny, { opts.workgroup_size_x, opts.workgroup_size_y, 1 });
+        // The transpose is staged through shared memory in tiles of up to 16 x 8 samples.
+        auto res = build_resolve_radix(N2, N1, { 16, 8, 1 }, false);
+        const Parameters params = {
+            res.size.x,
+            res.size.y,
+            res.size.z,
+            res.radix,
+            res.vector_size,
+            direction == InverseConvolve ? Inverse : direction,
+            FourStepTwiddle,
+            SSBO,
+            SSBO,
+            true,
+            false,
+            options.type.fp16, options.type.output_fp16, options.type.output_fp16,
+            false,
+            false,
+            false,
+            false,
+            false,
+        };
+
+        const Pass pass = {
+            params,
+            res.num_workgroups_x,
+            res.num_workgroups_y,
+            1,
+            1,
+            res.stride,
+            N, N,
+            0, 0,
+            get_program(params),
+        };
+
+        passes.push_back(pass);
+    }
 
-            const Parameters params = {
-                res.size.x,
-                res.size.y,
-                res.size.z,
-                res.radix,
-                res.vector_size,
-                dir,
-                mode,
-                in_target,
-                out_target,
-                true,
-                false,
-                base_opts.type.fp16, base_opts.type.input_fp16, base_opts.type.output_fp16,
-                base_opts.type.normalize,
-            };
+    init_twiddle_lut(N1, N2, 1);
+    init_constant_data();
+}
 
-            const Pass pass = {
-                params,
-                Nx / res.size.x,
-                Ny / res.size.y,
-                uv_scale_x,
-                next_pow2(Nx),
-                get_program(params),
-            };
+// The whole transform is a single pass, so no temporary buffers are needed.
+// Tile kernels compute their twiddle factors, and derive the tile size from the work group size,
+// (Nx / 4) x (Ny / 4) invocations.
+void FFT::init_tile(unsigned Nx, unsigned Ny, Direction direction, const FFTOptions &options)
+{
+    const Parameters params = {
+        Nx / 4,
+        Ny / 4,
+        1,
+        2,
+        2,
+        direction,
+        Tile2D,
+        SSBO,
+        SSBO,
+        true,
+        false,
+        options.type.fp16, options.type.input_fp16, options.type.output_fp16,
+        options.type.normalize,
+        false,
+        false,
+        false,
+        false,
+    };
 
-            passes.push_back(pass);
-        }
+    const Pass pass = {
+        params,
+        1, 1, 1,
+        1,
+        Nx,
+        Nx * Ny, Nx * Ny,
+        0, 0,
+        get_program(params),
+    };
 
-        index++;
-    }
+    passes.push_back(pass);
+    init_constant_data();
 }
 
 string FFT::load_shader_string(const char *path)
@@ -728,7 +1887,7 @@ void FFT::store_shader_string(const char *path, const string &source)
     file.write(source.data(), source.size());
 }
 
-unique_ptr<Program> FFT::build_program(const Parameters &params)
+string FFT::build_program_source(const Parameters &params)
 {
     string str;
     str.reserve(16 * 1024);
@@ -764,6 +1923,13 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
             params.fft_normalize);
 #endif
 
+    // #extension has to come before any shader code.
+    if (params.subgroup_shuffle)
+    {
+        str += "#extension GL_KHR_shader_subgroup_shuffle : require\n";
+        str += "#define FFT_SUBGROUP_SHUFFLE\n";
+    }
+
     if (params.p1)
     {
         str += "#define FFT_P1\n";
@@ -794,6 +1960,21 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
         str += "#define FFT_CONVOLVE\n";
     }
 
+    if (params.twiddle_lut)
+    {
+        str += "#define FFT_TWIDDLE_LUT\n";
+    }
+
+    if (params.packed_spectrum)
+    {
+        str += "#define FFT_PACKED_SPECTRUM\n";
+    }
+
+    if (params.fused_resolve)
+    {
+        str += params.direction == Forward ? "#define FFT_FUSED_REAL_TO_COMPLEX\n" : "#define FFT_FUSED_COMPLEX_TO_REAL\n";
+    }
+
     str += params.shared_banked ? "#define FFT_SHARED_BANKED 1\n" : "#define FFT_SHARED_BANKED 0\n";
 
     str += params.direction == Forward ? "#define FFT_FORWARD\n" : "#define FFT_INVERSE\n";
@@ -811,6 +1992,14 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
             str += "#define FFT_VERT\n";
             break;
 
+        case DepthDual:
+            str += "#define FFT_DUAL\n";
+            // Fallthrough
+        case Depth:
+            str += "#define FFT_DEPTH\n";
+            str += "#define FFT_VERT\n";
+            break;
+
         case HorizontalDual:
             str += "#define FFT_DUAL\n";
             str += "#define FFT_HORIZ\n";
@@ -831,6 +2020,30 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
             str += "#define FFT_HORIZ\n";
             vector_size = 2;
             break;
+
+        case ChirpPreMultiply:
+            str += "#define FFT_CHIRP_PRE_MULTIPLY\n";
+            str += "#define FFT_HORIZ\n";
+            vector_size = 2;
+            break;
+
+        case ChirpPostMultiply:
+            str += "#define FFT_CHIRP_POST_MULTIPLY\n";
+            str += "#define FFT_HORIZ\n";
+            vector_size = 2;
+            break;
+
+        case FourStepTwiddle:
+            str += "#define FFT_FOUR_STEP_TWIDDLE\n";
+            str += "#define FFT_HORIZ\n";
+            vector_size = 2;
+            break;
+
+        case Tile2D:
+            str += "#define FFT_TILE_2D\n";
+            str += "#define FFT_HORIZ\n";
+            vector_size = 2;
+            break;
     }
 
     switch (params.input_target)
@@ -905,6 +2118,32 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
             str += load_shader_string("glfft/glsl/fft_shared.comp");
             str += load_shader_string("glfft/glsl/fft_radix64.comp");
             break;
+
+        case 3:
+            str += load_shader_string("glfft/glsl/fft_radix3.comp");
+            break;
+
+        case 5:
+            str += load_shader_string("glfft/glsl/fft_radix5.comp");
+            break;
+
+        case 7:
+            str += load_shader_string("glfft/glsl/fft_radix7.comp");
+            break;
+
+        default:
+            if (params.mode == Tile2D)
+            {
+                str += load_shader_string("glfft/glsl/fft_radix4.comp");
+                str += load_shader_string("glfft/glsl/fft_tile.comp");
+            }
+            else if (params.radix > max_shared_radix)
+            {
+                str += load_shader_string("glfft/glsl/fft_radix4.comp");
+                str += load_shader_string("glfft/glsl/fft_shared.comp");
+                str += load_shader_string("glfft/glsl/fft_radix_row.comp");
+            }
+            break;
     }
     str += load_shader_string("glfft/glsl/fft_main.comp");
 #else
@@ -930,16 +2169,36 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
             str += Blob::fft_shared_source;
             str += Blob::fft_radix64_source;
             break;
+
+        case 3:
+            str += Blob::fft_radix3_source;
+            break;
+
+        case 5:
+            str += Blob::fft_radix5_source;
+            break;
+
+        case 7:
+            str += Blob::fft_radix7_source;
+            break;
+
+        default:
+            if (params.mode == Tile2D)
+            {
+                str += Blob::fft_radix4_source;
+                str += Blob::fft_tile_source;
+            }
+            else if (params.radix > max_shared_radix)
+            {
+                str += Blob::fft_radix4_source;
+                str += Blob::fft_shared_source;
+                str += Blob::fft_radix_row_source;
+            }
+            break;
     }
     str += Blob::fft_main_source;
 #endif
 
-    auto prog = context->compile_compute_shader(str.c_str());
-    if (!prog)
-    {
-        puts(str.c_str());
-    }
-
 #if 0
     char shader_path[1024];
     snprintf(shader_path, sizeof(shader_path), "glfft_shader_radix%u_first%u_mode%u_in_target%u_out_target%u.comp.src",
@@ -947,7 +2206,7 @@ unique_ptr<Program> FFT::build_program(const Parameters &params)
     store_shader_string(shader_path, str);
 #endif
 
-    return prog;
+    return str;
 }
 
 double FFT::bench(Context *context, Resource *output, Resource *input,
@@ -962,6 +2221,11 @@ double FFT::bench(Context *context, Resource *output, Resource *input,
     context->submit_command_buffer(cmd);
     context->wait_idle();
 
+    // Timestamps keep submission overhead and CPU jitter out of the measurement.
+    // Without them, we time from recording to idle on the CPU.
+    auto start_query = context->create_timestamp_query();
+    auto end_query = start_query ? context->create_timestamp_query() : nullptr;
+
     unsigned runs = 0;
     double start_time = context->get_time();
     double total_time = 0.0;
@@ -975,18 +2239,35 @@ double FFT::bench(Context *context, Resource *output, Resource *input,
         auto *cmd = context->request_command_buffer();
 
         double iteration_start = context->get_time();
+        if (end_query)
+        {
+            cmd->write_timestamp(start_query.get());
+        }
+
+        // Consecutive dispatches overwrite the output and scratch buffers of the previous one,
+        // and the input might be a texture.
+        AccessFlags dst_access = get_input_access() | get_output_access() | AccessShaderStorageWrite;
         for (unsigned d = 0; d < dispatches_per_iteration; d++)
         {
             process(cmd, output, input);
-            cmd->barrier();
+            cmd->barrier(get_output_access(), dst_access);
             runs++;
         }
 
+        if (end_query)
+        {
+            cmd->write_timestamp(end_query.get());
+        }
+
         context->submit_command_buffer(cmd);
         context->wait_idle();
 
         double iteration_end = context->get_time();
-        total_time += iteration_end - iteration_start;
+        double gpu_time = end_query ?
+            context->get_timestamp(end_query.get()) - context->get_timestamp(start_query.get()) : 0.0;
+
+        // Wisdom treats a cost of zero as invalid, so don't trust timers which are too coarse for the work.
+        total_time += gpu_time > 0.0 ? gpu_time : iteration_end - iteration_start;
     }
 
     return total_time / runs;
@@ -999,6 +2280,20 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
         return;
     }
 
+    for (auto &pass : passes)
+    {
+        if (cache->is_failed(pass.program))
+        {
+            throw runtime_error("Plan uses a program which failed to compile.\n");
+        }
+    }
+
+    if (bluestein)
+    {
+        process_bluestein(cmd, output, input);
+        return;
+    }
+
     Resource *buffers[2] = {
         input,
         passes.size() & 1 ?
@@ -1027,19 +2322,14 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
         }
     }
 
+    if (twiddle_lut)
+    {
+        cmd->bind_storage_buffer(BindingSSBOTwiddle, twiddle_lut.get());
+    }
+
     Program *current_program = nullptr;
-    unsigned p = 1;
     unsigned pass_index = 0;
 
-    struct FFTConstantData
-    {
-        uint32_t p;
-        uint32_t stride;
-        uint32_t padding[2];
-        float offset_x, offset_y;
-        float scale_x, scale_y;
-    };
-
     for (auto &pass : passes)
     {
         if (pass.program != current_program)
@@ -1048,15 +2338,8 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
             current_program = pass.program;
         }
 
-        if (pass.parameters.p1)
-        {
-            p = 1;
-        }
-
-        FFTConstantData constant_data;
-        constant_data.p = p;
-        constant_data.stride = pass.stride;
-        p *= pass.parameters.radix;
+        const ConstantData *pass_data = &constant_data[pass_index];
+        ConstantData texture_data;
 
         if (pass.parameters.input_target != SSBO)
         {
@@ -1066,10 +2349,13 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
             // If one compute thread reads multiple texels in X dimension, scale this accordingly.
             float scale_x = texture.scale_x * pass.uv_scale_x;
 
-            constant_data.offset_x = texture.offset_x;
-            constant_data.offset_y = texture.offset_y;
-            constant_data.scale_x = scale_x;
-            constant_data.scale_y = texture.scale_y;
+            // The texture transform can be changed between calls, so it is not part of the planned constants.
+            texture_data = *pass_data;
+            texture_data.offset_x = texture.offset_x;
+            texture_data.offset_y = texture.offset_y;
+            texture_data.scale_x = scale_x;
+            texture_data.scale_y = texture.scale_y;
+            pass_data = &texture_data;
         }
         else
         {
@@ -1132,14 +2418,16 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
             }
         }
 
-        cmd->push_constant_data(BindingUBO, &constant_data, sizeof(constant_data));
-        cmd->dispatch(pass.workgroups_x, pass.workgroups_y, 1);
+        cmd->push_constant_data(BindingUBO, pass_data, sizeof(*pass_data));
+        begin_pass_profile(cmd, pass_index);
+        cmd->dispatch(pass.workgroups_x, pass.workgroups_y, pass.workgroups_z * batch_count);
+        end_pass_profile(cmd, pass_index);
 
         // For last pass, we don't know how our resource will be used afterwards,
         // so let barrier decisions be up to the API user.
         if (pass_index + 1 < passes.size())
         {
-            cmd->barrier(static_cast<Buffer*>(buffers[1]));
+            cmd->barrier(AccessShaderStorageWrite, AccessShaderStorageRead);
         }
 
         if (pass_index == 0)
@@ -1154,3 +2442,168 @@ void FFT::process(CommandBuffer *cmd, Resource *output, Resource *input, Resourc
     }
 }
 
+unique_ptr<CommandList> FFT::bake(Resource *output, Resource *input, Resource *input_aux)
+{
+    unique_ptr<CommandList> list(new CommandList);
+    process(list.get(), output, input, input_aux);
+    return list;
+}
+
+void FFT::process_bluestein(CommandBuffer *cmd, Resource *output, Resource *input)
+{
+    auto &pre = passes[0];
+    auto &post = passes[1];
+    Buffer *buffers[2] = { bluestein->buffers[0].get(), bluestein->buffers[1].get() };
+
+    cmd->bind_program(pre.program);
+    if (ssbo.input.size != 0)
+    {
+        cmd->bind_storage_buffer_range(BindingSSBOIn,
+                ssbo.input.offset, ssbo.input.size, static_cast<Buffer*>(input));
+    }
+    else
+    {
+        cmd->bind_storage_buffer(BindingSSBOIn, static_cast<Buffer*>(input));
+    }
+    cmd->bind_storage_buffer(BindingSSBOAux, bluestein->chirp.get());
+    cmd->bind_storage_buffer(BindingSSBOOut, buffers[0]);
+    cmd->push_constant_data(BindingUBO, &constant_data[0], sizeof(constant_data[0]));
+    begin_pass_profile(cmd, 0);
+    cmd->dispatch(pre.workgroups_x, pre.workgroups_y, batch_count);
+    end_pass_profile(cmd, 0);
+    cmd->barrier(AccessShaderStorageWrite, AccessShaderStorageRead);
+
+    bluestein->forward->process(cmd, buffers[1], buffers[0]);
+    cmd->barrier(AccessShaderStorageWrite, AccessShaderStorageRead);
+    bluestein->inverse->process(cmd, buffers[0], buffers[1], bluestein->chirp_fft.get());
+    cmd->barrier(AccessShaderStorageWrite, AccessShaderStorageRead);
+
+    cmd->bind_program(post.program);
+    cmd->bind_storage_buffer(BindingSSBOIn, buffers[0]);
+    cmd->bind_storage_buffer(BindingSSBOAux, bluestein->chirp.get());
+    if (ssbo.output.size != 0)
+    {
+        cmd->bind_storage_buffer_range(BindingSSBOOut,
+                ssbo.output.offset, ssbo.output.size, static_cast<Buffer*>(output));
+    }
+    else
+    {
+        cmd->bind_storage_buffer(BindingSSBOOut, static_cast<Buffer*>(output));
+    }
+    cmd->push_constant_data(BindingUBO, &constant_data[1], sizeof(constant_data[1]));
+    begin_pass_profile(cmd, 1);
+    cmd->dispatch(post.workgroups_x, post.workgroups_y, batch_count);
+    end_pass_profile(cmd, 1);
+}
+
+AccessFlags FFT::get_input_access() const
+{
+    return passes.front().parameters.input_target != SSBO ? AccessTextureFetch : AccessShaderStorageRead;
+}
+
+AccessFlags FFT::get_output_access() const
+{
+    return passes.back().parameters.output_target != SSBO ? AccessImageWrite : AccessShaderStorageWrite;
+}
+
+void FFT::set_profiling(bool enable)
+{
+    profile_queries.clear();
+    profiled = false;
+
+    if (enable)
+    {
+        for (unsigned i = 0; i < 2 * passes.size(); i++)
+        {
+            auto query = context->create_timestamp_query();
+            if (!query)
+            {
+                profile_queries.clear();
+                throw logic_error("Profiling requires timestamp queries.");
+            }
+            profile_queries.push_back(move(query));
+        }
+    }
+
+    if (bluestein)
+    {
+        bluestein->forward->set_profiling(enable);
+        bluestein->inverse->set_profiling(enable);
+    }
+}
+
+void FFT::begin_pass_profile(CommandBuffer *cmd, unsigned pass_index)
+{
+    if (!profile_queries.empty())
+    {
+        cmd->write_timestamp(profile_queries[2 * pass_index].get());
+    }
+}
+
+void FFT::end_pass_profile(CommandBuffer *cmd, unsigned pass_index)
+{
+    if (!profile_queries.empty())
+    {
+        cmd->write_timestamp(profile_queries[2 * pass_index + 1].get());
+        profiled = true;
+    }
+}
+
+FFT::PassProfile FFT::get_pass_profile(unsigned pass_index)
+{
+    auto &pass = passes[pass_index];
+    auto &params = pass.parameters;
+
+    // Batch strides are in vectors, and every batch, or slice for 2D passes of 3D transforms, is read and written once.
+    size_t batches = size_t(pass.workgroups_z) * batch_count;
+    size_t floats_in = size_t(pass.batch_stride_in) * params.vector_size * batches;
+    size_t floats_out = size_t(pass.batch_stride_out) * params.vector_size * batches;
+
+    PassProfile profile;
+    profile.radix = params.radix;
+    profile.mode = params.mode;
+    profile.workgroup_size_x = params.workgroup_size_x;
+    profile.workgroup_size_y = params.workgroup_size_y;
+    profile.workgroup_size_z = params.workgroup_size_z;
+    profile.dispatch_x = pass.workgroups_x;
+    profile.dispatch_y = pass.workgroups_y;
+    profile.dispatch_z = pass.workgroups_z * batch_count;
+    profile.bytes_read = floats_in * (params.input_fp16 ? 2 : 4);
+    profile.bytes_written = floats_out * (params.output_fp16 ? 2 : 4);
+    profile.time = context->get_timestamp(profile_queries[2 * pass_index + 1].get()) -
+        context->get_timestamp(profile_queries[2 * pass_index].get());
+    return profile;
+}
+
+vector<FFT::PassProfile> FFT::get_pass_profiles()
+{
+    if (profile_queries.empty())
+    {
+        throw logic_error("Profiling is not enabled.");
+    }
+
+    if (!profiled)
+    {
+        throw logic_error("There is no profile before process() has been called.");
+    }
+
+    vector<PassProfile> profiles;
+    if (bluestein)
+    {
+        // The chirp passes run before and after the convolution.
+        profiles.push_back(get_pass_profile(0));
+        auto forward = bluestein->forward->get_pass_profiles();
+        auto inverse = bluestein->inverse->get_pass_profiles();
+        profiles.insert(end(profiles), begin(forward), end(forward));
+        profiles.insert(end(profiles), begin(inverse), end(inverse));
+        profiles.push_back(get_pass_profile(1));
+    }
+    else
+    {
+        for (unsigned i = 0; i < passes.size(); i++)
+        {
+            profiles.push_back(get_pass_profile(i));
+        }
+    }
+    return profiles;
+}
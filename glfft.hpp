@@ -22,9 +22,11 @@
 #include "glfft_interface.hpp"
 #include "glfft_common.hpp"
 #include "glfft_wisdom.hpp"
+#include "glfft_command_list.hpp"
 #include <vector>
 #include <unordered_map>
 #include <limits>
+#include <stdint.h>
 
 /// GLFFT doesn't try to preserve GL state in any way.
 /// E.g. SHADER_STORAGE_BUFFER bindings, programs bound, texture bindings, etc.
@@ -55,10 +57,29 @@ class FFT
         /// @param options       FFT options such as performance related parameters and types.
         /// @param wisdom        GLFFT wisdom which can override performance related options
         ///                      (options.performance is used as a fallback).
+        /// @param batch_count   Number of independent transforms done by a single process() call.
+        ///                      Each pass is a single dispatch for the entire batch.
+        ///                      Batches are packed back-to-back in input and output, which must both be SSBOs.
+        ///                      Complex-to-real output is packed as real samples, but like the unbatched case,
+        ///                      the output buffer is used as scratch and must be as large as the complex input.
+        ///                      Batches of complex-to-complex power-of-two tiles up to 64x64 are transformed
+        ///                      entirely in shared memory, with a single dispatch and one work group per tile.
         FFT(Context *context, unsigned Nx, unsigned Ny,
                 Type type, Direction direction, Target input_target, Target output_target,
                 std::shared_ptr<ProgramCache> cache, const FFTOptions &options,
-                const FFTWisdom &wisdom = FFTWisdom());
+                const FFTWisdom &wisdom = FFTWisdom(), unsigned batch_count = 1);
+
+        /// @brief Creates a full 3D FFT.
+        ///
+        /// Data is laid out as Nz slices of Nx * Ny samples, and input and output must both be SSBOs if Nz > 1.
+        /// For real-to-complex and complex-to-real transforms, every slice uses the layout of a 2D transform.
+        /// Otherwise, the parameters are the same as for the 2D constructor.
+        ///
+        /// @param Nz            Number of samples in depth dimension.
+        FFT(Context *context, unsigned Nx, unsigned Ny, unsigned Nz,
+                Type type, Direction direction, Target input_target, Target output_target,
+                std::shared_ptr<ProgramCache> cache, const FFTOptions &options,
+                const FFTWisdom &wisdom = FFTWisdom(), unsigned batch_count = 1);
 
         /// @brief Creates a single stage FFT. Used mostly internally for benchmarking partial FFTs.
         ///
@@ -91,6 +112,25 @@ class FFT
         ///                  the content of input and input_aux will be multiplied together.
         void process(CommandBuffer *cmd, Resource *output, Resource *input, Resource *input_aux = nullptr);
 
+        /// @brief Records process() with fixed resources into a command list.
+        ///
+        /// Replaying the list with CommandList::replay() issues the same commands as process(),
+        /// without walking the passes, building constant data or issuing redundant binds again.
+        /// Buffer ranges, samplers and the texture transform are fixed when baking.
+        /// The list refers to the resources and the programs and buffers of this FFT, which must outlive it.
+        std::unique_ptr<CommandList> bake(Resource *output, Resource *input, Resource *input_aux = nullptr);
+
+        /// @brief Returns how the first pass of process() reads its input.
+        ///
+        /// Use as destination access of a barrier between writing the input and process().
+        AccessFlags get_input_access() const;
+
+        /// @brief Returns how the last pass of process() writes its output.
+        ///
+        /// Use as source access of a barrier between process() and reading the output.
+        /// process() does not make its output visible by itself.
+        AccessFlags get_output_access() const;
+
         /// @brief Run process() multiple times, timing the results.
         ///
         /// Mostly used internally by GLFFT wisdom, glfft_cli's bench, and so on.
@@ -115,12 +155,49 @@ class FFT
         double get_cost() const { return cost; }
 
         /// @brief Returns number of passes (glDispatchCompute) in a process() call.
-        unsigned get_num_passes() const { return passes.size(); }
+        unsigned get_num_passes() const
+        {
+            unsigned num_passes = passes.size();
+            if (bluestein)
+            {
+                num_passes += bluestein->forward->get_num_passes() + bluestein->inverse->get_num_passes();
+            }
+            return num_passes;
+        }
+
+        /// @brief Profile of a single pass, see get_pass_profiles().
+        struct PassProfile
+        {
+            unsigned radix;
+            Mode mode;
+            unsigned workgroup_size_x, workgroup_size_y, workgroup_size_z;
+            unsigned dispatch_x, dispatch_y, dispatch_z;
+            /// Estimated from the number of samples the pass reads and writes, and their precision.
+            size_t bytes_read, bytes_written;
+            /// GPU time of the pass in seconds.
+            double time;
+        };
+
+        /// @brief Enables per-pass profiling.
+        ///
+        /// While enabled, process() brackets every pass with timestamp queries, which adds a little overhead.
+        /// Throws if the context does not support timestamp queries.
+        void set_profiling(bool enable);
+
+        /// @brief Returns the profile of every pass in the last process() call, in execution order.
+        ///
+        /// Waits for the results to become available. The passes of Bluestein sub-transforms are included.
+        /// Throws if profiling is not enabled, or process() has not been called since.
+        std::vector<PassProfile> get_pass_profiles();
 
         /// @brief Returns Nx.
         unsigned get_dimension_x() const { return size_x; }
         /// @brief Returns Ny.
         unsigned get_dimension_y() const { return size_y; }
+        /// @brief Returns Nz.
+        unsigned get_dimension_z() const { return size_z; }
+        /// @brief Returns number of transforms done in a process() call.
+        unsigned get_batch_count() const { return batch_count; }
 
         /// @brief Sets offset and scale parameters for normalized texel coordinates when sampling textures.
         ///
@@ -176,17 +253,43 @@ class FFT
             texture.samplers[1] = sampler1;
         }
 
+        /// @brief Generates the GLSL compute shader for a program, without #version.
+        ///
+        /// Used to precompile programs offline, see ProgramBundle.
+        static std::string build_program_source(const Parameters &params);
+
     private:
         Context *context;
 
+        // Matches the constant block in fft_common.comp.
+        struct ConstantData
+        {
+            uint32_t p;
+            uint32_t stride;
+            uint32_t twiddle_offset;
+            uint32_t twiddle_n;
+            float offset_x, offset_y;
+            float scale_x, scale_y;
+            uint32_t batch_stride_in;
+            uint32_t batch_stride_out;
+            uint32_t padding[2];
+        };
+
         struct Pass
         {
             Parameters parameters;
 
             unsigned workgroups_x;
             unsigned workgroups_y;
+            // Horizontal and vertical passes dispatch one layer of work groups per slice.
+            unsigned workgroups_z;
             unsigned uv_scale_x;
             unsigned stride;
+            unsigned batch_stride_in;
+            unsigned batch_stride_out;
+            // Range of the twiddle table this pass reads if parameters.twiddle_lut is set.
+            unsigned twiddle_offset;
+            unsigned twiddle_n;
             Program *program;
         };
 
@@ -197,7 +300,43 @@ class FFT
         std::vector<Pass> passes;
         std::shared_ptr<ProgramCache> cache;
 
-        std::unique_ptr<Program> build_program(const Parameters &params);
+        // Sizes which do not factor into radices we support are transformed with Bluestein's algorithm.
+        // passes then only holds the chirp pre- and post-multiply passes,
+        // and the convolution is done with two power-of-two FFTs.
+        struct Bluestein
+        {
+            std::unique_ptr<FFT> forward;
+            std::unique_ptr<FFT> inverse;
+            std::unique_ptr<Buffer> chirp;
+            std::unique_ptr<Buffer> chirp_fft;
+            std::unique_ptr<Buffer> buffers[2];
+        };
+        std::unique_ptr<Bluestein> bluestein;
+
+        // Twiddle factors for passes which use FFTOptions::Performance::twiddle_lut.
+        // The table for the horizontal dimension comes first, followed by the vertical and depth ones.
+        std::unique_ptr<Buffer> twiddle_lut;
+        void init_twiddle_lut(unsigned Nx, unsigned Ny, unsigned Nz);
+
+        // Constants of each pass which do not change between dispatches, built once the passes are planned.
+        // Only the texture coordinate transform of passes which sample textures is filled in by process().
+        std::vector<ConstantData> constant_data;
+        void init_constant_data();
+
+        // Two timestamps per pass, before and after its dispatch, if profiling is enabled.
+        std::vector<std::unique_ptr<TimestampQuery>> profile_queries;
+        bool profiled = false;
+        void begin_pass_profile(CommandBuffer *cmd, unsigned pass_index);
+        void end_pass_profile(CommandBuffer *cmd, unsigned pass_index);
+        PassProfile get_pass_profile(unsigned pass_index);
+
+        void init_bluestein(unsigned N, Direction direction, const FFTOptions &options, const FFTWisdom &wisdom);
+        // Large 1D transforms are done as an N1 x N2 2D transform with the four-step algorithm.
+        void init_four_step(unsigned N, Direction direction, const FFTOptions &options, const FFTWisdom &wisdom);
+        // Batches of small 2D transforms are done with one work group per tile.
+        void init_tile(unsigned Nx, unsigned Ny, Direction direction, const FFTOptions &options);
+        void process_bluestein(CommandBuffer *cmd, Resource *output, Resource *input);
+
         static std::string load_shader_string(const char *path);
         static void store_shader_string(const char *path, const std::string &source);
 
@@ -217,7 +356,8 @@ class FFT
                 size_t size = 0;
             } input, input_aux, output;
         } ssbo;
-        unsigned size_x, size_y;
+        unsigned size_x, size_y, size_z = 1;
+        unsigned batch_count = 1;
 };
 
 }
@@ -0,0 +1,221 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_command_list.hpp"
+#include <cstring>
+#include <stdexcept>
+
+using namespace GLFFT;
+using namespace std;
+
+static CommandList::Command make_command(CommandList::CommandType type, unsigned binding, void *object)
+{
+    CommandList::Command command = {};
+    command.type = type;
+    command.binding = binding;
+    command.object = object;
+    return command;
+}
+
+void CommandList::record_bind(Binding *state, const Command &command)
+{
+    if (elide_binds && command.binding < MaxBindings)
+    {
+        auto &current = state[command.binding];
+        if (current.valid && current.type == command.type && current.object == command.object &&
+                current.format == command.format && current.offset == command.offset && current.size == command.size)
+        {
+            return;
+        }
+
+        current.type = command.type;
+        current.object = command.object;
+        current.format = command.format;
+        current.offset = command.offset;
+        current.size = command.size;
+        current.valid = true;
+    }
+    commands.push_back(command);
+}
+
+void CommandList::bind_program(Program *program)
+{
+    if (!elide_binds || program != this->program)
+    {
+        commands.push_back(make_command(CommandBindProgram, 0, program));
+        this->program = program;
+    }
+}
+
+void CommandList::bind_storage_texture(unsigned binding, Texture *texture, Format format)
+{
+    auto command = make_command(CommandBindStorageTexture, binding, texture);
+    command.format = format;
+    record_bind(images, command);
+}
+
+void CommandList::bind_texture(unsigned binding, Texture *texture)
+{
+    record_bind(textures, make_command(CommandBindTexture, binding, texture));
+}
+
+void CommandList::bind_sampler(unsigned binding, Sampler *sampler)
+{
+    record_bind(samplers, make_command(CommandBindSampler, binding, sampler));
+}
+
+void CommandList::bind_storage_buffer(unsigned binding, Buffer *buffer)
+{
+    record_bind(buffers, make_command(CommandBindStorageBuffer, binding, buffer));
+}
+
+void CommandList::bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *buffer)
+{
+    auto command = make_command(CommandBindStorageBufferRange, binding, buffer);
+    command.offset = offset;
+    command.size = length;
+    record_bind(buffers, command);
+}
+
+void CommandList::dispatch(unsigned x, unsigned y, unsigned z)
+{
+    auto command = make_command(CommandDispatch, 0, nullptr);
+    command.x = x;
+    command.y = y;
+    command.z = z;
+    commands.push_back(command);
+}
+
+void CommandList::barrier(Buffer *buffer)
+{
+    commands.push_back(make_command(CommandBarrierBuffer, 0, buffer));
+}
+
+void CommandList::barrier(Texture *texture)
+{
+    commands.push_back(make_command(CommandBarrierTexture, 0, texture));
+}
+
+void CommandList::barrier()
+{
+    commands.push_back(make_command(CommandBarrierFull, 0, nullptr));
+}
+
+void CommandList::barrier(AccessFlags src_access, AccessFlags dst_access)
+{
+    auto command = make_command(CommandBarrierAccess, 0, nullptr);
+    command.src_access = src_access;
+    command.dst_access = dst_access;
+    commands.push_back(command);
+}
+
+void CommandList::push_constant_data(unsigned binding, const void *data, size_t size)
+{
+    if (size > MaxConstantDataSize)
+    {
+        throw logic_error("Constant data exceeds MaxConstantDataSize.");
+    }
+
+    // Payloads are copied, since callers may reuse their memory after recording.
+    auto command = make_command(CommandPushConstantData, binding, nullptr);
+    command.offset = constant_data.size();
+    command.size = size;
+    constant_data.resize(constant_data.size() + size);
+    memcpy(constant_data.data() + command.offset, data, size);
+    commands.push_back(command);
+}
+
+void CommandList::write_timestamp(TimestampQuery *query)
+{
+    commands.push_back(make_command(CommandWriteTimestamp, 0, query));
+}
+
+void CommandList::replay(CommandBuffer *cmd) const
+{
+    for (auto &command : commands)
+    {
+        switch (command.type)
+        {
+            case CommandBindProgram:
+                cmd->bind_program(static_cast<Program*>(command.object));
+                break;
+
+            case CommandBindStorageTexture:
+                cmd->bind_storage_texture(command.binding, static_cast<Texture*>(command.object), command.format);
+                break;
+
+            case CommandBindTexture:
+                cmd->bind_texture(command.binding, static_cast<Texture*>(command.object));
+                break;
+
+            case CommandBindSampler:
+                cmd->bind_sampler(command.binding, static_cast<Sampler*>(command.object));
+                break;
+
+            case CommandBindStorageBuffer:
+                cmd->bind_storage_buffer(command.binding, static_cast<Buffer*>(command.object));
+                break;
+
+            case CommandBindStorageBufferRange:
+                cmd->bind_storage_buffer_range(command.binding, command.offset, command.size, static_cast<Buffer*>(command.object));
+                break;
+
+            case CommandDispatch:
+                cmd->dispatch(command.x, command.y, command.z);
+                break;
+
+            case CommandBarrierBuffer:
+                cmd->barrier(static_cast<Buffer*>(command.object));
+                break;
+
+            case CommandBarrierTexture:
+                cmd->barrier(static_cast<Texture*>(command.object));
+                break;
+
+            case CommandBarrierFull:
+                cmd->barrier();
+                break;
+
+            case CommandBarrierAccess:
+                cmd->barrier(command.src_access, command.dst_access);
+                break;
+
+            case CommandPushConstantData:
+                cmd->push_constant_data(command.binding, constant_data.data() + command.offset, command.size);
+                break;
+
+            case CommandWriteTimestamp:
+                cmd->write_timestamp(static_cast<TimestampQuery*>(command.object));
+                break;
+        }
+    }
+}
+
+void CommandList::clear()
+{
+    commands.clear();
+    constant_data.clear();
+    for (unsigned i = 0; i < MaxBindings; i++)
+    {
+        buffers[i].valid = false;
+        textures[i].valid = false;
+        samplers[i].valid = false;
+        images[i].valid = false;
+    }
+    program = nullptr;
+}
@@ -0,0 +1,116 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLFFT_COMMAND_LIST_HPP__
+#define GLFFT_COMMAND_LIST_HPP__
+
+#include "glfft_interface.hpp"
+#include <vector>
+#include <cstdint>
+
+// A command buffer which records commands instead of executing them, see FFT::bake().
+// The recorded commands can be replayed into command buffers of any backend, any number of times,
+// without redoing the work which went into recording them.
+
+namespace GLFFT
+{
+    class CommandList : public CommandBuffer
+    {
+        public:
+            enum CommandType
+            {
+                CommandBindProgram,
+                CommandBindStorageTexture,
+                CommandBindTexture,
+                CommandBindSampler,
+                CommandBindStorageBuffer,
+                CommandBindStorageBufferRange,
+                CommandDispatch,
+                CommandBarrierBuffer,
+                CommandBarrierTexture,
+                CommandBarrierFull,
+                CommandBarrierAccess,
+                CommandPushConstantData,
+                CommandWriteTimestamp
+            };
+
+            // If elide_binds is false, every command is recorded as is, e.g. to trace what was issued.
+            explicit CommandList(bool elide_binds = true) : elide_binds(elide_binds) {}
+
+            struct Command
+            {
+                CommandType type;
+                unsigned binding;
+                // Program, Texture, Sampler, Buffer or TimestampQuery, depending on type.
+                void *object;
+                Format format;
+                // Buffer range, or range of the constant data in get_constant_data().
+                size_t offset, size;
+                unsigned x, y, z;
+                AccessFlags src_access, dst_access;
+            };
+
+            void bind_program(Program *program) override;
+            void bind_storage_texture(unsigned binding, Texture *texture, Format format) override;
+            void bind_texture(unsigned binding, Texture *texture) override;
+            void bind_sampler(unsigned binding, Sampler *sampler) override;
+            void bind_storage_buffer(unsigned binding, Buffer *texture) override;
+            void bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *texture) override;
+            void dispatch(unsigned x, unsigned y, unsigned z) override;
+
+            void barrier(Buffer *buffer) override;
+            void barrier(Texture *buffer) override;
+            void barrier() override;
+            void barrier(AccessFlags src_access, AccessFlags dst_access) override;
+
+            void push_constant_data(unsigned binding, const void *data, size_t size) override;
+            void write_timestamp(TimestampQuery *query) override;
+
+            // Issues the recorded commands into cmd.
+            void replay(CommandBuffer *cmd) const;
+            void clear();
+
+            const std::vector<Command>& get_commands() const { return commands; }
+            const std::vector<uint8_t>& get_constant_data() const { return constant_data; }
+
+        private:
+            std::vector<Command> commands;
+            std::vector<uint8_t> constant_data;
+
+            // Binds which would not change the state set up by earlier commands in the list are not recorded.
+            enum { MaxBindings = 16 };
+            struct Binding
+            {
+                CommandType type = CommandBindProgram;
+                void *object = nullptr;
+                Format format = FormatUnknown;
+                size_t offset = 0, size = 0;
+                bool valid = false;
+            };
+            Binding buffers[MaxBindings];
+            Binding textures[MaxBindings];
+            Binding samplers[MaxBindings];
+            Binding images[MaxBindings];
+            Program *program = nullptr;
+            bool elide_binds;
+
+            void record_bind(Binding *state, const Command &command);
+    };
+}
+
+#endif
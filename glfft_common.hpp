@@ -29,6 +29,8 @@
 #include <cstring>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace GLFFT
 {
@@ -53,6 +55,21 @@ enum Mode
 
     ResolveRealToComplex,
     ResolveComplexToReal,
+
+    /// Chirp multiplies which wrap the power-of-two convolution in Bluestein transforms.
+    ChirpPreMultiply,
+    ChirpPostMultiply,
+
+    /// Transforms along the Z axis of a 3D transform.
+    /// Added last to keep the values of serialized wisdom stable.
+    Depth,
+    DepthDual,
+
+    /// Twiddle multiply and transpose between the two vertical transforms of a four-step 1D transform.
+    FourStepTwiddle,
+
+    /// Complete 2D transform of a small tile in a single work group.
+    Tile2D,
 };
 
 enum Type
@@ -62,9 +79,11 @@ enum Type
     /// Complex-to-complex dual transform where the complex value is four-dimensional,
     /// i.e. a vector of two complex values. Typically used to transform RGBA data.
     ComplexToComplexDual,
-    /// Complex-to-real transform. N / 2 + 1 complex values are used per row with a stride of N complex samples.
+    /// Complex-to-real transform. N / 2 + 1 complex values are used per row with a stride of N complex samples,
+    /// or N / 2 + 1 complex samples with FFTOptions::Type::packed_spectrum.
     ComplexToReal,
-    /// Real-to-complex transform. N / 2 + 1 complex output samples are created per row with a stride of N complex samples.
+    /// Real-to-complex transform. N / 2 + 1 complex output samples are created per row with a stride of N complex samples,
+    /// or N / 2 + 1 complex samples with FFTOptions::Type::packed_spectrum.
     RealToComplex
 };
 
@@ -96,10 +115,18 @@ struct Parameters
     bool shared_banked;
     bool fft_fp16, input_fp16, output_fp16;
     bool fft_normalize;
+    bool twiddle_lut;
+    bool subgroup_shuffle;
+    bool packed_spectrum;
+    bool fused_resolve;
+
+    // Padding after the last member is left undefined by aggregate initialization, so it must not be compared.
+    // Members are ordered from largest to smallest, so there is no padding in between.
+    static size_t compared_size() { return offsetof(Parameters, fused_resolve) + sizeof(bool); }
 
     bool operator==(const Parameters &other) const
     {
-        return std::memcmp(this, &other, sizeof(Parameters)) == 0;
+        return std::memcmp(this, &other, compared_size()) == 0;
     }
 };
 
@@ -122,6 +149,22 @@ struct FFTOptions
         /// Whether to use banked shared memory or not.
         /// Desktop GPUs prefer true here, false for mobile in general.
         bool shared_banked = false;
+        /// Whether to read twiddle factors from a lookup table computed on the host in double precision
+        /// instead of evaluating cos/sin in the shader.
+        /// Helps GPUs which are limited by transcendental throughput or precision.
+        /// The table uses an extra SSBO binding (7).
+        bool twiddle_lut = false;
+        /// Whether radix-16 and radix-64 passes exchange butterflies between invocations with subgroup shuffles
+        /// instead of shared memory and barriers.
+        /// Only used if Context::supports_subgroup_shuffle() and the work group is exactly one subgroup,
+        /// i.e. workgroup_size_x * workgroup_size_y times the radix depth (4 or 8) equals Context::get_subgroup_size(),
+        /// otherwise passes silently fall back to shared memory.
+        bool subgroup_shuffle = false;
+        /// Whether real transforms fold the resolve pass into the horizontal transform.
+        /// If a row fits in a single whole-row pass (N / 2 between 256 and 4096, power-of-two),
+        /// that pass does the resolve as well, which saves a read and write of the spectrum.
+        /// Otherwise, a separate resolve pass is used.
+        bool fused_resolve = false;
     } performance;
 
     struct Type
@@ -134,6 +177,10 @@ struct FFTOptions
         bool output_fp16 = false;
         /// Whether to apply 1 / N normalization factor.
         bool normalize = false;
+        /// Whether the complex side of real transforms has rows of N / 2 + 1 complex samples back-to-back,
+        /// instead of rows N complex samples apart. This almost halves the size of the spectrum buffer.
+        /// Only supported if the complex side is an SSBO.
+        bool packed_spectrum = false;
     } type;
 };
 
@@ -148,7 +195,7 @@ namespace std
         {
             std::size_t h = 0;
             hash<uint8_t> hasher;
-            for (std::size_t i = 0; i < sizeof(GLFFT::Parameters); i++)
+            for (std::size_t i = 0; i < GLFFT::Parameters::compared_size(); i++)
             {
                 h ^= hasher(reinterpret_cast<const uint8_t*>(&params)[i]);
             }
@@ -161,6 +208,46 @@ namespace std
 namespace GLFFT
 {
 
+// Stores compiled programs on disk, so a later run can load them instead of compiling the shaders again.
+// Every program is a file in directory, named after a hash of its shader source and the renderer string.
+// Backends which cannot serialize programs, see Context::get_program_binary, always compile.
+class ProgramBinaryCache
+{
+    public:
+        ProgramBinaryCache(std::string directory) : directory(std::move(directory)) {}
+
+        std::unique_ptr<Program> load(Context *context, const std::string &source) const;
+        void store(Context *context, const std::string &source, Program *program) const;
+
+    private:
+        std::string directory;
+        static uint64_t hash(Context *context, const std::string &source);
+        std::string get_path(uint64_t key) const;
+};
+
+// Programs precompiled to SPIR-V at build time, see the bundle command of the CLI.
+// Programs are looked up by a hash of their Parameters, so plans skip generating and compiling shader source.
+// Loading goes through Context::load_program_binary, so only backends which take SPIR-V binaries, i.e. VulkanContext,
+// can use a bundle. Other backends, and Parameters which are not in the bundle, fall back to compiling the source.
+class ProgramBundle
+{
+    public:
+        /// Reads a bundle written by save(). Returns false if the file is missing, corrupt,
+        /// or was built from different shader sources.
+        bool load(const std::string &path);
+        bool save(const std::string &path) const;
+
+        void add(const Parameters &parameters, std::vector<uint32_t> spirv);
+        size_t size() const { return programs.size(); }
+
+        /// Returns nullptr if parameters are not in the bundle, or the context rejects the SPIR-V.
+        std::unique_ptr<Program> create_program(Context *context, const Parameters &parameters) const;
+
+    private:
+        std::unordered_map<uint64_t, std::vector<uint32_t>> programs;
+        static uint64_t hash(const Parameters &parameters);
+};
+
 class ProgramCache
 {
     public:
@@ -168,8 +255,57 @@ class ProgramCache
         void insert_program(const Parameters &parameters, std::unique_ptr<Program> program);
         size_t cache_size() const { return programs.size(); }
 
+        /// Programs which are not in the cache are looked up in binary_cache before compiling them,
+        /// and newly compiled programs are stored there.
+        void set_binary_cache(std::shared_ptr<ProgramBinaryCache> binary_cache) { this->binary_cache = std::move(binary_cache); }
+        ProgramBinaryCache* get_binary_cache() const { return binary_cache.get(); }
+
+        /// Programs which are not in the cache are created from bundle before generating and compiling their source.
+        void set_program_bundle(std::shared_ptr<ProgramBundle> bundle) { this->bundle = std::move(bundle); }
+
+        /// Creates the program from the bundle and inserts it, or returns nullptr if the bundle cannot provide it.
+        Program* load_bundled_program(Context *context, const Parameters &parameters);
+
+        /// Parameters of every program in the cache, e.g. to precompile them into a ProgramBundle.
+        std::vector<Parameters> get_parameters() const;
+
+        /// Compiles source, or loads it from the binary cache, and inserts the program. Throws if compilation fails.
+        /// With deferred compilation, the program can still be compiling when this returns.
+        Program* compile_program(Context *context, const Parameters &parameters, const std::string &source);
+
+        /// @brief Let programs compile in the background.
+        ///
+        /// By default, FFT constructors wait for every program they compile.
+        /// With deferred compilation, they only start compiling, so the programs of many plans can compile
+        /// at the same time, and the application can do other work in the meantime.
+        /// Plans must not be used before programs_ready() has returned true, or wait_for_programs() has returned.
+        void set_deferred_compile(bool enable) { deferred = enable; }
+
+        /// Whether all programs have been compiled. Never blocks. Throws if a program failed to compile.
+        bool programs_ready(Context *context);
+
+        /// Waits for all programs to be compiled. Throws if a program failed to compile.
+        void wait_for_programs(Context *context);
+
+        /// Whether program failed to compile.
+        /// Failed programs are kept in the cache, since plans may already refer to them.
+        bool is_failed(const Program *program) const { return !failed.empty() && failed.count(program) != 0; }
+
     private:
         std::unordered_map<Parameters, std::unique_ptr<Program>> programs;
+        std::shared_ptr<ProgramBinaryCache> binary_cache;
+        std::shared_ptr<ProgramBundle> bundle;
+
+        struct PendingProgram
+        {
+            Parameters parameters;
+            Program *program;
+            std::string source;
+        };
+        std::vector<PendingProgram> pending;
+        std::unordered_set<const Program*> failed;
+        bool deferred = false;
+        void finish_program(Context *context, const PendingProgram &pending_program);
 };
 
 }
@@ -0,0 +1,1483 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_cpu_interface.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+using namespace GLFFT;
+using namespace std;
+
+namespace GLFFT
+{
+    class CPUThreadPool
+    {
+        public:
+            CPUThreadPool(unsigned num_threads);
+            ~CPUThreadPool();
+
+            unsigned get_num_threads() const { return unsigned(workers.size()) + 1; }
+
+            // Calls func(index) for every index in [0, count) and blocks until all calls have completed.
+            // The calling thread participates.
+            void parallel_for(unsigned count, const function<void (unsigned)> &func);
+
+        private:
+            void worker_loop();
+            void run_job(const function<void (unsigned)> &func, unsigned count);
+
+            vector<thread> workers;
+            mutex lock;
+            condition_variable cond;
+            condition_variable done_cond;
+
+            const function<void (unsigned)> *job = nullptr;
+            unsigned job_count = 0;
+            atomic<unsigned> job_index;
+            unsigned active_workers = 0;
+            uint64_t generation = 0;
+            bool shutdown = false;
+    };
+}
+
+CPUThreadPool::CPUThreadPool(unsigned num_threads)
+    : job_index(0)
+{
+    for (unsigned i = 1; i < num_threads; i++)
+    {
+        workers.emplace_back(&CPUThreadPool::worker_loop, this);
+    }
+}
+
+CPUThreadPool::~CPUThreadPool()
+{
+    {
+        lock_guard<mutex> holder{lock};
+        shutdown = true;
+    }
+    cond.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void CPUThreadPool::run_job(const function<void (unsigned)> &func, unsigned count)
+{
+    unsigned index;
+    while ((index = job_index.fetch_add(1, memory_order_relaxed)) < count)
+    {
+        func(index);
+    }
+}
+
+void CPUThreadPool::worker_loop()
+{
+    uint64_t seen_generation = 0;
+    for (;;)
+    {
+        const function<void (unsigned)> *func;
+        unsigned count;
+
+        {
+            unique_lock<mutex> holder{lock};
+            cond.wait(holder, [&] { return shutdown || generation != seen_generation; });
+            if (shutdown)
+            {
+                return;
+            }
+
+            seen_generation = generation;
+            func = job;
+            count = job_count;
+        }
+
+        run_job(*func, count);
+
+        lock_guard<mutex> holder{lock};
+        if (--active_workers == 0)
+        {
+            done_cond.notify_one();
+        }
+    }
+}
+
+void CPUThreadPool::parallel_for(unsigned count, const function<void (unsigned)> &func)
+{
+    if (workers.empty() || count <= 1)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> holder{lock};
+        job = &func;
+        job_count = count;
+        job_index = 0;
+        active_workers = unsigned(workers.size());
+        generation++;
+    }
+    cond.notify_all();
+
+    run_job(func, count);
+
+    unique_lock<mutex> holder{lock};
+    done_cond.wait(holder, [&] { return active_workers == 0; });
+    job = nullptr;
+}
+
+uint16_t CPUTexture::fp32_to_fp16(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int exponent = int((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)
+    {
+        return uint16_t(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    }
+    else if (exponent >= 31)
+    {
+        return uint16_t(sign | 0x7c00u);
+    }
+    else if (exponent <= 0)
+    {
+        // Denormal or zero.
+        if (exponent < -10)
+        {
+            return uint16_t(sign);
+        }
+
+        mantissa |= 0x800000u;
+        unsigned shift = unsigned(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+        {
+            half++;
+        }
+        return uint16_t(sign | half);
+    }
+
+    // Round to nearest even, overflow into the exponent rounds up to infinity as expected.
+    uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+    {
+        half++;
+    }
+    return uint16_t(sign | half);
+}
+
+float CPUTexture::fp16_to_fp32(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1fu;
+    uint32_t mantissa = value & 0x3ffu;
+
+    if (exponent == 0)
+    {
+        float res = ldexp(float(mantissa), -24);
+        return sign ? -res : res;
+    }
+
+    uint32_t bits;
+    if (exponent == 31)
+    {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float res;
+    memcpy(&res, &bits, sizeof(res));
+    return res;
+}
+
+static float quantize_fp16(float value)
+{
+    return CPUTexture::fp16_to_fp32(CPUTexture::fp32_to_fp16(value));
+}
+
+static unsigned format_components(Format format)
+{
+    switch (format)
+    {
+        case FormatR16G16B16A16Float:
+        case FormatR32G32B32A32Float:
+            return 4;
+
+        case FormatR16G16Float:
+        case FormatR32G32Float:
+            return 2;
+
+        case FormatR32Float:
+        case FormatR32Uint:
+            return 1;
+
+        case FormatUnknown:
+            return 0;
+    }
+    return 0;
+}
+
+static bool format_is_fp16(Format format)
+{
+    return format == FormatR16G16B16A16Float || format == FormatR16G16Float;
+}
+
+CPUTexture::CPUTexture(const void *initial_data,
+        unsigned width, unsigned height,
+        Format format)
+    : width(width), height(height), components(format_components(format)), fp16(format_is_fp16(format))
+{
+    if (components == 0)
+    {
+        throw logic_error("Unsupported texture format.\n");
+    }
+
+    size_t count = size_t(width) * height * components;
+    data.resize(count);
+
+    if (initial_data)
+    {
+        if (fp16)
+        {
+            auto *src = static_cast<const uint16_t*>(initial_data);
+            for (size_t i = 0; i < count; i++)
+            {
+                data[i] = fp16_to_fp32(src[i]);
+            }
+        }
+        else
+        {
+            // R32Uint is stored as-is.
+            memcpy(data.data(), initial_data, count * sizeof(float));
+        }
+    }
+}
+
+float CPUTexture::load(int x, int y, unsigned component) const
+{
+    // Nearest filtering with clamp-to-edge, which is what GLFFT expects from its samplers.
+    x = max(min(x, int(width) - 1), 0);
+    y = max(min(y, int(height) - 1), 0);
+    return component < components ? data[(size_t(y) * width + x) * components + component] : 0.0f;
+}
+
+void CPUTexture::store(int x, int y, const float *value)
+{
+    if (x < 0 || y < 0 || unsigned(x) >= width || unsigned(y) >= height)
+    {
+        return;
+    }
+
+    float *texel = &data[(size_t(y) * width + x) * components];
+    for (unsigned i = 0; i < components; i++)
+    {
+        texel[i] = fp16 ? quantize_fp16(value[i]) : value[i];
+    }
+}
+
+void CPUTexture::read(void *buffer, Format format) const
+{
+    unsigned out_components = format_components(format);
+    bool out_fp16 = format_is_fp16(format);
+    size_t texels = size_t(width) * height;
+
+    for (size_t i = 0; i < texels; i++)
+    {
+        for (unsigned c = 0; c < out_components; c++)
+        {
+            float value = c < components ? data[i * components + c] : 0.0f;
+            if (out_fp16)
+            {
+                static_cast<uint16_t*>(buffer)[i * out_components + c] = fp32_to_fp16(value);
+            }
+            else
+            {
+                static_cast<float*>(buffer)[i * out_components + c] = value;
+            }
+        }
+    }
+}
+
+CPUBuffer::CPUBuffer(const void *initial_data, size_t size)
+    : size(size), data((size + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+{
+    if (initial_data)
+    {
+        memcpy(data.data(), initial_data, size);
+    }
+}
+
+namespace
+{
+    // Layout of the constant data GLFFT pushes for every pass. Matches the UBO in fft_common.comp.
+    struct ConstantData
+    {
+        uint32_t p;
+        uint32_t stride;
+        uint32_t twiddle_offset;
+        uint32_t twiddle_n;
+        float offset_x, offset_y;
+        float scale_x, scale_y;
+        uint32_t batch_stride_in;
+        uint32_t batch_stride_out;
+        uint32_t padding[2];
+    };
+
+    // Largest number of interleaved transforms which are processed together.
+    // Complex values from different transforms are laid out next to each other,
+    // so the butterfly loops below vectorize over transforms.
+    enum { BlockTransforms = 8, MaxBlockWidth = 2 * BlockTransforms, MaxKernelRadix = 32 };
+
+    const double pi = 3.14159265358979323846;
+
+    // Twiddle factors for a single radix stage, computed in double precision.
+    struct Stage
+    {
+        unsigned radix;
+        unsigned p;
+        vector<float> twiddles; // p * radix complex values, w[k][m] = exp(dir * 2 * pi * j * m * k / (radix * p)).
+        vector<float> dft;      // radix complex values, exp(dir * 2 * pi * j * m / radix).
+    };
+
+    struct Kernel
+    {
+        const CPUProgram::Pass *pass;
+        CPUTwiddleCache *twiddles;
+        ConstantData constants;
+        const uint8_t *input = nullptr;
+        const uint8_t *input_aux = nullptr;
+        uint8_t *output = nullptr;
+        const CPUTexture *texture = nullptr;
+        const CPUTexture *texture_aux = nullptr;
+        CPUTexture *image = nullptr;
+
+        // Number of complex values in one element, dual transforms carry two.
+        unsigned channels;
+        // Number of elements in one vector of the pass.
+        unsigned lanes;
+        float norm;
+
+        void load_texture(const CPUTexture *tex, unsigned col, unsigned row, float *value) const;
+        void load(size_t index, unsigned col, unsigned row, float *value) const;
+        void store(size_t index, unsigned col, unsigned row, float *value) const;
+    };
+}
+
+static vector<unsigned> factor_radix(unsigned radix)
+{
+    // Split a pass into smaller radix stages. Stockham passes compose,
+    // so a radix-16 pass at P is exactly two radix-4 stages at P and 4P.
+    vector<unsigned> factors;
+    while (radix % 4 == 0)
+    {
+        factors.push_back(4);
+        radix /= 4;
+    }
+
+    static const unsigned primes[] = { 2, 3, 5, 7 };
+    for (auto prime : primes)
+    {
+        while (radix % prime == 0)
+        {
+            factors.push_back(prime);
+            radix /= prime;
+        }
+    }
+
+    if (radix > 1)
+    {
+        if (radix > MaxKernelRadix)
+        {
+            throw logic_error("Radix is not supported by CPU backend.\n");
+        }
+        factors.push_back(radix);
+    }
+    return factors;
+}
+
+static vector<Stage> build_stages(unsigned radix, unsigned p, bool inverse)
+{
+    double dir = inverse ? 1.0 : -1.0;
+    vector<Stage> stages;
+
+    for (auto factor : factor_radix(radix))
+    {
+        Stage stage;
+        stage.radix = factor;
+        stage.p = p;
+        stage.twiddles.resize(2 * p * factor);
+        stage.dft.resize(2 * factor);
+
+        for (unsigned k = 0; k < p; k++)
+        {
+            for (unsigned m = 0; m < factor; m++)
+            {
+                double angle = dir * 2.0 * pi * double(m * k) / double(factor * p);
+                stage.twiddles[2 * (k * factor + m) + 0] = float(cos(angle));
+                stage.twiddles[2 * (k * factor + m) + 1] = float(sin(angle));
+            }
+        }
+
+        for (unsigned m = 0; m < factor; m++)
+        {
+            double angle = dir * 2.0 * pi * double(m) / double(factor);
+            stage.dft[2 * m + 0] = float(cos(angle));
+            stage.dft[2 * m + 1] = float(sin(angle));
+        }
+
+        stages.push_back(move(stage));
+        p *= factor;
+    }
+
+    return stages;
+}
+
+// One Stockham autosort stage over M interleaved transforms of length N in split real/imag form.
+// out[(j + r * p) * M + s] = sum_m in[(i + m * N / R) * M + s] * w[k][m] * W_R^(m * r),
+// where k = i mod p and j = (i - k) * R + k.
+static void run_stage(const Stage &stage, unsigned N, unsigned M,
+        const float *in_re, const float *in_im, float *out_re, float *out_im)
+{
+    const unsigned R = stage.radix;
+    const unsigned p = stage.p;
+    const unsigned stride = N / R;
+    const float *dft = stage.dft.data();
+
+    float tr[MaxKernelRadix][MaxBlockWidth];
+    float ti[MaxKernelRadix][MaxBlockWidth];
+
+    for (unsigned i = 0; i < stride; i++)
+    {
+        unsigned k = i % p;
+        unsigned j = (i - k) * R + k;
+        const float *w = &stage.twiddles[2 * k * R];
+
+        for (unsigned m = 0; m < R; m++)
+        {
+            const float *src_re = in_re + (i + m * stride) * M;
+            const float *src_im = in_im + (i + m * stride) * M;
+            const float wr = w[2 * m + 0];
+            const float wi = w[2 * m + 1];
+            for (unsigned s = 0; s < M; s++)
+            {
+                tr[m][s] = src_re[s] * wr - src_im[s] * wi;
+                ti[m][s] = src_re[s] * wi + src_im[s] * wr;
+            }
+        }
+
+        switch (R)
+        {
+            case 2:
+            {
+                float *o0r = out_re + (j + 0 * p) * M, *o0i = out_im + (j + 0 * p) * M;
+                float *o1r = out_re + (j + 1 * p) * M, *o1i = out_im + (j + 1 * p) * M;
+                for (unsigned s = 0; s < M; s++)
+                {
+                    o0r[s] = tr[0][s] + tr[1][s];
+                    o0i[s] = ti[0][s] + ti[1][s];
+                    o1r[s] = tr[0][s] - tr[1][s];
+                    o1i[s] = ti[0][s] - ti[1][s];
+                }
+                break;
+            }
+
+            case 4:
+            {
+                // W_4 is +/- j, the imaginary part of dft[1] carries the direction.
+                const float dir = dft[3];
+                float *o0r = out_re + (j + 0 * p) * M, *o0i = out_im + (j + 0 * p) * M;
+                float *o1r = out_re + (j + 1 * p) * M, *o1i = out_im + (j + 1 * p) * M;
+                float *o2r = out_re + (j + 2 * p) * M, *o2i = out_im + (j + 2 * p) * M;
+                float *o3r = out_re + (j + 3 * p) * M, *o3i = out_im + (j + 3 * p) * M;
+                for (unsigned s = 0; s < M; s++)
+                {
+                    float a0r = tr[0][s] + tr[2][s], a0i = ti[0][s] + ti[2][s];
+                    float a1r = tr[0][s] - tr[2][s], a1i = ti[0][s] - ti[2][s];
+                    float a2r = tr[1][s] + tr[3][s], a2i = ti[1][s] + ti[3][s];
+                    float a3r = -dir * (ti[1][s] - ti[3][s]), a3i = dir * (tr[1][s] - tr[3][s]);
+                    o0r[s] = a0r + a2r;
+                    o0i[s] = a0i + a2i;
+                    o1r[s] = a1r + a3r;
+                    o1i[s] = a1i + a3i;
+                    o2r[s] = a0r - a2r;
+                    o2i[s] = a0i - a2i;
+                    o3r[s] = a1r - a3r;
+                    o3i[s] = a1i - a3i;
+                }
+                break;
+            }
+
+            default:
+            {
+                for (unsigned r = 0; r < R; r++)
+                {
+                    float *or_ = out_re + (j + r * p) * M;
+                    float *oi = out_im + (j + r * p) * M;
+                    for (unsigned s = 0; s < M; s++)
+                    {
+                        or_[s] = tr[0][s];
+                        oi[s] = ti[0][s];
+                    }
+
+                    for (unsigned m = 1; m < R; m++)
+                    {
+                        const float dr = dft[2 * ((m * r) % R) + 0];
+                        const float di = dft[2 * ((m * r) % R) + 1];
+                        for (unsigned s = 0; s < M; s++)
+                        {
+                            or_[s] += tr[m][s] * dr - ti[m][s] * di;
+                            oi[s] += tr[m][s] * di + ti[m][s] * dr;
+                        }
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+void Kernel::load_texture(const CPUTexture *tex, unsigned col, unsigned row, float *value) const
+{
+    // Mirror the texel addressing of load_texture() in fft_common.comp.
+    unsigned vector_index = col / lanes;
+    unsigned lane = col % lanes;
+    float u = float(vector_index) * constants.scale_x + constants.offset_x;
+    float v = float(row) * constants.scale_y + constants.offset_y;
+    int x = int(floor(u * float(tex->get_width())));
+    int y = int(floor(v * float(tex->get_height())));
+
+    if (pass->input_real)
+    {
+        x += 2 * lane;
+        value[0] = tex->load(x + 0, y, 0);
+        value[1] = tex->load(x + 1, y, 0);
+    }
+    else
+    {
+        x += lane;
+        for (unsigned c = 0; c < 2 * channels; c++)
+        {
+            value[c] = tex->load(x, y, c);
+        }
+    }
+}
+
+void Kernel::load(size_t index, unsigned col, unsigned row, float *value) const
+{
+    const unsigned components = 2 * channels;
+
+    if (texture)
+    {
+        load_texture(texture, col, row, value);
+    }
+    else if (pass->input_fp16)
+    {
+        auto *src = reinterpret_cast<const uint16_t*>(input) + index * components;
+        for (unsigned c = 0; c < components; c++)
+        {
+            value[c] = CPUTexture::fp16_to_fp32(src[c]);
+        }
+    }
+    else
+    {
+        memcpy(value, reinterpret_cast<const float*>(input) + index * components, components * sizeof(float));
+    }
+
+    if (pass->convolve)
+    {
+        // Convolution in frequency domain is multiplication.
+        float aux[4];
+        if (texture_aux)
+        {
+            load_texture(texture_aux, col, row, aux);
+        }
+        else if (pass->input_fp16)
+        {
+            auto *src = reinterpret_cast<const uint16_t*>(input_aux) + index * components;
+            for (unsigned c = 0; c < components; c++)
+            {
+                aux[c] = CPUTexture::fp16_to_fp32(src[c]);
+            }
+        }
+        else
+        {
+            memcpy(aux, reinterpret_cast<const float*>(input_aux) + index * components, components * sizeof(float));
+        }
+
+        for (unsigned c = 0; c < components; c += 2)
+        {
+            float re = value[c + 0] * aux[c + 0] - value[c + 1] * aux[c + 1];
+            float im = value[c + 0] * aux[c + 1] + value[c + 1] * aux[c + 0];
+            value[c + 0] = re;
+            value[c + 1] = im;
+        }
+    }
+}
+
+void Kernel::store(size_t index, unsigned col, unsigned row, float *value) const
+{
+    const unsigned components = 2 * channels;
+    for (unsigned c = 0; c < components; c++)
+    {
+        value[c] *= norm;
+    }
+
+    if (image)
+    {
+        if (pass->output_real)
+        {
+            image->store(int(2 * col + 0), int(row), value + 0);
+            image->store(int(2 * col + 1), int(row), value + 1);
+        }
+        else
+        {
+            image->store(int(col), int(row), value);
+        }
+    }
+    else if (pass->output_fp16)
+    {
+        auto *dst = reinterpret_cast<uint16_t*>(output) + index * components;
+        for (unsigned c = 0; c < components; c++)
+        {
+            dst[c] = CPUTexture::fp32_to_fp16(value[c]);
+        }
+    }
+    else
+    {
+        memcpy(reinterpret_cast<float*>(output) + index * components, value, components * sizeof(float));
+    }
+}
+
+// Twiddles of the resolve passes, see r2c_twiddle() and c2r_twiddle() in fft_common.comp.
+static vector<float> build_resolve_twiddles(unsigned stride, bool inverse, bool real_to_complex)
+{
+    const double dir = inverse ? 1.0 : -1.0;
+    vector<float> twiddles(2 * stride);
+    for (unsigned i = 0; i < stride; i++)
+    {
+        // r2c_twiddle() is -j * w, c2r_twiddle() is +j * w.
+        double angle = dir * pi * double(i) / double(stride);
+        double sign = real_to_complex ? -1.0 : 1.0;
+        twiddles[2 * i + 0] = float(-sign * sin(angle));
+        twiddles[2 * i + 1] = float(sign * cos(angle));
+    }
+    return twiddles;
+}
+
+// Twiddles for w^n = exp(dir * 2 * pi * j * n / N) with n < N, in double precision.
+// w^n is split into w^(hi * split) * w^lo, so two tables of sqrt(N) values cover all of them.
+namespace
+{
+    struct FourStepTwiddles
+    {
+        unsigned split;
+        vector<double> coarse; // w^(hi * split)
+        vector<double> fine;   // w^lo
+    };
+}
+
+static FourStepTwiddles build_four_step_twiddles(uint64_t N, bool inverse)
+{
+    const double dir = inverse ? 1.0 : -1.0;
+    FourStepTwiddles twiddles;
+    twiddles.split = unsigned(ceil(sqrt(double(N))));
+    unsigned coarse = unsigned((N + twiddles.split - 1) / twiddles.split);
+    twiddles.coarse.resize(2 * coarse);
+    twiddles.fine.resize(2 * twiddles.split);
+
+    for (unsigned i = 0; i < coarse; i++)
+    {
+        double angle = dir * 2.0 * pi * double(uint64_t(i) * twiddles.split) / double(N);
+        twiddles.coarse[2 * i + 0] = cos(angle);
+        twiddles.coarse[2 * i + 1] = sin(angle);
+    }
+
+    for (unsigned i = 0; i < twiddles.split; i++)
+    {
+        double angle = dir * 2.0 * pi * double(i) / double(N);
+        twiddles.fine[2 * i + 0] = cos(angle);
+        twiddles.fine[2 * i + 1] = sin(angle);
+    }
+    return twiddles;
+}
+
+namespace GLFFT
+{
+    // Building twiddles with double precision cos/sin is far more expensive than the butterflies,
+    // so the tables are built the first time a program is dispatched with a given size, and then reused.
+    // Tables are never removed, so references stay valid while other threads add new ones.
+    struct CPUTwiddleCache
+    {
+        mutex lock;
+        // Keyed by radix and p. Tile passes use the stages of an entire row or column at p = 1.
+        map<pair<unsigned, unsigned>, vector<Stage>> stages;
+        // Keyed by the stride of the resolve.
+        map<unsigned, vector<float>> resolve;
+        // Keyed by N1 * N2.
+        map<uint64_t, FourStepTwiddles> four_step;
+
+        const vector<Stage>& get_stages(unsigned radix, unsigned p, bool inverse)
+        {
+            lock_guard<mutex> holder{lock};
+            auto key = make_pair(radix, p);
+            auto itr = stages.find(key);
+            if (itr == end(stages))
+            {
+                itr = stages.insert(make_pair(key, build_stages(radix, p, inverse))).first;
+            }
+            return itr->second;
+        }
+
+        const vector<float>& get_resolve(unsigned stride, bool inverse, bool real_to_complex)
+        {
+            lock_guard<mutex> holder{lock};
+            auto itr = resolve.find(stride);
+            if (itr == end(resolve))
+            {
+                itr = resolve.insert(make_pair(stride, build_resolve_twiddles(stride, inverse, real_to_complex))).first;
+            }
+            return itr->second;
+        }
+
+        const FourStepTwiddles& get_four_step(uint64_t N, bool inverse)
+        {
+            lock_guard<mutex> holder{lock};
+            auto itr = four_step.find(N);
+            if (itr == end(four_step))
+            {
+                itr = four_step.insert(make_pair(N, build_four_step_twiddles(N, inverse))).first;
+            }
+            return itr->second;
+        }
+    };
+}
+
+CPUProgram::CPUProgram(const Pass &pass)
+    : pass(pass), twiddles(new CPUTwiddleCache)
+{
+}
+
+CPUProgram::~CPUProgram()
+{
+}
+
+// Resolves sample i of a row from a = row[i] and b = row[stride - i].
+// See FFT_real_to_complex and FFT_complex_to_real in fft_common.comp.
+static void resolve_butterfly(const float *a, const float *b, const float *w, bool real_to_complex, float *res)
+{
+    float even_r = a[0] + b[0], even_i = a[1] - b[1];
+    float diff_r = a[0] - b[0], diff_i = a[1] + b[1];
+    float odd_r = diff_r * w[0] - diff_i * w[1];
+    float odd_i = diff_r * w[1] + diff_i * w[0];
+    float scale = real_to_complex ? 0.5f : 1.0f;
+    res[0] = scale * (even_r + odd_r);
+    res[1] = scale * (even_i + odd_i);
+}
+
+// Rows on the complex side of a resolve are either N complex samples apart, or packed back-to-back.
+static size_t spectrum_row_offset(const CPUProgram::Pass &pass, unsigned row, unsigned stride)
+{
+    return pass.packed_spectrum ? size_t(row) * (stride + 1) : 2 * size_t(row) * stride;
+}
+
+// Stores the resolved spectrum of a transformed row. Sample n of the row is at re[n * M] and im[n * M].
+static void store_real_to_complex(const Kernel &kernel, const vector<float> &twiddles,
+        const float *re, const float *im, unsigned M, unsigned stride, unsigned row)
+{
+    size_t offset = spectrum_row_offset(*kernel.pass, row, stride);
+    float a[2], b[2], res[2];
+
+    res[0] = re[0] + im[0];
+    res[1] = 0.0f;
+    kernel.store(offset, 0, row, res);
+    res[0] = re[0] - im[0];
+    res[1] = 0.0f;
+    kernel.store(offset + stride, stride, row, res);
+
+    for (unsigned i = 1; i < stride; i++)
+    {
+        a[0] = re[i * M];
+        a[1] = im[i * M];
+        b[0] = re[(stride - i) * M];
+        b[1] = im[(stride - i) * M];
+        resolve_butterfly(a, b, &twiddles[2 * i], true, res);
+        kernel.store(offset + i, i, row, res);
+    }
+}
+
+// Loads sample i of a row from the spectrum it is resolved from.
+static void load_complex_to_real(const Kernel &kernel, const vector<float> &twiddles,
+        unsigned stride, unsigned i, unsigned row, float *res)
+{
+    size_t offset = spectrum_row_offset(*kernel.pass, row, stride);
+    float a[2], b[2];
+    kernel.load(offset + i, i, row, a);
+    kernel.load(offset + stride - i, stride - i, row, b);
+    resolve_butterfly(a, b, &twiddles[2 * i], false, res);
+}
+
+// See FFT_real_to_complex and FFT_complex_to_real in fft_common.comp.
+static void execute_resolve(CPUThreadPool &pool, const Kernel &kernel, unsigned threads_x, unsigned threads_y)
+{
+    const auto &pass = *kernel.pass;
+    const unsigned stride = threads_x;
+    const auto &twiddles = kernel.twiddles->get_resolve(stride, pass.inverse, pass.resolve_real_to_complex);
+
+    pool.parallel_for(threads_y, [&](unsigned row) {
+        float a[2];
+        size_t offset = size_t(row) * stride;
+
+        if (pass.resolve_complex_to_real)
+        {
+            for (unsigned i = 0; i < stride; i++)
+            {
+                load_complex_to_real(kernel, twiddles, stride, i, row, a);
+                kernel.store(offset + i, i, row, a);
+            }
+            return;
+        }
+
+        // The transformed row is loaded in split real/imag form.
+        vector<float> re(stride), im(stride);
+        for (unsigned i = 0; i < stride; i++)
+        {
+            kernel.load(offset + i, i, row, a);
+            re[i] = a[0];
+            im[i] = a[1];
+        }
+        store_real_to_complex(kernel, twiddles, re.data(), im.data(), 1, stride, row);
+    });
+}
+
+static void execute_radix(CPUThreadPool &pool, const Kernel &kernel, unsigned threads_x, unsigned threads_y)
+{
+    const auto &pass = *kernel.pass;
+    const unsigned p = pass.p1 ? 1 : kernel.constants.p;
+
+    // Horizontal passes transform rows of N elements which are laid out contiguously.
+    // Vertical passes transform columns with a row stride given by the constant data.
+    unsigned N, transforms;
+    size_t element_stride, transform_stride;
+    if (pass.horizontal)
+    {
+        N = threads_x * pass.radix * kernel.lanes;
+        transforms = threads_y;
+        element_stride = 1;
+        transform_stride = N;
+    }
+    else
+    {
+        N = threads_y * pass.radix;
+        transforms = threads_x * kernel.lanes;
+        element_stride = size_t(kernel.constants.stride) * kernel.lanes;
+        transform_stride = 1;
+
+        // Packed spectra round the columns up to whole work groups, the excess invocations only redo the last one.
+        if (pass.packed_spectrum)
+        {
+            transforms = min(transforms, kernel.constants.stride * kernel.lanes);
+        }
+    }
+
+    const auto &stages = kernel.twiddles->get_stages(pass.radix, p, pass.inverse);
+    const unsigned channels = kernel.channels;
+
+    // Fused resolve passes transform whole rows, and resolve them as part of the loads or stores.
+    bool fused = pass.fused_real_to_complex || pass.fused_complex_to_real;
+    static const vector<float> no_twiddles;
+    const auto &resolve_twiddles = fused ?
+        kernel.twiddles->get_resolve(N, pass.inverse, pass.fused_real_to_complex) : no_twiddles;
+    const unsigned blocks = (transforms + BlockTransforms - 1) / BlockTransforms;
+
+    pool.parallel_for(blocks, [&](unsigned block) {
+        unsigned first = block * BlockTransforms;
+        unsigned count = min(unsigned(BlockTransforms), transforms - first);
+        unsigned M = count * channels;
+
+        static thread_local vector<float> scratch;
+        scratch.resize(4 * size_t(N) * M);
+        float *re[2] = { scratch.data(), scratch.data() + 2 * size_t(N) * M };
+        float *im[2] = { scratch.data() + size_t(N) * M, scratch.data() + 3 * size_t(N) * M };
+
+        float value[4];
+        for (unsigned n = 0; n < N; n++)
+        {
+            for (unsigned t = 0; t < count; t++)
+            {
+                unsigned transform = first + t;
+                size_t index = n * element_stride + transform * transform_stride;
+                if (pass.fused_complex_to_real)
+                {
+                    load_complex_to_real(kernel, resolve_twiddles, N, n, transform, value);
+                }
+                else if (pass.horizontal)
+                {
+                    kernel.load(index, n, transform, value);
+                }
+                else
+                {
+                    kernel.load(index, transform, n, value);
+                }
+
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    re[0][n * M + t * channels + c] = value[2 * c + 0];
+                    im[0][n * M + t * channels + c] = value[2 * c + 1];
+                }
+            }
+        }
+
+        unsigned current = 0;
+        for (auto &stage : stages)
+        {
+            run_stage(stage, N, M, re[current], im[current], re[current ^ 1], im[current ^ 1]);
+            current ^= 1;
+        }
+
+        if (pass.fused_real_to_complex)
+        {
+            for (unsigned t = 0; t < count; t++)
+            {
+                store_real_to_complex(kernel, resolve_twiddles, re[current] + t, im[current] + t, M, N, first + t);
+            }
+            return;
+        }
+
+        for (unsigned n = 0; n < N; n++)
+        {
+            for (unsigned t = 0; t < count; t++)
+            {
+                unsigned transform = first + t;
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    value[2 * c + 0] = re[current][n * M + t * channels + c];
+                    value[2 * c + 1] = im[current][n * M + t * channels + c];
+                }
+
+                size_t index = n * element_stride + transform * transform_stride;
+                if (pass.horizontal)
+                {
+                    kernel.store(index, n, transform, value);
+                }
+                else
+                {
+                    kernel.store(index, transform, n, value);
+                }
+            }
+        }
+    });
+}
+
+// See FFT_chirp_pre_multiply and FFT_chirp_post_multiply in fft_common.comp.
+static void execute_chirp(CPUThreadPool &pool, const Kernel &kernel, unsigned threads_x, unsigned threads_y)
+{
+    const auto &pass = *kernel.pass;
+    const unsigned N = kernel.constants.stride;
+    const unsigned padded = threads_x;
+    const float *chirp = reinterpret_cast<const float*>(kernel.input_aux);
+
+    pool.parallel_for(threads_y, [&](unsigned row) {
+        float value[2];
+        for (unsigned i = 0; i < padded; i++)
+        {
+            if (i >= N)
+            {
+                if (pass.chirp_pre_multiply)
+                {
+                    value[0] = 0.0f;
+                    value[1] = 0.0f;
+                    kernel.store(size_t(row) * padded + i, i, row, value);
+                }
+                continue;
+            }
+
+            size_t in_index = pass.chirp_pre_multiply ? size_t(row) * N + i : size_t(row) * padded + i;
+            size_t out_index = pass.chirp_pre_multiply ? size_t(row) * padded + i : size_t(row) * N + i;
+
+            kernel.load(in_index, i, row, value);
+            float re = value[0] * chirp[2 * i + 0] - value[1] * chirp[2 * i + 1];
+            float im = value[0] * chirp[2 * i + 1] + value[1] * chirp[2 * i + 0];
+            value[0] = re;
+            value[1] = im;
+            kernel.store(out_index, i, row, value);
+        }
+    });
+}
+
+// See FFT_four_step_twiddle in fft_common.comp.
+static void execute_four_step_twiddle(CPUThreadPool &pool, const Kernel &kernel, unsigned threads_x, unsigned threads_y)
+{
+    const auto &pass = *kernel.pass;
+    const unsigned N2 = threads_x;
+    const unsigned N1 = threads_y;
+    const uint64_t N = uint64_t(N1) * N2;
+    const auto &twiddles = kernel.twiddles->get_four_step(N, pass.inverse);
+
+    pool.parallel_for(N1, [&](unsigned k1) {
+        float value[2];
+        for (unsigned n2 = 0; n2 < N2; n2++)
+        {
+            uint64_t n = (uint64_t(k1) * n2) % N;
+            const double *hi = &twiddles.coarse[2 * (n / twiddles.split)];
+            const double *lo = &twiddles.fine[2 * (n % twiddles.split)];
+            float wr = float(hi[0] * lo[0] - hi[1] * lo[1]);
+            float wi = float(hi[0] * lo[1] + hi[1] * lo[0]);
+
+            kernel.load(size_t(k1) * N2 + n2, n2, k1, value);
+            float re = value[0] * wr - value[1] * wi;
+            float im = value[0] * wi + value[1] * wr;
+            value[0] = re;
+            value[1] = im;
+            kernel.store(size_t(n2) * N1 + k1, k1, n2, value);
+        }
+    });
+}
+
+// See FFT_tile in fft_tile.comp. Rows are transformed first, then columns.
+static void execute_tile_2d(CPUThreadPool &pool, const Kernel &kernel, unsigned threads_x, unsigned threads_y)
+{
+    const auto &pass = *kernel.pass;
+    const unsigned width = 4 * threads_x;
+    const unsigned height = 4 * threads_y;
+    const size_t size = size_t(width) * height;
+    const auto &row_stages = kernel.twiddles->get_stages(width, 1, pass.inverse);
+    const auto &column_stages = kernel.twiddles->get_stages(height, 1, pass.inverse);
+
+    // Columns are stored transposed, so both dimensions run the stages over contiguous samples.
+    vector<float> re(size), im(size);
+
+    pool.parallel_for(height, [&](unsigned y) {
+        vector<float> scratch(4 * width);
+        float *tr[2] = { scratch.data(), scratch.data() + 2 * width };
+        float *ti[2] = { scratch.data() + width, scratch.data() + 3 * width };
+
+        float value[2];
+        for (unsigned x = 0; x < width; x++)
+        {
+            kernel.load(size_t(y) * width + x, x, y, value);
+            tr[0][x] = value[0];
+            ti[0][x] = value[1];
+        }
+
+        unsigned current = 0;
+        for (auto &stage : row_stages)
+        {
+            run_stage(stage, width, 1, tr[current], ti[current], tr[current ^ 1], ti[current ^ 1]);
+            current ^= 1;
+        }
+
+        for (unsigned x = 0; x < width; x++)
+        {
+            re[size_t(x) * height + y] = tr[current][x];
+            im[size_t(x) * height + y] = ti[current][x];
+        }
+    });
+
+    pool.parallel_for(width, [&](unsigned x) {
+        vector<float> scratch(2 * height);
+        float *tr[2] = { &re[size_t(x) * height], scratch.data() };
+        float *ti[2] = { &im[size_t(x) * height], scratch.data() + height };
+
+        unsigned current = 0;
+        for (auto &stage : column_stages)
+        {
+            run_stage(stage, height, 1, tr[current], ti[current], tr[current ^ 1], ti[current ^ 1]);
+            current ^= 1;
+        }
+
+        float value[2];
+        for (unsigned y = 0; y < height; y++)
+        {
+            value[0] = tr[current][y];
+            value[1] = ti[current][y];
+            kernel.store(size_t(y) * width + x, x, y, value);
+        }
+    });
+}
+
+void CPUCommandBuffer::bind_program(Program *program)
+{
+    this->program = static_cast<CPUProgram*>(program);
+}
+
+void CPUCommandBuffer::bind_storage_texture(unsigned binding, Texture *texture, Format)
+{
+    textures[binding] = static_cast<CPUTexture*>(texture);
+}
+
+void CPUCommandBuffer::bind_texture(unsigned binding, Texture *texture)
+{
+    textures[binding] = static_cast<CPUTexture*>(texture);
+}
+
+void CPUCommandBuffer::bind_sampler(unsigned, Sampler *)
+{
+    // Textures are always sampled with nearest filtering and clamp-to-edge.
+}
+
+void CPUCommandBuffer::bind_storage_buffer(unsigned binding, Buffer *buffer)
+{
+    buffers[binding].buffer = static_cast<CPUBuffer*>(buffer);
+    buffers[binding].offset = 0;
+}
+
+void CPUCommandBuffer::bind_storage_buffer_range(unsigned binding, size_t offset, size_t, Buffer *buffer)
+{
+    buffers[binding].buffer = static_cast<CPUBuffer*>(buffer);
+    buffers[binding].offset = offset;
+}
+
+void CPUCommandBuffer::push_constant_data(unsigned binding, const void *data, size_t size)
+{
+    memcpy(constant_data[binding], data, min(size, size_t(MaxConstantDataSize)));
+}
+
+void CPUCommandBuffer::dispatch(unsigned x, unsigned y, unsigned z)
+{
+    if (!program)
+    {
+        throw logic_error("No program bound.\n");
+    }
+
+    // Binding points match the Bindings enum in glfft.cpp.
+    enum { BindingSSBOIn = 0, BindingSSBOOut = 1, BindingSSBOAux = 2, BindingUBO = 3,
+        BindingTexture0 = 4, BindingTexture1 = 5, BindingImage = 6 };
+
+    const auto &pass = program->get_pass();
+    Kernel kernel;
+    kernel.pass = &pass;
+    kernel.twiddles = program->twiddles.get();
+    memcpy(&kernel.constants, constant_data[BindingUBO], sizeof(kernel.constants));
+
+    kernel.channels = pass.dual ? 2 : 1;
+    // Real input and output are carried around as regular complex values.
+    kernel.lanes = max(pass.vector_size / (2 * kernel.channels), 1u);
+    kernel.norm = pass.normalize ? 1.0f / float(pass.radix) : 1.0f;
+    if (pass.tile_2d && pass.normalize)
+    {
+        // Tile kernels do the entire 2D transform in one pass.
+        kernel.norm = 1.0f / float(16 * pass.workgroup_size_x * pass.workgroup_size_y);
+    }
+    else if ((pass.fused_real_to_complex || pass.fused_complex_to_real) && pass.normalize)
+    {
+        // Fused resolve passes also do the radix-2 step of the resolve.
+        kernel.norm = 0.5f / float(pass.radix);
+    }
+
+    if (pass.input_texture)
+    {
+        kernel.texture = textures[BindingTexture0];
+        kernel.texture_aux = pass.convolve ? textures[BindingTexture1] : nullptr;
+    }
+    else
+    {
+        auto &in = buffers[BindingSSBOIn];
+        kernel.input = in.buffer->get(in.offset);
+        if (pass.convolve || pass.chirp_pre_multiply || pass.chirp_post_multiply)
+        {
+            auto &aux = buffers[BindingSSBOAux];
+            kernel.input_aux = aux.buffer->get(aux.offset);
+        }
+    }
+
+    if (pass.output_image)
+    {
+        kernel.image = textures[BindingImage];
+    }
+    else
+    {
+        auto &out = buffers[BindingSSBOOut];
+        kernel.output = out.buffer->get(out.offset);
+    }
+
+    unsigned threads_x = x * pass.workgroup_size_x;
+    unsigned threads_y = y * pass.workgroup_size_y;
+
+    // Batch strides are in units of the pass' vector type.
+    size_t batch_stride_in = size_t(kernel.constants.batch_stride_in) * pass.vector_size * sizeof(float);
+    size_t batch_stride_out = size_t(kernel.constants.batch_stride_out) * pass.vector_size * sizeof(float);
+    batch_stride_in >>= pass.input_fp16;
+    batch_stride_out >>= pass.output_fp16;
+
+    for (unsigned i = 0; i < z; i++)
+    {
+        if (i != 0)
+        {
+            kernel.input += batch_stride_in;
+            kernel.output += batch_stride_out;
+            if (pass.convolve)
+            {
+                kernel.input_aux += batch_stride_in;
+            }
+        }
+
+        if (pass.resolve_real_to_complex || pass.resolve_complex_to_real)
+        {
+            execute_resolve(pool, kernel, threads_x, threads_y);
+        }
+        else if (pass.chirp_pre_multiply || pass.chirp_post_multiply)
+        {
+            execute_chirp(pool, kernel, threads_x, threads_y);
+        }
+        else if (pass.four_step_twiddle)
+        {
+            execute_four_step_twiddle(pool, kernel, threads_x, threads_y);
+        }
+        else if (pass.tile_2d)
+        {
+            execute_tile_2d(pool, kernel, threads_x, threads_y);
+        }
+        else
+        {
+            execute_radix(pool, kernel, threads_x, threads_y);
+        }
+    }
+}
+
+CPUContext::CPUContext(unsigned num_threads)
+{
+    if (num_threads == 0)
+    {
+        num_threads = max(thread::hardware_concurrency(), 1u);
+    }
+
+    pool = unique_ptr<CPUThreadPool>(new CPUThreadPool(num_threads));
+    command_buffer = unique_ptr<CPUCommandBuffer>(new CPUCommandBuffer(*pool));
+    renderer_string = "GLFFT CPU (" + to_string(num_threads) + " threads)";
+}
+
+CPUContext::~CPUContext()
+{
+}
+
+unsigned CPUContext::get_num_threads() const
+{
+    return pool->get_num_threads();
+}
+
+void CPUContext::parallel_for(unsigned count, const function<void (unsigned)> &func)
+{
+    pool->parallel_for(count, func);
+}
+
+unique_ptr<Texture> CPUContext::create_texture(const void *initial_data,
+        unsigned width, unsigned height,
+        Format format)
+{
+    return unique_ptr<Texture>(new CPUTexture(initial_data, width, height, format));
+}
+
+unique_ptr<Buffer> CPUContext::create_buffer(const void *initial_data, size_t size, AccessMode)
+{
+    return unique_ptr<Buffer>(new CPUBuffer(initial_data, size));
+}
+
+unique_ptr<Program> CPUContext::compile_compute_shader(const char *source)
+{
+    // GLFFT prepends the pass configuration as a list of #defines followed by the work group size.
+    // Everything after that is the generic shader code which we implement natively.
+    unordered_map<string, string> defines;
+    CPUProgram::Pass pass;
+
+    istringstream stream(source);
+    string line;
+    bool found_layout = false;
+    while (getline(stream, line))
+    {
+        if (line.compare(0, 8, "#define ") == 0)
+        {
+            istringstream define(line.substr(8));
+            string name, value;
+            define >> name >> value;
+            defines[name] = value;
+        }
+        else if (line.compare(0, 7, "layout(") == 0)
+        {
+            if (sscanf(line.c_str(), "layout(local_size_x = %u, local_size_y = %u, local_size_z = %u) in;",
+                        &pass.workgroup_size_x, &pass.workgroup_size_y, &pass.workgroup_size_z) != 3)
+            {
+                log("Failed to parse work group size: %s\n", line.c_str());
+                return nullptr;
+            }
+            found_layout = true;
+            break;
+        }
+    }
+
+    auto has = [&](const char *name) { return defines.find(name) != end(defines); };
+
+    if (!found_layout || !has("FFT_RADIX"))
+    {
+        log("Shader does not contain a GLFFT pass configuration.\n");
+        return nullptr;
+    }
+
+    pass.radix = unsigned(stoul(defines["FFT_RADIX"]));
+    pass.p1 = has("FFT_P1");
+    pass.inverse = has("FFT_INVERSE");
+    pass.convolve = has("FFT_CONVOLVE");
+    pass.normalize = has("FFT_NORMALIZE");
+    pass.dual = has("FFT_DUAL");
+    pass.horizontal = has("FFT_HORIZ");
+    pass.resolve_real_to_complex = has("FFT_RESOLVE_REAL_TO_COMPLEX");
+    pass.resolve_complex_to_real = has("FFT_RESOLVE_COMPLEX_TO_REAL");
+    pass.chirp_pre_multiply = has("FFT_CHIRP_PRE_MULTIPLY");
+    pass.chirp_post_multiply = has("FFT_CHIRP_POST_MULTIPLY");
+    pass.four_step_twiddle = has("FFT_FOUR_STEP_TWIDDLE");
+    pass.tile_2d = has("FFT_TILE_2D");
+    pass.input_texture = has("FFT_INPUT_TEXTURE");
+    pass.input_real = has("FFT_INPUT_REAL");
+    pass.input_fp16 = has("FFT_INPUT_FP16");
+    pass.output_image = has("FFT_OUTPUT_IMAGE");
+    pass.output_real = has("FFT_OUTPUT_REAL");
+    pass.output_fp16 = has("FFT_OUTPUT_FP16");
+    pass.packed_spectrum = has("FFT_PACKED_SPECTRUM");
+    pass.fused_real_to_complex = has("FFT_FUSED_REAL_TO_COMPLEX");
+    pass.fused_complex_to_real = has("FFT_FUSED_COMPLEX_TO_REAL");
+
+    if (has("FFT_VEC8"))
+    {
+        pass.vector_size = 8;
+    }
+    else if (has("FFT_VEC4"))
+    {
+        pass.vector_size = 4;
+    }
+    else
+    {
+        pass.vector_size = 2;
+    }
+
+    try
+    {
+        factor_radix(pass.radix);
+    }
+    catch (const logic_error &)
+    {
+        log("Unsupported radix %u.\n", pass.radix);
+        return nullptr;
+    }
+
+    return unique_ptr<Program>(new CPUProgram(pass));
+}
+
+CommandBuffer* CPUContext::request_command_buffer()
+{
+    return command_buffer.get();
+}
+
+static double steady_time()
+{
+    return chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CPUCommandBuffer::write_timestamp(TimestampQuery *query)
+{
+    static_cast<CPUTimestampQuery*>(query)->time = steady_time();
+}
+
+unique_ptr<TimestampQuery> CPUContext::create_timestamp_query()
+{
+    return unique_ptr<TimestampQuery>(new CPUTimestampQuery);
+}
+
+double CPUContext::get_timestamp(TimestampQuery *query)
+{
+    return static_cast<CPUTimestampQuery*>(query)->time;
+}
+
+void CPUContext::submit_command_buffer(CommandBuffer*)
+{
+    // Work is executed as it is recorded.
+}
+
+void CPUContext::wait_idle()
+{
+}
+
+const char* CPUContext::get_renderer_string()
+{
+    return renderer_string.c_str();
+}
+
+void CPUContext::log(const char *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+}
+
+double CPUContext::get_time()
+{
+    return steady_time();
+}
+
+unsigned CPUContext::get_max_work_group_threads()
+{
+    // Work groups are a pure bookkeeping concept on the CPU, so mirror common GL limits.
+    return 1024;
+}
+
+unsigned CPUContext::get_max_work_group_size_z()
+{
+    return 1024;
+}
+
+const void* CPUContext::map(Buffer *buffer, size_t offset, size_t)
+{
+    return static_cast<CPUBuffer*>(buffer)->get(offset);
+}
+
+void CPUContext::unmap(Buffer*)
+{
+}
+
+void CPUContext::read_texture(void *buffer, Texture *texture, Format format)
+{
+    static_cast<CPUTexture*>(texture)->read(buffer, format);
+}
+
@@ -0,0 +1,248 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLFFT_CPU_INTERFACE_HPP__
+#define GLFFT_CPU_INTERFACE_HPP__
+
+#include "glfft_interface.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+// A pure C++ implementation of the GLFFT interface.
+// FFT passes are not compiled from GLSL, instead the CPU backend parses the configuration
+// GLFFT prepends to every generated shader and executes the pass with native kernels
+// spread out over a thread pool.
+// This is useful to run GLFFT plans, wisdom and the test suite on machines without a GPU,
+// and as a reference to compare GPU backends against.
+
+namespace GLFFT
+{
+    class CPUContext;
+    class CPUThreadPool;
+    struct CPUTwiddleCache;
+
+    class CPUTexture : public Texture
+    {
+        public:
+            friend class CPUContext;
+            friend class CPUCommandBuffer;
+
+            unsigned get_width() const { return width; }
+            unsigned get_height() const { return height; }
+            unsigned get_components() const { return components; }
+
+            // Nearest, clamp-to-edge lookup of a single component.
+            float load(int x, int y, unsigned component) const;
+            // Writes all components of a texel, out-of-bounds writes are discarded like imageStore().
+            void store(int x, int y, const float *value);
+
+            // Conversions between FP32 and IEEE half floats, rounding to nearest even.
+            static uint16_t fp32_to_fp16(float value);
+            static float fp16_to_fp32(uint16_t value);
+
+        private:
+            CPUTexture(const void *initial_data,
+                    unsigned width, unsigned height,
+                    Format format);
+
+            void read(void *buffer, Format format) const;
+
+            unsigned width, height;
+            unsigned components;
+            bool fp16;
+            // Everything is stored as FP32, FP16 formats are quantized on store.
+            std::vector<float> data;
+    };
+
+    class CPUBuffer : public Buffer
+    {
+        public:
+            friend class CPUContext;
+            friend class CPUCommandBuffer;
+            friend class SPIRVCommandBuffer;
+
+        private:
+            CPUBuffer(const void *initial_data, size_t size);
+
+            uint8_t* get(size_t offset = 0) { return reinterpret_cast<uint8_t*>(data.data()) + offset; }
+            size_t size;
+            std::vector<uint32_t> data;
+    };
+
+    class CPUProgram : public Program
+    {
+        public:
+            friend class CPUContext;
+            friend class CPUCommandBuffer;
+
+            // Configuration of a pass, recovered from the #defines GLFFT generates.
+            struct Pass
+            {
+                unsigned radix = 0;
+                unsigned vector_size = 2;
+                unsigned workgroup_size_x = 1;
+                unsigned workgroup_size_y = 1;
+                unsigned workgroup_size_z = 1;
+                bool p1 = false;
+                bool inverse = false;
+                bool convolve = false;
+                bool normalize = false;
+                bool dual = false;
+                bool horizontal = false;
+                bool resolve_real_to_complex = false;
+                bool resolve_complex_to_real = false;
+                bool chirp_pre_multiply = false;
+                bool chirp_post_multiply = false;
+                bool four_step_twiddle = false;
+                bool tile_2d = false;
+                bool input_texture = false;
+                bool input_real = false;
+                bool input_fp16 = false;
+                bool output_image = false;
+                bool output_real = false;
+                bool output_fp16 = false;
+                bool packed_spectrum = false;
+                bool fused_real_to_complex = false;
+                bool fused_complex_to_real = false;
+            };
+
+            const Pass& get_pass() const { return pass; }
+            ~CPUProgram();
+
+        private:
+            CPUProgram(const Pass &pass);
+            Pass pass;
+            // Twiddle factors only depend on the pass and the dispatch, so they are built once and kept here.
+            std::unique_ptr<CPUTwiddleCache> twiddles;
+    };
+
+    // Work executes as it is recorded, so a timestamp is simply the time it was recorded at.
+    class CPUTimestampQuery : public TimestampQuery
+    {
+        public:
+            friend class CPUContext;
+            friend class CPUCommandBuffer;
+            friend class SPIRVCommandBuffer;
+
+        private:
+            CPUTimestampQuery() = default;
+            double time = 0.0;
+    };
+
+    class CPUCommandBuffer : public CommandBuffer
+    {
+        public:
+            friend class CPUContext;
+
+            void bind_program(Program *program) override;
+            void bind_storage_texture(unsigned binding, Texture *texture, Format format) override;
+            void bind_texture(unsigned binding, Texture *texture) override;
+            void bind_sampler(unsigned binding, Sampler *sampler) override;
+            void bind_storage_buffer(unsigned binding, Buffer *texture) override;
+            void bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *texture) override;
+            void dispatch(unsigned x, unsigned y, unsigned z) override;
+
+            // Dispatches execute synchronously, so barriers are no-ops.
+            void barrier(Buffer*) override {}
+            void barrier(Texture*) override {}
+            void barrier() override {}
+            void barrier(AccessFlags, AccessFlags) override {}
+
+            void push_constant_data(unsigned binding, const void *data, size_t size) override;
+            void write_timestamp(TimestampQuery *query) override;
+
+        private:
+            CPUCommandBuffer(CPUThreadPool &pool) : pool(pool) {}
+            CPUThreadPool &pool;
+
+            enum { MaxBindings = 8 };
+            struct BufferBinding
+            {
+                CPUBuffer *buffer = nullptr;
+                size_t offset = 0;
+            };
+
+            CPUProgram *program = nullptr;
+            BufferBinding buffers[MaxBindings];
+            CPUTexture *textures[MaxBindings] = {};
+            uint8_t constant_data[MaxBindings][MaxConstantDataSize] = {};
+    };
+
+    class CPUContext : public Context
+    {
+        public:
+            // If num_threads is 0, one worker thread per hardware thread is used.
+            CPUContext(unsigned num_threads = 0);
+            ~CPUContext();
+
+            std::unique_ptr<Texture> create_texture(const void *initial_data,
+                    unsigned width, unsigned height,
+                    Format format) override;
+
+            std::unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) override;
+            std::unique_ptr<Program> compile_compute_shader(const char *source) override;
+
+            // Compiling only parses the pass configuration, which is not worth a worker thread.
+            std::unique_ptr<Program> begin_compile_compute_shader(const char *source) override { return compile_compute_shader(source); }
+            bool is_program_compiled(Program*) override { return true; }
+            bool end_compile_compute_shader(Program*) override { return true; }
+
+            // Compiling is only parsing the pass configuration, so there is nothing worth caching.
+            bool get_program_binary(Program*, std::vector<uint8_t>&) override { return false; }
+            std::unique_ptr<Program> load_program_binary(const void*, size_t) override { return nullptr; }
+
+            CommandBuffer* request_command_buffer() override;
+            void submit_command_buffer(CommandBuffer *cmd) override;
+            void wait_idle() override;
+
+            const char* get_renderer_string() override;
+            void log(const char *fmt, ...) override;
+            double get_time() override;
+
+            unsigned get_max_work_group_threads() override;
+            unsigned get_max_work_group_size_z() override;
+
+            // Butterflies are never exchanged between invocations on the CPU.
+            bool supports_subgroup_shuffle() override { return false; }
+            unsigned get_subgroup_size() override { return 0; }
+
+            const void* map(Buffer *buffer, size_t offset, size_t size) override;
+            void unmap(Buffer *buffer) override;
+
+            bool supports_texture_readback() override { return true; }
+            void read_texture(void *buffer, Texture *texture, Format format) override;
+
+            std::unique_ptr<TimestampQuery> create_timestamp_query() override;
+            double get_timestamp(TimestampQuery *query) override;
+
+        protected:
+            // Lets backends built on top of the CPU context, e.g. SPIRVContext, share its worker threads.
+            unsigned get_num_threads() const;
+            void parallel_for(unsigned count, const std::function<void (unsigned)> &func);
+            std::string renderer_string;
+
+        private:
+            std::unique_ptr<CPUThreadPool> pool;
+            std::unique_ptr<CPUCommandBuffer> command_buffer;
+    };
+}
+
+#endif
+
@@ -25,38 +25,130 @@
 using namespace GLFFT;
 using namespace std;
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifndef GL_SUBGROUP_SIZE_KHR
+#define GL_SUBGROUP_SIZE_KHR 0x9532
+#define GL_SUBGROUP_SUPPORTED_STAGES_KHR 0x9533
+#define GL_SUBGROUP_SUPPORTED_FEATURES_KHR 0x9534
+#define GL_SUBGROUP_FEATURE_SHUFFLE_BIT_KHR 0x00000010
+#endif
+
+static bool has_extension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        if (strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 GLCommandBuffer GLContext::static_command_buffer;
 
+void GLCommandBuffer::invalidate_state()
+{
+    program = InvalidName;
+    active_texture = InvalidName;
+    for (unsigned i = 0; i < MaxBindings; i++)
+    {
+        buffers[i] = { InvalidName, 0, 0 };
+        images[i] = { InvalidName, GL_NONE };
+        textures[i] = InvalidName;
+        samplers[i] = InvalidName;
+    }
+}
+
+bool GLCommandBuffer::elide(bool current)
+{
+    if (current)
+        elided_binds++;
+    else
+        issued_binds++;
+    return current;
+}
+
 void GLCommandBuffer::bind_program(Program *program)
 {
-    glUseProgram(program ? static_cast<GLProgram*>(program)->name : 0);
+    GLuint name = program ? static_cast<GLProgram*>(program)->name : 0;
+    if (elide(this->program == name))
+        return;
+
+    glUseProgram(name);
+    this->program = name;
 }
 
 void GLCommandBuffer::bind_storage_texture(unsigned binding, Texture *texture, Format format)
 {
-    glBindImageTexture(binding, static_cast<GLTexture*>(texture)->name,
-            0, GL_FALSE, 0, GL_WRITE_ONLY, convert(format));
+    GLuint name = static_cast<GLTexture*>(texture)->name;
+    GLenum gl_format = convert(format);
+    bool tracked = binding < MaxBindings;
+    if (elide(tracked && images[binding].name == name && images[binding].format == gl_format))
+        return;
+
+    glBindImageTexture(binding, name, 0, GL_FALSE, 0, GL_WRITE_ONLY, gl_format);
+    if (tracked)
+        images[binding] = { name, gl_format };
 }
 
 void GLCommandBuffer::bind_texture(unsigned binding, Texture *texture)
 {
-    glActiveTexture(GL_TEXTURE0 + binding);
-    glBindTexture(GL_TEXTURE_2D, static_cast<GLTexture*>(texture)->name);
+    GLuint name = static_cast<GLTexture*>(texture)->name;
+    bool tracked = binding < MaxBindings;
+    if (elide(tracked && textures[binding] == name))
+        return;
+
+    if (active_texture != binding)
+    {
+        glActiveTexture(GL_TEXTURE0 + binding);
+        active_texture = binding;
+    }
+    glBindTexture(GL_TEXTURE_2D, name);
+    if (tracked)
+        textures[binding] = name;
 }
 
 void GLCommandBuffer::bind_sampler(unsigned binding, Sampler *sampler)
 {
-    glBindSampler(binding, sampler ? static_cast<GLSampler*>(sampler)->name : 0);
+    GLuint name = sampler ? static_cast<GLSampler*>(sampler)->name : 0;
+    bool tracked = binding < MaxBindings;
+    if (elide(tracked && samplers[binding] == name))
+        return;
+
+    glBindSampler(binding, name);
+    if (tracked)
+        samplers[binding] = name;
 }
 
 void GLCommandBuffer::bind_storage_buffer(unsigned binding, Buffer *buffer)
 {
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, static_cast<GLBuffer*>(buffer)->name);
+    GLuint name = static_cast<GLBuffer*>(buffer)->name;
+    bool tracked = binding < MaxBindings;
+    if (elide(tracked && buffers[binding].name == name && buffers[binding].size == 0))
+        return;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, name);
+    if (tracked)
+        buffers[binding] = { name, 0, 0 };
 }
 
 void GLCommandBuffer::bind_storage_buffer_range(unsigned binding, size_t offset, size_t size, Buffer *buffer)
 {
-    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, static_cast<GLBuffer*>(buffer)->name, offset, size);
+    GLuint name = static_cast<GLBuffer*>(buffer)->name;
+    bool tracked = binding < MaxBindings;
+    BufferBinding &current = buffers[tracked ? binding : 0];
+    if (elide(tracked && current.name == name && current.offset == offset && current.size == size))
+        return;
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, name, offset, size);
+    if (tracked)
+        current = { name, offset, size };
 }
 
 void GLCommandBuffer::dispatch(unsigned x, unsigned y, unsigned z)
@@ -79,8 +171,72 @@ void GLCommandBuffer::barrier()
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 }
 
+void GLCommandBuffer::barrier(AccessFlags src_access, AccessFlags dst_access)
+{
+    // Only incoherent shader writes need explicit barriers in GL,
+    // and the barrier bits describe how the data is accessed afterwards.
+    if ((src_access & (AccessShaderStorageWrite | AccessImageWrite)) == 0)
+        return;
+
+    GLbitfield bits = 0;
+    if (dst_access & (AccessShaderStorageRead | AccessShaderStorageWrite))
+        bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+    if (dst_access & (AccessImageRead | AccessImageWrite))
+        bits |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    if (dst_access & AccessTextureFetch)
+        bits |= GL_TEXTURE_FETCH_BARRIER_BIT;
+    if (dst_access & AccessUniformRead)
+        bits |= GL_UNIFORM_BARRIER_BIT;
+    if (dst_access & AccessHostRead)
+        bits |= GL_BUFFER_UPDATE_BARRIER_BIT;
+    if (dst_access & AccessTextureRead)
+        bits |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+
+    if (bits)
+        glMemoryBarrier(bits);
+}
+
+static void wait_fence(GLsync &fence)
+{
+    if (!fence)
+        return;
+
+    // Wait in one second increments, flushing first so the fence is guaranteed to signal.
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED)
+        ;
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
 void GLCommandBuffer::push_constant_data(unsigned binding, const void *data, size_t size)
 {
+    if (ring)
+    {
+        unsigned segment = ring->slot / GLConstantRing::SlotsPerSegment;
+
+        // Entering a new segment, so every dispatch reading the previous one has been issued.
+        // A fresh ring has not written the previous segment, so there is nothing to fence yet.
+        if (ring->slot % GLConstantRing::SlotsPerSegment == 0)
+        {
+            unsigned prev_segment = (segment + GLConstantRing::Segments - 1) % GLConstantRing::Segments;
+            if (ring->written[prev_segment])
+            {
+                ring->fences[prev_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                ring->written[prev_segment] = false;
+            }
+            wait_fence(ring->fences[segment]);
+        }
+        ring->written[segment] = true;
+
+        size_t offset = ring->slot * ring->slot_size;
+        std::memcpy(ring->mapped + offset, data, size);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer, offset, CommandBuffer::MaxConstantDataSize);
+
+        if (++ring->slot >= GLConstantRing::Segments * GLConstantRing::SlotsPerSegment)
+            ring->slot = 0;
+        return;
+    }
+
     glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubos[ubo_index]);
     void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER,
             0, CommandBuffer::MaxConstantDataSize,
@@ -96,10 +252,72 @@ void GLCommandBuffer::push_constant_data(unsigned binding, const void *data, siz
         ubo_index = 0;
 }
 
+bool GLContext::init_constant_ring()
+{
+#ifdef GL_MAP_PERSISTENT_BIT
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if ((major * 10 + minor < 44) && !has_extension("GL_ARB_buffer_storage"))
+    {
+        return false;
+    }
+
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t slot_size = CommandBuffer::MaxConstantDataSize;
+    if (alignment > 0)
+    {
+        slot_size = (slot_size + alignment - 1) / alignment * alignment;
+    }
+
+    size_t size = slot_size * GLConstantRing::Segments * GLConstantRing::SlotsPerSegment;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &ring.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+    glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+    ring.mapped = static_cast<uint8_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    if (!ring.mapped)
+    {
+        glDeleteBuffers(1, &ring.buffer);
+        ring.buffer = 0;
+        return false;
+    }
+
+    ring.slot_size = slot_size;
+    ring.slot = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GLCommandBuffer::write_timestamp(TimestampQuery *query)
+{
+#ifdef GL_TIMESTAMP
+    glQueryCounter(static_cast<GLTimestampQuery*>(query)->name, GL_TIMESTAMP);
+#else
+    (void)query;
+#endif
+}
+
 CommandBuffer* GLContext::request_command_buffer()
 {
+    // The application is free to change GL state between command buffers.
+    static_command_buffer.invalidate_state();
+
     if (!initialized_ubos)
     {
+        if (init_constant_ring())
+        {
+            static_command_buffer.set_constant_data_ring(&ring);
+            initialized_ubos = true;
+            return &static_command_buffer;
+        }
+
         glGenBuffers(MaxBuffersRing, ubos);
         for (auto &ubo : ubos)
         {
@@ -124,15 +342,29 @@ unique_ptr<Texture> GLContext::create_texture(const void *initial_data,
         unsigned width, unsigned height,
         Format format)
 {
+    // Creation binds the texture, and names of deleted objects may be reused,
+    // so the tracked bindings might no longer be current.
+    static_command_buffer.invalidate_state();
     return unique_ptr<Texture>(new GLTexture(initial_data, width, height, format));
 }
 
 unique_ptr<Buffer> GLContext::create_buffer(const void *initial_data, size_t size, AccessMode access)
 {
+    static_command_buffer.invalidate_state();
     return unique_ptr<Buffer>(new GLBuffer(initial_data, size, access));
 }
 
 unique_ptr<Program> GLContext::compile_compute_shader(const char *source)
+{
+    auto program = begin_compile_compute_shader(source);
+    if (program && !end_compile_compute_shader(program.get()))
+    {
+        return nullptr;
+    }
+    return program;
+}
+
+unique_ptr<Program> GLContext::begin_compile_compute_shader(const char *source)
 {
 #ifdef GLFFT_GL_DEBUG
     if (!validate_glsl_source(source))
@@ -151,39 +383,140 @@ unique_ptr<Program> GLContext::compile_compute_shader(const char *source)
     glShaderSource(shader, 2, sources, NULL);
     glCompileShader(shader);
 
+    // Linking right away lets the driver compile and link in the background.
+    // Compile errors show up as link errors, and are checked in end_compile_compute_shader().
+    glAttachShader(program, shader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+
+    return unique_ptr<Program>(new GLProgram(program, shader));
+}
+
+bool GLContext::is_program_compiled(Program *program)
+{
+    if (parallel_shader_compile < 0)
+    {
+        parallel_shader_compile = has_extension("GL_KHR_parallel_shader_compile") ||
+            has_extension("GL_ARB_parallel_shader_compile");
+    }
+
+    // Without the extension, there is no way to query without blocking,
+    // so report the program as compiled and let end_compile_compute_shader() wait.
+    if (!parallel_shader_compile)
+    {
+        return true;
+    }
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(static_cast<GLProgram*>(program)->name, GL_COMPLETION_STATUS_KHR, &status);
+    return status == GL_TRUE;
+}
+
+bool GLContext::end_compile_compute_shader(Program *program)
+{
+    auto *gl_program = static_cast<GLProgram*>(program);
+    GLuint shader = gl_program->shader;
+    gl_program->shader = 0;
+
     GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
+    if (shader)
     {
-        GLint len;
-        GLsizei out_len;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status == GL_FALSE)
+        {
+            GLint len;
+            GLsizei out_len;
 
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
-        vector<char> buf(len);
-        glGetShaderInfoLog(shader, len, &out_len, buf.data());
-        log("GLFFT: Shader log:\n%s\n\n", buf.data());
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+            vector<char> buf(len);
+            glGetShaderInfoLog(shader, len, &out_len, buf.data());
+            log("GLFFT: Shader log:\n%s\n\n", buf.data());
 
+            glDeleteShader(shader);
+            return false;
+        }
         glDeleteShader(shader);
-        glDeleteProgram(program);
-        return 0;
     }
 
-    glAttachShader(program, shader);
-    glLinkProgram(program);
-    glDeleteShader(shader);
-
-    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    glGetProgramiv(gl_program->name, GL_LINK_STATUS, &status);
     if (status == GL_FALSE)
     {
         GLint len;
         GLsizei out_len;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+        glGetProgramiv(gl_program->name, GL_INFO_LOG_LENGTH, &len);
         vector<char> buf(len);
-        glGetProgramInfoLog(program, len, &out_len, buf.data());
+        glGetProgramInfoLog(gl_program->name, len, &out_len, buf.data());
         log("Program log:\n%s\n\n", buf.data());
+        return false;
+    }
+
+    return true;
+}
+
+bool GLContext::get_program_binary(Program *program, vector<uint8_t> &binary)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0)
+    {
+        return false;
+    }
 
+    GLuint name = static_cast<GLProgram*>(program)->name;
+    GLint length = 0;
+    glGetProgramiv(name, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    // Binaries are only valid for the driver which created them, so prefix them with the driver version.
+    // Layout is the version string, the binary format and the binary itself.
+    const char *version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    size_t header_size = strlen(version) + 1 + sizeof(GLenum);
+    binary.resize(header_size + length);
+
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(name, length, &written, &format, binary.data() + header_size);
+    if (written <= 0)
+    {
+        return false;
+    }
+
+    memcpy(binary.data(), version, strlen(version) + 1);
+    memcpy(binary.data() + header_size - sizeof(GLenum), &format, sizeof(format));
+    binary.resize(header_size + written);
+    return true;
+}
+
+unique_ptr<Program> GLContext::load_program_binary(const void *binary, size_t size)
+{
+    const char *version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    size_t header_size = strlen(version) + 1 + sizeof(GLenum);
+    const uint8_t *data = static_cast<const uint8_t*>(binary);
+    if (size <= header_size || memcmp(data, version, strlen(version) + 1) != 0)
+    {
+        return nullptr;
+    }
+
+    GLenum format;
+    memcpy(&format, data + header_size - sizeof(GLenum), sizeof(format));
+
+    GLuint program = glCreateProgram();
+    if (!program)
+    {
+        return nullptr;
+    }
+
+    glProgramBinary(program, format, data + header_size, size - header_size);
+
+    // Drivers are allowed to reject binaries at any time, e.g. after an update.
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
         glDeleteProgram(program);
-        glDeleteShader(shader);
         return nullptr;
     }
 
@@ -213,6 +546,79 @@ unsigned GLContext::get_max_work_group_threads()
     return value;
 }
 
+unsigned GLContext::get_max_work_group_size_z()
+{
+    GLint value;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 2, &value);
+    return value;
+}
+
+bool GLContext::supports_subgroup_shuffle()
+{
+    // The subgroup queries are only valid enums if the extension is present.
+    if (!has_extension("GL_KHR_shader_subgroup"))
+    {
+        return false;
+    }
+
+    GLint stages = 0, features = 0;
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+    return (stages & GL_COMPUTE_SHADER_BIT) && (features & GL_SUBGROUP_FEATURE_SHUFFLE_BIT_KHR);
+}
+
+unsigned GLContext::get_subgroup_size()
+{
+    if (!has_extension("GL_KHR_shader_subgroup"))
+    {
+        return 0;
+    }
+
+    GLint value = 0;
+    glGetIntegerv(GL_SUBGROUP_SIZE_KHR, &value);
+    return value;
+}
+
+unique_ptr<TimestampQuery> GLContext::create_timestamp_query()
+{
+#ifdef GL_TIMESTAMP
+    if (timestamp_queries < 0)
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        timestamp_queries = (major * 10 + minor >= 33) || has_extension("GL_ARB_timer_query");
+
+        // Implementations are allowed to not keep time at all, which they report as zero bits.
+        if (timestamp_queries)
+        {
+            GLint bits = 0;
+            glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+            timestamp_queries = bits > 0;
+        }
+    }
+
+    if (timestamp_queries)
+    {
+        return unique_ptr<TimestampQuery>(new GLTimestampQuery);
+    }
+#endif
+    // GLES only has timestamps through GL_EXT_disjoint_timer_query, which we do not use.
+    return nullptr;
+}
+
+double GLContext::get_timestamp(TimestampQuery *query)
+{
+#ifdef GL_TIMESTAMP
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(static_cast<GLTimestampQuery*>(query)->name, GL_QUERY_RESULT, &ns);
+    return 1e-9 * double(ns);
+#else
+    (void)query;
+    return 0.0;
+#endif
+}
+
 const char* GLContext::get_renderer_string()
 {
     return reinterpret_cast<const char*>(glGetString(GL_RENDERER));
@@ -235,7 +641,25 @@ void GLContext::unmap(Buffer *buffer)
 
 void GLContext::teardown()
 {
-    if (initialized_ubos)
+    if (ring.buffer)
+    {
+        for (auto &fence : ring.fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        for (auto &written : ring.written)
+            written = false;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glDeleteBuffers(1, &ring.buffer);
+        ring.buffer = 0;
+        ring.mapped = nullptr;
+    }
+    else if (initialized_ubos)
         glDeleteBuffers(MaxBuffersRing, ubos);
     initialized_ubos = false;
 }
@@ -286,18 +710,33 @@ GLBuffer::~GLBuffer()
         glDeleteBuffers(1, &name);
 }
 
-GLProgram::GLProgram(GLuint name)
-    : name(name)
+GLProgram::GLProgram(GLuint name, GLuint shader)
+    : name(name), shader(shader)
 {}
 
 GLProgram::~GLProgram()
 {
+    if (shader != 0)
+    {
+        glDeleteShader(shader);
+    }
+
     if (name != 0)
     {
         glDeleteProgram(name);
     }
 }
 
+GLTimestampQuery::GLTimestampQuery()
+{
+    glGenQueries(1, &name);
+}
+
+GLTimestampQuery::~GLTimestampQuery()
+{
+    glDeleteQueries(1, &name);
+}
+
 GLSampler::~GLSampler()
 {
     if (name != 0)
@@ -20,6 +20,7 @@
 #define GLFFT_GL_INTERFACE_HPP__
 
 #include "glfft_interface.hpp"
+#include <stdint.h>
 
 // Implement this header somewhere in your include path and include relevant GL/GLES API headers.
 #include "glfft_gl_api_headers.hpp"
@@ -95,6 +96,18 @@ namespace GLFFT
             bool owned = true;
     };
 
+    class GLTimestampQuery : public TimestampQuery
+    {
+        public:
+            friend class GLContext;
+            friend class GLCommandBuffer;
+            ~GLTimestampQuery();
+
+        private:
+            GLTimestampQuery();
+            GLuint name;
+    };
+
     class GLProgram : public Program
     {
         public:
@@ -105,13 +118,31 @@ namespace GLFFT
             GLuint get() const { return name; }
 
         private:
-            GLProgram(GLuint name);
+            GLProgram(GLuint name, GLuint shader = 0);
             GLuint name;
+            // Shader of a program which is still compiling, kept around for its info log.
+            GLuint shader;
+    };
+
+    // Persistently mapped ring buffer for constant data, used if buffer storage is supported.
+    // The ring is split into segments, and a fence is inserted once a segment has been used up,
+    // so a segment is only written to again after the GPU is done reading it.
+    struct GLConstantRing
+    {
+        enum { Segments = 4, SlotsPerSegment = 256 };
+        GLuint buffer = 0;
+        uint8_t *mapped = nullptr;
+        size_t slot_size = 0;
+        unsigned slot = 0;
+        GLsync fences[Segments] = {};
+        // Whether a segment has been written since it was last fenced.
+        bool written[Segments] = {};
     };
 
     class GLCommandBuffer : public CommandBuffer
     {
         public:
+            GLCommandBuffer() { invalidate_state(); }
             ~GLCommandBuffer() = default;
 
             void set_constant_data_buffers(const GLuint *ubos, unsigned count)
@@ -119,6 +150,13 @@ namespace GLFFT
                 this->ubos = ubos;
                 ubo_index = 0;
                 ubo_count = count;
+                ring = nullptr;
+            }
+
+            void set_constant_data_ring(GLConstantRing *ring)
+            {
+                this->ring = ring;
+                ubos = nullptr;
             }
 
             void bind_program(Program *program) override;
@@ -132,13 +170,50 @@ namespace GLFFT
             void barrier(Buffer *buffer) override;
             void barrier(Texture *buffer) override;
             void barrier() override;
+            void barrier(AccessFlags src_access, AccessFlags dst_access) override;
 
             void push_constant_data(unsigned binding, const void *data, size_t size) override;
+            void write_timestamp(TimestampQuery *query) override;
+
+            // Binds which are already current are skipped.
+            // The tracked state is reset when a command buffer is requested,
+            // so call this if GL bindings are changed outside GLFFT while recording.
+            void invalidate_state();
+
+            unsigned get_issued_binds() const { return issued_binds; }
+            unsigned get_elided_binds() const { return elided_binds; }
+            void reset_bind_counters() { issued_binds = 0; elided_binds = 0; }
 
         private:
             const GLuint *ubos = nullptr;
             unsigned ubo_count = 0;
             unsigned ubo_index = 0;
+            GLConstantRing *ring = nullptr;
+
+            // Shadow copy of the state bound through this command buffer, InvalidName if unknown.
+            enum { MaxBindings = 16 };
+            static const GLuint InvalidName = ~0u;
+            struct BufferBinding
+            {
+                GLuint name;
+                // Size is 0 for glBindBufferBase().
+                size_t offset, size;
+            };
+            struct ImageBinding
+            {
+                GLuint name;
+                GLenum format;
+            };
+            GLuint program;
+            GLuint active_texture;
+            BufferBinding buffers[MaxBindings];
+            ImageBinding images[MaxBindings];
+            GLuint textures[MaxBindings];
+            GLuint samplers[MaxBindings];
+
+            unsigned issued_binds = 0;
+            unsigned elided_binds = 0;
+            bool elide(bool current);
     };
 
     class GLContext : public Context
@@ -152,6 +227,11 @@ namespace GLFFT
 
             std::unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) override;
             std::unique_ptr<Program> compile_compute_shader(const char *source) override;
+            std::unique_ptr<Program> begin_compile_compute_shader(const char *source) override;
+            bool is_program_compiled(Program *program) override;
+            bool end_compile_compute_shader(Program *program) override;
+            bool get_program_binary(Program *program, std::vector<uint8_t> &binary) override;
+            std::unique_ptr<Program> load_program_binary(const void *binary, size_t size) override;
 
             CommandBuffer* request_command_buffer() override;
             void submit_command_buffer(CommandBuffer *cmd) override;
@@ -162,6 +242,10 @@ namespace GLFFT
             double get_time() override;
 
             unsigned get_max_work_group_threads() override;
+            unsigned get_max_work_group_size_z() override;
+
+            bool supports_subgroup_shuffle() override;
+            unsigned get_subgroup_size() override;
 
             const void* map(Buffer *buffer, size_t offset, size_t size) override;
             void unmap(Buffer *buffer) override;
@@ -170,15 +254,27 @@ namespace GLFFT
             bool supports_texture_readback() override { return false; }
             void read_texture(void*, Texture*, Format) override {}
 
+            std::unique_ptr<TimestampQuery> create_timestamp_query() override;
+            double get_timestamp(TimestampQuery *query) override;
+
         protected:
             void teardown();
 
         private:
             static GLCommandBuffer static_command_buffer;
 
+            // Fallback if buffer storage is not supported, where each constant upload maps one of these buffers.
             enum { MaxBuffersRing = 256 };
             GLuint ubos[MaxBuffersRing];
             bool initialized_ubos = false;
+
+            GLConstantRing ring;
+            bool init_constant_ring();
+
+            // Whether GL_KHR_parallel_shader_compile is supported, -1 until queried.
+            int parallel_shader_compile = -1;
+            // Whether GL_TIMESTAMP queries are supported, -1 until queried.
+            int timestamp_queries = -1;
     };
 
     static inline GLenum convert(AccessMode mode)
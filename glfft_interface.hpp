@@ -20,6 +20,8 @@
 #define GLFFT_INTERFACE_HPP__
 
 #include <memory>
+#include <vector>
+#include <stdint.h>
 
 namespace GLFFT
 {
@@ -41,6 +43,7 @@ namespace GLFFT
     class Texture : public Resource {};
     class Sampler : public Resource {};
     class Buffer : public Resource {};
+    class TimestampQuery : public Resource {};
 
     class Program
     {
@@ -58,6 +61,23 @@ namespace GLFFT
         AccessStreamRead
     };
 
+    // Memory accesses on either side of a barrier.
+    enum AccessFlagBits
+    {
+        AccessShaderStorageRead = 1 << 0,
+        AccessShaderStorageWrite = 1 << 1,
+        AccessImageRead = 1 << 2,
+        AccessImageWrite = 1 << 3,
+        AccessTextureFetch = 1 << 4,
+        AccessUniformRead = 1 << 5,
+        // Reading buffers with Context::map().
+        AccessHostRead = 1 << 6,
+        // Reading textures with Context::read_texture().
+        AccessTextureRead = 1 << 7,
+        AccessAll = (1 << 8) - 1
+    };
+    typedef unsigned AccessFlags;
+
     enum Format
     {
         FormatUnknown,
@@ -83,6 +103,19 @@ namespace GLFFT
             virtual std::unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) = 0;
             virtual std::unique_ptr<Program> compile_compute_shader(const char *source) = 0;
 
+            // Two-phase compilation, so programs can compile in the background if the backend supports it.
+            // begin_compile_compute_shader returns a program which may still be compiling, or nullptr on immediate failure.
+            // is_program_compiled never blocks, and end_compile_compute_shader waits for the program,
+            // returning false if it failed to compile.
+            virtual std::unique_ptr<Program> begin_compile_compute_shader(const char *source) = 0;
+            virtual bool is_program_compiled(Program *program) = 0;
+            virtual bool end_compile_compute_shader(Program *program) = 0;
+
+            // Serialized programs, which ProgramBinaryCache stores to skip compiling on later runs.
+            // Backends which cannot serialize programs return false and nullptr respectively.
+            virtual bool get_program_binary(Program *program, std::vector<uint8_t> &binary) = 0;
+            virtual std::unique_ptr<Program> load_program_binary(const void *binary, size_t size) = 0;
+
             virtual CommandBuffer* request_command_buffer() = 0;
             virtual void submit_command_buffer(CommandBuffer *cmd) = 0;
             virtual void wait_idle() = 0;
@@ -92,6 +125,13 @@ namespace GLFFT
             virtual double get_time() = 0;
 
             virtual unsigned get_max_work_group_threads() = 0;
+            // Largest work group size in Z, which bounds the radix of whole-row passes.
+            virtual unsigned get_max_work_group_size_z() = 0;
+
+            // Whether compute shaders can use GL_KHR_shader_subgroup_shuffle, and the subgroup size if so.
+            // A work group of exactly get_subgroup_size() invocations must run as a single, full subgroup.
+            virtual bool supports_subgroup_shuffle() = 0;
+            virtual unsigned get_subgroup_size() = 0;
 
             virtual const void* map(Buffer *buffer, size_t offset, size_t size) = 0;
             virtual void unmap(Buffer *buffer) = 0;
@@ -99,6 +139,12 @@ namespace GLFFT
             virtual bool supports_texture_readback() = 0;
             virtual void read_texture(void *buffer, Texture *texture, Format format) = 0;
 
+            // GPU timestamps, which FFT::bench() uses to time only the work itself if supported.
+            // create_timestamp_query returns nullptr if not supported.
+            // get_timestamp waits for the timestamp to be written, and returns it in seconds.
+            virtual std::unique_ptr<TimestampQuery> create_timestamp_query() = 0;
+            virtual double get_timestamp(TimestampQuery *query) = 0;
+
         protected:
             Context() = default;
     };
@@ -120,9 +166,16 @@ namespace GLFFT
             virtual void barrier(Texture *buffer) = 0;
             virtual void barrier() = 0;
 
+            // Makes src_access of earlier commands visible to dst_access of later commands,
+            // which can be much cheaper than a full barrier.
+            virtual void barrier(AccessFlags src_access, AccessFlags dst_access) = 0;
+
             enum { MaxConstantDataSize = 64 };
             virtual void push_constant_data(unsigned binding, const void *data, size_t size) = 0;
 
+            // Writes a timestamp once all previously recorded work has completed.
+            virtual void write_timestamp(TimestampQuery *query) = 0;
+
         protected:
             CommandBuffer() = default;
     };
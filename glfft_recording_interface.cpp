@@ -0,0 +1,120 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_recording_interface.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace GLFFT;
+using namespace std;
+
+RecordingBuffer::RecordingBuffer(const void *initial_data, size_t size, AccessMode access)
+    : data(size), access(access)
+{
+    if (initial_data)
+    {
+        memcpy(data.data(), initial_data, size);
+    }
+}
+
+RecordingContext::RecordingContext(unsigned max_work_group_threads, unsigned subgroup_size,
+        unsigned max_work_group_size_z)
+    : max_work_group_threads(max_work_group_threads), subgroup_size(subgroup_size),
+      max_work_group_size_z(max_work_group_size_z)
+{}
+
+unique_ptr<Texture> RecordingContext::create_texture(const void*,
+        unsigned width, unsigned height,
+        Format format)
+{
+    return unique_ptr<Texture>(new RecordingTexture(width, height, format));
+}
+
+unique_ptr<Buffer> RecordingContext::create_buffer(const void *initial_data, size_t size, AccessMode access)
+{
+    return unique_ptr<Buffer>(new RecordingBuffer(initial_data, size, access));
+}
+
+unique_ptr<Program> RecordingContext::compile_compute_shader(const char *source)
+{
+    shader_sources.push_back(source);
+    return unique_ptr<Program>(new RecordingProgram(source));
+}
+
+CommandBuffer* RecordingContext::request_command_buffer()
+{
+    recording.emplace_back(new CommandList(false));
+    return recording.back().get();
+}
+
+void RecordingContext::submit_command_buffer(CommandBuffer *cmd)
+{
+    for (auto itr = begin(recording); itr != end(recording); ++itr)
+    {
+        if (itr->get() == cmd)
+        {
+            submissions.push_back(move(*itr));
+            recording.erase(itr);
+            return;
+        }
+    }
+
+    throw logic_error("Command buffer was not requested from this context.\n");
+}
+
+const char* RecordingContext::get_renderer_string()
+{
+    return "GLFFT Recording";
+}
+
+void RecordingContext::log(const char *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+}
+
+double RecordingContext::get_time()
+{
+    return chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const void* RecordingContext::map(Buffer *buffer, size_t offset, size_t size)
+{
+    auto &data = static_cast<RecordingBuffer*>(buffer)->data;
+    if (offset + size > data.size())
+    {
+        throw logic_error("Mapped range is out of bounds.\n");
+    }
+    return data.data() + offset;
+}
+
+void RecordingContext::read_texture(void*, Texture*, Format)
+{
+    throw logic_error("Recording context cannot read back textures.\n");
+}
+
+void RecordingContext::clear_trace()
+{
+    shader_sources.clear();
+    submissions.clear();
+}
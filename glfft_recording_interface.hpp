@@ -0,0 +1,142 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLFFT_RECORDING_INTERFACE_HPP__
+#define GLFFT_RECORDING_INTERFACE_HPP__
+
+#include "glfft_interface.hpp"
+#include "glfft_command_list.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// An implementation of the GLFFT interface which executes nothing.
+// Compiled shader sources and submitted command buffers are kept as a trace which can be inspected,
+// so plans can be tested, and the CPU overhead of GLFFT measured, without a GPU.
+// Buffers are backed by host memory so they can be mapped, but their contents are never computed.
+
+namespace GLFFT
+{
+    class RecordingContext;
+
+    class RecordingTexture : public Texture
+    {
+        public:
+            friend class RecordingContext;
+            unsigned get_width() const { return width; }
+            unsigned get_height() const { return height; }
+            Format get_format() const { return format; }
+
+        private:
+            RecordingTexture(unsigned width, unsigned height, Format format)
+                : width(width), height(height), format(format)
+            {}
+
+            unsigned width, height;
+            Format format;
+    };
+
+    class RecordingBuffer : public Buffer
+    {
+        public:
+            friend class RecordingContext;
+            size_t get_size() const { return data.size(); }
+            AccessMode get_access() const { return access; }
+
+        private:
+            RecordingBuffer(const void *initial_data, size_t size, AccessMode access);
+
+            std::vector<uint8_t> data;
+            AccessMode access;
+    };
+
+    class RecordingProgram : public Program
+    {
+        public:
+            friend class RecordingContext;
+            const std::string& get_source() const { return source; }
+
+        private:
+            RecordingProgram(std::string source) : source(std::move(source)) {}
+            std::string source;
+    };
+
+    class RecordingContext : public Context
+    {
+        public:
+            // Limits which the planner queries from the context, e.g. to mimic a particular GPU.
+            RecordingContext(unsigned max_work_group_threads = 1024, unsigned subgroup_size = 0,
+                    unsigned max_work_group_size_z = 1024);
+
+            std::unique_ptr<Texture> create_texture(const void *initial_data,
+                    unsigned width, unsigned height,
+                    Format format) override;
+
+            std::unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) override;
+            std::unique_ptr<Program> compile_compute_shader(const char *source) override;
+
+            std::unique_ptr<Program> begin_compile_compute_shader(const char *source) override { return compile_compute_shader(source); }
+            bool is_program_compiled(Program*) override { return true; }
+            bool end_compile_compute_shader(Program*) override { return true; }
+
+            bool get_program_binary(Program*, std::vector<uint8_t>&) override { return false; }
+            std::unique_ptr<Program> load_program_binary(const void*, size_t) override { return nullptr; }
+
+            CommandBuffer* request_command_buffer() override;
+            void submit_command_buffer(CommandBuffer *cmd) override;
+            void wait_idle() override {}
+
+            const char* get_renderer_string() override;
+            void log(const char *fmt, ...) override;
+            double get_time() override;
+
+            unsigned get_max_work_group_threads() override { return max_work_group_threads; }
+            unsigned get_max_work_group_size_z() override { return max_work_group_size_z; }
+            bool supports_subgroup_shuffle() override { return subgroup_size != 0; }
+            unsigned get_subgroup_size() override { return subgroup_size; }
+
+            const void* map(Buffer *buffer, size_t offset, size_t size) override;
+            void unmap(Buffer*) override {}
+
+            // Textures have no contents.
+            bool supports_texture_readback() override { return false; }
+            void read_texture(void *buffer, Texture *texture, Format format) override;
+
+            std::unique_ptr<TimestampQuery> create_timestamp_query() override { return nullptr; }
+            double get_timestamp(TimestampQuery*) override { return 0.0; }
+
+            // Sources of all compiled programs, in order of compilation.
+            const std::vector<std::string>& get_shader_sources() const { return shader_sources; }
+
+            // Command buffers in order of submission. Every call is recorded, including redundant binds.
+            const std::vector<std::unique_ptr<CommandList>>& get_submissions() const { return submissions; }
+
+            // Forgets shader sources and submissions, e.g. between parts of a test or benchmark.
+            void clear_trace();
+
+        private:
+            unsigned max_work_group_threads;
+            unsigned subgroup_size;
+            unsigned max_work_group_size_z;
+            std::vector<std::string> shader_sources;
+            std::vector<std::unique_ptr<CommandList>> recording;
+            std::vector<std::unique_ptr<CommandList>> submissions;
+    };
+}
+
+#endif
@@ -0,0 +1,40 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLFFT_SPIRV_HPP__
+#define GLFFT_SPIRV_HPP__
+
+#include <vector>
+#include <stdint.h>
+
+struct TBuiltInResource;
+
+// Compiles the generated shaders to SPIR-V with the vendored glslang,
+// for the Vulkan backend and for precompiled program bundles.
+
+namespace GLFFT
+{
+    // Prepends #version 450 and GLFFT_VULKAN, which makes the constant data a push constant block.
+    // The module targets Vulkan 1.1, i.e. SPIR-V 1.3.
+    bool compile_glsl_to_spirv(const char *source, std::vector<uint32_t> &spirv);
+
+    // Resource limits GLFFT compiles shaders with.
+    void get_glslang_resources(TBuiltInResource &resources);
+}
+
+#endif
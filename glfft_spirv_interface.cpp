@@ -0,0 +1,2894 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "glfft_spirv_interface.hpp"
+#include "glfft_spirv.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+using namespace GLFFT;
+using namespace std;
+
+// The subset of SPIR-V which glslang emits for GLFFT's shaders.
+namespace Spv
+{
+    enum Op
+    {
+        OpUndef = 1,
+        OpSourceContinued = 2,
+        OpSource = 3,
+        OpSourceExtension = 4,
+        OpName = 5,
+        OpMemberName = 6,
+        OpString = 7,
+        OpLine = 8,
+        OpExtension = 10,
+        OpExtInstImport = 11,
+        OpExtInst = 12,
+        OpMemoryModel = 14,
+        OpEntryPoint = 15,
+        OpExecutionMode = 16,
+        OpCapability = 17,
+        OpTypeVoid = 19,
+        OpTypeBool = 20,
+        OpTypeInt = 21,
+        OpTypeFloat = 22,
+        OpTypeVector = 23,
+        OpTypeImage = 25,
+        OpTypeSampler = 26,
+        OpTypeSampledImage = 27,
+        OpTypeArray = 28,
+        OpTypeRuntimeArray = 29,
+        OpTypeStruct = 30,
+        OpTypePointer = 32,
+        OpTypeFunction = 33,
+        OpConstantTrue = 41,
+        OpConstantFalse = 42,
+        OpConstant = 43,
+        OpConstantComposite = 44,
+        OpConstantNull = 46,
+        OpSpecConstantTrue = 48,
+        OpSpecConstantFalse = 49,
+        OpSpecConstant = 50,
+        OpSpecConstantComposite = 51,
+        OpFunction = 54,
+        OpFunctionParameter = 55,
+        OpFunctionEnd = 56,
+        OpFunctionCall = 57,
+        OpVariable = 59,
+        OpLoad = 61,
+        OpStore = 62,
+        OpCopyMemory = 63,
+        OpAccessChain = 65,
+        OpInBoundsAccessChain = 66,
+        OpDecorate = 71,
+        OpMemberDecorate = 72,
+        OpVectorExtractDynamic = 77,
+        OpVectorInsertDynamic = 78,
+        OpVectorShuffle = 79,
+        OpCompositeConstruct = 80,
+        OpCompositeExtract = 81,
+        OpCompositeInsert = 82,
+        OpCopyObject = 83,
+        OpSampledImage = 86,
+        OpImageSampleImplicitLod = 87,
+        OpImageSampleExplicitLod = 88,
+        OpImageFetch = 95,
+        OpImageRead = 98,
+        OpImageWrite = 99,
+        OpImage = 100,
+        OpImageQuerySizeLod = 103,
+        OpImageQuerySize = 104,
+        OpConvertFToU = 109,
+        OpConvertFToS = 110,
+        OpConvertSToF = 111,
+        OpConvertUToF = 112,
+        OpUConvert = 113,
+        OpSConvert = 114,
+        OpFConvert = 115,
+        OpQuantizeToF16 = 116,
+        OpBitcast = 124,
+        OpSNegate = 126,
+        OpFNegate = 127,
+        OpIAdd = 128,
+        OpFAdd = 129,
+        OpISub = 130,
+        OpFSub = 131,
+        OpIMul = 132,
+        OpFMul = 133,
+        OpUDiv = 134,
+        OpSDiv = 135,
+        OpFDiv = 136,
+        OpUMod = 137,
+        OpSRem = 138,
+        OpSMod = 139,
+        OpFRem = 140,
+        OpFMod = 141,
+        OpVectorTimesScalar = 142,
+        OpDot = 148,
+        OpAny = 154,
+        OpAll = 155,
+        OpIsNan = 156,
+        OpIsInf = 157,
+        OpLogicalEqual = 164,
+        OpLogicalNotEqual = 165,
+        OpLogicalOr = 166,
+        OpLogicalAnd = 167,
+        OpLogicalNot = 168,
+        OpSelect = 169,
+        OpIEqual = 170,
+        OpINotEqual = 171,
+        OpUGreaterThan = 172,
+        OpSGreaterThan = 173,
+        OpUGreaterThanEqual = 174,
+        OpSGreaterThanEqual = 175,
+        OpULessThan = 176,
+        OpSLessThan = 177,
+        OpULessThanEqual = 178,
+        OpSLessThanEqual = 179,
+        OpFOrdEqual = 180,
+        OpFUnordEqual = 181,
+        OpFOrdNotEqual = 182,
+        OpFUnordNotEqual = 183,
+        OpFOrdLessThan = 184,
+        OpFUnordLessThan = 185,
+        OpFOrdGreaterThan = 186,
+        OpFUnordGreaterThan = 187,
+        OpFOrdLessThanEqual = 188,
+        OpFUnordLessThanEqual = 189,
+        OpFOrdGreaterThanEqual = 190,
+        OpFUnordGreaterThanEqual = 191,
+        OpShiftRightLogical = 194,
+        OpShiftRightArithmetic = 195,
+        OpShiftLeftLogical = 196,
+        OpBitwiseOr = 197,
+        OpBitwiseXor = 198,
+        OpBitwiseAnd = 199,
+        OpNot = 200,
+        OpControlBarrier = 224,
+        OpMemoryBarrier = 225,
+        OpPhi = 245,
+        OpLoopMerge = 246,
+        OpSelectionMerge = 247,
+        OpLabel = 248,
+        OpBranch = 249,
+        OpBranchConditional = 250,
+        OpSwitch = 251,
+        OpKill = 252,
+        OpReturn = 253,
+        OpReturnValue = 254,
+        OpUnreachable = 255,
+        OpNoLine = 317,
+        OpModuleProcessed = 330,
+        OpGroupNonUniformShuffle = 345
+    };
+
+    enum GLSLstd450
+    {
+        Round = 1,
+        RoundEven = 2,
+        Trunc = 3,
+        FAbs = 4,
+        SAbs = 5,
+        FSign = 6,
+        SSign = 7,
+        Floor = 8,
+        Ceil = 9,
+        Fract = 10,
+        Sin = 13,
+        Cos = 14,
+        Tan = 15,
+        Atan = 18,
+        Atan2 = 25,
+        Pow = 26,
+        Exp = 27,
+        Log = 28,
+        Exp2 = 29,
+        Log2 = 30,
+        Sqrt = 31,
+        InverseSqrt = 32,
+        FMin = 37,
+        UMin = 38,
+        SMin = 39,
+        FMax = 40,
+        UMax = 41,
+        SMax = 42,
+        FClamp = 43,
+        UClamp = 44,
+        SClamp = 45,
+        FMix = 46,
+        Step = 48,
+        Fma = 50,
+        PackHalf2x16 = 58,
+        UnpackHalf2x16 = 62,
+        Length = 66,
+        Normalize = 69,
+        FindILsb = 73,
+        FindSMsb = 74,
+        FindUMsb = 75
+    };
+
+    enum StorageClass
+    {
+        StorageUniformConstant = 0,
+        StorageInput = 1,
+        StorageUniform = 2,
+        StorageWorkgroup = 4,
+        StoragePrivate = 6,
+        StorageFunction = 7,
+        StoragePushConstant = 9,
+        StorageBuffer = 12
+    };
+
+    enum Decoration
+    {
+        DecorationArrayStride = 6,
+        DecorationBuiltIn = 11,
+        DecorationBinding = 33,
+        DecorationOffset = 35
+    };
+
+    enum BuiltIn
+    {
+        BuiltInNumWorkgroups = 24,
+        BuiltInWorkgroupId = 26,
+        BuiltInLocalInvocationId = 27,
+        BuiltInGlobalInvocationId = 28,
+        BuiltInLocalInvocationIndex = 29,
+        BuiltInSubgroupSize = 36,
+        BuiltInNumSubgroups = 38,
+        BuiltInSubgroupId = 40,
+        BuiltInSubgroupLocalInvocationId = 41
+    };
+
+    enum
+    {
+        Magic = 0x07230203,
+        ExecutionModelGLCompute = 5,
+        ExecutionModeLocalSize = 17,
+        ImageOperandsBias = 0x1,
+        ImageOperandsLod = 0x2,
+        ImageOperandsGrad = 0x4,
+        ImageOperandsConstOffset = 0x8
+    };
+}
+
+// Operations of the interpreter. Most map to a single SPIR-V opcode on scalars or vectors,
+// composites are lowered to plain copies.
+enum Code : uint32_t
+{
+    CodeCopy,
+    CodeLoad,
+    CodeLoadChunks,
+    CodeStore,
+    CodeStoreChunks,
+    CodeAccessChain,
+    CodeExtractDynamic,
+    CodeInsertDynamic,
+
+    CodeFAdd,
+    CodeFSub,
+    CodeFMul,
+    CodeFDiv,
+    CodeFMod,
+    CodeFRem,
+    CodeFNegate,
+    CodeVectorTimesScalar,
+    CodeDot,
+
+    CodeIAdd,
+    CodeISub,
+    CodeIMul,
+    CodeUDiv,
+    CodeSDiv,
+    CodeUMod,
+    CodeSRem,
+    CodeSMod,
+    CodeSNegate,
+    CodeShiftRightLogical,
+    CodeShiftRightArithmetic,
+    CodeShiftLeftLogical,
+    CodeBitwiseOr,
+    CodeBitwiseXor,
+    CodeBitwiseAnd,
+    CodeNot,
+
+    CodeFOrdEqual,
+    CodeFOrdNotEqual,
+    CodeFOrdLessThan,
+    CodeFOrdGreaterThan,
+    CodeFOrdLessThanEqual,
+    CodeFOrdGreaterThanEqual,
+    CodeFUnordEqual,
+    CodeFUnordNotEqual,
+    CodeFUnordLessThan,
+    CodeFUnordGreaterThan,
+    CodeFUnordLessThanEqual,
+    CodeFUnordGreaterThanEqual,
+    CodeIEqual,
+    CodeINotEqual,
+    CodeULessThan,
+    CodeSLessThan,
+    CodeUGreaterThan,
+    CodeSGreaterThan,
+    CodeULessThanEqual,
+    CodeSLessThanEqual,
+    CodeUGreaterThanEqual,
+    CodeSGreaterThanEqual,
+    CodeLogicalAnd,
+    CodeLogicalOr,
+    CodeLogicalNot,
+    CodeSelect,
+    CodeSelectScalar,
+    CodeAny,
+    CodeAll,
+    CodeIsNan,
+    CodeIsInf,
+
+    CodeConvertFToU,
+    CodeConvertFToS,
+    CodeConvertSToF,
+    CodeConvertUToF,
+    CodeQuantizeToF16,
+
+    CodeRound,
+    CodeRoundEven,
+    CodeTrunc,
+    CodeFAbs,
+    CodeSAbs,
+    CodeFSign,
+    CodeSSign,
+    CodeFloor,
+    CodeCeil,
+    CodeFract,
+    CodeSin,
+    CodeCos,
+    CodeTan,
+    CodeAtan,
+    CodeAtan2,
+    CodePow,
+    CodeExp,
+    CodeLog,
+    CodeExp2,
+    CodeLog2,
+    CodeSqrt,
+    CodeInverseSqrt,
+    CodeFMin,
+    CodeUMin,
+    CodeSMin,
+    CodeFMax,
+    CodeUMax,
+    CodeSMax,
+    CodeFClamp,
+    CodeUClamp,
+    CodeSClamp,
+    CodeFMix,
+    CodeStep,
+    CodeFma,
+    CodePackHalf2x16,
+    CodeUnpackHalf2x16,
+    CodeLength,
+    CodeNormalize,
+    CodeFindILsb,
+    CodeFindSMsb,
+    CodeFindUMsb,
+
+    CodeSampleImage,
+    CodeFetchImage,
+    CodeWriteImage,
+    CodeImageSize,
+
+    CodeBranch,
+    CodeBranchConditional,
+    CodeSwitch,
+    CodeCall,
+    CodeReturn,
+    CodeReturnValue,
+    CodeKill,
+    CodeBarrier,
+    CodeShuffle
+};
+
+// Operands are byte offsets. Registers, and the storage of Function, Private and Input variables,
+// are private to an invocation. Constants and the pointers to resources are shared by the work group,
+// those offsets are tagged with UniformBit.
+static const uint32_t UniformBit = 0x80000000u;
+
+namespace
+{
+    struct Instruction
+    {
+        uint32_t code;
+        uint32_t result;
+        uint32_t a, b, c;
+        // Number of components, or the size in bytes for copies.
+        uint32_t n;
+    };
+
+    // A branch target, and the copies which implement the OpPhis of the target for this edge.
+    struct Edge
+    {
+        uint32_t pc;
+        uint32_t label;
+        uint32_t from_label;
+        uint32_t copies;
+        uint32_t num_copies;
+    };
+
+    struct Frame
+    {
+        uint32_t return_pc;
+        uint32_t result;
+        uint32_t size;
+    };
+
+    enum State
+    {
+        StateRunning,
+        StateBarrier,
+        StateShuffle,
+        StateDone
+    };
+
+    struct Invocation
+    {
+        uint8_t *registers;
+        Frame *frames;
+        uint32_t pc;
+        uint32_t depth;
+        State state;
+    };
+
+    struct ImageBinding
+    {
+        CPUTexture *texture;
+        Format format;
+    };
+
+    // Memory of one work group, reused by the work groups a thread executes.
+    struct Workspace
+    {
+        vector<uint64_t> uniforms;
+        vector<uint64_t> registers;
+        vector<uint64_t> shared;
+        vector<Frame> frames;
+        vector<Invocation> invocations;
+    };
+}
+
+namespace GLFFT
+{
+    struct SPIRVModule
+    {
+        vector<Instruction> code;
+        vector<uint32_t> extra;
+        vector<Edge> edges;
+        uint32_t entry = 0;
+        uint32_t local_size[3] = { 1, 1, 1 };
+        uint32_t subgroup_size = 0;
+
+        // Constants, laid out in the uniform block at the offsets of their ids.
+        vector<uint8_t> uniforms;
+        uint32_t register_size = 0;
+        uint32_t shared_size = 0;
+        uint32_t max_call_depth = 1;
+
+        struct Pointer
+        {
+            uint32_t slot;
+            uint32_t offset;
+        };
+        // Function, Private and Input variables live in the registers of an invocation,
+        // Workgroup variables in shared memory.
+        vector<Pointer> register_pointers;
+        vector<Pointer> shared_pointers;
+
+        struct Initializer
+        {
+            uint32_t offset;
+            uint32_t value;
+            uint32_t size;
+        };
+        vector<Initializer> private_initializers;
+
+        struct BuiltinVariable
+        {
+            uint32_t builtin;
+            uint32_t offset;
+        };
+        vector<BuiltinVariable> builtins;
+
+        enum ResourceType
+        {
+            ResourceBuffer,
+            ResourceConstantData,
+            ResourceImage
+        };
+        struct Resource
+        {
+            ResourceType type;
+            uint32_t slot;
+            uint32_t binding;
+        };
+        vector<Resource> resources;
+
+        unique_ptr<Workspace> acquire_workspace();
+        void release_workspace(unique_ptr<Workspace> workspace);
+
+        mutex lock;
+        vector<unique_ptr<Workspace>> workspaces;
+    };
+}
+
+namespace
+{
+    struct Type
+    {
+        enum Kind
+        {
+            Void,
+            Bool,
+            Int,
+            Float,
+            Vector,
+            Array,
+            RuntimeArray,
+            Struct,
+            Pointer,
+            Function,
+            Image,
+            Sampler,
+            SampledImage
+        };
+
+        Kind kind = Void;
+        // Component, element or pointee type.
+        uint32_t element = 0;
+        // Components of vectors, elements of arrays.
+        uint32_t count = 0;
+        uint32_t storage = 0;
+        vector<uint32_t> members;
+    };
+
+    struct Chunk
+    {
+        uint32_t memory;
+        uint32_t reg;
+        uint32_t size;
+    };
+
+    // Translates a module to the instructions of the interpreter, and assigns every result id a fixed slot.
+    // There is no recursion in GLSL, so registers and variables of functions can be allocated statically.
+    class SPIRVCompiler
+    {
+        public:
+            SPIRVCompiler(const vector<uint32_t> &spirv, SPIRVModule &module)
+                : spirv(spirv), module(module)
+            {
+            }
+
+            void compile();
+
+        private:
+            const vector<uint32_t> &spirv;
+            SPIRVModule &module;
+
+            struct Function
+            {
+                size_t begin = 0;
+                uint32_t pc = ~0u;
+                vector<uint32_t> params;
+                vector<uint32_t> callees;
+            };
+
+            vector<Type> types;
+            vector<uint32_t> result_types;
+            vector<uint32_t> slots;
+            vector<uint32_t> builtins;
+            vector<uint32_t> bindings;
+            vector<uint32_t> array_strides;
+            unordered_map<uint32_t, vector<uint32_t>> member_offsets;
+            unordered_map<uint32_t, uint32_t> variable_storage;
+            unordered_map<uint32_t, Function> functions;
+            unordered_map<uint32_t, uint32_t> label_pcs;
+            unordered_map<uint64_t, vector<uint32_t>> phi_copies;
+            vector<pair<size_t, uint32_t>> call_sites;
+            uint32_t glsl_std450 = ~0u;
+            uint32_t entry_function = ~0u;
+
+            void declare();
+            void declare_variable(const uint32_t *words, bool in_function);
+            void declare_constant(const uint32_t *words, uint32_t count);
+            void emit_function_code();
+            void emit_instruction(const uint32_t *words, uint32_t count, Function &function, uint32_t &label);
+            void emit_extended(const uint32_t *words, uint32_t count);
+            void emit_image_sample(Code code, const uint32_t *words, uint32_t count);
+            void resolve();
+            unsigned call_depth(uint32_t function, unsigned level);
+
+            void emit(Code code, uint32_t result, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t n = 0);
+            uint32_t add_edge(uint32_t from_label, uint32_t to_label);
+
+            const Type& type(uint32_t id) const;
+            uint32_t operand(uint32_t id) const;
+            uint32_t constant_value(uint32_t id) const;
+            uint32_t components(uint32_t type_id) const;
+            uint32_t type_size(uint32_t type_id) const;
+            uint32_t member_offset(uint32_t type_id, uint32_t member, bool explicit_layout) const;
+            uint32_t element_stride(uint32_t type_id, bool explicit_layout) const;
+            void build_chunks(uint32_t type_id, uint32_t memory, uint32_t reg, vector<Chunk> &chunks) const;
+            uint32_t pointee_layout(uint32_t pointer, uint32_t &pointee, bool &explicit_layout) const;
+            void emit_memory_access(Code simple, Code chunked, uint32_t reg, uint32_t pointer, uint32_t type_id);
+
+            uint32_t allocate_uniform(uint32_t size);
+            uint32_t allocate_register(uint32_t size);
+    };
+}
+
+static bool has_explicit_layout(uint32_t storage)
+{
+    return storage == Spv::StorageUniform || storage == Spv::StoragePushConstant || storage == Spv::StorageBuffer;
+}
+
+// Opcodes of function bodies which have a result type and a result id.
+static bool has_result(uint32_t op)
+{
+    switch (op)
+    {
+        case Spv::OpUndef:
+        case Spv::OpExtInst:
+        case Spv::OpFunctionCall:
+        case Spv::OpLoad:
+        case Spv::OpAccessChain:
+        case Spv::OpInBoundsAccessChain:
+        case Spv::OpVectorExtractDynamic:
+        case Spv::OpVectorInsertDynamic:
+        case Spv::OpVectorShuffle:
+        case Spv::OpCompositeConstruct:
+        case Spv::OpCompositeExtract:
+        case Spv::OpCompositeInsert:
+        case Spv::OpCopyObject:
+        case Spv::OpSampledImage:
+        case Spv::OpImageSampleImplicitLod:
+        case Spv::OpImageSampleExplicitLod:
+        case Spv::OpImageFetch:
+        case Spv::OpImageRead:
+        case Spv::OpImage:
+        case Spv::OpImageQuerySizeLod:
+        case Spv::OpImageQuerySize:
+        case Spv::OpBitcast:
+        case Spv::OpVectorTimesScalar:
+        case Spv::OpDot:
+        case Spv::OpAny:
+        case Spv::OpAll:
+        case Spv::OpIsNan:
+        case Spv::OpIsInf:
+        case Spv::OpPhi:
+        case Spv::OpGroupNonUniformShuffle:
+            return true;
+
+        default:
+            return (op >= Spv::OpConvertFToU && op <= Spv::OpQuantizeToF16) ||
+                (op >= Spv::OpSNegate && op <= Spv::OpFMod) ||
+                (op >= Spv::OpLogicalEqual && op <= Spv::OpFUnordGreaterThanEqual) ||
+                (op >= Spv::OpShiftRightLogical && op <= Spv::OpNot);
+    }
+}
+
+// Instructions without results which the interpreter either executes or can ignore.
+static bool is_known_statement(uint32_t op)
+{
+    switch (op)
+    {
+        case Spv::OpLine:
+        case Spv::OpNoLine:
+        case Spv::OpStore:
+        case Spv::OpCopyMemory:
+        case Spv::OpImageWrite:
+        case Spv::OpControlBarrier:
+        case Spv::OpMemoryBarrier:
+        case Spv::OpLoopMerge:
+        case Spv::OpSelectionMerge:
+        case Spv::OpLabel:
+        case Spv::OpBranch:
+        case Spv::OpBranchConditional:
+        case Spv::OpSwitch:
+        case Spv::OpKill:
+        case Spv::OpReturn:
+        case Spv::OpReturnValue:
+        case Spv::OpUnreachable:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+const Type& SPIRVCompiler::type(uint32_t id) const
+{
+    if (id >= types.size())
+    {
+        throw runtime_error("Invalid type id.");
+    }
+    return types[id];
+}
+
+uint32_t SPIRVCompiler::operand(uint32_t id) const
+{
+    if (id >= slots.size() || slots[id] == ~0u)
+    {
+        throw runtime_error("Use of undefined id " + to_string(id) + ".");
+    }
+    return slots[id];
+}
+
+uint32_t SPIRVCompiler::constant_value(uint32_t id) const
+{
+    uint32_t slot = operand(id);
+    if (!(slot & UniformBit))
+    {
+        throw runtime_error("Expected a constant for id " + to_string(id) + ".");
+    }
+
+    uint32_t value;
+    memcpy(&value, module.uniforms.data() + (slot & ~UniformBit), sizeof(value));
+    return value;
+}
+
+uint32_t SPIRVCompiler::components(uint32_t type_id) const
+{
+    auto &t = type(type_id);
+    return t.kind == Type::Vector ? t.count : 1;
+}
+
+uint32_t SPIRVCompiler::type_size(uint32_t type_id) const
+{
+    auto &t = type(type_id);
+    switch (t.kind)
+    {
+        case Type::Bool:
+        case Type::Int:
+        case Type::Float:
+            return 4;
+
+        case Type::Vector:
+        case Type::Array:
+            return t.count * type_size(t.element);
+
+        case Type::Struct:
+        {
+            uint32_t size = 0;
+            for (auto member : t.members)
+            {
+                size += type_size(member);
+            }
+            return size;
+        }
+
+        // Pointers, and images which are pointers to their bindings.
+        case Type::Pointer:
+        case Type::Image:
+        case Type::Sampler:
+        case Type::SampledImage:
+            return sizeof(void*);
+
+        default:
+            return 0;
+    }
+}
+
+uint32_t SPIRVCompiler::member_offset(uint32_t type_id, uint32_t member, bool explicit_layout) const
+{
+    auto &t = type(type_id);
+    if (member >= t.members.size())
+    {
+        throw runtime_error("Struct member out of range.");
+    }
+
+    auto itr = member_offsets.find(type_id);
+    if (explicit_layout && itr != end(member_offsets) && member < itr->second.size())
+    {
+        return itr->second[member];
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < member; i++)
+    {
+        offset += type_size(t.members[i]);
+    }
+    return offset;
+}
+
+uint32_t SPIRVCompiler::element_stride(uint32_t type_id, bool explicit_layout) const
+{
+    auto &t = type(type_id);
+    if (explicit_layout && (t.kind == Type::Array || t.kind == Type::RuntimeArray) && array_strides[type_id])
+    {
+        return array_strides[type_id];
+    }
+    return t.kind == Type::Vector ? 4 : type_size(t.element);
+}
+
+// Describes how a value of the given type in registers maps to memory with an explicit layout.
+void SPIRVCompiler::build_chunks(uint32_t type_id, uint32_t memory, uint32_t reg, vector<Chunk> &chunks) const
+{
+    auto &t = type(type_id);
+    if (t.kind == Type::Array)
+    {
+        uint32_t stride = element_stride(type_id, true);
+        uint32_t size = type_size(t.element);
+        for (uint32_t i = 0; i < t.count; i++)
+        {
+            build_chunks(t.element, memory + i * stride, reg + i * size, chunks);
+        }
+    }
+    else if (t.kind == Type::Struct)
+    {
+        for (uint32_t i = 0; i < t.members.size(); i++)
+        {
+            build_chunks(t.members[i], memory + member_offset(type_id, i, true),
+                    reg + member_offset(type_id, i, false), chunks);
+        }
+    }
+    else
+    {
+        uint32_t size = type_size(type_id);
+        if (!chunks.empty() && chunks.back().memory + chunks.back().size == memory &&
+                chunks.back().reg + chunks.back().size == reg)
+        {
+            chunks.back().size += size;
+        }
+        else
+        {
+            chunks.push_back({ memory, reg, size });
+        }
+    }
+}
+
+uint32_t SPIRVCompiler::pointee_layout(uint32_t pointer, uint32_t &pointee, bool &explicit_layout) const
+{
+    auto &t = type(result_types[pointer]);
+    if (t.kind != Type::Pointer)
+    {
+        throw runtime_error("Expected a pointer.");
+    }
+    pointee = t.element;
+    explicit_layout = has_explicit_layout(t.storage);
+    return operand(pointer);
+}
+
+void SPIRVCompiler::emit_memory_access(Code simple, Code chunked, uint32_t reg, uint32_t pointer, uint32_t type_id)
+{
+    uint32_t pointee;
+    bool explicit_layout;
+    uint32_t pointer_slot = pointee_layout(pointer, pointee, explicit_layout);
+
+    vector<Chunk> chunks;
+    if (explicit_layout)
+    {
+        build_chunks(type_id, 0, 0, chunks);
+    }
+
+    // Loads write their result register, stores read the value from operand c.
+    bool store = simple == CodeStore;
+    uint32_t result = store ? 0 : reg;
+    uint32_t value = store ? reg : 0;
+
+    if (chunks.size() <= 1 && (chunks.empty() || (chunks[0].memory == 0 && chunks[0].reg == 0)))
+    {
+        emit(simple, result, pointer_slot, 0, value, type_size(type_id));
+    }
+    else
+    {
+        uint32_t index = uint32_t(module.extra.size());
+        for (auto &chunk : chunks)
+        {
+            module.extra.push_back(chunk.memory);
+            module.extra.push_back(chunk.reg);
+            module.extra.push_back(chunk.size);
+        }
+        emit(chunked, result, pointer_slot, index, value, uint32_t(chunks.size()));
+    }
+}
+
+uint32_t SPIRVCompiler::allocate_uniform(uint32_t size)
+{
+    uint32_t offset = uint32_t(module.uniforms.size());
+    module.uniforms.resize(offset + ((size + 7) & ~7u));
+    return offset | UniformBit;
+}
+
+uint32_t SPIRVCompiler::allocate_register(uint32_t size)
+{
+    uint32_t offset = module.register_size;
+    module.register_size += (size + 7) & ~7u;
+    return offset;
+}
+
+void SPIRVCompiler::emit(Code code, uint32_t result, uint32_t a, uint32_t b, uint32_t c, uint32_t n)
+{
+    module.code.push_back({ code, result, a, b, c, n });
+}
+
+uint32_t SPIRVCompiler::add_edge(uint32_t from_label, uint32_t to_label)
+{
+    module.edges.push_back({ 0, to_label, from_label, 0, 0 });
+    return uint32_t(module.edges.size() - 1);
+}
+
+void SPIRVCompiler::declare_constant(const uint32_t *words, uint32_t count)
+{
+    uint32_t type_id = words[1];
+    uint32_t id = words[2];
+    uint32_t size = type_size(type_id);
+    uint32_t slot = allocate_uniform(size);
+    uint8_t *data = module.uniforms.data() + (slot & ~UniformBit);
+    slots[id] = slot;
+    result_types[id] = type_id;
+
+    switch (words[0] & 0xffff)
+    {
+        case Spv::OpConstantTrue:
+        case Spv::OpSpecConstantTrue:
+        {
+            uint32_t value = 1;
+            memcpy(data, &value, sizeof(value));
+            break;
+        }
+
+        case Spv::OpConstant:
+        case Spv::OpSpecConstant:
+            if (count != 4)
+            {
+                throw runtime_error("Only 32-bit constants are supported.");
+            }
+            memcpy(data, &words[3], sizeof(uint32_t));
+            break;
+
+        case Spv::OpConstantComposite:
+        case Spv::OpSpecConstantComposite:
+        {
+            uint32_t offset = 0;
+            for (uint32_t i = 3; i < count; i++)
+            {
+                uint32_t constituent = operand(words[i]);
+                uint32_t constituent_size = type_size(result_types[words[i]]);
+                memcpy(data + offset, module.uniforms.data() + (constituent & ~UniformBit), constituent_size);
+                offset += constituent_size;
+            }
+            break;
+        }
+
+        default:
+            // False, null and undefined values are all zero.
+            break;
+    }
+}
+
+void SPIRVCompiler::declare_variable(const uint32_t *words, bool in_function)
+{
+    uint32_t type_id = words[1];
+    uint32_t id = words[2];
+    uint32_t storage = words[3];
+    result_types[id] = type_id;
+
+    uint32_t pointee = type(type_id).element;
+    uint32_t size = type_size(pointee);
+
+    switch (storage)
+    {
+        case Spv::StorageFunction:
+        case Spv::StoragePrivate:
+        case Spv::StorageInput:
+        {
+            if (storage == Spv::StorageFunction && !in_function)
+            {
+                throw runtime_error("Function variable outside of a function.");
+            }
+
+            slots[id] = allocate_register(sizeof(void*));
+            uint32_t offset = allocate_register(size);
+            module.register_pointers.push_back({ slots[id], offset });
+            variable_storage[id] = offset;
+
+            if (storage == Spv::StorageInput)
+            {
+                if (builtins[id] == ~0u)
+                {
+                    throw runtime_error("Compute shaders only have built-in inputs.");
+                }
+                module.builtins.push_back({ builtins[id], offset });
+            }
+            break;
+        }
+
+        case Spv::StorageWorkgroup:
+        {
+            slots[id] = allocate_uniform(sizeof(void*));
+            uint32_t offset = (module.shared_size + 15) & ~15u;
+            module.shared_size = offset + size;
+            module.shared_pointers.push_back({ slots[id], offset });
+            break;
+        }
+
+        case Spv::StorageUniform:
+        case Spv::StorageBuffer:
+            slots[id] = allocate_uniform(sizeof(void*));
+            module.resources.push_back({ SPIRVModule::ResourceBuffer, slots[id], bindings[id] });
+            break;
+
+        case Spv::StoragePushConstant:
+            slots[id] = allocate_uniform(sizeof(void*));
+            module.resources.push_back({ SPIRVModule::ResourceConstantData, slots[id], 0 });
+            break;
+
+        case Spv::StorageUniformConstant:
+        {
+            auto kind = type(pointee).kind;
+            if (kind != Type::Image && kind != Type::SampledImage)
+            {
+                throw runtime_error("Unsupported uniform constant.");
+            }
+            slots[id] = allocate_uniform(sizeof(void*));
+            module.resources.push_back({ SPIRVModule::ResourceImage, slots[id], bindings[id] });
+            break;
+        }
+
+        default:
+            throw runtime_error("Unsupported storage class " + to_string(storage) + ".");
+    }
+
+    if (storage == Spv::StoragePrivate && (words[0] >> 16) > 4)
+    {
+        module.private_initializers.push_back({ variable_storage[id], operand(words[4]), size });
+    }
+}
+
+void SPIRVCompiler::declare()
+{
+    uint32_t bound = spirv[3];
+    types.resize(bound);
+    result_types.resize(bound);
+    slots.assign(bound, ~0u);
+    builtins.assign(bound, ~0u);
+    bindings.assign(bound, 0);
+    array_strides.assign(bound, 0);
+
+    uint32_t current_function = ~0u;
+
+    for (size_t i = 5; i < spirv.size(); )
+    {
+        const uint32_t *words = &spirv[i];
+        uint32_t op = words[0] & 0xffff;
+        uint32_t count = words[0] >> 16;
+        if (count == 0 || i + count > spirv.size())
+        {
+            throw runtime_error("Truncated SPIR-V module.");
+        }
+
+        // Ids are used as indices, so check them once up front.
+        auto check_id = [&](uint32_t id) {
+            if (id >= bound)
+            {
+                throw runtime_error("Id out of bounds.");
+            }
+            return id;
+        };
+
+        switch (op)
+        {
+            case Spv::OpCapability:
+            case Spv::OpExtension:
+            case Spv::OpMemoryModel:
+            case Spv::OpSource:
+            case Spv::OpSourceContinued:
+            case Spv::OpSourceExtension:
+            case Spv::OpName:
+            case Spv::OpMemberName:
+            case Spv::OpString:
+            case Spv::OpLine:
+            case Spv::OpNoLine:
+            case Spv::OpModuleProcessed:
+                break;
+
+            case Spv::OpExtInstImport:
+                if (strcmp(reinterpret_cast<const char*>(&words[2]), "GLSL.std.450") != 0)
+                {
+                    throw runtime_error("Unsupported extended instruction set.");
+                }
+                glsl_std450 = check_id(words[1]);
+                break;
+
+            case Spv::OpEntryPoint:
+                if (words[1] == Spv::ExecutionModelGLCompute && entry_function == ~0u)
+                {
+                    entry_function = check_id(words[2]);
+                }
+                break;
+
+            case Spv::OpExecutionMode:
+                if (words[2] == Spv::ExecutionModeLocalSize)
+                {
+                    module.local_size[0] = words[3];
+                    module.local_size[1] = words[4];
+                    module.local_size[2] = words[5];
+                }
+                break;
+
+            case Spv::OpDecorate:
+                check_id(words[1]);
+                if (words[2] == Spv::DecorationBuiltIn)
+                {
+                    builtins[words[1]] = words[3];
+                }
+                else if (words[2] == Spv::DecorationBinding)
+                {
+                    bindings[words[1]] = words[3];
+                }
+                else if (words[2] == Spv::DecorationArrayStride)
+                {
+                    array_strides[words[1]] = words[3];
+                }
+                break;
+
+            case Spv::OpMemberDecorate:
+                if (words[3] == Spv::DecorationOffset)
+                {
+                    auto &offsets = member_offsets[words[1]];
+                    if (offsets.size() <= words[2])
+                    {
+                        offsets.resize(words[2] + 1);
+                    }
+                    offsets[words[2]] = words[4];
+                }
+                break;
+
+            case Spv::OpTypeVoid:
+                types[check_id(words[1])].kind = Type::Void;
+                break;
+
+            case Spv::OpTypeBool:
+                types[check_id(words[1])].kind = Type::Bool;
+                break;
+
+            case Spv::OpTypeInt:
+            case Spv::OpTypeFloat:
+                if (words[2] != 32)
+                {
+                    throw runtime_error("Only 32-bit scalars are supported.");
+                }
+                types[check_id(words[1])].kind = op == Spv::OpTypeInt ? Type::Int : Type::Float;
+                break;
+
+            case Spv::OpTypeVector:
+            {
+                auto &t = types[check_id(words[1])];
+                t.kind = Type::Vector;
+                t.element = check_id(words[2]);
+                t.count = words[3];
+                break;
+            }
+
+            case Spv::OpTypeArray:
+            {
+                auto &t = types[check_id(words[1])];
+                t.kind = Type::Array;
+                t.element = check_id(words[2]);
+                t.count = constant_value(words[3]);
+                break;
+            }
+
+            case Spv::OpTypeRuntimeArray:
+            {
+                auto &t = types[check_id(words[1])];
+                t.kind = Type::RuntimeArray;
+                t.element = check_id(words[2]);
+                break;
+            }
+
+            case Spv::OpTypeStruct:
+            {
+                auto &t = types[check_id(words[1])];
+                t.kind = Type::Struct;
+                for (uint32_t m = 2; m < count; m++)
+                {
+                    t.members.push_back(check_id(words[m]));
+                }
+                break;
+            }
+
+            case Spv::OpTypePointer:
+            {
+                auto &t = types[check_id(words[1])];
+                t.kind = Type::Pointer;
+                t.storage = words[2];
+                t.element = check_id(words[3]);
+                break;
+            }
+
+            case Spv::OpTypeFunction:
+                types[check_id(words[1])].kind = Type::Function;
+                break;
+
+            case Spv::OpTypeImage:
+                types[check_id(words[1])].kind = Type::Image;
+                break;
+
+            case Spv::OpTypeSampler:
+                types[check_id(words[1])].kind = Type::Sampler;
+                break;
+
+            case Spv::OpTypeSampledImage:
+                types[check_id(words[1])].kind = Type::SampledImage;
+                break;
+
+            case Spv::OpConstantTrue:
+            case Spv::OpConstantFalse:
+            case Spv::OpConstant:
+            case Spv::OpConstantComposite:
+            case Spv::OpConstantNull:
+            case Spv::OpSpecConstantTrue:
+            case Spv::OpSpecConstantFalse:
+            case Spv::OpSpecConstant:
+            case Spv::OpSpecConstantComposite:
+                check_id(words[2]);
+                declare_constant(words, count);
+                break;
+
+            case Spv::OpVariable:
+                check_id(words[2]);
+                declare_variable(words, current_function != ~0u);
+                break;
+
+            case Spv::OpFunction:
+                current_function = check_id(words[2]);
+                functions[current_function].begin = i;
+                break;
+
+            case Spv::OpFunctionParameter:
+            {
+                uint32_t id = check_id(words[2]);
+                result_types[id] = words[1];
+                slots[id] = allocate_register(type_size(words[1]));
+                functions[current_function].params.push_back(id);
+                break;
+            }
+
+            case Spv::OpFunctionEnd:
+                current_function = ~0u;
+                break;
+
+            default:
+                if (current_function == ~0u && op == Spv::OpUndef)
+                {
+                    check_id(words[2]);
+                    declare_constant(words, count);
+                }
+                else if (current_function != ~0u && has_result(op))
+                {
+                    uint32_t id = check_id(words[2]);
+                    result_types[id] = words[1];
+                    slots[id] = allocate_register(type_size(words[1]));
+                }
+                else if (current_function == ~0u || !is_known_statement(op))
+                {
+                    throw runtime_error("Unsupported opcode " + to_string(op) + ".");
+                }
+                break;
+        }
+
+        i += count;
+    }
+
+    if (entry_function == ~0u || functions.find(entry_function) == end(functions))
+    {
+        throw runtime_error("Module has no compute entry point.");
+    }
+}
+
+// Opcodes which map one to one onto an operation on all components.
+static bool component_code(uint32_t op, Code &code, unsigned &operands)
+{
+    static const struct
+    {
+        uint32_t op;
+        Code code;
+        unsigned operands;
+    } table[] = {
+        { Spv::OpConvertFToU, CodeConvertFToU, 1 },
+        { Spv::OpConvertFToS, CodeConvertFToS, 1 },
+        { Spv::OpConvertSToF, CodeConvertSToF, 1 },
+        { Spv::OpConvertUToF, CodeConvertUToF, 1 },
+        { Spv::OpQuantizeToF16, CodeQuantizeToF16, 1 },
+        { Spv::OpSNegate, CodeSNegate, 1 },
+        { Spv::OpFNegate, CodeFNegate, 1 },
+        { Spv::OpIAdd, CodeIAdd, 2 },
+        { Spv::OpFAdd, CodeFAdd, 2 },
+        { Spv::OpISub, CodeISub, 2 },
+        { Spv::OpFSub, CodeFSub, 2 },
+        { Spv::OpIMul, CodeIMul, 2 },
+        { Spv::OpFMul, CodeFMul, 2 },
+        { Spv::OpUDiv, CodeUDiv, 2 },
+        { Spv::OpSDiv, CodeSDiv, 2 },
+        { Spv::OpFDiv, CodeFDiv, 2 },
+        { Spv::OpUMod, CodeUMod, 2 },
+        { Spv::OpSRem, CodeSRem, 2 },
+        { Spv::OpSMod, CodeSMod, 2 },
+        { Spv::OpFRem, CodeFRem, 2 },
+        { Spv::OpFMod, CodeFMod, 2 },
+        { Spv::OpIsNan, CodeIsNan, 1 },
+        { Spv::OpIsInf, CodeIsInf, 1 },
+        // Booleans are stored as 0 or 1.
+        { Spv::OpLogicalEqual, CodeIEqual, 2 },
+        { Spv::OpLogicalNotEqual, CodeINotEqual, 2 },
+        { Spv::OpLogicalOr, CodeLogicalOr, 2 },
+        { Spv::OpLogicalAnd, CodeLogicalAnd, 2 },
+        { Spv::OpLogicalNot, CodeLogicalNot, 1 },
+        { Spv::OpIEqual, CodeIEqual, 2 },
+        { Spv::OpINotEqual, CodeINotEqual, 2 },
+        { Spv::OpUGreaterThan, CodeUGreaterThan, 2 },
+        { Spv::OpSGreaterThan, CodeSGreaterThan, 2 },
+        { Spv::OpUGreaterThanEqual, CodeUGreaterThanEqual, 2 },
+        { Spv::OpSGreaterThanEqual, CodeSGreaterThanEqual, 2 },
+        { Spv::OpULessThan, CodeULessThan, 2 },
+        { Spv::OpSLessThan, CodeSLessThan, 2 },
+        { Spv::OpULessThanEqual, CodeULessThanEqual, 2 },
+        { Spv::OpSLessThanEqual, CodeSLessThanEqual, 2 },
+        { Spv::OpFOrdEqual, CodeFOrdEqual, 2 },
+        { Spv::OpFUnordEqual, CodeFUnordEqual, 2 },
+        { Spv::OpFOrdNotEqual, CodeFOrdNotEqual, 2 },
+        { Spv::OpFUnordNotEqual, CodeFUnordNotEqual, 2 },
+        { Spv::OpFOrdLessThan, CodeFOrdLessThan, 2 },
+        { Spv::OpFUnordLessThan, CodeFUnordLessThan, 2 },
+        { Spv::OpFOrdGreaterThan, CodeFOrdGreaterThan, 2 },
+        { Spv::OpFUnordGreaterThan, CodeFUnordGreaterThan, 2 },
+        { Spv::OpFOrdLessThanEqual, CodeFOrdLessThanEqual, 2 },
+        { Spv::OpFUnordLessThanEqual, CodeFUnordLessThanEqual, 2 },
+        { Spv::OpFOrdGreaterThanEqual, CodeFOrdGreaterThanEqual, 2 },
+        { Spv::OpFUnordGreaterThanEqual, CodeFUnordGreaterThanEqual, 2 },
+        { Spv::OpShiftRightLogical, CodeShiftRightLogical, 2 },
+        { Spv::OpShiftRightArithmetic, CodeShiftRightArithmetic, 2 },
+        { Spv::OpShiftLeftLogical, CodeShiftLeftLogical, 2 },
+        { Spv::OpBitwiseOr, CodeBitwiseOr, 2 },
+        { Spv::OpBitwiseXor, CodeBitwiseXor, 2 },
+        { Spv::OpBitwiseAnd, CodeBitwiseAnd, 2 },
+        { Spv::OpNot, CodeNot, 1 },
+    };
+
+    for (auto &entry : table)
+    {
+        if (entry.op == op)
+        {
+            code = entry.code;
+            operands = entry.operands;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SPIRVCompiler::emit_extended(const uint32_t *words, uint32_t count)
+{
+    static const struct
+    {
+        uint32_t op;
+        Code code;
+        unsigned operands;
+    } table[] = {
+        { Spv::Round, CodeRound, 1 },
+        { Spv::RoundEven, CodeRoundEven, 1 },
+        { Spv::Trunc, CodeTrunc, 1 },
+        { Spv::FAbs, CodeFAbs, 1 },
+        { Spv::SAbs, CodeSAbs, 1 },
+        { Spv::FSign, CodeFSign, 1 },
+        { Spv::SSign, CodeSSign, 1 },
+        { Spv::Floor, CodeFloor, 1 },
+        { Spv::Ceil, CodeCeil, 1 },
+        { Spv::Fract, CodeFract, 1 },
+        { Spv::Sin, CodeSin, 1 },
+        { Spv::Cos, CodeCos, 1 },
+        { Spv::Tan, CodeTan, 1 },
+        { Spv::Atan, CodeAtan, 1 },
+        { Spv::Atan2, CodeAtan2, 2 },
+        { Spv::Pow, CodePow, 2 },
+        { Spv::Exp, CodeExp, 1 },
+        { Spv::Log, CodeLog, 1 },
+        { Spv::Exp2, CodeExp2, 1 },
+        { Spv::Log2, CodeLog2, 1 },
+        { Spv::Sqrt, CodeSqrt, 1 },
+        { Spv::InverseSqrt, CodeInverseSqrt, 1 },
+        { Spv::FMin, CodeFMin, 2 },
+        { Spv::UMin, CodeUMin, 2 },
+        { Spv::SMin, CodeSMin, 2 },
+        { Spv::FMax, CodeFMax, 2 },
+        { Spv::UMax, CodeUMax, 2 },
+        { Spv::SMax, CodeSMax, 2 },
+        { Spv::FClamp, CodeFClamp, 3 },
+        { Spv::UClamp, CodeUClamp, 3 },
+        { Spv::SClamp, CodeSClamp, 3 },
+        { Spv::FMix, CodeFMix, 3 },
+        { Spv::Step, CodeStep, 2 },
+        { Spv::Fma, CodeFma, 3 },
+        { Spv::PackHalf2x16, CodePackHalf2x16, 1 },
+        { Spv::UnpackHalf2x16, CodeUnpackHalf2x16, 1 },
+        { Spv::Length, CodeLength, 1 },
+        { Spv::Normalize, CodeNormalize, 1 },
+        { Spv::FindILsb, CodeFindILsb, 1 },
+        { Spv::FindSMsb, CodeFindSMsb, 1 },
+        { Spv::FindUMsb, CodeFindUMsb, 1 },
+    };
+
+    if (words[3] != glsl_std450)
+    {
+        throw runtime_error("Unknown extended instruction set.");
+    }
+
+    for (auto &entry : table)
+    {
+        if (entry.op == words[4])
+        {
+            if (count != 5 + entry.operands)
+            {
+                throw runtime_error("Wrong number of operands for GLSL.std.450 instruction " + to_string(words[4]) + ".");
+            }
+
+            uint32_t args[3] = {};
+            for (unsigned i = 0; i < entry.operands; i++)
+            {
+                args[i] = operand(words[5 + i]);
+            }
+
+            // Reductions work on the components of their operand.
+            uint32_t n = entry.code == CodeLength || entry.code == CodeNormalize ?
+                components(result_types[words[5]]) : components(words[1]);
+            emit(entry.code, operand(words[2]), args[0], args[1], args[2], n);
+            return;
+        }
+    }
+
+    throw runtime_error("Unsupported GLSL.std.450 instruction " + to_string(words[4]) + ".");
+}
+
+void SPIRVCompiler::emit_image_sample(Code code, const uint32_t *words, uint32_t count)
+{
+    // Only constant offsets are supported, which are all GLFFT uses.
+    int32_t offset[2] = {};
+    if (count > 5)
+    {
+        uint32_t mask = words[5];
+        uint32_t index = 6;
+        if (mask & Spv::ImageOperandsBias)
+        {
+            index++;
+        }
+        if (mask & Spv::ImageOperandsLod)
+        {
+            index++;
+        }
+        if (mask & Spv::ImageOperandsGrad)
+        {
+            index += 2;
+        }
+        if (mask & ~(Spv::ImageOperandsBias | Spv::ImageOperandsLod | Spv::ImageOperandsGrad | Spv::ImageOperandsConstOffset))
+        {
+            throw runtime_error("Unsupported image operands.");
+        }
+
+        if ((mask & Spv::ImageOperandsConstOffset) && index < count)
+        {
+            uint32_t slot = operand(words[index]);
+            if (!(slot & UniformBit))
+            {
+                throw runtime_error("Image offset is not constant.");
+            }
+            memcpy(offset, module.uniforms.data() + (slot & ~UniformBit), sizeof(offset));
+        }
+    }
+
+    uint32_t index = uint32_t(module.extra.size());
+    module.extra.push_back(uint32_t(offset[0]));
+    module.extra.push_back(uint32_t(offset[1]));
+    emit(code, operand(words[2]), operand(words[3]), operand(words[4]), index);
+}
+
+void SPIRVCompiler::emit_instruction(const uint32_t *words, uint32_t count, Function &function, uint32_t &label)
+{
+    uint32_t op = words[0] & 0xffff;
+
+    Code code;
+    unsigned operands;
+    if (component_code(op, code, operands))
+    {
+        if (count != 3 + operands)
+        {
+            throw runtime_error("Wrong number of operands for opcode " + to_string(op) + ".");
+        }
+        emit(code, operand(words[2]), operand(words[3]),
+                operands > 1 ? operand(words[4]) : 0, 0, components(words[1]));
+        return;
+    }
+
+    switch (op)
+    {
+        case Spv::OpLabel:
+            label = words[1];
+            label_pcs[label] = uint32_t(module.code.size());
+            if (function.pc == ~0u)
+            {
+                function.pc = uint32_t(module.code.size());
+            }
+            break;
+
+        case Spv::OpVariable:
+            if (count > 4)
+            {
+                emit(CodeCopy, variable_storage[words[2]], operand(words[4]), 0, 0,
+                        type_size(type(words[1]).element));
+            }
+            break;
+
+        case Spv::OpLoad:
+        {
+            auto kind = type(words[1]).kind;
+            if (kind == Type::Image || kind == Type::SampledImage || kind == Type::Sampler)
+            {
+                // Images are pointers to their bindings, which is what the variable holds.
+                emit(CodeCopy, operand(words[2]), operand(words[3]), 0, 0, sizeof(void*));
+            }
+            else
+            {
+                emit_memory_access(CodeLoad, CodeLoadChunks, operand(words[2]), words[3], words[1]);
+            }
+            break;
+        }
+
+        case Spv::OpStore:
+            emit_memory_access(CodeStore, CodeStoreChunks, operand(words[2]), words[1], result_types[words[2]]);
+            break;
+
+        case Spv::OpCopyMemory:
+        {
+            uint32_t pointee = type(result_types[words[1]]).element;
+            uint32_t temp = allocate_register(type_size(pointee));
+            emit_memory_access(CodeLoad, CodeLoadChunks, temp, words[2], pointee);
+            emit_memory_access(CodeStore, CodeStoreChunks, temp, words[1], pointee);
+            break;
+        }
+
+        case Spv::OpAccessChain:
+        case Spv::OpInBoundsAccessChain:
+        {
+            uint32_t current;
+            bool explicit_layout;
+            uint32_t base = pointee_layout(words[3], current, explicit_layout);
+            uint32_t offset = 0;
+            uint32_t index = uint32_t(module.extra.size());
+            uint32_t dynamic = 0;
+
+            for (uint32_t i = 4; i < count; i++)
+            {
+                auto &t = type(current);
+                uint32_t slot = operand(words[i]);
+                if (t.kind == Type::Struct)
+                {
+                    uint32_t member = constant_value(words[i]);
+                    offset += member_offset(current, member, explicit_layout);
+                    current = t.members[member];
+                }
+                else if (t.kind == Type::Array || t.kind == Type::RuntimeArray || t.kind == Type::Vector)
+                {
+                    uint32_t stride = element_stride(current, explicit_layout);
+                    if (slot & UniformBit)
+                    {
+                        offset += constant_value(words[i]) * stride;
+                    }
+                    else
+                    {
+                        module.extra.push_back(slot);
+                        module.extra.push_back(stride);
+                        dynamic++;
+                    }
+                    current = t.element;
+                }
+                else
+                {
+                    throw runtime_error("Invalid access chain.");
+                }
+            }
+
+            emit(CodeAccessChain, operand(words[2]), base, offset, index, dynamic);
+            break;
+        }
+
+        case Spv::OpVectorExtractDynamic:
+            emit(CodeExtractDynamic, operand(words[2]), operand(words[3]), operand(words[4]), 0,
+                    components(result_types[words[3]]));
+            break;
+
+        case Spv::OpVectorInsertDynamic:
+            emit(CodeInsertDynamic, operand(words[2]), operand(words[3]), operand(words[4]), operand(words[5]),
+                    components(words[1]));
+            break;
+
+        case Spv::OpVectorShuffle:
+        {
+            uint32_t first = components(result_types[words[3]]);
+            for (uint32_t i = 5; i < count; i++)
+            {
+                uint32_t component = words[i];
+                if (component == ~0u)
+                {
+                    continue;
+                }
+
+                uint32_t src = component < first ?
+                    operand(words[3]) + 4 * component : operand(words[4]) + 4 * (component - first);
+                emit(CodeCopy, operand(words[2]) + 4 * (i - 5), src, 0, 0, 4);
+            }
+            break;
+        }
+
+        case Spv::OpCompositeConstruct:
+        {
+            uint32_t offset = 0;
+            for (uint32_t i = 3; i < count; i++)
+            {
+                uint32_t size = type_size(result_types[words[i]]);
+                emit(CodeCopy, operand(words[2]) + offset, operand(words[i]), 0, 0, size);
+                offset += size;
+            }
+            break;
+        }
+
+        case Spv::OpCompositeExtract:
+        case Spv::OpCompositeInsert:
+        {
+            bool insert = op == Spv::OpCompositeInsert;
+            uint32_t composite = words[insert ? 4 : 3];
+            uint32_t current = result_types[composite];
+            uint32_t offset = 0;
+            for (uint32_t i = insert ? 5 : 4; i < count; i++)
+            {
+                auto &t = type(current);
+                if (t.kind == Type::Struct)
+                {
+                    offset += member_offset(current, words[i], false);
+                    current = t.members.at(words[i]);
+                }
+                else
+                {
+                    offset += words[i] * element_stride(current, false);
+                    current = t.element;
+                }
+            }
+
+            if (insert)
+            {
+                emit(CodeCopy, operand(words[2]), operand(composite), 0, 0, type_size(words[1]));
+                emit(CodeCopy, operand(words[2]) + offset, operand(words[3]), 0, 0, type_size(current));
+            }
+            else
+            {
+                emit(CodeCopy, operand(words[2]), operand(composite) + offset, 0, 0, type_size(words[1]));
+            }
+            break;
+        }
+
+        case Spv::OpCopyObject:
+        case Spv::OpBitcast:
+        case Spv::OpUConvert:
+        case Spv::OpSConvert:
+        case Spv::OpFConvert:
+        case Spv::OpSampledImage:
+        case Spv::OpImage:
+            emit(CodeCopy, operand(words[2]), operand(words[3]), 0, 0, type_size(words[1]));
+            break;
+
+        case Spv::OpImageSampleImplicitLod:
+        case Spv::OpImageSampleExplicitLod:
+            emit_image_sample(CodeSampleImage, words, count);
+            break;
+
+        case Spv::OpImageFetch:
+        case Spv::OpImageRead:
+            emit_image_sample(CodeFetchImage, words, count);
+            break;
+
+        case Spv::OpImageWrite:
+            emit(CodeWriteImage, 0, operand(words[1]), operand(words[2]), operand(words[3]));
+            break;
+
+        case Spv::OpImageQuerySize:
+        case Spv::OpImageQuerySizeLod:
+            emit(CodeImageSize, operand(words[2]), operand(words[3]));
+            break;
+
+        case Spv::OpVectorTimesScalar:
+            emit(CodeVectorTimesScalar, operand(words[2]), operand(words[3]), operand(words[4]), 0, components(words[1]));
+            break;
+
+        case Spv::OpDot:
+            emit(CodeDot, operand(words[2]), operand(words[3]), operand(words[4]), 0, components(result_types[words[3]]));
+            break;
+
+        case Spv::OpAny:
+        case Spv::OpAll:
+            emit(op == Spv::OpAny ? CodeAny : CodeAll, operand(words[2]), operand(words[3]), 0, 0,
+                    components(result_types[words[3]]));
+            break;
+
+        case Spv::OpSelect:
+            if (components(result_types[words[3]]) == 1)
+            {
+                emit(CodeSelectScalar, operand(words[2]), operand(words[3]), operand(words[4]), operand(words[5]),
+                        type_size(words[1]));
+            }
+            else
+            {
+                emit(CodeSelect, operand(words[2]), operand(words[3]), operand(words[4]), operand(words[5]),
+                        components(words[1]));
+            }
+            break;
+
+        case Spv::OpExtInst:
+            emit_extended(words, count);
+            break;
+
+        case Spv::OpPhi:
+            for (uint32_t i = 3; i + 1 < count; i += 2)
+            {
+                auto &copies = phi_copies[(uint64_t(words[i + 1]) << 32) | label];
+                copies.push_back(operand(words[2]));
+                copies.push_back(operand(words[i]));
+                copies.push_back(type_size(words[1]));
+            }
+            break;
+
+        case Spv::OpFunctionCall:
+        {
+            uint32_t callee = words[3];
+            auto itr = functions.find(callee);
+            if (itr == end(functions) || itr->second.params.size() != count - 4)
+            {
+                throw runtime_error("Invalid function call.");
+            }
+
+            uint32_t index = uint32_t(module.extra.size());
+            module.extra.push_back(0);
+            for (uint32_t i = 4; i < count; i++)
+            {
+                uint32_t param = itr->second.params[i - 4];
+                module.extra.push_back(operand(param));
+                module.extra.push_back(operand(words[i]));
+                module.extra.push_back(type_size(result_types[param]));
+            }
+
+            call_sites.push_back({ index, callee });
+            function.callees.push_back(callee);
+            emit(CodeCall, operand(words[2]), index, count - 4, 0, type_size(words[1]));
+            break;
+        }
+
+        case Spv::OpGroupNonUniformShuffle:
+            emit(CodeShuffle, operand(words[2]), operand(words[4]), operand(words[5]), 0, type_size(words[1]));
+            break;
+
+        case Spv::OpControlBarrier:
+            emit(CodeBarrier, 0);
+            break;
+
+        case Spv::OpBranch:
+            emit(CodeBranch, 0, add_edge(label, words[1]));
+            break;
+
+        case Spv::OpBranchConditional:
+            emit(CodeBranchConditional, 0, operand(words[1]), add_edge(label, words[2]), add_edge(label, words[3]));
+            break;
+
+        case Spv::OpSwitch:
+        {
+            uint32_t index = uint32_t(module.extra.size());
+            module.extra.push_back(add_edge(label, words[2]));
+            for (uint32_t i = 3; i + 1 < count; i += 2)
+            {
+                module.extra.push_back(words[i]);
+                module.extra.push_back(add_edge(label, words[i + 1]));
+            }
+            emit(CodeSwitch, 0, operand(words[1]), index, 0, (count - 3) / 2);
+            break;
+        }
+
+        case Spv::OpReturn:
+            emit(CodeReturn, 0);
+            break;
+
+        case Spv::OpReturnValue:
+            emit(CodeReturnValue, 0, operand(words[1]));
+            break;
+
+        case Spv::OpKill:
+        case Spv::OpUnreachable:
+            emit(CodeKill, 0);
+            break;
+
+        default:
+            // Declarations, merge instructions and debug information.
+            break;
+    }
+}
+
+void SPIRVCompiler::emit_function_code()
+{
+    for (auto &entry : functions)
+    {
+        auto &function = entry.second;
+        uint32_t label = 0;
+        for (size_t i = function.begin; i < spirv.size(); )
+        {
+            const uint32_t *words = &spirv[i];
+            uint32_t op = words[0] & 0xffff;
+            uint32_t count = words[0] >> 16;
+            if (op == Spv::OpFunctionEnd)
+            {
+                break;
+            }
+
+            if (op != Spv::OpFunction && op != Spv::OpFunctionParameter)
+            {
+                emit_instruction(words, count, function, label);
+            }
+            i += count;
+        }
+    }
+}
+
+unsigned SPIRVCompiler::call_depth(uint32_t function, unsigned level)
+{
+    if (level > functions.size())
+    {
+        throw runtime_error("Recursion is not supported.");
+    }
+
+    unsigned depth = 0;
+    for (auto callee : functions[function].callees)
+    {
+        depth = max(depth, call_depth(callee, level + 1));
+    }
+    return depth + 1;
+}
+
+void SPIRVCompiler::resolve()
+{
+    for (auto &edge : module.edges)
+    {
+        auto itr = label_pcs.find(edge.label);
+        if (itr == end(label_pcs))
+        {
+            throw runtime_error("Branch to unknown label.");
+        }
+        edge.pc = itr->second;
+
+        auto copies = phi_copies.find((uint64_t(edge.from_label) << 32) | edge.label);
+        if (copies != end(phi_copies))
+        {
+            // Copies run in order, so a phi must not read the result of another phi of the same block.
+            auto &list = copies->second;
+            for (size_t i = 0; i < list.size(); i += 3)
+            {
+                for (size_t j = 0; j < i; j += 3)
+                {
+                    if (list[i + 1] == list[j])
+                    {
+                        throw runtime_error("Unsupported dependency between phis.");
+                    }
+                }
+            }
+
+            edge.copies = uint32_t(module.extra.size());
+            edge.num_copies = uint32_t(list.size() / 3);
+            module.extra.insert(end(module.extra), begin(list), end(list));
+        }
+    }
+
+    for (auto &site : call_sites)
+    {
+        module.extra[site.first] = functions[site.second].pc;
+    }
+
+    module.entry = functions[entry_function].pc;
+    module.max_call_depth = call_depth(entry_function, 0);
+}
+
+void SPIRVCompiler::compile()
+{
+    if (spirv.size() < 5 || spirv[0] != Spv::Magic)
+    {
+        throw runtime_error("Not a SPIR-V module.");
+    }
+
+    declare();
+    emit_function_code();
+    resolve();
+}
+
+static inline float get_f(const uint8_t *ptr, uint32_t index)
+{
+    float value;
+    memcpy(&value, ptr + 4 * index, sizeof(value));
+    return value;
+}
+
+static inline uint32_t get_u(const uint8_t *ptr, uint32_t index)
+{
+    uint32_t value;
+    memcpy(&value, ptr + 4 * index, sizeof(value));
+    return value;
+}
+
+static inline int32_t get_i(const uint8_t *ptr, uint32_t index)
+{
+    int32_t value;
+    memcpy(&value, ptr + 4 * index, sizeof(value));
+    return value;
+}
+
+static inline void set_f(uint8_t *ptr, uint32_t index, float value)
+{
+    memcpy(ptr + 4 * index, &value, sizeof(value));
+}
+
+static inline void set_u(uint8_t *ptr, uint32_t index, uint32_t value)
+{
+    memcpy(ptr + 4 * index, &value, sizeof(value));
+}
+
+static inline void set_i(uint8_t *ptr, uint32_t index, int32_t value)
+{
+    memcpy(ptr + 4 * index, &value, sizeof(value));
+}
+
+static inline uint8_t* get_pointer(const uint8_t *ptr)
+{
+    uint8_t *value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline void set_pointer(uint8_t *ptr, const void *value)
+{
+    memcpy(ptr, &value, sizeof(value));
+}
+
+// Out of range conversions are undefined in GLSL, but must not be undefined behavior here.
+static inline uint32_t float_to_uint(float value)
+{
+    if (!(value > 0.0f))
+    {
+        return 0;
+    }
+    return value >= 4294967296.0f ? 0xffffffffu : uint32_t(value);
+}
+
+static inline int32_t float_to_int(float value)
+{
+    if (value != value)
+    {
+        return 0;
+    }
+    else if (value <= -2147483648.0f)
+    {
+        return INT32_MIN;
+    }
+    return value >= 2147483648.0f ? INT32_MAX : int32_t(value);
+}
+
+static inline int32_t find_msb(uint32_t value)
+{
+    int32_t msb = -1;
+    while (value)
+    {
+        msb++;
+        value >>= 1;
+    }
+    return msb;
+}
+
+static inline int32_t find_lsb(uint32_t value)
+{
+    if (!value)
+    {
+        return -1;
+    }
+
+    int32_t lsb = 0;
+    while (!(value & 1))
+    {
+        lsb++;
+        value >>= 1;
+    }
+    return lsb;
+}
+
+static inline int32_t clamp_coord(float coord, unsigned size)
+{
+    // Keeps the conversion to int defined, the texture clamps to edge anyway.
+    return int32_t(max(min(floor(coord), float(size)), -1.0f));
+}
+
+static void sample_image(const ImageBinding &image, int x, int y, uint8_t *result)
+{
+    auto *texture = image.texture;
+    for (unsigned c = 0; c < 4; c++)
+    {
+        // Like GL, missing components read as 0, and a missing alpha as 1.
+        float value = c < texture->get_components() ? texture->load(x, y, c) : (c == 3 ? 1.0f : 0.0f);
+        set_f(result, c, value);
+    }
+}
+
+static void write_image(const ImageBinding &image, int x, int y, const uint8_t *texel)
+{
+    float value[4];
+    if (image.format == FormatR32Uint)
+    {
+        uint32_t bits = get_u(texel, 0);
+        if (image.texture->get_components() == 2)
+        {
+            // Packed halves written through an R32Uint view of an R16G16Float texture.
+            value[0] = CPUTexture::fp16_to_fp32(uint16_t(bits & 0xffff));
+            value[1] = CPUTexture::fp16_to_fp32(uint16_t(bits >> 16));
+        }
+        else
+        {
+            memcpy(value, &bits, sizeof(bits));
+        }
+    }
+    else
+    {
+        for (unsigned c = 0; c < 4; c++)
+        {
+            value[c] = get_f(texel, c);
+        }
+    }
+
+    image.texture->store(x, y, value);
+}
+
+#define OPERAND(offset) (bases[(offset) >> 31] + ((offset) & ~UniformBit))
+
+#define UNARY(code, get, set, expr) \
+    case code: \
+    { \
+        const uint8_t *a = OPERAND(in.a); \
+        for (uint32_t i = 0; i < in.n; i++) \
+        { \
+            auto x = get(a, i); \
+            set(result, i, expr); \
+        } \
+        break; \
+    }
+
+#define BINARY(code, get, set, expr) \
+    case code: \
+    { \
+        const uint8_t *a = OPERAND(in.a); \
+        const uint8_t *b = OPERAND(in.b); \
+        for (uint32_t i = 0; i < in.n; i++) \
+        { \
+            auto x = get(a, i); \
+            auto y = get(b, i); \
+            set(result, i, expr); \
+        } \
+        break; \
+    }
+
+#define TERNARY(code, get, set, expr) \
+    case code: \
+    { \
+        const uint8_t *a = OPERAND(in.a); \
+        const uint8_t *b = OPERAND(in.b); \
+        const uint8_t *c = OPERAND(in.c); \
+        for (uint32_t i = 0; i < in.n; i++) \
+        { \
+            auto x = get(a, i); \
+            auto y = get(b, i); \
+            auto z = get(c, i); \
+            set(result, i, expr); \
+        } \
+        break; \
+    }
+
+// Runs an invocation until it finishes, or reaches a barrier or a subgroup operation
+// which needs the other invocations of the work group to catch up.
+static State run_invocation(const SPIRVModule &module, Invocation &invocation, uint8_t *uniforms)
+{
+    uint8_t *const registers = invocation.registers;
+    uint8_t *const bases[2] = { registers, uniforms };
+    const Instruction *code = module.code.data();
+    const uint32_t *extra = module.extra.data();
+    uint32_t pc = invocation.pc;
+
+    auto take_edge = [&](uint32_t index) {
+        auto &edge = module.edges[index];
+        const uint32_t *copies = extra + edge.copies;
+        for (uint32_t i = 0; i < edge.num_copies; i++, copies += 3)
+        {
+            memcpy(registers + copies[0], OPERAND(copies[1]), copies[2]);
+        }
+        pc = edge.pc;
+    };
+
+    for (;;)
+    {
+        const Instruction &in = code[pc++];
+        uint8_t *result = registers + in.result;
+
+        switch (in.code)
+        {
+            case CodeCopy:
+                memcpy(result, OPERAND(in.a), in.n);
+                break;
+
+            case CodeLoad:
+                memcpy(result, get_pointer(OPERAND(in.a)), in.n);
+                break;
+
+            case CodeStore:
+                memcpy(get_pointer(OPERAND(in.a)), OPERAND(in.c), in.n);
+                break;
+
+            case CodeLoadChunks:
+            {
+                const uint8_t *ptr = get_pointer(OPERAND(in.a));
+                const uint32_t *chunks = extra + in.b;
+                for (uint32_t i = 0; i < in.n; i++, chunks += 3)
+                {
+                    memcpy(result + chunks[1], ptr + chunks[0], chunks[2]);
+                }
+                break;
+            }
+
+            case CodeStoreChunks:
+            {
+                uint8_t *ptr = get_pointer(OPERAND(in.a));
+                const uint8_t *value = OPERAND(in.c);
+                const uint32_t *chunks = extra + in.b;
+                for (uint32_t i = 0; i < in.n; i++, chunks += 3)
+                {
+                    memcpy(ptr + chunks[0], value + chunks[1], chunks[2]);
+                }
+                break;
+            }
+
+            case CodeAccessChain:
+            {
+                uint8_t *ptr = get_pointer(OPERAND(in.a)) + in.b;
+                const uint32_t *indices = extra + in.c;
+                for (uint32_t i = 0; i < in.n; i++, indices += 2)
+                {
+                    ptr += ptrdiff_t(get_i(OPERAND(indices[0]), 0)) * ptrdiff_t(indices[1]);
+                }
+                set_pointer(result, ptr);
+                break;
+            }
+
+            case CodeExtractDynamic:
+            {
+                uint32_t index = get_u(OPERAND(in.b), 0);
+                set_u(result, 0, index < in.n ? get_u(OPERAND(in.a), index) : 0);
+                break;
+            }
+
+            case CodeInsertDynamic:
+            {
+                uint32_t index = get_u(OPERAND(in.c), 0);
+                memcpy(result, OPERAND(in.a), 4 * in.n);
+                if (index < in.n)
+                {
+                    set_u(result, index, get_u(OPERAND(in.b), 0));
+                }
+                break;
+            }
+
+            BINARY(CodeFAdd, get_f, set_f, x + y)
+            BINARY(CodeFSub, get_f, set_f, x - y)
+            BINARY(CodeFMul, get_f, set_f, x * y)
+            BINARY(CodeFDiv, get_f, set_f, x / y)
+            BINARY(CodeFMod, get_f, set_f, x - y * floor(x / y))
+            BINARY(CodeFRem, get_f, set_f, fmod(x, y))
+            UNARY(CodeFNegate, get_f, set_f, -x)
+
+            case CodeVectorTimesScalar:
+            {
+                const uint8_t *a = OPERAND(in.a);
+                float scalar = get_f(OPERAND(in.b), 0);
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    set_f(result, i, get_f(a, i) * scalar);
+                }
+                break;
+            }
+
+            case CodeDot:
+            {
+                const uint8_t *a = OPERAND(in.a);
+                const uint8_t *b = OPERAND(in.b);
+                float sum = 0.0f;
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    sum += get_f(a, i) * get_f(b, i);
+                }
+                set_f(result, 0, sum);
+                break;
+            }
+
+            BINARY(CodeIAdd, get_u, set_u, x + y)
+            BINARY(CodeISub, get_u, set_u, x - y)
+            BINARY(CodeIMul, get_u, set_u, x * y)
+            BINARY(CodeUDiv, get_u, set_u, y ? x / y : 0xffffffffu)
+            BINARY(CodeUMod, get_u, set_u, y ? x % y : 0u)
+            BINARY(CodeSDiv, get_i, set_u, y == -1 ? 0u - uint32_t(x) : (y ? uint32_t(x / y) : 0u))
+            BINARY(CodeSRem, get_i, set_i, y == -1 || y == 0 ? 0 : x % y)
+            BINARY(CodeSMod, get_i, set_i, y == -1 || y == 0 ? 0 : ((x % y) && ((x % y < 0) != (y < 0)) ? x % y + y : x % y))
+            UNARY(CodeSNegate, get_u, set_u, 0u - x)
+            BINARY(CodeShiftRightLogical, get_u, set_u, x >> (y & 31))
+            BINARY(CodeShiftRightArithmetic, get_i, set_i, x >> (y & 31))
+            BINARY(CodeShiftLeftLogical, get_u, set_u, x << (y & 31))
+            BINARY(CodeBitwiseOr, get_u, set_u, x | y)
+            BINARY(CodeBitwiseXor, get_u, set_u, x ^ y)
+            BINARY(CodeBitwiseAnd, get_u, set_u, x & y)
+            UNARY(CodeNot, get_u, set_u, ~x)
+
+            BINARY(CodeFOrdEqual, get_f, set_u, x == y)
+            BINARY(CodeFOrdNotEqual, get_f, set_u, x < y || x > y)
+            BINARY(CodeFOrdLessThan, get_f, set_u, x < y)
+            BINARY(CodeFOrdGreaterThan, get_f, set_u, x > y)
+            BINARY(CodeFOrdLessThanEqual, get_f, set_u, x <= y)
+            BINARY(CodeFOrdGreaterThanEqual, get_f, set_u, x >= y)
+            BINARY(CodeFUnordEqual, get_f, set_u, !(x < y || x > y))
+            BINARY(CodeFUnordNotEqual, get_f, set_u, x != y)
+            BINARY(CodeFUnordLessThan, get_f, set_u, !(x >= y))
+            BINARY(CodeFUnordGreaterThan, get_f, set_u, !(x <= y))
+            BINARY(CodeFUnordLessThanEqual, get_f, set_u, !(x > y))
+            BINARY(CodeFUnordGreaterThanEqual, get_f, set_u, !(x < y))
+            BINARY(CodeIEqual, get_u, set_u, x == y)
+            BINARY(CodeINotEqual, get_u, set_u, x != y)
+            BINARY(CodeULessThan, get_u, set_u, x < y)
+            BINARY(CodeSLessThan, get_i, set_u, x < y)
+            BINARY(CodeUGreaterThan, get_u, set_u, x > y)
+            BINARY(CodeSGreaterThan, get_i, set_u, x > y)
+            BINARY(CodeULessThanEqual, get_u, set_u, x <= y)
+            BINARY(CodeSLessThanEqual, get_i, set_u, x <= y)
+            BINARY(CodeUGreaterThanEqual, get_u, set_u, x >= y)
+            BINARY(CodeSGreaterThanEqual, get_i, set_u, x >= y)
+            BINARY(CodeLogicalAnd, get_u, set_u, x && y)
+            BINARY(CodeLogicalOr, get_u, set_u, x || y)
+            UNARY(CodeLogicalNot, get_u, set_u, !x)
+            UNARY(CodeIsNan, get_f, set_u, x != x)
+            UNARY(CodeIsInf, get_f, set_u, x == x && (x - x) != (x - x))
+
+            case CodeSelect:
+            {
+                const uint8_t *cond = OPERAND(in.a);
+                const uint8_t *a = OPERAND(in.b);
+                const uint8_t *b = OPERAND(in.c);
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    set_u(result, i, get_u(cond, i) ? get_u(a, i) : get_u(b, i));
+                }
+                break;
+            }
+
+            case CodeSelectScalar:
+                memcpy(result, get_u(OPERAND(in.a), 0) ? OPERAND(in.b) : OPERAND(in.c), in.n);
+                break;
+
+            case CodeAny:
+            case CodeAll:
+            {
+                const uint8_t *a = OPERAND(in.a);
+                bool any = false, all = true;
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    any = any || get_u(a, i);
+                    all = all && get_u(a, i);
+                }
+                set_u(result, 0, in.code == CodeAny ? any : all);
+                break;
+            }
+
+            UNARY(CodeConvertFToU, get_f, set_u, float_to_uint(x))
+            UNARY(CodeConvertFToS, get_f, set_i, float_to_int(x))
+            UNARY(CodeConvertSToF, get_i, set_f, float(x))
+            UNARY(CodeConvertUToF, get_u, set_f, float(x))
+            UNARY(CodeQuantizeToF16, get_f, set_f, CPUTexture::fp16_to_fp32(CPUTexture::fp32_to_fp16(x)))
+
+            UNARY(CodeRound, get_f, set_f, round(x))
+            UNARY(CodeRoundEven, get_f, set_f, nearbyint(x))
+            UNARY(CodeTrunc, get_f, set_f, trunc(x))
+            UNARY(CodeFAbs, get_f, set_f, fabs(x))
+            UNARY(CodeSAbs, get_i, set_u, x < 0 ? 0u - uint32_t(x) : uint32_t(x))
+            UNARY(CodeFSign, get_f, set_f, x > 0.0f ? 1.0f : (x < 0.0f ? -1.0f : 0.0f))
+            UNARY(CodeSSign, get_i, set_i, x > 0 ? 1 : (x < 0 ? -1 : 0))
+            UNARY(CodeFloor, get_f, set_f, floor(x))
+            UNARY(CodeCeil, get_f, set_f, ceil(x))
+            UNARY(CodeFract, get_f, set_f, x - floor(x))
+            UNARY(CodeSin, get_f, set_f, sin(x))
+            UNARY(CodeCos, get_f, set_f, cos(x))
+            UNARY(CodeTan, get_f, set_f, tan(x))
+            UNARY(CodeAtan, get_f, set_f, atan(x))
+            BINARY(CodeAtan2, get_f, set_f, atan2(x, y))
+            BINARY(CodePow, get_f, set_f, pow(x, y))
+            UNARY(CodeExp, get_f, set_f, exp(x))
+            UNARY(CodeLog, get_f, set_f, log(x))
+            UNARY(CodeExp2, get_f, set_f, exp2(x))
+            UNARY(CodeLog2, get_f, set_f, log2(x))
+            UNARY(CodeSqrt, get_f, set_f, sqrt(x))
+            UNARY(CodeInverseSqrt, get_f, set_f, 1.0f / sqrt(x))
+            BINARY(CodeFMin, get_f, set_f, y < x ? y : x)
+            BINARY(CodeUMin, get_u, set_u, min(x, y))
+            BINARY(CodeSMin, get_i, set_i, min(x, y))
+            BINARY(CodeFMax, get_f, set_f, x < y ? y : x)
+            BINARY(CodeUMax, get_u, set_u, max(x, y))
+            BINARY(CodeSMax, get_i, set_i, max(x, y))
+            TERNARY(CodeFClamp, get_f, set_f, min(max(x, y), z))
+            TERNARY(CodeUClamp, get_u, set_u, min(max(x, y), z))
+            TERNARY(CodeSClamp, get_i, set_i, min(max(x, y), z))
+            TERNARY(CodeFMix, get_f, set_f, x + (y - x) * z)
+            BINARY(CodeStep, get_f, set_f, y < x ? 0.0f : 1.0f)
+            TERNARY(CodeFma, get_f, set_f, x * y + z)
+            UNARY(CodeFindILsb, get_u, set_i, find_lsb(x))
+            UNARY(CodeFindSMsb, get_i, set_i, find_msb(uint32_t(x < 0 ? ~x : x)))
+            UNARY(CodeFindUMsb, get_u, set_i, find_msb(x))
+
+            case CodePackHalf2x16:
+            {
+                const uint8_t *a = OPERAND(in.a);
+                set_u(result, 0, uint32_t(CPUTexture::fp32_to_fp16(get_f(a, 0))) |
+                        (uint32_t(CPUTexture::fp32_to_fp16(get_f(a, 1))) << 16));
+                break;
+            }
+
+            case CodeUnpackHalf2x16:
+            {
+                uint32_t value = get_u(OPERAND(in.a), 0);
+                set_f(result, 0, CPUTexture::fp16_to_fp32(uint16_t(value & 0xffff)));
+                set_f(result, 1, CPUTexture::fp16_to_fp32(uint16_t(value >> 16)));
+                break;
+            }
+
+            case CodeLength:
+            case CodeNormalize:
+            {
+                const uint8_t *a = OPERAND(in.a);
+                float sum = 0.0f;
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    sum += get_f(a, i) * get_f(a, i);
+                }
+
+                float length = sqrt(sum);
+                if (in.code == CodeLength)
+                {
+                    set_f(result, 0, length);
+                }
+                else
+                {
+                    for (uint32_t i = 0; i < in.n; i++)
+                    {
+                        set_f(result, i, get_f(a, i) / length);
+                    }
+                }
+                break;
+            }
+
+            case CodeSampleImage:
+            {
+                auto &image = *reinterpret_cast<const ImageBinding*>(get_pointer(OPERAND(in.a)));
+                const uint8_t *coord = OPERAND(in.b);
+                // Samplers are nearest with clamp to edge.
+                int x = clamp_coord(get_f(coord, 0) * float(image.texture->get_width()), image.texture->get_width());
+                int y = clamp_coord(get_f(coord, 1) * float(image.texture->get_height()), image.texture->get_height());
+                sample_image(image, x + int32_t(extra[in.c]), y + int32_t(extra[in.c + 1]), result);
+                break;
+            }
+
+            case CodeFetchImage:
+            {
+                auto &image = *reinterpret_cast<const ImageBinding*>(get_pointer(OPERAND(in.a)));
+                const uint8_t *coord = OPERAND(in.b);
+                sample_image(image, get_i(coord, 0) + int32_t(extra[in.c]), get_i(coord, 1) + int32_t(extra[in.c + 1]), result);
+                break;
+            }
+
+            case CodeWriteImage:
+            {
+                auto &image = *reinterpret_cast<const ImageBinding*>(get_pointer(OPERAND(in.a)));
+                const uint8_t *coord = OPERAND(in.b);
+                write_image(image, get_i(coord, 0), get_i(coord, 1), OPERAND(in.c));
+                break;
+            }
+
+            case CodeImageSize:
+            {
+                auto &image = *reinterpret_cast<const ImageBinding*>(get_pointer(OPERAND(in.a)));
+                set_u(result, 0, image.texture->get_width());
+                set_u(result, 1, image.texture->get_height());
+                break;
+            }
+
+            case CodeBranch:
+                take_edge(in.a);
+                break;
+
+            case CodeBranchConditional:
+                take_edge(get_u(OPERAND(in.a), 0) ? in.b : in.c);
+                break;
+
+            case CodeSwitch:
+            {
+                uint32_t selector = get_u(OPERAND(in.a), 0);
+                const uint32_t *cases = extra + in.b;
+                uint32_t edge = cases[0];
+                for (uint32_t i = 0; i < in.n; i++)
+                {
+                    if (cases[1 + 2 * i] == selector)
+                    {
+                        edge = cases[2 + 2 * i];
+                        break;
+                    }
+                }
+                take_edge(edge);
+                break;
+            }
+
+            case CodeCall:
+            {
+                const uint32_t *call = extra + in.a;
+                const uint32_t *params = call + 1;
+                for (uint32_t i = 0; i < in.b; i++, params += 3)
+                {
+                    memcpy(registers + params[0], OPERAND(params[1]), params[2]);
+                }
+
+                invocation.frames[invocation.depth++] = { pc, in.result, in.n };
+                pc = call[0];
+                break;
+            }
+
+            case CodeReturn:
+            case CodeReturnValue:
+                if (invocation.depth == 0)
+                {
+                    invocation.pc = pc;
+                    return StateDone;
+                }
+                else
+                {
+                    auto &frame = invocation.frames[--invocation.depth];
+                    if (in.code == CodeReturnValue)
+                    {
+                        memcpy(registers + frame.result, OPERAND(in.a), frame.size);
+                    }
+                    pc = frame.return_pc;
+                }
+                break;
+
+            case CodeKill:
+                invocation.pc = pc;
+                return StateDone;
+
+            case CodeBarrier:
+                invocation.pc = pc;
+                return StateBarrier;
+
+            case CodeShuffle:
+                invocation.pc = pc;
+                return StateShuffle;
+        }
+    }
+}
+
+#undef UNARY
+#undef BINARY
+#undef TERNARY
+
+namespace
+{
+    struct DispatchState
+    {
+        uint8_t *buffers[8];
+        ImageBinding images[8];
+        const uint8_t *constant_data;
+        uint32_t groups[3];
+    };
+}
+
+unique_ptr<Workspace> SPIRVModule::acquire_workspace()
+{
+    {
+        lock_guard<mutex> holder{lock};
+        if (!workspaces.empty())
+        {
+            auto workspace = move(workspaces.back());
+            workspaces.pop_back();
+            return workspace;
+        }
+    }
+
+    unsigned invocations = local_size[0] * local_size[1] * local_size[2];
+    unique_ptr<Workspace> workspace(new Workspace);
+    workspace->uniforms.resize((uniforms.size() + 7) / 8);
+    memcpy(workspace->uniforms.data(), uniforms.data(), uniforms.size());
+    workspace->registers.resize(size_t(invocations) * register_size / 8);
+    workspace->shared.resize((shared_size + 7) / 8);
+    workspace->frames.resize(size_t(invocations) * max_call_depth);
+    workspace->invocations.resize(invocations);
+
+    auto *uniform_data = reinterpret_cast<uint8_t*>(workspace->uniforms.data());
+    auto *shared_data = reinterpret_cast<uint8_t*>(workspace->shared.data());
+    for (auto &pointer : shared_pointers)
+    {
+        set_pointer(uniform_data + (pointer.slot & ~UniformBit), shared_data + pointer.offset);
+    }
+
+    for (unsigned i = 0; i < invocations; i++)
+    {
+        auto &invocation = workspace->invocations[i];
+        invocation.registers = reinterpret_cast<uint8_t*>(workspace->registers.data()) + size_t(i) * register_size;
+        invocation.frames = workspace->frames.data() + size_t(i) * max_call_depth;
+        for (auto &pointer : register_pointers)
+        {
+            set_pointer(invocation.registers + pointer.slot, invocation.registers + pointer.offset);
+        }
+    }
+
+    return workspace;
+}
+
+void SPIRVModule::release_workspace(unique_ptr<Workspace> workspace)
+{
+    lock_guard<mutex> holder{lock};
+    workspaces.push_back(move(workspace));
+}
+
+static void write_builtin(const SPIRVModule &module, uint8_t *storage, uint32_t builtin,
+        const uint32_t *group, const uint32_t *num_groups, unsigned index)
+{
+    const uint32_t *local_size = module.local_size;
+    uint32_t invocations = local_size[0] * local_size[1] * local_size[2];
+    uint32_t subgroup_size = module.subgroup_size;
+    uint32_t local[3] = {
+        index % local_size[0],
+        (index / local_size[0]) % local_size[1],
+        index / (local_size[0] * local_size[1]),
+    };
+
+    switch (builtin)
+    {
+        case Spv::BuiltInNumWorkgroups:
+            memcpy(storage, num_groups, 3 * sizeof(uint32_t));
+            break;
+
+        case Spv::BuiltInWorkgroupId:
+            memcpy(storage, group, 3 * sizeof(uint32_t));
+            break;
+
+        case Spv::BuiltInLocalInvocationId:
+            memcpy(storage, local, sizeof(local));
+            break;
+
+        case Spv::BuiltInGlobalInvocationId:
+            for (unsigned i = 0; i < 3; i++)
+            {
+                set_u(storage, i, group[i] * local_size[i] + local[i]);
+            }
+            break;
+
+        case Spv::BuiltInLocalInvocationIndex:
+            set_u(storage, 0, index);
+            break;
+
+        case Spv::BuiltInSubgroupSize:
+            set_u(storage, 0, subgroup_size);
+            break;
+
+        case Spv::BuiltInNumSubgroups:
+            set_u(storage, 0, (invocations + subgroup_size - 1) / subgroup_size);
+            break;
+
+        case Spv::BuiltInSubgroupId:
+            set_u(storage, 0, index / subgroup_size);
+            break;
+
+        case Spv::BuiltInSubgroupLocalInvocationId:
+            set_u(storage, 0, subgroup_size - 1 - index % subgroup_size);
+            break;
+
+        default:
+            // Other built-ins do not exist in compute shaders, leave them zero.
+            break;
+    }
+}
+
+// Every invocation reached the same shuffle, so all values are available.
+static void resolve_shuffles(const SPIRVModule &module, Workspace &workspace)
+{
+    auto *uniforms = reinterpret_cast<uint8_t*>(workspace.uniforms.data());
+    unsigned invocations = unsigned(workspace.invocations.size());
+    unsigned subgroup_size = module.subgroup_size;
+
+    for (unsigned i = 0; i < invocations; i++)
+    {
+        auto &invocation = workspace.invocations[i];
+        if (invocation.state != StateShuffle)
+        {
+            continue;
+        }
+
+        auto &in = module.code[invocation.pc - 1];
+        uint8_t *bases[2] = { invocation.registers, uniforms };
+        uint32_t lane = get_u(OPERAND(in.b), 0);
+        unsigned source = i - i % subgroup_size + (subgroup_size - 1 - lane);
+        uint8_t *result = invocation.registers + in.result;
+
+        if (lane < subgroup_size && source < invocations)
+        {
+            bases[0] = workspace.invocations[source].registers;
+            memcpy(result, OPERAND(in.a), in.n);
+        }
+        else
+        {
+            memset(result, 0, in.n);
+        }
+    }
+}
+
+#undef OPERAND
+
+static void execute_work_group(const SPIRVModule &module, Workspace &workspace, const DispatchState &dispatch,
+        const uint32_t *group)
+{
+    auto *uniforms = reinterpret_cast<uint8_t*>(workspace.uniforms.data());
+    for (auto &resource : module.resources)
+    {
+        const void *pointer = nullptr;
+        if (resource.binding < 8)
+        {
+            switch (resource.type)
+            {
+                case SPIRVModule::ResourceBuffer:
+                    pointer = dispatch.buffers[resource.binding];
+                    break;
+
+                case SPIRVModule::ResourceConstantData:
+                    pointer = dispatch.constant_data;
+                    break;
+
+                case SPIRVModule::ResourceImage:
+                    pointer = &dispatch.images[resource.binding];
+                    break;
+            }
+        }
+        set_pointer(uniforms + (resource.slot & ~UniformBit), pointer);
+    }
+
+    unsigned invocations = unsigned(workspace.invocations.size());
+    for (unsigned i = 0; i < invocations; i++)
+    {
+        auto &invocation = workspace.invocations[i];
+        for (auto &builtin : module.builtins)
+        {
+            write_builtin(module, invocation.registers + builtin.offset, builtin.builtin, group, dispatch.groups, i);
+        }
+
+        for (auto &init : module.private_initializers)
+        {
+            const uint8_t *value = (init.value & UniformBit) ?
+                uniforms + (init.value & ~UniformBit) : invocation.registers + init.value;
+            memcpy(invocation.registers + init.offset, value, init.size);
+        }
+
+        invocation.pc = module.entry;
+        invocation.depth = 0;
+        invocation.state = StateRunning;
+    }
+
+    // Invocations take turns, each running until the next barrier. Once all of them have arrived,
+    // the work group continues past it. Without barriers, every invocation simply runs to completion.
+    for (;;)
+    {
+        bool done = true;
+        bool shuffle = false;
+        for (auto &invocation : workspace.invocations)
+        {
+            if (invocation.state != StateDone)
+            {
+                invocation.state = run_invocation(module, invocation, uniforms);
+                done = done && invocation.state == StateDone;
+                shuffle = shuffle || invocation.state == StateShuffle;
+            }
+        }
+
+        if (done)
+        {
+            break;
+        }
+        else if (shuffle)
+        {
+            resolve_shuffles(module, workspace);
+        }
+    }
+}
+
+SPIRVProgram::SPIRVProgram(vector<uint32_t> spirv, unique_ptr<SPIRVModule> module)
+    : spirv(move(spirv)), module(move(module))
+{
+}
+
+SPIRVProgram::~SPIRVProgram()
+{
+}
+
+void SPIRVCommandBuffer::bind_program(Program *program)
+{
+    this->program = static_cast<SPIRVProgram*>(program);
+}
+
+void SPIRVCommandBuffer::bind_storage_texture(unsigned binding, Texture *texture, Format format)
+{
+    bindings[binding].texture = static_cast<CPUTexture*>(texture);
+    bindings[binding].format = format;
+}
+
+void SPIRVCommandBuffer::bind_texture(unsigned binding, Texture *texture)
+{
+    bindings[binding].texture = static_cast<CPUTexture*>(texture);
+    bindings[binding].format = FormatUnknown;
+}
+
+void SPIRVCommandBuffer::bind_sampler(unsigned, Sampler *)
+{
+    // Textures are always sampled with nearest filtering and clamp to edge.
+}
+
+void SPIRVCommandBuffer::bind_storage_buffer(unsigned binding, Buffer *buffer)
+{
+    bindings[binding].buffer = static_cast<CPUBuffer*>(buffer);
+    bindings[binding].offset = 0;
+}
+
+void SPIRVCommandBuffer::bind_storage_buffer_range(unsigned binding, size_t offset, size_t, Buffer *buffer)
+{
+    bindings[binding].buffer = static_cast<CPUBuffer*>(buffer);
+    bindings[binding].offset = offset;
+}
+
+void SPIRVCommandBuffer::push_constant_data(unsigned, const void *data, size_t size)
+{
+    memcpy(constant_data, data, min(size, sizeof(constant_data)));
+}
+
+void SPIRVCommandBuffer::write_timestamp(TimestampQuery *query)
+{
+    static_cast<CPUTimestampQuery*>(query)->time = context->get_time();
+}
+
+void SPIRVCommandBuffer::dispatch(unsigned x, unsigned y, unsigned z)
+{
+    if (!program)
+    {
+        throw logic_error("Dispatch without a bound program.\n");
+    }
+
+    DispatchState state;
+    for (unsigned i = 0; i < MaxBindings; i++)
+    {
+        auto &binding = bindings[i];
+        state.buffers[i] = binding.buffer ? binding.buffer->get(binding.offset) : nullptr;
+        state.images[i] = { binding.texture, binding.format };
+    }
+    state.constant_data = constant_data;
+    state.groups[0] = x;
+    state.groups[1] = y;
+    state.groups[2] = z;
+
+    auto &module = *program->module;
+    context->parallel_for(x * y * z, [&](unsigned index) {
+        uint32_t group[3] = { index % x, (index / x) % y, index / (x * y) };
+        auto workspace = module.acquire_workspace();
+        execute_work_group(module, *workspace, state, group);
+        module.release_workspace(move(workspace));
+    });
+}
+
+SPIRVContext::SPIRVContext(unsigned num_threads)
+    : CPUContext(num_threads)
+{
+    command_buffer = unique_ptr<SPIRVCommandBuffer>(new SPIRVCommandBuffer(this));
+    renderer_string = "GLFFT SPIR-V interpreter (" + to_string(get_num_threads()) + " threads)";
+}
+
+SPIRVContext::~SPIRVContext()
+{
+}
+
+unique_ptr<Program> SPIRVContext::create_program(vector<uint32_t> spirv)
+{
+    unique_ptr<SPIRVModule> module(new SPIRVModule);
+    module->subgroup_size = SubgroupSize;
+
+    try
+    {
+        SPIRVCompiler(spirv, *module).compile();
+    }
+    catch (const exception &e)
+    {
+        log("Failed to load SPIR-V module: %s\n", e.what());
+        return nullptr;
+    }
+
+    return unique_ptr<Program>(new SPIRVProgram(move(spirv), move(module)));
+}
+
+unique_ptr<Program> SPIRVContext::compile_compute_shader(const char *source)
+{
+    vector<uint32_t> spirv;
+    if (!compile_glsl_to_spirv(source, spirv))
+    {
+        log("Failed to compile shader to SPIR-V:\n%s\n", source);
+        return nullptr;
+    }
+    return create_program(move(spirv));
+}
+
+bool SPIRVContext::get_program_binary(Program *program, vector<uint8_t> &binary)
+{
+    auto &spirv = static_cast<SPIRVProgram*>(program)->spirv;
+    binary.resize(spirv.size() * sizeof(uint32_t));
+    memcpy(binary.data(), spirv.data(), binary.size());
+    return true;
+}
+
+unique_ptr<Program> SPIRVContext::load_program_binary(const void *binary, size_t size)
+{
+    uint32_t magic;
+    if (size < sizeof(magic) || (size % sizeof(uint32_t)) != 0)
+    {
+        return nullptr;
+    }
+    memcpy(&magic, binary, sizeof(magic));
+    if (magic != Spv::Magic)
+    {
+        return nullptr;
+    }
+
+    vector<uint32_t> spirv(size / sizeof(uint32_t));
+    memcpy(spirv.data(), binary, size);
+    return create_program(move(spirv));
+}
+
+CommandBuffer* SPIRVContext::request_command_buffer()
+{
+    return command_buffer.get();
+}
@@ -0,0 +1,122 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef GLFFT_SPIRV_INTERFACE_HPP__
+#define GLFFT_SPIRV_INTERFACE_HPP__
+
+#include "glfft_cpu_interface.hpp"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+// Runs the generated shaders themselves on the CPU.
+// Shaders are compiled to SPIR-V with glslang like for the Vulkan backend, and the SPIR-V is interpreted.
+// Work groups are spread out over the thread pool of the CPU backend. Every invocation of a work group
+// has its own registers and runs until it reaches a barrier, so barrier() and shared memory behave like on a GPU.
+// Unlike CPUContext, this exercises the exact code paths of the shaders, e.g. FFT_SHARED_BANKED and FP16 packing,
+// which makes it useful to validate shader changes on machines without a GPU. It is a lot slower than CPUContext.
+
+namespace GLFFT
+{
+    class SPIRVContext;
+    struct SPIRVModule;
+
+    class SPIRVProgram : public Program
+    {
+        public:
+            friend class SPIRVContext;
+            friend class SPIRVCommandBuffer;
+            ~SPIRVProgram();
+
+        private:
+            SPIRVProgram(std::vector<uint32_t> spirv, std::unique_ptr<SPIRVModule> module);
+
+            std::vector<uint32_t> spirv;
+            std::unique_ptr<SPIRVModule> module;
+    };
+
+    class SPIRVCommandBuffer : public CommandBuffer
+    {
+        public:
+            friend class SPIRVContext;
+
+            void bind_program(Program *program) override;
+            void bind_storage_texture(unsigned binding, Texture *texture, Format format) override;
+            void bind_texture(unsigned binding, Texture *texture) override;
+            void bind_sampler(unsigned binding, Sampler *sampler) override;
+            void bind_storage_buffer(unsigned binding, Buffer *texture) override;
+            void bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *texture) override;
+            void dispatch(unsigned x, unsigned y, unsigned z) override;
+
+            // Dispatches execute synchronously, so barriers are no-ops.
+            void barrier(Buffer*) override {}
+            void barrier(Texture*) override {}
+            void barrier() override {}
+            void barrier(AccessFlags, AccessFlags) override {}
+
+            void push_constant_data(unsigned binding, const void *data, size_t size) override;
+            void write_timestamp(TimestampQuery *query) override;
+
+        private:
+            SPIRVCommandBuffer(SPIRVContext *context) : context(context) {}
+            SPIRVContext *context;
+
+            enum { MaxBindings = 8 };
+            struct Binding
+            {
+                CPUBuffer *buffer = nullptr;
+                size_t offset = 0;
+                CPUTexture *texture = nullptr;
+                // Format of storage images, R32Uint is used to write packed FP16 into R16G16Float textures.
+                Format format = FormatUnknown;
+            };
+
+            SPIRVProgram *program = nullptr;
+            Binding bindings[MaxBindings];
+            uint8_t constant_data[MaxConstantDataSize] = {};
+    };
+
+    class SPIRVContext : public CPUContext
+    {
+        public:
+            friend class SPIRVCommandBuffer;
+
+            // If num_threads is 0, one worker thread per hardware thread is used.
+            SPIRVContext(unsigned num_threads = 0);
+            ~SPIRVContext();
+
+            std::unique_ptr<Program> compile_compute_shader(const char *source) override;
+
+            // Programs serialize to their SPIR-V, so precompiled bundles can be loaded as well.
+            bool get_program_binary(Program *program, std::vector<uint8_t> &binary) override;
+            std::unique_ptr<Program> load_program_binary(const void *binary, size_t size) override;
+
+            CommandBuffer* request_command_buffer() override;
+
+            // Subgroups are emulated within work groups. Lanes are numbered in reverse order of
+            // gl_LocalInvocationIndex, so shaders which assume the two match fail validation.
+            bool supports_subgroup_shuffle() override { return true; }
+            unsigned get_subgroup_size() override { return SubgroupSize; }
+
+        private:
+            enum { SubgroupSize = 32 };
+            std::unique_ptr<Program> create_program(std::vector<uint32_t> spirv);
+            std::unique_ptr<SPIRVCommandBuffer> command_buffer;
+    };
+}
+
+#endif
@@ -0,0 +1,1141 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_vulkan_interface.hpp"
+#include "glfft_spirv.hpp"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace GLFFT;
+using namespace std;
+
+// Descriptor types of the bindings in glsl/fft_common.comp, indexed by binding.
+// Constant data is a push constant block when compiling for Vulkan, so binding 3 is unused.
+static const VkDescriptorType binding_types[] = {
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_MAX_ENUM,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+// Descriptor sets per pool. A new pool is created once a command buffer has used up its pools.
+static const uint32_t SetsPerPool = 64;
+
+static void check(VkResult result, const char *what)
+{
+    if (result != VK_SUCCESS)
+    {
+        throw runtime_error(string(what) + " failed.");
+    }
+}
+
+static VkFormat convert(Format format)
+{
+    switch (format)
+    {
+        case FormatR16G16B16A16Float: return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case FormatR32G32B32A32Float: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case FormatR32Float: return VK_FORMAT_R32_SFLOAT;
+        case FormatR16G16Float: return VK_FORMAT_R16G16_SFLOAT;
+        case FormatR32G32Float: return VK_FORMAT_R32G32_SFLOAT;
+        case FormatR32Uint: return VK_FORMAT_R32_UINT;
+        case FormatUnknown: return VK_FORMAT_UNDEFINED;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+static unsigned format_components(Format format)
+{
+    switch (format)
+    {
+        case FormatR16G16B16A16Float:
+        case FormatR32G32B32A32Float:
+            return 4;
+
+        case FormatR16G16Float:
+        case FormatR32G32Float:
+            return 2;
+
+        case FormatR32Float:
+        case FormatR32Uint:
+            return 1;
+
+        case FormatUnknown:
+            return 0;
+    }
+    return 0;
+}
+
+static bool format_is_fp16(Format format)
+{
+    return format == FormatR16G16B16A16Float || format == FormatR16G16Float;
+}
+
+static size_t format_size(Format format)
+{
+    return format_components(format) * (format_is_fp16(format) ? 2 : 4);
+}
+
+static float fp16_to_fp32(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1fu;
+    uint32_t mantissa = value & 0x3ffu;
+
+    if (exponent == 0)
+    {
+        float res = ldexp(float(mantissa), -24);
+        return sign ? -res : res;
+    }
+
+    uint32_t bits;
+    if (exponent == 31)
+    {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float res;
+    memcpy(&res, &bits, sizeof(res));
+    return res;
+}
+
+// Stage and access masks of the GLFFT access flags.
+static void convert_access(AccessFlags access, VkPipelineStageFlags &stages, VkAccessFlags &vk_access)
+{
+    stages = 0;
+    vk_access = 0;
+
+    if (access & (AccessShaderStorageRead | AccessImageRead | AccessTextureFetch | AccessUniformRead))
+    {
+        stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        vk_access |= VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    if (access & (AccessShaderStorageWrite | AccessImageWrite))
+    {
+        stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        vk_access |= VK_ACCESS_SHADER_WRITE_BIT;
+    }
+
+    if (access & AccessHostRead)
+    {
+        stages |= VK_PIPELINE_STAGE_HOST_BIT;
+        vk_access |= VK_ACCESS_HOST_READ_BIT;
+    }
+
+    if (access & AccessTextureRead)
+    {
+        stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        vk_access |= VK_ACCESS_TRANSFER_READ_BIT;
+    }
+}
+
+VulkanTexture::VulkanTexture(VulkanContext *context, unsigned width, unsigned height, Format format)
+    : context(context), width(width), height(height), format(format)
+{
+    VkImageCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    // FFT passes write packed FP16 data through R32Uint views, so usage is checked against the view formats.
+    info.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.format = convert(format);
+    info.extent = { width, height, 1 };
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    check(vkCreateImage(context->device, &info, nullptr, &image), "vkCreateImage");
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(context->device, image, &requirements);
+    memory = context->allocate_memory(requirements, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    check(vkBindImageMemory(context->device, image, memory, 0), "vkBindImageMemory");
+}
+
+VulkanTexture::~VulkanTexture()
+{
+    for (auto &view : views)
+    {
+        vkDestroyImageView(context->device, view.second, nullptr);
+    }
+    vkDestroyImage(context->device, image, nullptr);
+    vkFreeMemory(context->device, memory, nullptr);
+}
+
+VkImageView VulkanTexture::get_view(VkFormat view_format)
+{
+    for (auto &view : views)
+    {
+        if (view.first == view_format)
+        {
+            return view.second;
+        }
+    }
+
+    VkImageViewCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    info.image = image;
+    info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    info.format = view_format;
+    info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    VkImageView view;
+    check(vkCreateImageView(context->device, &info, nullptr, &view), "vkCreateImageView");
+    views.push_back({ view_format, view });
+    return view;
+}
+
+VulkanBuffer::VulkanBuffer(VulkanContext *context, const void *initial_data, size_t size, AccessMode access)
+    : context(context), size(size)
+{
+    VkBufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = size;
+    info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    check(vkCreateBuffer(context->device, &info, nullptr, &buffer), "vkCreateBuffer");
+
+    // Readback buffers live in host memory so they can be mapped directly,
+    // everything else goes to device local memory and is uploaded through a staging buffer.
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->device, buffer, &requirements);
+    VkMemoryPropertyFlags flags = 0;
+    if (access == AccessStreamRead)
+    {
+        memory = context->allocate_memory(requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &flags);
+    }
+    else
+    {
+        memory = context->allocate_memory(requirements, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &flags);
+    }
+    check(vkBindBufferMemory(context->device, buffer, memory, 0), "vkBindBufferMemory");
+
+    host_visible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    host_coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    if (!initial_data)
+    {
+        return;
+    }
+
+    if (host_visible)
+    {
+        void *ptr;
+        check(vkMapMemory(context->device, memory, 0, VK_WHOLE_SIZE, 0, &ptr), "vkMapMemory");
+        memcpy(ptr, initial_data, size);
+        if (!host_coherent)
+        {
+            VkMappedMemoryRange range = {};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = memory;
+            range.size = VK_WHOLE_SIZE;
+            vkFlushMappedMemoryRanges(context->device, 1, &range);
+        }
+        vkUnmapMemory(context->device, memory);
+    }
+    else
+    {
+        VulkanBuffer upload(context, initial_data, size, AccessStreamRead);
+        auto *cmd = context->begin_transfer();
+        VkBufferCopy region = { 0, 0, size };
+        vkCmdCopyBuffer(cmd->get(), upload.buffer, buffer, 1, &region);
+        context->end_transfer(cmd);
+    }
+}
+
+VulkanBuffer::~VulkanBuffer()
+{
+    // Buffers wrapping application buffers do not own any memory.
+    if (memory != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(context->device, buffer, nullptr);
+        vkFreeMemory(context->device, memory, nullptr);
+    }
+}
+
+VulkanProgram::VulkanProgram(VulkanContext *context, vector<uint32_t> spirv, VkPipeline pipeline)
+    : context(context), spirv(move(spirv)), pipeline(pipeline)
+{
+}
+
+VulkanProgram::~VulkanProgram()
+{
+    vkDestroyPipeline(context->device, pipeline, nullptr);
+}
+
+VulkanTimestampQuery::~VulkanTimestampQuery()
+{
+    vkDestroyQueryPool(context->device, pool, nullptr);
+}
+
+VulkanCommandBuffer::VulkanCommandBuffer(VulkanContext *context)
+    : context(context)
+{
+    VkCommandBufferAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    info.commandPool = context->command_pool;
+    info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    info.commandBufferCount = 1;
+    check(vkAllocateCommandBuffers(context->device, &info, &cmd), "vkAllocateCommandBuffers");
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    check(vkCreateFence(context->device, &fence_info, nullptr, &fence), "vkCreateFence");
+}
+
+VulkanCommandBuffer::~VulkanCommandBuffer()
+{
+    for (auto pool : descriptor_pools)
+    {
+        vkDestroyDescriptorPool(context->device, pool, nullptr);
+    }
+    vkDestroyFence(context->device, fence, nullptr);
+    vkFreeCommandBuffers(context->device, context->command_pool, 1, &cmd);
+}
+
+void VulkanCommandBuffer::begin()
+{
+    for (auto pool : descriptor_pools)
+    {
+        vkResetDescriptorPool(context->device, pool, 0);
+    }
+    current_pool = 0;
+
+    for (unsigned i = 0; i < MaxBindings; i++)
+    {
+        bound[i] = false;
+        samplers[i] = VK_NULL_HANDLE;
+    }
+    dirty = true;
+
+    VkCommandBufferBeginInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    check(vkBeginCommandBuffer(cmd, &info), "vkBeginCommandBuffer");
+}
+
+VkDescriptorSet VulkanCommandBuffer::allocate_descriptor_set()
+{
+    VkDescriptorSetAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    info.descriptorSetCount = 1;
+    info.pSetLayouts = &context->set_layout;
+
+    // Move on to the next pool once the current one runs out of sets.
+    VkDescriptorSet set;
+    for (; current_pool < descriptor_pools.size(); current_pool++)
+    {
+        info.descriptorPool = descriptor_pools[current_pool];
+        if (vkAllocateDescriptorSets(context->device, &info, &set) == VK_SUCCESS)
+        {
+            return set;
+        }
+    }
+
+    const VkDescriptorPoolSize sizes[] = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * SetsPerPool },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * SetsPerPool },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, SetsPerPool },
+    };
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = SetsPerPool;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes = sizes;
+
+    VkDescriptorPool pool;
+    check(vkCreateDescriptorPool(context->device, &pool_info, nullptr, &pool), "vkCreateDescriptorPool");
+    descriptor_pools.push_back(pool);
+
+    info.descriptorPool = pool;
+    check(vkAllocateDescriptorSets(context->device, &info, &set), "vkAllocateDescriptorSets");
+    return set;
+}
+
+void VulkanCommandBuffer::flush_descriptors()
+{
+    if (!dirty)
+    {
+        return;
+    }
+
+    VkDescriptorSet set = allocate_descriptor_set();
+    VkWriteDescriptorSet writes[MaxBindings];
+    uint32_t count = 0;
+
+    for (unsigned i = 0; i < MaxBindings; i++)
+    {
+        if (!bound[i])
+        {
+            continue;
+        }
+
+        auto &write = writes[count++];
+        write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = i;
+        write.descriptorCount = 1;
+        write.descriptorType = binding_types[i];
+
+        if (binding_types[i] == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+        {
+            write.pBufferInfo = &buffers[i];
+        }
+        else
+        {
+            if (binding_types[i] == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+            {
+                images[i].sampler = samplers[i] != VK_NULL_HANDLE ? samplers[i] : context->default_sampler;
+            }
+            write.pImageInfo = &images[i];
+        }
+    }
+
+    vkUpdateDescriptorSets(context->device, count, writes, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipeline_layout, 0, 1, &set, 0, nullptr);
+    dirty = false;
+}
+
+void VulkanCommandBuffer::bind_program(Program *program)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, static_cast<VulkanProgram*>(program)->pipeline);
+}
+
+void VulkanCommandBuffer::bind_storage_texture(unsigned binding, Texture *texture, Format format)
+{
+    if (binding >= MaxBindings || binding_types[binding] != VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+    {
+        throw logic_error("Invalid storage image binding.");
+    }
+
+    auto *tex = static_cast<VulkanTexture*>(texture);
+    images[binding] = { VK_NULL_HANDLE, tex->get_view(convert(format)), VK_IMAGE_LAYOUT_GENERAL };
+    bound[binding] = true;
+    dirty = true;
+}
+
+void VulkanCommandBuffer::bind_texture(unsigned binding, Texture *texture)
+{
+    if (binding >= MaxBindings || binding_types[binding] != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+    {
+        throw logic_error("Invalid texture binding.");
+    }
+
+    auto *tex = static_cast<VulkanTexture*>(texture);
+    images[binding] = { VK_NULL_HANDLE, tex->get_view(convert(tex->format)), VK_IMAGE_LAYOUT_GENERAL };
+    bound[binding] = true;
+    dirty = true;
+}
+
+void VulkanCommandBuffer::bind_sampler(unsigned binding, Sampler *sampler)
+{
+    if (binding >= MaxBindings)
+    {
+        throw logic_error("Invalid sampler binding.");
+    }
+
+    samplers[binding] = sampler ? static_cast<VulkanSampler*>(sampler)->sampler : VK_NULL_HANDLE;
+    dirty = true;
+}
+
+void VulkanCommandBuffer::bind_storage_buffer(unsigned binding, Buffer *buffer)
+{
+    bind_storage_buffer_range(binding, 0, VK_WHOLE_SIZE, buffer);
+}
+
+void VulkanCommandBuffer::bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *buffer)
+{
+    if (binding >= MaxBindings || binding_types[binding] != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+    {
+        throw logic_error("Invalid storage buffer binding.");
+    }
+
+    buffers[binding] = { static_cast<VulkanBuffer*>(buffer)->buffer, offset, length };
+    bound[binding] = true;
+    dirty = true;
+}
+
+void VulkanCommandBuffer::dispatch(unsigned x, unsigned y, unsigned z)
+{
+    flush_descriptors();
+    vkCmdDispatch(cmd, x, y, z);
+}
+
+void VulkanCommandBuffer::barrier(Buffer*)
+{
+    barrier(AccessShaderStorageWrite, AccessShaderStorageRead);
+}
+
+void VulkanCommandBuffer::barrier(Texture*)
+{
+    barrier(AccessImageWrite, AccessTextureFetch | AccessImageRead);
+}
+
+void VulkanCommandBuffer::barrier()
+{
+    barrier(AccessAll, AccessAll);
+}
+
+void VulkanCommandBuffer::barrier(AccessFlags src_access, AccessFlags dst_access)
+{
+    VkPipelineStageFlags src_stages, dst_stages;
+    VkMemoryBarrier memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    convert_access(src_access, src_stages, memory_barrier.srcAccessMask);
+    convert_access(dst_access, dst_stages, memory_barrier.dstAccessMask);
+
+    // Unlike GL, a write-after-read hazard still needs an execution dependency, so read-only sources are not skipped.
+    // Only writes have to be made available.
+    memory_barrier.srcAccessMask &= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT;
+    if (!src_stages)
+    {
+        src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    if (!dst_stages)
+    {
+        dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+
+    vkCmdPipelineBarrier(cmd, src_stages, dst_stages, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanCommandBuffer::push_constant_data(unsigned, const void *data, size_t size)
+{
+    // The constant data block is a push constant block in the Vulkan variant of the shaders.
+    if (size > MaxConstantDataSize)
+    {
+        throw logic_error("Constant data exceeds MaxConstantDataSize.");
+    }
+    vkCmdPushConstants(cmd, context->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, uint32_t(size), data);
+}
+
+void VulkanCommandBuffer::write_timestamp(TimestampQuery *query)
+{
+    auto *q = static_cast<VulkanTimestampQuery*>(query);
+    vkCmdResetQueryPool(cmd, q->pool, 0, 1);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, q->pool, 0);
+}
+
+VulkanContext::VulkanContext(VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family)
+    : gpu(gpu), device(device), queue(queue), queue_family(queue_family)
+{
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+
+    subgroup_properties = {};
+    subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroup_properties;
+    vkGetPhysicalDeviceProperties2(gpu, &properties2);
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, nullptr);
+    vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, families.data());
+    timestamps = queue_family < family_count &&
+        families[queue_family].timestampValidBits != 0 &&
+        properties.limits.timestampPeriod > 0.0f;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+    check(vkCreateCommandPool(device, &pool_info, nullptr, &command_pool), "vkCreateCommandPool");
+
+    VkDescriptorSetLayoutBinding bindings[VulkanCommandBuffer::MaxBindings];
+    uint32_t binding_count = 0;
+    for (unsigned i = 0; i < VulkanCommandBuffer::MaxBindings; i++)
+    {
+        if (binding_types[i] == VK_DESCRIPTOR_TYPE_MAX_ENUM)
+        {
+            continue;
+        }
+
+        auto &binding = bindings[binding_count++];
+        binding = {};
+        binding.binding = i;
+        binding.descriptorType = binding_types[i];
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.bindingCount = binding_count;
+    set_info.pBindings = bindings;
+    check(vkCreateDescriptorSetLayout(device, &set_info, nullptr, &set_layout), "vkCreateDescriptorSetLayout");
+
+    VkPushConstantRange range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, CommandBuffer::MaxConstantDataSize };
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &range;
+    check(vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout), "vkCreatePipelineLayout");
+
+    // Matches the GL backend, which samples with nearest filtering and clamps to edge.
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    check(vkCreateSampler(device, &sampler_info, nullptr, &default_sampler), "vkCreateSampler");
+
+    precise_trig = needs_precise_trig();
+}
+
+VulkanContext::~VulkanContext()
+{
+    teardown();
+}
+
+void VulkanContext::teardown()
+{
+    if (command_pool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    wait_idle();
+    command_buffers.clear();
+
+    vkDestroySampler(device, default_sampler, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    default_sampler = VK_NULL_HANDLE;
+    pipeline_layout = VK_NULL_HANDLE;
+    set_layout = VK_NULL_HANDLE;
+    command_pool = VK_NULL_HANDLE;
+}
+
+uint32_t VulkanContext::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+    for (auto flags : { required | preferred, required })
+    {
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+        {
+            if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                return i;
+            }
+        }
+    }
+    return UINT32_MAX;
+}
+
+VkDeviceMemory VulkanContext::allocate_memory(const VkMemoryRequirements &requirements,
+        VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags *flags)
+{
+    uint32_t type = find_memory_type(requirements.memoryTypeBits, required, preferred);
+    if (type == UINT32_MAX)
+    {
+        throw runtime_error("No suitable Vulkan memory type.");
+    }
+
+    VkMemoryAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = requirements.size;
+    info.memoryTypeIndex = type;
+
+    VkDeviceMemory memory;
+    check(vkAllocateMemory(device, &info, nullptr, &memory), "vkAllocateMemory");
+    if (flags)
+    {
+        *flags = memory_properties.memoryTypes[type].propertyFlags;
+    }
+    return memory;
+}
+
+VulkanCommandBuffer* VulkanContext::begin_transfer()
+{
+    auto *cmd = static_cast<VulkanCommandBuffer*>(request_command_buffer());
+    // Makes earlier shader and transfer writes visible to the copy.
+    cmd->barrier();
+    return cmd;
+}
+
+void VulkanContext::end_transfer(VulkanCommandBuffer *cmd)
+{
+    cmd->barrier();
+    submit_command_buffer(cmd);
+    wait_idle();
+}
+
+unique_ptr<Texture> VulkanContext::create_texture(const void *initial_data,
+        unsigned width, unsigned height,
+        Format format)
+{
+    unique_ptr<VulkanTexture> tex(new VulkanTexture(this, width, height, format));
+
+    // Upload through a host visible buffer.
+    unique_ptr<VulkanBuffer> upload;
+    if (initial_data)
+    {
+        upload.reset(new VulkanBuffer(this, initial_data, width * height * format_size(format), AccessStreamRead));
+    }
+
+    // Textures stay in the general layout, since FFT passes both sample and write them.
+    auto *cmd = begin_transfer();
+    VkImageMemoryBarrier transition = {};
+    transition.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    transition.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    transition.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    transition.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    transition.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    transition.image = tex->image;
+    transition.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier(cmd->get(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &transition);
+
+    if (upload)
+    {
+        VkBufferImageCopy region = {};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageExtent = { width, height, 1 };
+        vkCmdCopyBufferToImage(cmd->get(), upload->buffer, tex->image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+    }
+    end_transfer(cmd);
+
+    return unique_ptr<Texture>(move(tex));
+}
+
+unique_ptr<Buffer> VulkanContext::create_buffer(const void *initial_data, size_t size, AccessMode access)
+{
+    return unique_ptr<Buffer>(new VulkanBuffer(this, initial_data, size, access));
+}
+
+VkPipeline VulkanContext::create_pipeline(const vector<uint32_t> &spirv)
+{
+    VkShaderModuleCreateInfo module_info = {};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = spirv.size() * sizeof(uint32_t);
+    module_info.pCode = spirv.data();
+
+    VkShaderModule module;
+    if (vkCreateShaderModule(device, &module_info, nullptr, &module) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module = module;
+    info.stage.pName = "main";
+    info.layout = pipeline_layout;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        pipeline = VK_NULL_HANDLE;
+    }
+
+    vkDestroyShaderModule(device, module, nullptr);
+    return pipeline;
+}
+
+// Whether a module calls GLSL.std.450 Sin or Cos, i.e. was not compiled with FFT_PRECISE_TRIG.
+static bool uses_builtin_trig(const vector<uint32_t> &spirv)
+{
+    static const uint32_t OpExtInstImport = 11;
+    static const uint32_t OpExtInst = 12;
+    static const uint32_t GLSLstd450Sin = 13;
+    static const uint32_t GLSLstd450Cos = 14;
+
+    vector<uint32_t> glsl_sets;
+    for (size_t i = 5; i < spirv.size(); i += spirv[i] >> 16)
+    {
+        uint32_t op = spirv[i] & 0xffff;
+        uint32_t count = spirv[i] >> 16;
+        if (count == 0 || i + count > spirv.size())
+        {
+            // Malformed, let the driver decide what to make of it.
+            return false;
+        }
+
+        if (op == OpExtInstImport && count >= 3 &&
+                strncmp(reinterpret_cast<const char*>(&spirv[i + 2]), "GLSL.std.450", (count - 2) * sizeof(uint32_t)) == 0)
+        {
+            glsl_sets.push_back(spirv[i + 1]);
+        }
+        else if (op == OpExtInst && count >= 5 &&
+                find(begin(glsl_sets), end(glsl_sets), spirv[i + 3]) != end(glsl_sets) &&
+                (spirv[i + 4] == GLSLstd450Sin || spirv[i + 4] == GLSLstd450Cos))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Vulkan only requires sin() and cos() to be within 2^-11 of the exact result, and some implementations,
+// e.g. SwiftShader, are not much better than that, which is far too coarse for twiddle factors.
+// Evaluates angles like the FFT shaders do, and checks them against the host.
+bool VulkanContext::needs_precise_trig()
+{
+    const double pi = 3.14159265358979323846;
+    static const unsigned Samples = 4096;
+    static const char source[] =
+        "layout(local_size_x = 64) in;\n"
+        "layout(std430, binding = 0) writeonly buffer Probe { vec2 data[]; } probe;\n"
+        "void main()\n"
+        "{\n"
+        "    float angle = -3.14159265359 * float(gl_GlobalInvocationID.x) / 2048.0;\n"
+        "    probe.data[gl_GlobalInvocationID.x] = vec2(cos(angle), sin(angle));\n"
+        "}\n";
+
+    // If this fails, so will every FFT shader.
+    auto program = compile_compute_shader(source);
+    if (!program)
+    {
+        return false;
+    }
+
+    auto buffer = create_buffer(nullptr, 2 * Samples * sizeof(float), AccessStreamRead);
+    auto *cmd = request_command_buffer();
+    cmd->bind_program(program.get());
+    cmd->bind_storage_buffer(0, buffer.get());
+    cmd->dispatch(Samples / 64, 1, 1);
+    cmd->barrier(AccessShaderStorageWrite, AccessHostRead);
+    submit_command_buffer(cmd);
+
+    auto *data = static_cast<const float*>(map(buffer.get(), 0, 2 * Samples * sizeof(float)));
+    double max_error = 0.0;
+    for (unsigned i = 0; i < Samples; i++)
+    {
+        double angle = -pi * i / (Samples / 2);
+        max_error = max(max_error, fabs(data[2 * i + 0] - cos(angle)));
+        max_error = max(max_error, fabs(data[2 * i + 1] - sin(angle)));
+    }
+    unmap(buffer.get());
+
+    // Accurate implementations are only off by the rounding of the angle, a few times 1e-7.
+    return max_error > 1e-5;
+}
+
+unique_ptr<Program> VulkanContext::compile_compute_shader(const char *source)
+{
+    string str;
+    if (precise_trig)
+    {
+        str = "#define FFT_PRECISE_TRIG\n";
+        str += source;
+        source = str.c_str();
+    }
+
+    vector<uint32_t> spirv;
+    if (!compile_glsl_to_spirv(source, spirv))
+    {
+        log("Failed to compile shader to SPIR-V:\n%s\n", source);
+        return nullptr;
+    }
+
+    VkPipeline pipeline = create_pipeline(spirv);
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        return nullptr;
+    }
+    return unique_ptr<Program>(new VulkanProgram(this, move(spirv), pipeline));
+}
+
+bool VulkanContext::get_program_binary(Program *program, vector<uint8_t> &binary)
+{
+    auto &spirv = static_cast<VulkanProgram*>(program)->spirv;
+    binary.resize(spirv.size() * sizeof(uint32_t));
+    memcpy(binary.data(), spirv.data(), binary.size());
+    return true;
+}
+
+unique_ptr<Program> VulkanContext::load_program_binary(const void *binary, size_t size)
+{
+    static const uint32_t SpirvMagic = 0x07230203;
+
+    uint32_t magic;
+    if (size < sizeof(magic) || (size % sizeof(uint32_t)) != 0)
+    {
+        return nullptr;
+    }
+    memcpy(&magic, binary, sizeof(magic));
+    if (magic != SpirvMagic)
+    {
+        return nullptr;
+    }
+
+    vector<uint32_t> spirv(size / sizeof(uint32_t));
+    memcpy(spirv.data(), binary, size);
+
+    // Programs from a bundle are compiled without FFT_PRECISE_TRIG, compile those from source instead.
+    if (precise_trig && uses_builtin_trig(spirv))
+    {
+        return nullptr;
+    }
+
+    VkPipeline pipeline = create_pipeline(spirv);
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        return nullptr;
+    }
+    return unique_ptr<Program>(new VulkanProgram(this, move(spirv), pipeline));
+}
+
+CommandBuffer* VulkanContext::request_command_buffer()
+{
+    VulkanCommandBuffer *cmd = nullptr;
+    for (auto &buffer : command_buffers)
+    {
+        if (buffer->recording)
+        {
+            continue;
+        }
+
+        if (buffer->pending && vkGetFenceStatus(device, buffer->fence) == VK_SUCCESS)
+        {
+            vkResetFences(device, 1, &buffer->fence);
+            buffer->pending = false;
+        }
+
+        if (!buffer->pending)
+        {
+            cmd = buffer.get();
+            break;
+        }
+    }
+
+    if (!cmd)
+    {
+        command_buffers.emplace_back(new VulkanCommandBuffer(this));
+        cmd = command_buffers.back().get();
+    }
+
+    cmd->begin();
+    cmd->recording = true;
+    return cmd;
+}
+
+void VulkanContext::submit_command_buffer(CommandBuffer *cmd)
+{
+    auto *vk_cmd = static_cast<VulkanCommandBuffer*>(cmd);
+    check(vkEndCommandBuffer(vk_cmd->cmd), "vkEndCommandBuffer");
+
+    VkSubmitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.commandBufferCount = 1;
+    info.pCommandBuffers = &vk_cmd->cmd;
+    check(vkQueueSubmit(queue, 1, &info, vk_cmd->fence), "vkQueueSubmit");
+
+    vk_cmd->recording = false;
+    vk_cmd->pending = true;
+}
+
+void VulkanContext::wait_idle()
+{
+    for (auto &buffer : command_buffers)
+    {
+        if (buffer->pending)
+        {
+            vkWaitForFences(device, 1, &buffer->fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(device, 1, &buffer->fence);
+            buffer->pending = false;
+        }
+    }
+}
+
+const char* VulkanContext::get_renderer_string()
+{
+    return properties.deviceName;
+}
+
+void VulkanContext::log(const char *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+}
+
+double VulkanContext::get_time()
+{
+    auto now = chrono::steady_clock::now().time_since_epoch();
+    return chrono::duration_cast<chrono::duration<double>>(now).count();
+}
+
+unsigned VulkanContext::get_max_work_group_threads()
+{
+    return properties.limits.maxComputeWorkGroupInvocations;
+}
+
+bool VulkanContext::supports_subgroup_shuffle()
+{
+    return (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroup_properties.supportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_BIT);
+}
+
+unsigned VulkanContext::get_subgroup_size()
+{
+    return subgroup_properties.subgroupSize;
+}
+
+unsigned VulkanContext::get_max_work_group_size_z()
+{
+    return properties.limits.maxComputeWorkGroupSize[2];
+}
+
+const void* VulkanContext::map(Buffer *buffer, size_t offset, size_t size)
+{
+    auto *buf = static_cast<VulkanBuffer*>(buffer);
+
+    // Like glMapBufferRange, mapping waits for all work which could write the buffer.
+    wait_idle();
+
+    VulkanBuffer *source = buf;
+    if (!buf->host_visible)
+    {
+        buf->staging.reset(new VulkanBuffer(this, nullptr, size, AccessStreamRead));
+
+        auto *cmd = begin_transfer();
+        VkBufferCopy region = { offset, 0, size };
+        vkCmdCopyBuffer(cmd->get(), buf->buffer, buf->staging->buffer, 1, &region);
+        end_transfer(cmd);
+
+        source = buf->staging.get();
+        offset = 0;
+    }
+
+    void *ptr;
+    check(vkMapMemory(device, source->memory, 0, VK_WHOLE_SIZE, 0, &ptr), "vkMapMemory");
+    if (!source->host_coherent)
+    {
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = source->memory;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+    return static_cast<const uint8_t*>(ptr) + offset;
+}
+
+void VulkanContext::unmap(Buffer *buffer)
+{
+    auto *buf = static_cast<VulkanBuffer*>(buffer);
+    if (buf->staging)
+    {
+        vkUnmapMemory(device, buf->staging->memory);
+        buf->staging.reset();
+    }
+    else
+    {
+        vkUnmapMemory(device, buf->memory);
+    }
+}
+
+void VulkanContext::read_texture(void *buffer, Texture *texture, Format format)
+{
+    auto *tex = static_cast<VulkanTexture*>(texture);
+    size_t texels = size_t(tex->width) * tex->height;
+    unsigned components = format_components(tex->format);
+
+    bool convert_fp16 = format_is_fp16(tex->format) && !format_is_fp16(format) &&
+        format != FormatR32Uint && format_components(format) == components;
+    if (format != tex->format && !convert_fp16)
+    {
+        throw logic_error("Unsupported texture readback conversion.");
+    }
+
+    wait_idle();
+    VulkanBuffer readback(this, nullptr, texels * format_size(tex->format), AccessStreamRead);
+
+    auto *cmd = begin_transfer();
+    VkBufferImageCopy region = {};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { tex->width, tex->height, 1 };
+    vkCmdCopyImageToBuffer(cmd->get(), tex->image, VK_IMAGE_LAYOUT_GENERAL, readback.buffer, 1, &region);
+    end_transfer(cmd);
+
+    auto *data = static_cast<const uint8_t*>(map(&readback, 0, readback.size));
+    if (convert_fp16)
+    {
+        auto *src = reinterpret_cast<const uint16_t*>(data);
+        auto *dst = static_cast<float*>(buffer);
+        for (size_t i = 0; i < texels * components; i++)
+        {
+            dst[i] = fp16_to_fp32(src[i]);
+        }
+    }
+    else
+    {
+        memcpy(buffer, data, readback.size);
+    }
+    unmap(&readback);
+}
+
+unique_ptr<TimestampQuery> VulkanContext::create_timestamp_query()
+{
+    if (!timestamps)
+    {
+        return nullptr;
+    }
+
+    VkQueryPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = 1;
+
+    VkQueryPool pool;
+    if (vkCreateQueryPool(device, &info, nullptr, &pool) != VK_SUCCESS)
+    {
+        return nullptr;
+    }
+    return unique_ptr<TimestampQuery>(new VulkanTimestampQuery(this, pool));
+}
+
+double VulkanContext::get_timestamp(TimestampQuery *query)
+{
+    auto *q = static_cast<VulkanTimestampQuery*>(query);
+    uint64_t ticks = 0;
+    check(vkGetQueryPoolResults(device, q->pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT), "vkGetQueryPoolResults");
+    return double(ticks) * properties.limits.timestampPeriod * 1e-9;
+}
@@ -0,0 +1,266 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLFFT_VULKAN_INTERFACE_HPP__
+#define GLFFT_VULKAN_INTERFACE_HPP__
+
+#include "glfft_interface.hpp"
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// Vulkan implementation of the GLFFT interface.
+// Shaders are compiled to SPIR-V with glslang, constant data is uploaded as push constants,
+// and barriers are recorded as pipeline barriers.
+// VulkanContext does not create a device itself, so it can share the device of an application.
+
+namespace GLFFT
+{
+    class VulkanContext;
+
+    class VulkanTexture : public Texture
+    {
+        public:
+            friend class VulkanContext;
+            friend class VulkanCommandBuffer;
+            ~VulkanTexture();
+
+        private:
+            VulkanTexture(VulkanContext *context, unsigned width, unsigned height, Format format);
+
+            // Storage images are written through views of other, size compatible formats, e.g. R32Uint for R16G16Float.
+            VkImageView get_view(VkFormat format);
+
+            VulkanContext *context;
+            unsigned width, height;
+            Format format;
+            VkImage image = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            std::vector<std::pair<VkFormat, VkImageView>> views;
+    };
+
+    class VulkanSampler : public Sampler
+    {
+        public:
+            friend class VulkanCommandBuffer;
+
+            // Samplers are owned by the application.
+            VulkanSampler(VkSampler sampler) : sampler(sampler) {}
+
+        private:
+            VkSampler sampler;
+    };
+
+    class VulkanBuffer : public Buffer
+    {
+        public:
+            friend class VulkanContext;
+            friend class VulkanCommandBuffer;
+            ~VulkanBuffer();
+
+            // Wraps a buffer owned by the application.
+            VulkanBuffer(VkBuffer buffer, VkDeviceSize size) : buffer(buffer), size(size) {}
+
+        private:
+            VulkanBuffer(VulkanContext *context, const void *initial_data, size_t size, AccessMode access);
+
+            VulkanContext *context = nullptr;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size;
+            // Readback buffers are allocated from host visible memory and mapped directly.
+            bool host_visible = false;
+            bool host_coherent = false;
+            // Staging copy used to map buffers which are not host visible.
+            std::unique_ptr<VulkanBuffer> staging;
+    };
+
+    class VulkanProgram : public Program
+    {
+        public:
+            friend class VulkanContext;
+            friend class VulkanCommandBuffer;
+            ~VulkanProgram();
+
+        private:
+            VulkanProgram(VulkanContext *context, std::vector<uint32_t> spirv, VkPipeline pipeline);
+
+            VulkanContext *context;
+            // Kept around to serve as program binary.
+            std::vector<uint32_t> spirv;
+            VkPipeline pipeline;
+    };
+
+    class VulkanTimestampQuery : public TimestampQuery
+    {
+        public:
+            friend class VulkanContext;
+            friend class VulkanCommandBuffer;
+            ~VulkanTimestampQuery();
+
+        private:
+            VulkanTimestampQuery(VulkanContext *context, VkQueryPool pool) : context(context), pool(pool) {}
+
+            VulkanContext *context;
+            VkQueryPool pool;
+    };
+
+    class VulkanCommandBuffer : public CommandBuffer
+    {
+        public:
+            friend class VulkanContext;
+            ~VulkanCommandBuffer();
+
+            void bind_program(Program *program) override;
+            void bind_storage_texture(unsigned binding, Texture *texture, Format format) override;
+            void bind_texture(unsigned binding, Texture *texture) override;
+            void bind_sampler(unsigned binding, Sampler *sampler) override;
+            void bind_storage_buffer(unsigned binding, Buffer *texture) override;
+            void bind_storage_buffer_range(unsigned binding, size_t offset, size_t length, Buffer *texture) override;
+            void dispatch(unsigned x, unsigned y, unsigned z) override;
+
+            void barrier(Buffer *buffer) override;
+            void barrier(Texture *buffer) override;
+            void barrier() override;
+            void barrier(AccessFlags src_access, AccessFlags dst_access) override;
+
+            void push_constant_data(unsigned binding, const void *data, size_t size) override;
+            void write_timestamp(TimestampQuery *query) override;
+
+            VkCommandBuffer get() const { return cmd; }
+
+        private:
+            VulkanCommandBuffer(VulkanContext *context);
+            void begin();
+            void flush_descriptors();
+            VkDescriptorSet allocate_descriptor_set();
+
+            VulkanContext *context;
+            VkCommandBuffer cmd = VK_NULL_HANDLE;
+            // Signalled once the GPU is done with the command buffer, and it can be recorded again.
+            VkFence fence = VK_NULL_HANDLE;
+            bool recording = false;
+            bool pending = false;
+
+            // Descriptor sets are allocated from pools owned by the command buffer, which are reset along with it.
+            std::vector<VkDescriptorPool> descriptor_pools;
+            unsigned current_pool = 0;
+
+            // Bindings are only written to a descriptor set when the next dispatch needs them.
+            enum { MaxBindings = 8 };
+            VkDescriptorBufferInfo buffers[MaxBindings];
+            VkDescriptorImageInfo images[MaxBindings];
+            VkSampler samplers[MaxBindings];
+            bool bound[MaxBindings];
+            bool dirty = true;
+    };
+
+    class VulkanContext : public Context
+    {
+        public:
+            // The device must support Vulkan 1.1, and the queue must support compute.
+            // VulkanContext does not take ownership of any of the objects.
+            VulkanContext(VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family);
+            ~VulkanContext();
+
+            std::unique_ptr<Texture> create_texture(const void *initial_data,
+                    unsigned width, unsigned height,
+                    Format format) override;
+
+            std::unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) override;
+            std::unique_ptr<Program> compile_compute_shader(const char *source) override;
+
+            // glslang compiles in-process, so compilation is always done immediately.
+            std::unique_ptr<Program> begin_compile_compute_shader(const char *source) override { return compile_compute_shader(source); }
+            bool is_program_compiled(Program*) override { return true; }
+            bool end_compile_compute_shader(Program*) override { return true; }
+
+            // The binary is the SPIR-V module, which skips glslang when loaded.
+            bool get_program_binary(Program *program, std::vector<uint8_t> &binary) override;
+            std::unique_ptr<Program> load_program_binary(const void *binary, size_t size) override;
+
+            CommandBuffer* request_command_buffer() override;
+            void submit_command_buffer(CommandBuffer *cmd) override;
+            void wait_idle() override;
+
+            const char* get_renderer_string() override;
+            void log(const char *fmt, ...) override;
+            double get_time() override;
+
+            unsigned get_max_work_group_threads() override;
+            unsigned get_max_work_group_size_z() override;
+
+            // From VkPhysicalDeviceSubgroupProperties. Pipelines do not vary the subgroup size,
+            // so every shader sees the default size reported there.
+            bool supports_subgroup_shuffle() override;
+            unsigned get_subgroup_size() override;
+
+            const void* map(Buffer *buffer, size_t offset, size_t size) override;
+            void unmap(Buffer *buffer) override;
+
+            bool supports_texture_readback() override { return true; }
+            void read_texture(void *buffer, Texture *texture, Format format) override;
+
+            std::unique_ptr<TimestampQuery> create_timestamp_query() override;
+            double get_timestamp(TimestampQuery *query) override;
+
+            VkDevice get_device() const { return device; }
+
+        protected:
+            // Destroys all objects owned by the context, must be called before the device is destroyed.
+            void teardown();
+
+        private:
+            friend class VulkanTexture;
+            friend class VulkanBuffer;
+            friend class VulkanProgram;
+            friend class VulkanTimestampQuery;
+            friend class VulkanCommandBuffer;
+
+            VkPhysicalDevice gpu;
+            VkDevice device;
+            VkQueue queue;
+            uint32_t queue_family;
+            VkPhysicalDeviceProperties properties;
+            VkPhysicalDeviceMemoryProperties memory_properties;
+            VkPhysicalDeviceSubgroupProperties subgroup_properties;
+            bool timestamps = false;
+            // Whether shaders are compiled with FFT_PRECISE_TRIG, see needs_precise_trig().
+            bool precise_trig = false;
+
+            VkCommandPool command_pool = VK_NULL_HANDLE;
+            VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+            VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+            VkSampler default_sampler = VK_NULL_HANDLE;
+            std::vector<std::unique_ptr<VulkanCommandBuffer>> command_buffers;
+
+            uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred);
+            VkDeviceMemory allocate_memory(const VkMemoryRequirements &requirements,
+                    VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags *flags = nullptr);
+            VkPipeline create_pipeline(const std::vector<uint32_t> &spirv);
+            bool needs_precise_trig();
+
+            // Records commands into a one-off command buffer and waits for them to complete,
+            // used for uploads and readbacks.
+            VulkanCommandBuffer* begin_transfer();
+            void end_transfer(VulkanCommandBuffer *cmd);
+    };
+}
+
+#endif
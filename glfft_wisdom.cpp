@@ -20,6 +20,7 @@
 #include "glfft_interface.hpp"
 #include "glfft.hpp"
 #include <utility>
+#include <stdexcept>
 
 #ifdef GLFFT_SERIALIZATION
 #include "rapidjson/include/rapidjson/reader.h"
@@ -80,6 +81,14 @@ FFTStaticWisdom FFTWisdom::get_static_wisdom_from_renderer(Context *context)
     return res;
 }
 
+// Packed half-spectra only change how real transforms address the spectrum,
+// so they share wisdom with the regular layout.
+static FFTOptions::Type wisdom_type(FFTOptions::Type type)
+{
+    type.packed_spectrum = false;
+    return type;
+}
+
 pair<double, FFTOptions::Performance> FFTWisdom::learn_optimal_options(
         Context *context, unsigned Nx, unsigned Ny, unsigned radix,
         Mode mode, Target input_target, Target output_target,
@@ -88,7 +97,7 @@ pair<double, FFTOptions::Performance> FFTWisdom::learn_optimal_options(
     WisdomPass pass = {
         {
             Nx, Ny, radix, mode, input_target, output_target,
-            type,
+            wisdom_type(type),
         },
         0.0,
     };
@@ -117,7 +126,8 @@ void FFTWisdom::learn_optimal_options_exhaustive(Context *context,
     Mode horizontal_mode = type == ComplexToComplexDual ? HorizontalDual : Horizontal;
 
     // Create wisdom for horizontal transforms and vertical transform.
-    static const unsigned radices[] = { 4, 8, 16, 64 };
+    // Radices which do not divide the transform will throw and be ignored.
+    static const unsigned radices[] = { 3, 4, 5, 7, 8, 16, 64, 256, 512, 1024, 2048, 4096 };
     for (auto radix : radices)
     {
         try
@@ -222,6 +232,7 @@ static inline unsigned mode_to_size(Mode mode)
     {
         case VerticalDual:
         case HorizontalDual:
+        case DepthDual:
         case ResolveRealToComplex:
         case ResolveComplexToReal:
             return 4;
@@ -234,6 +245,7 @@ static inline unsigned mode_to_size(Mode mode)
 std::pair<double, FFTOptions::Performance> FFTWisdom::study(Context *context, const WisdomPass &pass, FFTOptions::Type type) const
 {
     auto cache = make_shared<ProgramCache>();
+    cache->set_binary_cache(binary_cache);
 
     unique_ptr<Resource> output;
     unique_ptr<Resource> input;
@@ -315,6 +327,8 @@ std::pair<double, FFTOptions::Performance> FFTWisdom::study(Context *context, co
     double minimum_cost = bench(context, output.get(), input.get(), pass, { best_perf, type }, cache);
 
     static const FFTStaticWisdom::Tristate shared_banked_values[] = { FFTStaticWisdom::False, FFTStaticWisdom::True };
+    static const FFTStaticWisdom::Tristate twiddle_lut_values[] = { FFTStaticWisdom::False, FFTStaticWisdom::True };
+    static const FFTStaticWisdom::Tristate subgroup_shuffle_values[] = { FFTStaticWisdom::False, FFTStaticWisdom::True };
     static const unsigned vector_size_values[] = { 2, 4, 8 };
     static const unsigned workgroup_size_x_values[] = { 4, 8, 16, 32, 64, 128, 256 };
     static const unsigned workgroup_size_y_values[] = { 1, 2, 4, 8, };
@@ -323,117 +337,173 @@ std::pair<double, FFTOptions::Performance> FFTWisdom::study(Context *context, co
     bool test_dual = pass.pass.mode == VerticalDual || pass.pass.mode == HorizontalDual;
     unsigned bench_count = 0;
 
-    for (auto shared_banked : shared_banked_values)
+    // Shuffles only replace the shared memory exchange of radix-16 and radix-64 passes.
+    bool test_subgroup = pass.pass.radix == 16 || pass.pass.radix == 64;
+    unsigned subgroup_size = context->supports_subgroup_shuffle() ? context->get_subgroup_size() : 0;
+
+    for (auto subgroup_shuffle : subgroup_shuffle_values)
     {
-        // Useless test, since shared banked is only relevant for radix 16/64.
-        if (pass.pass.radix < 16 && shared_banked)
+        if (subgroup_shuffle && (!test_subgroup || !subgroup_size))
         {
             continue;
         }
 
-        bool fair_shared_banked = (pass.pass.radix < 16) ||
-                                  (static_wisdom.shared_banked == FFTStaticWisdom::DontCare) ||
-                                  (shared_banked == static_wisdom.shared_banked);
+        bool fair_subgroup_shuffle = !test_subgroup ||
+                                     (static_wisdom.subgroup_shuffle == FFTStaticWisdom::DontCare) ||
+                                     (subgroup_shuffle == static_wisdom.subgroup_shuffle);
 
-        if (!fair_shared_banked)
+        if (!fair_subgroup_shuffle)
         {
             continue;
         }
 
-        for (auto vector_size : vector_size_values)
+        for (auto twiddle_lut : twiddle_lut_values)
         {
-            // Resolve passes currently only support vector size 2. Shared banked makes no sense either.
-            if (test_resolve && (vector_size != 2 || shared_banked))
-            {
-                continue;
-            }
+            bool fair_twiddle_lut = (static_wisdom.twiddle_lut == FFTStaticWisdom::DontCare) ||
+                                    (twiddle_lut == static_wisdom.twiddle_lut);
 
-            // We can only use vector_size 8 with FP16.
-            if (vector_size == 8 && (!type.fp16 || !type.input_fp16 || !type.output_fp16))
+            if (!fair_twiddle_lut)
             {
                 continue;
             }
 
-            // Makes little sense to test since since vector_size will be bumped to 4 anyways.
-            if (test_dual && vector_size < 4)
+            for (auto shared_banked : shared_banked_values)
             {
-                continue;
-            }
-
-            for (auto workgroup_size_x : workgroup_size_x_values)
-            {
-                for (auto workgroup_size_y : workgroup_size_y_values)
+                // Useless test, since shared banked is only relevant for radix 16/64,
+                // and shuffles do not use shared memory.
+                if ((pass.pass.radix < 16 || subgroup_shuffle) && shared_banked)
                 {
-                    unsigned workgroup_size  = workgroup_size_x * workgroup_size_y;
+                    continue;
+                }
 
-                    unsigned min_workgroup_size = pass.pass.radix >= 16 ? static_wisdom.min_workgroup_size_shared :
-                                                                          static_wisdom.min_workgroup_size;
+                bool fair_shared_banked = (pass.pass.radix < 16) || subgroup_shuffle ||
+                                          (static_wisdom.shared_banked == FFTStaticWisdom::DontCare) ||
+                                          (shared_banked == static_wisdom.shared_banked);
 
-                    unsigned min_vector_size = test_dual ? max(4u, static_wisdom.min_vector_size) : static_wisdom.min_vector_size;
-                    unsigned max_vector_size = test_dual ? max(4u, static_wisdom.max_vector_size) : static_wisdom.max_vector_size;
+                if (!fair_shared_banked)
+                {
+                    continue;
+                }
 
-                    bool fair_workgroup_size = workgroup_size <= static_wisdom.max_workgroup_size &&
-                                               workgroup_size >= min_workgroup_size;
-                    if (pass.pass.Ny == 1 && workgroup_size_y > 1)
+                for (auto vector_size : vector_size_values)
+                {
+                    // Resolve passes currently only support vector size 2. Shared banked makes no sense either.
+                    if (test_resolve && (vector_size != 2 || shared_banked))
                     {
-                        fair_workgroup_size = false;
+                        continue;
                     }
 
-                    if (!fair_workgroup_size)
+                    // We can only use vector_size 8 with FP16.
+                    if (vector_size == 8 && (!type.fp16 || !type.input_fp16 || !type.output_fp16))
                     {
                         continue;
                     }
 
-                    // If we have dual mode, accept vector sizes larger than max.
-                    bool fair_vector_size = test_resolve || (vector_size <= max_vector_size &&
-                                                             vector_size >= min_vector_size);
+                    // Makes little sense to test since since vector_size will be bumped to 4 anyways.
+                    if (test_dual && vector_size < 4)
+                    {
+                        continue;
+                    }
 
-                    if (!fair_vector_size)
+                    // Odd radices always transform a single complex value per thread horizontally.
+                    bool test_horizontal = pass.pass.mode == Horizontal || pass.pass.mode == HorizontalDual;
+                    if ((pass.pass.radix & 1) && test_horizontal && vector_size > (test_dual ? 4u : 2u))
                     {
                         continue;
                     }
 
-                    FFTOptions::Performance perf;
-                    perf.shared_banked = shared_banked;
-                    perf.vector_size = vector_size;
-                    perf.workgroup_size_x = workgroup_size_x;
-                    perf.workgroup_size_y = workgroup_size_y;
+                    // Whole-row radices always transform a single complex value per thread.
+                    if (pass.pass.radix > 64 && vector_size > 2)
+                    {
+                        continue;
+                    }
 
-                    try
+                    for (auto workgroup_size_x : workgroup_size_x_values)
                     {
-                        // If workgroup sizes are too big for our test, this will throw.
-                        double cost = bench(context, output.get(), input.get(), pass, { perf, type }, cache);
-                        bench_count++;
+                        for (auto workgroup_size_y : workgroup_size_y_values)
+                        {
+                            unsigned workgroup_size  = workgroup_size_x * workgroup_size_y;
+
+                            unsigned min_workgroup_size = pass.pass.radix >= 16 ? static_wisdom.min_workgroup_size_shared :
+                                                                                  static_wisdom.min_workgroup_size;
+
+                            unsigned min_vector_size = test_dual ? max(4u, static_wisdom.min_vector_size) : static_wisdom.min_vector_size;
+                            unsigned max_vector_size = test_dual ? max(4u, static_wisdom.max_vector_size) : static_wisdom.max_vector_size;
+
+                            bool fair_workgroup_size = workgroup_size <= static_wisdom.max_workgroup_size &&
+                                                       workgroup_size >= min_workgroup_size;
+                            if (pass.pass.Ny == 1 && workgroup_size_y > 1)
+                            {
+                                fair_workgroup_size = false;
+                            }
+
+                            // Passes fall back to shared memory if the work group does not fit in a subgroup.
+                            if (subgroup_shuffle && workgroup_size > subgroup_size)
+                            {
+                                fair_workgroup_size = false;
+                            }
+
+                            if (!fair_workgroup_size)
+                            {
+                                continue;
+                            }
+
+                            // If we have dual mode, accept vector sizes larger than max.
+                            bool fair_vector_size = test_resolve || (vector_size <= max_vector_size &&
+                                                                     vector_size >= min_vector_size);
+
+                            if (!fair_vector_size)
+                            {
+                                continue;
+                            }
+
+                            FFTOptions::Performance perf;
+                            perf.shared_banked = shared_banked;
+                            perf.twiddle_lut = twiddle_lut;
+                            perf.subgroup_shuffle = subgroup_shuffle;
+                            perf.vector_size = vector_size;
+                            perf.workgroup_size_x = workgroup_size_x;
+                            perf.workgroup_size_y = workgroup_size_y;
+
+                            try
+                            {
+                                // If workgroup sizes are too big for our test, this will throw.
+                                double cost = bench(context, output.get(), input.get(), pass, { perf, type }, cache);
+                                bench_count++;
 
 #if 1
-                        context->log("\nWisdom run (mode = %u, radix = %u):\n", pass.pass.mode, pass.pass.radix);
-                        context->log("  Width:            %4u\n", pass.pass.Nx);
-                        context->log("  Height:           %4u\n", pass.pass.Ny);
-                        context->log("  Shared banked:     %3s\n", shared_banked ? "yes" : "no");
-                        context->log("  Vector size:         %u\n", vector_size);
-                        context->log("  Workgroup size: (%u, %u)\n", workgroup_size_x, workgroup_size_y);
-                        context->log("  Cost:         %8.3g\n", cost);
+                                context->log("\nWisdom run (mode = %u, radix = %u):\n", pass.pass.mode, pass.pass.radix);
+                                context->log("  Width:            %4u\n", pass.pass.Nx);
+                                context->log("  Height:           %4u\n", pass.pass.Ny);
+                                context->log("  Shared banked:     %3s\n", shared_banked ? "yes" : "no");
+                                context->log("  Twiddle LUT:       %3s\n", twiddle_lut ? "yes" : "no");
+                                context->log("  Subgroup shuffle:  %3s\n", subgroup_shuffle ? "yes" : "no");
+                                context->log("  Vector size:         %u\n", vector_size);
+                                context->log("  Workgroup size: (%u, %u)\n", workgroup_size_x, workgroup_size_y);
+                                context->log("  Cost:         %8.3g\n", cost);
 #endif
 
-                        if (cost < minimum_cost)
-                        {
+                                if (cost < minimum_cost)
+                                {
 #if 1
-                            context->log("  New optimal solution! (%g -> %g)\n", minimum_cost, cost);
+                                    context->log("  New optimal solution! (%g -> %g)\n", minimum_cost, cost);
 #endif
-                            best_perf = perf;
-                            minimum_cost = cost;
-                        }
-                    }
+                                    best_perf = perf;
+                                    minimum_cost = cost;
+                                }
+                            }
 #ifdef GLFFT_CLI_ASYNC
-                    catch (const AsyncCancellation &)
-                    {
-                        throw;
-                    }
+                            catch (const AsyncCancellation &)
+                            {
+                                throw;
+                            }
 #endif
-                    catch (...)
-                    {
-                        // If we pass in bogus parameters,
-                        // FFT will throw and we just ignore this.
+                            catch (...)
+                            {
+                                // If we pass in bogus parameters,
+                                // FFT will throw and we just ignore this.
+                            }
+                        }
                     }
                 }
             }
@@ -450,7 +520,7 @@ const pair<const WisdomPass, FFTOptions::Performance>* FFTWisdom::find_optimal_o
     WisdomPass pass = {
         {
             Nx, Ny, radix, mode, input_target, output_target,
-            type,
+            wisdom_type(type),
         },
         0.0,
     };
@@ -465,7 +535,7 @@ const FFTOptions::Performance& FFTWisdom::find_optimal_options_or_default(unsign
     WisdomPass pass = {
         {
             Nx, Ny, radix, mode, input_target, output_target,
-            base_options.type,
+            wisdom_type(base_options.type),
         },
         0.0,
     };
@@ -530,6 +600,10 @@ std::string FFTWisdom::archive() const
         writer.StartObject();
         writer.String("shared_banked");
         writer.Bool(entry.second.shared_banked);
+        writer.String("twiddle_lut");
+        writer.Bool(entry.second.twiddle_lut);
+        writer.String("subgroup_shuffle");
+        writer.Bool(entry.second.subgroup_shuffle);
         writer.String("vector_size");
         writer.Uint(entry.second.vector_size);
         writer.String("workgroup_size_x");
@@ -585,6 +659,9 @@ void FFTWisdom::extract(const char *json)
 
         auto &performance = v["performance"];
         perf.shared_banked = performance["shared_banked"].GetBool();
+        // Wisdom archived before twiddle LUTs existed computes twiddles in the shader.
+        perf.twiddle_lut = performance.HasMember("twiddle_lut") && performance["twiddle_lut"].GetBool();
+        perf.subgroup_shuffle = performance.HasMember("subgroup_shuffle") && performance["subgroup_shuffle"].GetBool();
         perf.vector_size = performance["vector_size"].GetUint();
         perf.workgroup_size_x = performance["workgroup_size_x"].GetUint();
         perf.workgroup_size_y = performance["workgroup_size_y"].GetUint();
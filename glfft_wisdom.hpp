@@ -85,6 +85,8 @@ struct FFTStaticWisdom
     unsigned min_vector_size = 2;
     unsigned max_vector_size = 4;
     Tristate shared_banked = DontCare;
+    Tristate twiddle_lut = DontCare;
+    Tristate subgroup_shuffle = DontCare;
 };
 
 class FFTWisdom
@@ -116,6 +118,12 @@ class FFTWisdom
             params.timeout = timeout;
         }
 
+        // Studying compiles many program variants, which can be loaded from disk instead on later runs.
+        void set_program_binary_cache(std::shared_ptr<ProgramBinaryCache> binary_cache)
+        {
+            this->binary_cache = std::move(binary_cache);
+        }
+
 #ifdef GLFFT_SERIALIZATION
         // Serialization interface.
         std::string archive() const;
@@ -133,6 +141,7 @@ class FFTWisdom
                 const std::shared_ptr<ProgramCache> &cache) const;
 
         FFTStaticWisdom static_wisdom;
+        std::shared_ptr<ProgramBinaryCache> binary_cache;
 
         struct
         {
@@ -13,9 +13,9 @@ include $(BUILD_STATIC_LIBRARY)
 
 include $(CLEAR_VARS)
 
-LOCAL_CFLAGS += -std=c++11 -Wall -Wextra -DGLFFT_CLI_ASYNC
+LOCAL_CFLAGS += -std=c++11 -Wall -Wextra -DGLFFT_CLI_ASYNC -DGLFFT_CLI_GL
 LOCAL_MODULE := GLFFT
-LOCAL_SRC_FILES := $(addprefix ../,$(wildcard *.cpp) test/android/jni.cpp test/glfft_cli.cpp test/glfft_test.cpp)
+LOCAL_SRC_FILES := $(addprefix ../,$(filter-out glfft_vulkan_interface.cpp glfft_spirv.cpp,$(wildcard *.cpp)) test/android/jni.cpp test/glfft_cli.cpp test/glfft_test.cpp)
 LOCAL_CPP_FEATURES := exceptions
 LOCAL_ARM_MODE := arm
 LOCAL_LDLIBS := -lGLESv3 -llog -lEGL -lm
@@ -0,0 +1,197 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_gl_interface.hpp"
+#include "glfft_context.hpp"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdlib>
+#include <cstring>
+
+using namespace GLFFT;
+using namespace std;
+
+// Headless context for build and benchmark machines without a window system.
+// The Mesa surfaceless platform is used if available, otherwise the first EGL device.
+// GLFFT_EGL_DEVICE selects another device by index, e.g. on machines with several GPUs.
+
+#ifdef GLFFT_GL_DEBUG
+static void APIENTRY gl_debug_cb(GLenum, GLenum, GLuint, GLenum, GLsizei,
+        const GLchar *message, void*)
+{
+    glfft_log("GLDEBUG: %s.\n", message);
+}
+#endif
+
+struct EGLContextHeadless : GLContext
+{
+    ~EGLContextHeadless()
+    {
+        if (context != EGL_NO_CONTEXT)
+        {
+            teardown();
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglTerminate(display);
+        }
+    }
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool supports_texture_readback() override { return true; }
+    void read_texture(void *buffer, Texture *texture, Format format) override
+    {
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLTexture*>(texture)->get());
+        glGetTexImage(GL_TEXTURE_2D, 0, convert_format(format), convert_type(format), buffer);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+static bool has_egl_extension(EGLDisplay display, const char *name)
+{
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions)
+    {
+        return false;
+    }
+
+    size_t len = strlen(name);
+    for (const char *ext = strstr(extensions, name); ext; ext = strstr(ext + len, name))
+    {
+        if ((ext == extensions || ext[-1] == ' ') && (ext[len] == ' ' || ext[len] == '\0'))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static EGLDisplay get_device_display(PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display, unsigned index)
+{
+    auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+    if (!query_devices || !has_egl_extension(EGL_NO_DISPLAY, "EGL_EXT_platform_device"))
+    {
+        return EGL_NO_DISPLAY;
+    }
+
+    EGLDeviceEXT devices[16];
+    EGLint count = 0;
+    if (!query_devices(16, devices, &count) || index >= unsigned(count))
+    {
+        return EGL_NO_DISPLAY;
+    }
+
+    return get_platform_display(EGL_PLATFORM_DEVICE_EXT, devices[index], nullptr);
+}
+
+static EGLDisplay get_display()
+{
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!get_platform_display)
+    {
+        return EGL_NO_DISPLAY;
+    }
+
+    if (const char *device = getenv("GLFFT_EGL_DEVICE"))
+    {
+        return get_device_display(get_platform_display, unsigned(strtoul(device, nullptr, 0)));
+    }
+
+    if (has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+    {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY)
+        {
+            return display;
+        }
+    }
+
+    return get_device_display(get_platform_display, 0);
+}
+
+unique_ptr<Context> GLFFT::create_cli_context()
+{
+    unique_ptr<EGLContextHeadless> context(new EGLContextHeadless);
+
+    context->display = get_display();
+    if (context->display == EGL_NO_DISPLAY)
+    {
+        glfft_log("Found no headless EGL display.\n");
+        return nullptr;
+    }
+
+    if (!eglInitialize(context->display, nullptr, nullptr))
+    {
+        context->display = EGL_NO_DISPLAY;
+        return nullptr;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API) || !has_egl_extension(context->display, "EGL_KHR_surfaceless_context"))
+    {
+        return nullptr;
+    }
+
+    // Without a surface, a config is only needed if EGL cannot create contexts without one.
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!has_egl_extension(context->display, "EGL_KHR_no_config_context"))
+    {
+        static const EGLint config_attribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_SURFACE_TYPE, EGL_DONT_CARE,
+            EGL_NONE,
+        };
+        EGLint count = 0;
+        if (!eglChooseConfig(context->display, config_attribs, &config, 1, &count) || count == 0)
+        {
+            return nullptr;
+        }
+    }
+
+    static const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE,
+    };
+    context->context = eglCreateContext(context->display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context->context == EGL_NO_CONTEXT)
+    {
+        return nullptr;
+    }
+
+    if (!eglMakeCurrent(context->display, EGL_NO_SURFACE, EGL_NO_SURFACE, context->context))
+    {
+        return nullptr;
+    }
+
+    rglgen_resolve_symbols(reinterpret_cast<rglgen_proc_address_t>(eglGetProcAddress));
+
+#ifdef GLFFT_GL_DEBUG
+    glDebugMessageCallback(gl_debug_cb, nullptr);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+
+    return unique_ptr<Context>(move(context));
+}
@@ -19,7 +19,13 @@
 #include "glfft_cli.hpp"
 #include "glfft_context.hpp"
 #include "glfft.hpp"
+#include "glfft_spirv.hpp"
+#include "glfft_recording_interface.hpp"
+#include <algorithm>
 #include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iterator>
 #include <stdexcept>
 #include <functional>
 #include <limits>
@@ -140,6 +146,7 @@ struct BenchArguments
 {
     unsigned width = 0;
     unsigned height = 0;
+    unsigned depth = 1;
     unsigned warmup = 2;
     unsigned iterations = 20;
     unsigned dispatches = 50;
@@ -150,12 +157,14 @@ struct BenchArguments
     bool fp16 = false;
     bool input_texture = false;
     bool output_texture = false;
+    const char *program_cache = nullptr;
+    const char *program_bundle = nullptr;
 };
 
 // Rough estimate based on a canonical FFT implementation.
-static double get_estimated_flops(unsigned width, unsigned height, Type type)
+static double get_estimated_flops(unsigned width, unsigned height, unsigned depth, Type type)
 {
-    double flops = width * height * (log2(float(width)) + log2(float(height))) * 5.0;
+    double flops = double(width) * height * depth * (log2(float(width)) + log2(float(height)) + log2(float(depth))) * 5.0;
 
     switch (type)
     {
@@ -175,9 +184,9 @@ static double get_estimated_flops(unsigned width, unsigned height, Type type)
     return flops;
 }
 
-static double get_estimated_bw_per_pass(unsigned width, unsigned height, Type type, bool fp16)
+static double get_estimated_bw_per_pass(unsigned width, unsigned height, unsigned depth, Type type, bool fp16)
 {
-    double bw = width * height * 4.0 * sizeof(float); // BW for reading the buffer and writing it back.
+    double bw = double(width) * height * depth * 4.0 * sizeof(float); // BW for reading the buffer and writing it back.
 
     switch (type)
     {
@@ -202,22 +211,15 @@ static double get_estimated_bw_per_pass(unsigned width, unsigned height, Type ty
     return bw;
 }
 
-static void run_benchmark(Context *context, const BenchArguments &args)
+// Input and output of a plan, with placeholder contents.
+static void create_bench_resources(Context *context, const BenchArguments &args,
+        unique_ptr<Resource> &input, unique_ptr<Resource> &output,
+        Target &input_target, Target &output_target)
 {
-    auto cache = make_shared<ProgramCache>();
-
-    FFTOptions options;
-    options.type.input_fp16 = args.fp16;
-    options.type.output_fp16 = args.fp16;
-    options.type.fp16 = args.fp16;
-
-    unique_ptr<Resource> output;
-    unique_ptr<Resource> input;
-
-    Target input_target = SSBO;
-    Target output_target = SSBO;
+    input_target = SSBO;
+    output_target = SSBO;
 
-    size_t buffer_size = sizeof(float) * (args.fp16 ? 1 : 2) * args.size_for_type * args.width * args.height;
+    size_t buffer_size = sizeof(float) * (args.fp16 ? 1 : 2) * args.size_for_type * args.width * args.height * args.depth;
 
     if (args.input_texture)
     {
@@ -279,20 +281,55 @@ static void run_benchmark(Context *context, const BenchArguments &args)
     {
         output = context->create_buffer(nullptr, buffer_size, AccessStreamCopy);
     }
+}
+
+static void run_benchmark(Context *context, const BenchArguments &args)
+{
+    auto cache = make_shared<ProgramCache>();
+    shared_ptr<ProgramBinaryCache> binary_cache;
+    if (args.program_cache)
+    {
+        binary_cache = make_shared<ProgramBinaryCache>(args.program_cache);
+        cache->set_binary_cache(binary_cache);
+    }
+
+    if (args.program_bundle)
+    {
+        auto bundle = make_shared<ProgramBundle>();
+        if (!bundle->load(args.program_bundle))
+        {
+            throw runtime_error("Failed to load program bundle.\n");
+        }
+        cache->set_program_bundle(bundle);
+    }
+
+    FFTOptions options;
+    options.type.input_fp16 = args.fp16;
+    options.type.output_fp16 = args.fp16;
+    options.type.fp16 = args.fp16;
+
+    unique_ptr<Resource> output;
+    unique_ptr<Resource> input;
+    Target input_target, output_target;
+    create_bench_resources(context, args, input, output, input_target, output_target);
 
     FFTWisdom wisdom;
     wisdom.set_static_wisdom(FFTWisdom::get_static_wisdom_from_renderer(context));
     wisdom.set_bench_params(args.warmup, args.iterations, args.dispatches, args.timeout);
+    wisdom.set_program_binary_cache(binary_cache);
     wisdom.learn_optimal_options_exhaustive(context, args.width, args.height, args.type, input_target, output_target, options.type);
 
-    FFT fft(context, args.width, args.height, args.type, args.type == ComplexToReal ? Inverse : Forward, input_target, output_target, cache, options, wisdom);
+    double plan_start = context->get_time();
+    FFT fft(context, args.width, args.height, args.depth, args.type, args.type == ComplexToReal ? Inverse : Forward, input_target, output_target, cache, options, wisdom);
+    double plan_time = context->get_time() - plan_start;
 
-    double estimated_gflops = 1e-9 * get_estimated_flops(args.width, args.height, args.type);
-    double estimated_bandwidth_gb = 1e-9 * fft.get_num_passes() * get_estimated_bw_per_pass(args.width, args.height, args.type, args.fp16);
+    double estimated_gflops = 1e-9 * get_estimated_flops(args.width, args.height, args.depth, args.type);
+    double estimated_bandwidth_gb = 1e-9 * fft.get_num_passes() * get_estimated_bw_per_pass(args.width, args.height, args.depth, args.type, args.fp16);
 
     context->log("Test:\n");
     context->log("  %s -> %s\n", input_target == SSBO ? "SSBO" : "Texture", output_target == SSBO ? "SSBO" : "Image");
-    context->log("  Size: %u x %u %s %s\n", args.width, args.height, args.string_for_type, args.fp16 ? "FP16" : "FP32");
+    context->log("  Size: %u x %u x %u %s %s\n", args.width, args.height, args.depth, args.string_for_type, args.fp16 ? "FP16" : "FP32");
+    context->log("  %8.3f ms to create plan with %u programs\n", 1000.0 * plan_time, unsigned(cache->cache_size()));
 
     double dispatch_time = fft.bench(context, output.get(), input.get(), 5, 100, 100, 5.0);
     context->log("  %8.3f ms\n", 1000.0 * dispatch_time);
@@ -300,19 +337,100 @@ static void run_benchmark(Context *context, const BenchArguments &args)
     context->log("  %8.3f GB/s global memory bandwidth (estimated)\n", estimated_bandwidth_gb / dispatch_time);
 }
 
+// Measures the host CPU cost of GLFFT itself. The plan runs on a RecordingContext,
+// so nothing is compiled or executed and no GPU is needed.
+static void run_overhead_benchmark(Context *context, const BenchArguments &args)
+{
+    RecordingContext recording;
+
+    FFTOptions options;
+    options.type.input_fp16 = args.fp16;
+    options.type.output_fp16 = args.fp16;
+    options.type.fp16 = args.fp16;
+
+    unique_ptr<Resource> output;
+    unique_ptr<Resource> input;
+    Target input_target, output_target;
+    create_bench_resources(&recording, args, input, output, input_target, output_target);
+
+    Direction direction = args.type == ComplexToReal ? Inverse : Forward;
+    unsigned iterations = max(args.iterations, 1u);
+
+    // Cold plans build all their programs, warm plans find them in the cache.
+    double start = recording.get_time();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        FFT fft(&recording, args.width, args.height, args.depth, args.type, direction, input_target, output_target,
+                make_shared<ProgramCache>(), options);
+        recording.clear_trace();
+    }
+    double cold_plan_time = (recording.get_time() - start) / iterations;
+
+    auto cache = make_shared<ProgramCache>();
+    FFT fft(&recording, args.width, args.height, args.depth, args.type, direction, input_target, output_target, cache, options);
+
+    start = recording.get_time();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        FFT warm(&recording, args.width, args.height, args.depth, args.type, direction, input_target, output_target, cache, options);
+    }
+    double warm_plan_time = (recording.get_time() - start) / iterations;
+    recording.clear_trace();
+
+    // Recording the commands is part of the measurement, but it is a plain vector append.
+    start = recording.get_time();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        for (unsigned d = 0; d < args.dispatches; d++)
+        {
+            auto *cmd = recording.request_command_buffer();
+            fft.process(cmd, output.get(), input.get());
+            recording.submit_command_buffer(cmd);
+        }
+        recording.clear_trace();
+    }
+    double process_time = (recording.get_time() - start) / (double(iterations) * args.dispatches);
+
+    auto baked = fft.bake(output.get(), input.get());
+    start = recording.get_time();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        for (unsigned d = 0; d < args.dispatches; d++)
+        {
+            auto *cmd = recording.request_command_buffer();
+            baked->replay(cmd);
+            recording.submit_command_buffer(cmd);
+        }
+        recording.clear_trace();
+    }
+    double replay_time = (recording.get_time() - start) / (double(iterations) * args.dispatches);
+
+    unsigned passes = fft.get_num_passes();
+    context->log("Overhead:\n");
+    context->log("  %s -> %s\n", input_target == SSBO ? "SSBO" : "Texture", output_target == SSBO ? "SSBO" : "Image");
+    context->log("  Size: %u x %u x %u %s %s, %u passes, %u programs\n", args.width, args.height, args.depth,
+            args.string_for_type, args.fp16 ? "FP16" : "FP32", passes, unsigned(cache->cache_size()));
+    context->log("  %10.3f us to create plan (cold program cache)\n", 1e6 * cold_plan_time);
+    context->log("  %10.3f us to create plan (warm program cache)\n", 1e6 * warm_plan_time);
+    context->log("  %10.3f us per process(), %.3f us per pass\n", 1e6 * process_time, 1e6 * process_time / passes);
+    context->log("  %10.3f us per baked replay, %.3f us per pass\n", 1e6 * replay_time, 1e6 * replay_time / passes);
+}
+
 static void cli_help(Context *context, char *argv[])
 {
-    context->log("Usage: %s [test | bench | help] (args...)\n", argv[0]);
+    context->log("Usage: %s [test | bench | overhead | bundle | help] (args...)\n", argv[0]);
     context->log("       For help on various subsystems, e.g. %s test help\n", argv[0]);
 }
 
 static void cli_test_help(Context *context)
 {
-    context->log("Usage: test [--test testid] [--test-all] [--test-range testidmin testidmax] [--exit-on-fail] [--minimum-snr-fp16 value-db] [--maximum-snr-fp32 value-db] [--epsilon-fp16 value] [--epsilon-fp32 value]\n"
+    context->log("Usage: test [--test testid] [--test-all] [--test-range testidmin testidmax] [--exit-on-fail] [--minimum-snr-fp16 value-db] [--maximum-snr-fp32 value-db] [--epsilon-fp16 value] [--epsilon-fp32 value] [--program-cache dir] [--program-bundle file]\n"
               "       --test testid: Run a specific test, indexed by number.\n"
               "       --test-all: Run all tests.\n"
               "       --test-range testidmin testidmax: Run specific tests between testidmin and testidmax, indexed by number.\n"
-              "       --exit-on-fail: Exit immediately when a test does not pass.\n");
+              "       --exit-on-fail: Exit immediately when a test does not pass.\n"
+              "       --program-cache dir: Store compiled programs in dir, and load them from there on later runs.\n"
+              "       --program-bundle file: Load programs from a bundle written by the bundle command.\n");
 }
 
 static int cli_test(Context *context, int argc, char *argv[])
@@ -335,6 +453,8 @@ static int cli_test(Context *context, int argc, char *argv[])
     cbs.add("--minimum-snr-fp32", [&args](CLIParser &parser) { args.min_snr_fp32 = parser.next_double(); });
     cbs.add("--epsilon-fp16",     [&args](CLIParser &parser) { args.epsilon_fp16 = parser.next_double(); });
     cbs.add("--epsilon-fp32",     [&args](CLIParser &parser) { args.epsilon_fp32 = parser.next_double(); });
+    cbs.add("--program-cache",    [&args](CLIParser &parser) { args.program_cache = parser.next_string(); });
+    cbs.add("--program-bundle",   [&args](CLIParser &parser) { args.program_bundle = parser.next_string(); });
 
     cbs.error_handler = [context]{ cli_test_help(context); };
     CLIParser parser(move(cbs), argc, argv);
@@ -354,8 +474,10 @@ static int cli_test(Context *context, int argc, char *argv[])
 
 static void cli_bench_help(Context *context)
 {
-    context->log("Usage: bench [--width value] [--height value] [--warmup arg] [--iterations arg] [--dispatches arg] [--timeout arg] [--type type] [--input-texture] [--output-texture]\n"
-              "--type type: ComplexToComplex, ComplexToComplexDual, ComplexToReal, RealToComplex\n");
+    context->log("Usage: bench [--width value] [--height value] [--depth value] [--warmup arg] [--iterations arg] [--dispatches arg] [--timeout arg] [--type type] [--input-texture] [--output-texture] [--program-cache dir] [--program-bundle file]\n"
+              "--type type: ComplexToComplex, ComplexToComplexDual, ComplexToReal, RealToComplex\n"
+              "--program-cache dir: Store compiled programs in dir, and load them from there on later runs.\n"
+              "--program-bundle file: Load programs from a bundle written by the bundle command.\n");
 }
 
 static Type parse_type(const char *arg, BenchArguments &args)
@@ -389,6 +511,18 @@ static Type parse_type(const char *arg, BenchArguments &args)
     }
 }
 
+// Arguments which describe the plan, shared by bench and the plans of bundle.
+static void add_plan_arguments(CLICallbacks &cbs, BenchArguments &args)
+{
+    cbs.add("--width",          [&args](CLIParser &parser) { args.width = parser.next_uint(); });
+    cbs.add("--height",         [&args](CLIParser &parser) { args.height = parser.next_uint(); });
+    cbs.add("--depth",          [&args](CLIParser &parser) { args.depth = parser.next_uint(); });
+    cbs.add("--fp16",           [&args](CLIParser&)        { args.fp16 = true; });
+    cbs.add("--type",           [&args](CLIParser &parser) { args.type = parse_type(parser.next_string(), args); });
+    cbs.add("--input-texture",  [&args](CLIParser&)        { args.input_texture = true; });
+    cbs.add("--output-texture", [&args](CLIParser&)        { args.output_texture = true; });
+}
+
 static int cli_bench(Context *context, int argc, char *argv[])
 {
     if (argc < 1)
@@ -401,16 +535,13 @@ static int cli_bench(Context *context, int argc, char *argv[])
 
     CLICallbacks cbs;
     cbs.add("help",             [context](CLIParser &parser) { cli_bench_help(context); parser.end(); });
-    cbs.add("--width",          [&args](CLIParser &parser) { args.width = parser.next_uint(); });
-    cbs.add("--height",         [&args](CLIParser &parser) { args.height = parser.next_uint(); });
+    add_plan_arguments(cbs, args);
     cbs.add("--warmup",         [&args](CLIParser &parser) { args.warmup = parser.next_uint(); });
     cbs.add("--iterations",     [&args](CLIParser &parser) { args.iterations = parser.next_uint(); });
     cbs.add("--dispatches",     [&args](CLIParser &parser) { args.dispatches = parser.next_uint(); });
     cbs.add("--timeout",        [&args](CLIParser &parser) { args.timeout = parser.next_double(); });
-    cbs.add("--fp16",           [&args](CLIParser&)        { args.fp16 = true; });
-    cbs.add("--type",           [&args](CLIParser &parser) { args.type = parse_type(parser.next_string(), args); });
-    cbs.add("--input-texture",  [&args](CLIParser&)        { args.input_texture = true; });
-    cbs.add("--output-texture", [&args](CLIParser&)        { args.output_texture = true; });
+    cbs.add("--program-cache",  [&args](CLIParser &parser) { args.program_cache = parser.next_string(); });
+    cbs.add("--program-bundle", [&args](CLIParser &parser) { args.program_bundle = parser.next_string(); });
 
     cbs.error_handler = [context]{ cli_bench_help(context); };
 
@@ -429,6 +560,157 @@ static int cli_bench(Context *context, int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
+static void cli_overhead_help(Context *context)
+{
+    context->log("Usage: overhead [--width value] [--height value] [--depth value] [--iterations arg] [--dispatches arg] [--type type] [--input-texture] [--output-texture]\n"
+              "       Measures the CPU time GLFFT spends to create a plan and to record its passes. Nothing runs on the GPU.\n"
+              "--iterations arg: Plans to create, and rounds of process() to record.\n"
+              "--dispatches arg: Calls to process() per round.\n"
+              "--type type: ComplexToComplex, ComplexToComplexDual, ComplexToReal, RealToComplex\n");
+}
+
+static int cli_overhead(Context *context, int argc, char *argv[])
+{
+    if (argc < 1)
+    {
+        cli_overhead_help(context);
+        return EXIT_FAILURE;
+    }
+
+    BenchArguments args;
+
+    CLICallbacks cbs;
+    cbs.add("help",         [context](CLIParser &parser) { cli_overhead_help(context); parser.end(); });
+    add_plan_arguments(cbs, args);
+    cbs.add("--iterations", [&args](CLIParser &parser) { args.iterations = parser.next_uint(); });
+    cbs.add("--dispatches", [&args](CLIParser &parser) { args.dispatches = parser.next_uint(); });
+
+    cbs.error_handler = [context]{ cli_overhead_help(context); };
+
+    CLIParser parser(move(cbs), argc, argv);
+
+    if (!parser.parse())
+    {
+        return EXIT_FAILURE;
+    }
+    else if (parser.ended_state)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    run_overhead_benchmark(context, args);
+    return EXIT_SUCCESS;
+}
+
+static void cli_bundle_help(Context *context)
+{
+    context->log("Usage: bundle --plans file --output file\n"
+              "       --plans file: Plans to precompile, one per line, with the plan arguments of bench, e.g. --width 256 --height 256 --type RealToComplex.\n"
+              "                     Plans use default options, so plans using other options or wisdom are not covered.\n"
+              "       --output file: Write the SPIR-V of all programs of the plans to file, see ProgramBundle.\n");
+}
+
+static void build_program_bundle(Context *context, const char *plans_path, const char *output_path)
+{
+    ifstream plans(plans_path);
+    if (!plans)
+    {
+        throw runtime_error("Failed to open plans.\n");
+    }
+
+    // Planning the FFTs fills the cache with the Parameters of every program they use.
+    auto cache = make_shared<ProgramCache>();
+    string line;
+    while (getline(plans, line))
+    {
+        istringstream stream(line);
+        vector<string> tokens((istream_iterator<string>(stream)), istream_iterator<string>());
+        if (tokens.empty() || tokens.front()[0] == '#')
+        {
+            continue;
+        }
+
+        vector<char*> plan_argv;
+        for (auto &token : tokens)
+        {
+            plan_argv.push_back(&token[0]);
+        }
+
+        BenchArguments args;
+        CLICallbacks cbs;
+        add_plan_arguments(cbs, args);
+        cbs.error_handler = [context, &line]{ context->log("Invalid plan: %s\n", line.c_str()); };
+        CLIParser parser(move(cbs), int(plan_argv.size()), plan_argv.data());
+        if (!parser.parse())
+        {
+            throw logic_error("Invalid plan.\n");
+        }
+
+        FFTOptions options;
+        options.type.input_fp16 = args.fp16;
+        options.type.output_fp16 = args.fp16;
+        options.type.fp16 = args.fp16;
+
+        Target input_target = args.input_texture ? (args.type == RealToComplex ? ImageReal : Image) : SSBO;
+        Target output_target = args.output_texture ? (args.type == ComplexToReal ? ImageReal : Image) : SSBO;
+
+        FFT plan(context, args.width, args.height, args.depth, args.type, args.type == ComplexToReal ? Inverse : Forward,
+                input_target, output_target, cache, options);
+        if (args.type == ComplexToComplex || args.type == ComplexToComplexDual)
+        {
+            FFT inverse_plan(context, args.width, args.height, args.depth, args.type, Inverse,
+                    input_target, output_target, cache, options);
+        }
+    }
+
+    ProgramBundle bundle;
+    for (auto &params : cache->get_parameters())
+    {
+        vector<uint32_t> spirv;
+        if (!compile_glsl_to_spirv(FFT::build_program_source(params).c_str(), spirv))
+        {
+            throw runtime_error("Failed to compile program to SPIR-V.\n");
+        }
+        bundle.add(params, move(spirv));
+    }
+
+    if (!bundle.save(output_path))
+    {
+        throw runtime_error("Failed to write program bundle.\n");
+    }
+    context->log("Wrote %u programs to %s.\n", unsigned(bundle.size()), output_path);
+}
+
+static int cli_bundle(Context *context, int argc, char *argv[])
+{
+    const char *plans = nullptr;
+    const char *output = nullptr;
+
+    CLICallbacks cbs;
+    cbs.add("help",     [context](CLIParser &parser) { cli_bundle_help(context); parser.end(); });
+    cbs.add("--plans",  [&plans](CLIParser &parser) { plans = parser.next_string(); });
+    cbs.add("--output", [&output](CLIParser &parser) { output = parser.next_string(); });
+    cbs.error_handler = [context]{ cli_bundle_help(context); };
+
+    CLIParser parser(move(cbs), argc, argv);
+    if (!parser.parse())
+    {
+        return EXIT_FAILURE;
+    }
+    else if (parser.ended_state)
+    {
+        return EXIT_SUCCESS;
+    }
+    else if (!plans || !output)
+    {
+        cli_bundle_help(context);
+        return EXIT_FAILURE;
+    }
+
+    build_program_bundle(context, plans, output);
+    return EXIT_SUCCESS;
+}
+
 int GLFFT::cli_main(
         Context *context,
         int argc, char *argv[])
@@ -453,6 +735,14 @@ int GLFFT::cli_main(
         {
             return cli_bench(context, argc - 2, argv + 2);
         }
+        else if (!strcmp(argv[1], "overhead"))
+        {
+            return cli_overhead(context, argc - 2, argv + 2);
+        }
+        else if (!strcmp(argv[1], "bundle"))
+        {
+            return cli_bundle(context, argc - 2, argv + 2);
+        }
         else if (!strcmp(argv[1], "help"))
         {
             cli_help(context, argv);
@@ -45,6 +45,10 @@ namespace GLFFT
             double min_snr_fp32 = 100.0;
             double epsilon_fp16 = 1e-3;
             double epsilon_fp32 = 1e-6;
+            // If set, programs are loaded from and stored to this directory, so a second run tests loaded binaries.
+            const char *program_cache = nullptr;
+            // If set, programs are created from this bundle where possible, see ProgramBundle.
+            const char *program_bundle = nullptr;
         };
 
         void run_test_suite(Context *context, const TestSuiteArguments &args);
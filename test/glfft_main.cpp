@@ -18,12 +18,27 @@
 
 #include "glfft_cli.hpp"
 #include "glfft_context.hpp"
+#include "glfft_recording_interface.hpp"
+#include <cstdio>
+#include <cstring>
 
 using namespace GLFFT;
 
 int main(int argc, char *argv[])
 {
+    // The overhead benchmark runs on a RecordingContext, so do not require a GPU or window system for it.
+    if (argc >= 2 && !strcmp(argv[1], "overhead"))
+    {
+        RecordingContext context;
+        return cli_main(&context, argc, argv);
+    }
+
     auto context = create_cli_context();
+    if (!context)
+    {
+        fprintf(stderr, "Failed to create context.\n");
+        return 1;
+    }
     return cli_main(context.get(), argc, argv);
 }
 
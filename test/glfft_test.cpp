@@ -19,10 +19,22 @@
 #include "glfft_common.hpp"
 #include "glfft_cli.hpp"
 #include "glfft.hpp"
+#include "glfft_spirv.hpp"
+#include "glfft_recording_interface.hpp"
+#include "glfft_cpu_interface.hpp"
+#include "glfft_spirv_interface.hpp"
+#ifdef GLFFT_CLI_GL
+#include "glfft_gl_interface.hpp"
+#endif
 #include <stdexcept>
 #include <random>
 #include <complex>
 #include <functional>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
 #include "fft.h"
 #include <stdlib.h>
 #include <cmath>
@@ -98,6 +110,151 @@ static inline size_t type_to_output_size(Type type)
     }
 }
 
+using cdouble = complex<double>;
+static const double pi = 3.14159265358979323846;
+
+// Composite sizes are split by their smallest factor, so large sizes like the four-step ones stay fast.
+// Prime sizes fall back to a plain DFT.
+static void reference_dft(vector<cdouble> &data, int direction)
+{
+    size_t N = data.size();
+    vector<cdouble> result(N);
+
+    size_t P = 2;
+    while (P * P <= N && N % P != 0)
+    {
+        P++;
+    }
+
+    if (P * P > N)
+    {
+        for (size_t k = 0; k < N; k++)
+        {
+            cdouble sum = 0.0;
+            for (size_t n = 0; n < N; n++)
+            {
+                sum += data[n] * polar(1.0, direction * 2.0 * pi * double((k * n) % N) / double(N));
+            }
+            result[k] = sum;
+        }
+    }
+    else
+    {
+        size_t M = N / P;
+        vector<vector<cdouble>> sub(P, vector<cdouble>(M));
+        for (size_t r = 0; r < P; r++)
+        {
+            for (size_t m = 0; m < M; m++)
+            {
+                sub[r][m] = data[m * P + r];
+            }
+            reference_dft(sub[r], direction);
+        }
+
+        for (size_t k = 0; k < N; k++)
+        {
+            cdouble sum = 0.0;
+            for (size_t r = 0; r < P; r++)
+            {
+                sum += sub[r][k % M] * polar(1.0, direction * 2.0 * pi * double((k * r) % N) / double(N));
+            }
+            result[k] = sum;
+        }
+    }
+
+    data = move(result);
+}
+
+// muFFT only implements power-of-two transforms, so mixed radix transforms are verified against a plain DFT.
+// Data layouts match what muFFT uses for real transforms.
+static void create_reference_dft(Type type, int direction, unsigned Nx, unsigned Ny, void *output, const void *input)
+{
+    unsigned columns = type == ComplexToComplex ? Nx : Nx / 2 + 1;
+    vector<cdouble> grid(columns * Ny);
+    vector<cdouble> row(Nx);
+    vector<cdouble> column(Ny);
+
+    if (type == ComplexToComplex || type == RealToComplex)
+    {
+        for (unsigned y = 0; y < Ny; y++)
+        {
+            for (unsigned x = 0; x < Nx; x++)
+            {
+                if (type == RealToComplex)
+                {
+                    row[x] = static_cast<const float*>(input)[y * Nx + x];
+                }
+                else
+                {
+                    row[x] = cdouble(static_cast<const cfloat*>(input)[y * Nx + x]);
+                }
+            }
+
+            reference_dft(row, direction);
+            copy(begin(row), begin(row) + columns, begin(grid) + y * columns);
+        }
+    }
+    else
+    {
+        for (unsigned y = 0; y < Ny; y++)
+        {
+            for (unsigned x = 0; x < columns; x++)
+            {
+                grid[y * columns + x] = cdouble(static_cast<const cfloat*>(input)[y * Nx + x]);
+            }
+        }
+    }
+
+    for (unsigned x = 0; x < columns; x++)
+    {
+        for (unsigned y = 0; y < Ny; y++)
+        {
+            column[y] = grid[y * columns + x];
+        }
+
+        reference_dft(column, direction);
+
+        for (unsigned y = 0; y < Ny; y++)
+        {
+            grid[y * columns + x] = column[y];
+        }
+    }
+
+    if (type != ComplexToReal)
+    {
+        for (unsigned y = 0; y < Ny; y++)
+        {
+            for (unsigned x = 0; x < columns; x++)
+            {
+                static_cast<cfloat*>(output)[y * Nx + x] = cfloat(grid[y * columns + x]);
+            }
+        }
+        return;
+    }
+
+    // Complex-to-real is done as a half-sized complex transform on the even and odd samples.
+    unsigned half = Nx / 2;
+    vector<cdouble> z(half);
+    for (unsigned y = 0; y < Ny; y++)
+    {
+        const cdouble *g = grid.data() + y * columns;
+        for (unsigned k = 0; k < half; k++)
+        {
+            cdouble a = g[k];
+            cdouble b = conj(g[half - k]);
+            z[k] = (a + b) + cdouble(0.0, 1.0) * polar(1.0, 2.0 * pi * k / Nx) * (a - b);
+        }
+
+        reference_dft(z, 1);
+
+        for (unsigned x = 0; x < half; x++)
+        {
+            static_cast<float*>(output)[y * Nx + 2 * x + 0] = float(z[x].real());
+            static_cast<float*>(output)[y * Nx + 2 * x + 1] = float(z[x].imag());
+        }
+    }
+}
+
 static mufft_buffer create_reference(Type type, Direction direction,
         unsigned Nx, unsigned Ny, const void *buffer, size_t output_size)
 {
@@ -142,7 +299,19 @@ static mufft_buffer create_reference(Type type, Direction direction,
         out = inter_out;
     }
 
-    if (Ny > 1)
+    if ((Nx & (Nx - 1)) || (Ny & (Ny - 1)))
+    {
+        if (type == ComplexToComplexDual)
+        {
+            create_reference_dft(ComplexToComplex, direction, Nx, Ny, out, in);
+            create_reference_dft(ComplexToComplex, direction, Nx, Ny, out + Nx * Ny, in + Nx * Ny);
+        }
+        else
+        {
+            create_reference_dft(type, direction, Nx, Ny, out, in);
+        }
+    }
+    else if (Ny > 1)
     {
         mufft_plan_2d *plan = nullptr;
         switch (type)
@@ -237,6 +406,70 @@ static mufft_buffer create_reference(Type type, Direction direction,
     return output;
 }
 
+// Normalized DFT along Z of Nz slices, each holding slice_size complex values.
+static void reference_dft_depth(cfloat *data, unsigned slice_size, unsigned Nz, int direction)
+{
+    vector<cdouble> column(Nz);
+    for (unsigned i = 0; i < slice_size; i++)
+    {
+        for (unsigned z = 0; z < Nz; z++)
+        {
+            column[z] = cdouble(data[z * slice_size + i]);
+        }
+
+        reference_dft(column, direction);
+
+        for (unsigned z = 0; z < Nz; z++)
+        {
+            data[z * slice_size + i] = cfloat(column[z] / double(Nz));
+        }
+    }
+}
+
+// 3D transforms are verified as a 2D transform of every slice and a DFT along Z.
+// Complex-to-real transforms have real output, so the DFT along Z is done first.
+static mufft_buffer create_reference_volume(Type type, Direction direction,
+        unsigned Nx, unsigned Ny, unsigned Nz, const void *buffer, size_t output_size)
+{
+    if (Nz == 1)
+    {
+        return create_reference(type, direction, Nx, Ny, buffer, output_size);
+    }
+
+    int dft_direction = direction == Forward ? -1 : 1;
+    size_t slice_input_size = Nx * Ny * type_to_input_size(type);
+    size_t slice_output_size = Nx * Ny * type_to_output_size(type);
+    auto output = alloc(output_size);
+
+    if (type == ComplexToReal)
+    {
+        auto input = alloc(Nz * slice_input_size);
+        memcpy(input.get(), buffer, Nz * slice_input_size);
+        reference_dft_depth(static_cast<cfloat*>(input.get()), Nx * Ny, Nz, dft_direction);
+
+        size_t slice_real_size = Nx * Ny * sizeof(float);
+        for (unsigned z = 0; z < Nz; z++)
+        {
+            auto slice = create_reference(type, direction, Nx, Ny,
+                    static_cast<const uint8_t*>(input.get()) + z * slice_input_size, slice_output_size);
+            memcpy(static_cast<uint8_t*>(output.get()) + z * slice_real_size, slice.get(), slice_real_size);
+        }
+    }
+    else
+    {
+        for (unsigned z = 0; z < Nz; z++)
+        {
+            auto slice = create_reference(type, direction, Nx, Ny,
+                    static_cast<const uint8_t*>(buffer) + z * slice_input_size, slice_output_size);
+            memcpy(static_cast<uint8_t*>(output.get()) + z * slice_output_size, slice.get(), slice_output_size);
+        }
+
+        reference_dft_depth(static_cast<cfloat*>(output.get()), slice_output_size / sizeof(cfloat), Nz, dft_direction);
+    }
+
+    return output;
+}
+
 static mufft_buffer readback(Context *context, Buffer *buffer, size_t size)
 {
     auto buf = alloc(size);
@@ -491,23 +724,80 @@ static mufft_buffer convert_fp16_fp32(const uint32_t *input, unsigned N)
     return buffer;
 }
 
+// Packed half-spectra only keep the N / 2 + 1 complex samples of every row which are used.
+// Rows of the regular layout are N complex samples apart.
+static mufft_buffer pack_spectrum(const float *input, unsigned Nx, unsigned rows)
+{
+    auto buffer = alloc(rows * (Nx + 2) * sizeof(float));
+    auto ptr = static_cast<float*>(buffer.get());
+
+    for (unsigned y = 0; y < rows; y++)
+    {
+        memcpy(ptr + y * (Nx + 2), input + y * 2 * Nx, (Nx + 2) * sizeof(float));
+    }
+
+    return buffer;
+}
+
+static mufft_buffer unpack_spectrum(const float *input, unsigned Nx, unsigned rows)
+{
+    auto buffer = alloc(rows * 2 * Nx * sizeof(float));
+    auto ptr = static_cast<float*>(buffer.get());
+    memset(ptr, 0, rows * 2 * Nx * sizeof(float));
+
+    for (unsigned y = 0; y < rows; y++)
+    {
+        memcpy(ptr + y * 2 * Nx, input + y * (Nx + 2), (Nx + 2) * sizeof(float));
+    }
+
+    return buffer;
+}
+
 static void run_test_ssbo(Context *context,
-        const TestSuiteArguments &args, unsigned Nx, unsigned Ny, Type type, Direction direction, const FFTOptions &options, const shared_ptr<ProgramCache> &cache)
+        const TestSuiteArguments &args, unsigned Nx, unsigned Ny, Type type, Direction direction, const FFTOptions &options, const shared_ptr<ProgramCache> &cache,
+        unsigned batch = 1, unsigned Nz = 1)
 {
-    context->log("Running SSBO -> SSBO FFT, %04u x %04u\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s ...\n",
-            Nx, Ny, direction_to_str(direction), type_to_str(type),
-            options.performance.shared_banked ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
+    context->log("Running SSBO -> SSBO FFT, %04u x %04u x %04u, %u batches\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\ttwiddle LUT %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s\n\tpacked spectrum %s ...\n",
+            Nx, Ny, Nz, batch, direction_to_str(direction), type_to_str(type),
+            options.performance.shared_banked ? "yes" : "no", options.performance.twiddle_lut ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
             options.type.input_fp16 ? "yes" : "no",
-            options.type.output_fp16 ? "yes" : "no");
+            options.type.output_fp16 ? "yes" : "no",
+            options.type.packed_spectrum ? "yes" : "no");
 
     unique_ptr<Buffer> test_input;
     unique_ptr<Buffer> test_output;
 
-    size_t input_size = Nx * Ny * type_to_input_size(type);
-    size_t output_size = Nx * Ny * type_to_output_size(type);
+    size_t batch_input_size = Nx * Ny * Nz * type_to_input_size(type);
+    size_t batch_output_size = Nx * Ny * Nz * type_to_output_size(type);
+    // Complex-to-real output is packed as real samples,
+    // but the output buffer doubles as scratch space for the complex passes, so allocate it complex-sized.
+    size_t batch_stride_output = type == ComplexToReal ? Nx * Ny * Nz * sizeof(float) : batch_output_size;
+    size_t input_size = batch * batch_input_size;
+    size_t output_size = batch * batch_output_size;
 
+    // Batches are packed back-to-back, so every batch is validated against its own reference.
     auto input = create_input(input_size / sizeof(float));
-    auto output = create_reference(type, direction, Nx, Ny, input.get(), output_size);
+    auto output = alloc(output_size);
+    for (unsigned b = 0; b < batch; b++)
+    {
+        auto reference = create_reference_volume(type, direction, Nx, Ny, Nz,
+                static_cast<const uint8_t*>(input.get()) + b * batch_input_size, batch_output_size);
+        memcpy(static_cast<uint8_t*>(output.get()) + b * batch_stride_output, reference.get(), batch_stride_output);
+    }
+
+    // The references are computed with the regular layout, so only the data the FFT sees is packed.
+    bool packed = options.type.packed_spectrum && (type == ComplexToReal || type == RealToComplex);
+    unsigned rows = Ny * Nz * batch;
+    size_t readback_size = output_size;
+    if (packed && type == ComplexToReal)
+    {
+        input = pack_spectrum(static_cast<const float*>(input.get()), Nx, rows);
+        input_size = rows * (Nx + 2) * sizeof(float);
+    }
+    else if (packed)
+    {
+        readback_size = rows * (Nx + 2) * sizeof(float);
+    }
 
     if (options.type.input_fp16)
     {
@@ -515,20 +805,25 @@ static void run_test_ssbo(Context *context,
     }
 
     test_input = context->create_buffer(input.get(), input_size >> options.type.input_fp16, AccessStreamCopy);
-    test_output = context->create_buffer(nullptr, output_size >> options.type.output_fp16, AccessStreamRead);
+    test_output = context->create_buffer(nullptr, readback_size >> options.type.output_fp16, AccessStreamRead);
 
-    FFT fft(context, Nx, Ny, type, direction, SSBO, SSBO, cache, options);
+    FFT fft(context, Nx, Ny, Nz, type, direction, SSBO, SSBO, cache, options, FFTWisdom(), batch);
 
     auto *cmd = context->request_command_buffer();
     fft.process(cmd, test_output.get(), test_input.get(), test_input.get());
-    cmd->barrier();
+    cmd->barrier(fft.get_output_access(), AccessHostRead);
     context->submit_command_buffer(cmd);
     context->wait_idle();
 
-    auto output_data = readback(context, test_output.get(), output_size >> options.type.output_fp16);
+    auto output_data = readback(context, test_output.get(), readback_size >> options.type.output_fp16);
     if (options.type.output_fp16)
     {
-        output_data = convert_fp16_fp32(static_cast<const uint32_t*>(output_data.get()), output_size / sizeof(float));
+        output_data = convert_fp16_fp32(static_cast<const uint32_t*>(output_data.get()), readback_size / sizeof(float));
+    }
+
+    if (packed && type == RealToComplex)
+    {
+        output_data = unpack_spectrum(static_cast<const float*>(output_data.get()), Nx, rows);
     }
 
     float epsilon = options.type.output_fp16 || options.type.input_fp16 ? args.epsilon_fp16 : args.epsilon_fp32;
@@ -537,7 +832,14 @@ static void run_test_ssbo(Context *context,
     {
         epsilon *= 1.5f;
     }
-    validate(context, type, static_cast<const float*>(output_data.get()), static_cast<const float*>(output.get()), Nx, Ny, epsilon, min_snr);
+
+    for (unsigned b = 0; b < batch; b++)
+    {
+        size_t offset = b * batch_stride_output / sizeof(float);
+        // Slices are validated as if they were extra rows.
+        validate(context, type, static_cast<const float*>(output_data.get()) + offset, static_cast<const float*>(output.get()) + offset,
+                Nx, Ny * Nz, epsilon, min_snr);
+    }
 
     context->log("... Success!\n");
 }
@@ -545,9 +847,9 @@ static void run_test_ssbo(Context *context,
 static void run_test_texture(Context *context,
         const TestSuiteArguments &args, unsigned Nx, unsigned Ny, Type type, Direction direction, const FFTOptions &options, const shared_ptr<ProgramCache> &cache)
 {
-    context->log("Running Texture -> SSBO FFT, %04u x %04u\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s ...\n",
+    context->log("Running Texture -> SSBO FFT, %04u x %04u\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\ttwiddle LUT %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s ...\n",
             Nx, Ny, direction_to_str(direction), type_to_str(type),
-            options.performance.shared_banked ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
+            options.performance.shared_banked ? "yes" : "no", options.performance.twiddle_lut ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
             options.type.input_fp16 ? "yes" : "no",
             options.type.output_fp16 ? "yes" : "no");
 
@@ -587,7 +889,7 @@ static void run_test_texture(Context *context,
 
     auto *cmd = context->request_command_buffer();
     fft.process(cmd, test_output.get(), test_input.get(), test_input.get());
-    cmd->barrier();
+    cmd->barrier(fft.get_output_access(), AccessHostRead);
     context->submit_command_buffer(cmd);
     context->wait_idle();
 
@@ -634,9 +936,9 @@ static mufft_buffer readback_texture(Context *context, Texture *tex, unsigned co
 
 static void run_test_image(Context *context, const TestSuiteArguments &args, unsigned Nx, unsigned Ny, Type type, Direction direction, const FFTOptions &options, const shared_ptr<ProgramCache> &cache)
 {
-    context->log("Running SSBO -> Image FFT, %04u x %04u\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s ...\n",
+    context->log("Running SSBO -> Image FFT, %04u x %04u\n\t%7s transform\n\t%8s\n\tbanked shared %s\n\ttwiddle LUT %s\n\tvector size %u\n\twork group (%u, %u)\n\tinput fp16 %s\n\toutput fp16 %s ...\n",
             Nx, Ny, direction_to_str(direction), type_to_str(type),
-            options.performance.shared_banked ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
+            options.performance.shared_banked ? "yes" : "no", options.performance.twiddle_lut ? "yes" : "no", options.performance.vector_size, options.performance.workgroup_size_x, options.performance.workgroup_size_y,
             options.type.input_fp16 ? "yes" : "no",
             options.type.output_fp16 ? "yes" : "no");
 
@@ -684,7 +986,7 @@ static void run_test_image(Context *context, const TestSuiteArguments &args, uns
 
     auto *cmd = context->request_command_buffer();
     fft.process(cmd, tex.get(), test_input.get(), test_input.get());
-    cmd->barrier();
+    cmd->barrier(fft.get_output_access(), AccessTextureRead);
     context->submit_command_buffer(cmd);
     context->wait_idle();
 
@@ -703,6 +1005,139 @@ static void run_test_image(Context *context, const TestSuiteArguments &args, uns
     context->log("... Success!\n");
 }
 
+#ifdef GLFFT_CLI_GL
+// Drivers like llvmpipe lack GL_KHR_shader_subgroup_shuffle, so the shuffle variants would never run.
+// This context forwards to a GL context, but claims subgroups of subgroup_size invocations
+// and implements subgroupShuffle() through shared memory, which exercises the shuffle indexing.
+// Lanes are numbered in reverse gl_LocalInvocationIndex order, since nothing guarantees the two match.
+class SubgroupShuffleEmulationContext : public Context
+{
+    public:
+        SubgroupShuffleEmulationContext(Context *context, unsigned subgroup_size)
+            : context(context), subgroup_size(subgroup_size)
+        {
+        }
+
+        unique_ptr<Texture> create_texture(const void *initial_data,
+                unsigned width, unsigned height,
+                Format format) override
+        {
+            return context->create_texture(initial_data, width, height, format);
+        }
+
+        unique_ptr<Buffer> create_buffer(const void *initial_data, size_t size, AccessMode access) override
+        {
+            return context->create_buffer(initial_data, size, access);
+        }
+
+        unique_ptr<Program> compile_compute_shader(const char *source) override
+        {
+            return context->compile_compute_shader(emulate_shuffle(source).c_str());
+        }
+
+        unique_ptr<Program> begin_compile_compute_shader(const char *source) override
+        {
+            return context->begin_compile_compute_shader(emulate_shuffle(source).c_str());
+        }
+
+        bool is_program_compiled(Program *program) override { return context->is_program_compiled(program); }
+        bool end_compile_compute_shader(Program *program) override { return context->end_compile_compute_shader(program); }
+
+        bool get_program_binary(Program *program, vector<uint8_t> &binary) override
+        {
+            return context->get_program_binary(program, binary);
+        }
+
+        unique_ptr<Program> load_program_binary(const void *binary, size_t size) override
+        {
+            return context->load_program_binary(binary, size);
+        }
+
+        CommandBuffer* request_command_buffer() override { return context->request_command_buffer(); }
+        void submit_command_buffer(CommandBuffer *cmd) override { context->submit_command_buffer(cmd); }
+        void wait_idle() override { context->wait_idle(); }
+
+        const char* get_renderer_string() override { return context->get_renderer_string(); }
+
+        void log(const char *fmt, ...) override
+        {
+            char buffer[4 * 1024];
+
+            va_list va;
+            va_start(va, fmt);
+            vsnprintf(buffer, sizeof(buffer), fmt, va);
+            va_end(va);
+            context->log("%s", buffer);
+        }
+
+        double get_time() override { return context->get_time(); }
+
+        unsigned get_max_work_group_threads() override { return context->get_max_work_group_threads(); }
+        unsigned get_max_work_group_size_z() override { return context->get_max_work_group_size_z(); }
+
+        bool supports_subgroup_shuffle() override { return true; }
+        unsigned get_subgroup_size() override { return subgroup_size; }
+
+        const void* map(Buffer *buffer, size_t offset, size_t size) override { return context->map(buffer, offset, size); }
+        void unmap(Buffer *buffer) override { context->unmap(buffer); }
+
+        bool supports_texture_readback() override { return context->supports_texture_readback(); }
+        void read_texture(void *buffer, Texture *texture, Format format) override
+        {
+            context->read_texture(buffer, texture, format);
+        }
+
+        unique_ptr<TimestampQuery> create_timestamp_query() override { return context->create_timestamp_query(); }
+        double get_timestamp(TimestampQuery *query) override { return context->get_timestamp(query); }
+
+    private:
+        Context *context;
+        unsigned subgroup_size;
+
+        static string emulate_shuffle(const char *source)
+        {
+            string str = source;
+
+            // The lane macro takes the place of the extension, so it is defined before any shader code uses it.
+            static const string extension = "#extension GL_KHR_shader_subgroup_shuffle : require\n";
+            size_t pos = str.find(extension);
+            if (pos == string::npos)
+            {
+                return str;
+            }
+            str.replace(pos, extension.size(),
+                    "#define fft_emulated_lane "
+                    "(gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z - 1u - gl_LocalInvocationIndex)\n");
+
+            static const string invocation_id = "gl_SubgroupInvocationID";
+            while ((pos = str.find(invocation_id)) != string::npos)
+            {
+                str.replace(pos, invocation_id.size(), "fft_emulated_lane");
+            }
+
+            // Every invocation calls shuffle_block() in uniform control flow, so barriers are fine here.
+            static const char emulation[] =
+                "shared cfloat fft_shuffle_emulation[gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z];\n"
+                "cfloat subgroupShuffle(cfloat v, uint id)\n"
+                "{\n"
+                "    barrier();\n"
+                "    fft_shuffle_emulation[fft_emulated_lane] = v;\n"
+                "    memoryBarrierShared();\n"
+                "    barrier();\n"
+                "    return fft_shuffle_emulation[id];\n"
+                "}\n";
+
+            pos = str.find("cfloat shuffle_block(");
+            if (pos == string::npos)
+            {
+                throw logic_error("Shader requires subgroup shuffles, but does not use shuffle_block().");
+            }
+            str.insert(pos, emulation);
+            return str;
+        }
+};
+#endif
+
 static void enqueue_test(Context *context,
         vector<function<void ()>> &tests,
         const TestSuiteArguments &args, unsigned Nx, unsigned Ny, Type type, Direction direction,
@@ -751,6 +1186,151 @@ static void test_fp32_fp16_convert()
     }
 }
 
+// The CPU backend recovers the pass configuration from the source FFT::build_program_source() generates.
+// Check that every Parameters field it depends on comes back out, so changes to the generated source are caught here.
+static void test_cpu_pass_configuration()
+{
+    static const Mode modes[] = {
+        Horizontal, HorizontalDual, Vertical, VerticalDual, Depth, DepthDual,
+        ResolveRealToComplex, ResolveComplexToReal, ChirpPreMultiply, ChirpPostMultiply, FourStepTwiddle, Tile2D,
+    };
+    static const Direction directions[] = { Forward, Inverse, InverseConvolve };
+    static const Target targets[] = { SSBO, Image, ImageReal };
+    static const unsigned radices[] = { 3, 4, 5, 7, 8, 16, 64, 256, 4096 };
+    static const unsigned vector_sizes[] = { 2, 4, 8 };
+
+    CPUContext cpu(1);
+    for (unsigned i = 0; i < 4096; i++)
+    {
+        // Step through the options with different periods, so they are not tied to the mode.
+        Parameters params = {};
+        params.mode = modes[i % 12];
+        params.direction = directions[i % 11 % 3];
+        params.input_target = targets[i % 7 % 3];
+        params.output_target = targets[i % 5 % 3];
+        params.radix = radices[i % 13 % 9];
+        params.vector_size = vector_sizes[i % 17 % 3];
+        params.workgroup_size_x = 1 + i % 8;
+        params.workgroup_size_y = 1 + i % 3;
+        params.workgroup_size_z = 1 + i % 19;
+        params.p1 = i & 1;
+        params.fft_normalize = i & 2;
+        params.input_fp16 = i & 4;
+        params.output_fp16 = i & 8;
+        params.packed_spectrum = i & 16;
+        params.fused_resolve = i & 32;
+        params.shared_banked = i & 64;
+        params.twiddle_lut = i & 128;
+
+        auto program = cpu.compile_compute_shader(FFT::build_program_source(params).c_str());
+        if (!program)
+        {
+            throw logic_error("CPU backend failed to parse a pass configuration.");
+        }
+        const auto &pass = static_cast<CPUProgram*>(program.get())->get_pass();
+
+        bool resolve_mode = params.mode >= ResolveRealToComplex && params.mode <= ChirpPostMultiply;
+        bool scalar_mode = resolve_mode || params.mode == FourStepTwiddle || params.mode == Tile2D;
+        bool dual = params.mode == HorizontalDual || params.mode == VerticalDual || params.mode == DepthDual;
+        bool horizontal = params.mode == Horizontal || params.mode == HorizontalDual || scalar_mode;
+
+        bool matches =
+            pass.radix == params.radix &&
+            pass.vector_size == (scalar_mode ? 2 : params.vector_size) &&
+            pass.workgroup_size_x == params.workgroup_size_x &&
+            pass.workgroup_size_y == params.workgroup_size_y &&
+            pass.workgroup_size_z == params.workgroup_size_z &&
+            pass.p1 == params.p1 &&
+            pass.inverse == (params.direction != Forward) &&
+            pass.convolve == (params.direction == InverseConvolve) &&
+            pass.normalize == params.fft_normalize &&
+            pass.dual == dual &&
+            pass.horizontal == horizontal &&
+            pass.resolve_real_to_complex == (params.mode == ResolveRealToComplex) &&
+            pass.resolve_complex_to_real == (params.mode == ResolveComplexToReal) &&
+            pass.chirp_pre_multiply == (params.mode == ChirpPreMultiply) &&
+            pass.chirp_post_multiply == (params.mode == ChirpPostMultiply) &&
+            pass.four_step_twiddle == (params.mode == FourStepTwiddle) &&
+            pass.tile_2d == (params.mode == Tile2D) &&
+            pass.input_texture == (params.input_target != SSBO) &&
+            pass.input_real == (params.input_target == ImageReal) &&
+            pass.input_fp16 == params.input_fp16 &&
+            pass.output_image == (params.output_target != SSBO) &&
+            pass.output_real == (params.output_target == ImageReal) &&
+            pass.output_fp16 == params.output_fp16 &&
+            pass.packed_spectrum == params.packed_spectrum &&
+            pass.fused_real_to_complex == (params.fused_resolve && params.direction == Forward) &&
+            pass.fused_complex_to_real == (params.fused_resolve && params.direction != Forward);
+
+        if (!matches)
+        {
+            throw logic_error("CPU pass configuration does not match the parameters of the program.");
+        }
+    }
+}
+
+// The FFT tests only pass on the SPIR-V interpreter if barriers, shared memory and shuffles work,
+// but check them directly, so a broken interpreter is not mistaken for a broken shader.
+static void test_spirv_work_group_semantics()
+{
+    static const char source[] =
+        "#extension GL_KHR_shader_subgroup_shuffle : require\n"
+        "layout(local_size_x = 64) in;\n"
+        "layout(std430, binding = 0) buffer Output { uvec4 results[]; };\n"
+        "shared uint values[64];\n"
+        "void main()\n"
+        "{\n"
+        "    uint index = gl_LocalInvocationIndex;\n"
+        "    values[index] = 3u * index + gl_WorkGroupID.x;\n"
+        "    barrier();\n"
+        "    uint mirrored = values[63u - index];\n"
+        "    uint lane = gl_SubgroupInvocationID;\n"
+        "    results[gl_GlobalInvocationID.x] = uvec4(mirrored, lane, subgroupShuffle(lane, lane ^ 1u),\n"
+        "        subgroupShuffle(index, lane ^ 1u));\n"
+        "}\n";
+
+    SPIRVContext spirv(1);
+    auto program = spirv.compile_compute_shader(source);
+    if (!program)
+    {
+        throw logic_error("Failed to compile work group test shader.");
+    }
+
+    const unsigned groups = 2;
+    const unsigned invocations = 64;
+    auto buffer = spirv.create_buffer(nullptr, groups * invocations * 4 * sizeof(uint32_t), AccessStreamRead);
+    auto *cmd = spirv.request_command_buffer();
+    cmd->bind_program(program.get());
+    cmd->bind_storage_buffer(0, buffer.get());
+    cmd->dispatch(groups, 1, 1);
+    spirv.submit_command_buffer(cmd);
+
+    auto *results = static_cast<const uint32_t*>(spirv.map(buffer.get(), 0, groups * invocations * 4 * sizeof(uint32_t)));
+    unsigned subgroup_size = spirv.get_subgroup_size();
+    for (unsigned group = 0; group < groups; group++)
+    {
+        for (unsigned i = 0; i < invocations; i++)
+        {
+            const uint32_t *result = results + 4 * (group * invocations + i);
+            // Every invocation must have stored to shared memory before any of them got past the barrier.
+            if (result[0] != 3 * (invocations - 1 - i) + group)
+            {
+                throw logic_error("Shared memory was read before all invocations reached the barrier.");
+            }
+
+            // The shuffled index must come from the same subgroup, from the invocation with the requested lane.
+            unsigned source = result[3];
+            const uint32_t *partner = results + 4 * (group * invocations + source);
+            if (result[1] >= subgroup_size || result[2] != (result[1] ^ 1) ||
+                    source / subgroup_size != i / subgroup_size || partner[1] != (result[1] ^ 1))
+            {
+                throw logic_error("Subgroup shuffle read from the wrong invocation.");
+            }
+        }
+    }
+    spirv.unmap(buffer.get());
+}
+
 void GLFFT::Internal::run_test_suite(Context *context, const TestSuiteArguments &args)
 {
     // Sanity test, should never fail.
@@ -761,6 +1341,26 @@ void GLFFT::Internal::run_test_suite(Context *context, const TestSuiteArguments
 
     vector<function<void ()>> tests;
     auto cache = make_shared<ProgramCache>();
+#ifdef GLFFT_CLI_GL
+    // Tests run at the end of this function, so the emulation context can live on the stack.
+    // Radix-64 work groups are 8 invocations with small work groups, and radix-16 and 64 are both 32 with big ones.
+    SubgroupShuffleEmulationContext small_shuffle_context(context, 8);
+    SubgroupShuffleEmulationContext big_shuffle_context(context, 32);
+    auto shuffle_cache = make_shared<ProgramCache>();
+#endif
+    if (args.program_cache)
+    {
+        cache->set_binary_cache(make_shared<ProgramBinaryCache>(args.program_cache));
+    }
+    if (args.program_bundle)
+    {
+        auto bundle = make_shared<ProgramBundle>();
+        if (!bundle->load(args.program_bundle))
+        {
+            throw runtime_error("Failed to load program bundle.\n");
+        }
+        cache->set_program_bundle(bundle);
+    }
 
     // Very exhaustive. Lots of overlap in tests which could be avoided to speed up the tests.
     for (unsigned i = 0; i < 64; i++)
@@ -887,8 +1487,640 @@ void GLFFT::Internal::run_test_suite(Context *context, const TestSuiteArguments
                 }
             }
         }
+
+        // Non-POT transforms which need radix-3, radix-5 and radix-7 passes.
+        static const unsigned mixed_radix_sizes[][2] = {
+            { 240, 45 }, { 120, 28 }, { 105, 49 }, { 480, 1 },
+        };
+
+        for (auto &size : mixed_radix_sizes)
+        {
+            unsigned Nx = size[0];
+            unsigned Ny = size[1];
+
+            if (Ny == 1 && big_workgroup)
+            {
+                continue;
+            }
+
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, Image, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Inverse, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, InverseConvolve, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, ComplexToReal, Inverse, SSBO, SSBO, options, cache);
+
+            if (options.performance.vector_size >= 4)
+            {
+                enqueue_test(context, tests, args, Nx, Ny, ComplexToComplexDual, Forward, SSBO, SSBO, options, cache);
+            }
+
+            if (context->supports_texture_readback())
+            {
+                enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Inverse, SSBO, Image, options, cache);
+                enqueue_test(context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, Image, options, cache);
+            }
+        }
+
+        // 1D sizes with prime factors we have no radix for fall back to Bluestein's algorithm.
+        static const unsigned bluestein_sizes[] = { 22, 37, 101, 1031 };
+
+        for (auto Nx : bluestein_sizes)
+        {
+            if (big_workgroup)
+            {
+                continue;
+            }
+
+            enqueue_test(context, tests, args, Nx, 1, ComplexToComplex, Forward, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, 1, ComplexToComplex, Inverse, SSBO, SSBO, options, cache);
+        }
+
+        // Twiddle factors read from a precomputed table rather than computed in the shader.
+        auto lut_options = options;
+        lut_options.performance.twiddle_lut = true;
+        static const unsigned twiddle_lut_sizes[][2] = {
+            { 256, 128 }, { 1024, 1 }, { 240, 45 },
+        };
+
+        for (auto &size : twiddle_lut_sizes)
+        {
+            unsigned Nx = size[0] * N_mult;
+            unsigned Ny = size[1];
+
+            if (Ny == 1 && big_workgroup)
+            {
+                continue;
+            }
+
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, Image, SSBO, lut_options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Inverse, SSBO, SSBO, lut_options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, InverseConvolve, SSBO, SSBO, lut_options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, SSBO, lut_options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, ComplexToReal, Inverse, SSBO, SSBO, lut_options, cache);
+
+            if (options.performance.vector_size >= 4)
+            {
+                enqueue_test(context, tests, args, Nx, Ny, ComplexToComplexDual, Forward, SSBO, SSBO, lut_options, cache);
+            }
+        }
+
+        // Radix-16 and 64 butterflies exchanged with subgroup shuffles.
+        // Contexts without subgroup support fall back to shared memory.
+        auto subgroup_options = options;
+        subgroup_options.performance.subgroup_shuffle = true;
+        static const unsigned subgroup_sizes[][2] = {
+            { 64, 64 }, { 256, 16 }, { 1024, 1 },
+        };
+
+        for (auto &size : subgroup_sizes)
+        {
+            unsigned Nx = size[0] * N_mult;
+            unsigned Ny = size[1];
+
+            if (Ny == 1 && big_workgroup)
+            {
+                continue;
+            }
+
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, SSBO, SSBO, subgroup_options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, InverseConvolve, SSBO, SSBO, subgroup_options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, SSBO, subgroup_options, cache);
+
+#ifdef GLFFT_CLI_GL
+            if (!context->supports_subgroup_shuffle())
+            {
+                auto *shuffle_context = big_workgroup ? &big_shuffle_context : &small_shuffle_context;
+                enqueue_test(shuffle_context, tests, args, Nx, Ny, ComplexToComplex, Forward, SSBO, SSBO, subgroup_options, shuffle_cache);
+                enqueue_test(shuffle_context, tests, args, Nx, Ny, ComplexToComplex, InverseConvolve, SSBO, SSBO, subgroup_options, shuffle_cache);
+                enqueue_test(shuffle_context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, SSBO, subgroup_options, shuffle_cache);
+            }
+#endif
+        }
+
+        // The largest whole-row kernels, horizontally and vertically.
+        static const unsigned row_sizes[][2] = {
+            { 4096, 16 }, { 256, 4096 }, { 2048, 64 },
+        };
+
+        for (auto &size : row_sizes)
+        {
+            unsigned Nx = size[0];
+            unsigned Ny = size[1];
+
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, Image, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Inverse, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, RealToComplex, Forward, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, 2 * Nx, Ny, ComplexToReal, Inverse, SSBO, SSBO, options, cache);
+            enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Forward, SSBO, SSBO, lut_options, cache);
+
+            if (context->supports_texture_readback())
+            {
+                enqueue_test(context, tests, args, Nx, Ny, ComplexToComplex, Inverse, SSBO, Image, options, cache);
+            }
+        }
+
+        // Large 1D transforms are done as 2D transforms with the four-step algorithm.
+        static const unsigned four_step_sizes[][2] = {
+            { 1 << 16, 1 }, { 1 << 18, 2 }, { 70000, 1 },
+        };
+
+        for (auto &size : four_step_sizes)
+        {
+            unsigned Nx = size[0];
+            unsigned batch = size[1];
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, 1, ComplexToComplex, Forward, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, 1, ComplexToComplex, Inverse, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, 1, ComplexToComplex, InverseConvolve, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, 1, ComplexToComplex, Forward, lut_options, cache, batch); });
+        }
+
+        // Batched transforms, where every pass is a single dispatch for all transforms.
+        static const unsigned batch_sizes[][3] = {
+            { 256, 1, 7 }, { 64, 32, 3 }, { 240, 45, 2 }, { 101, 1, 5 },
+        };
+
+        for (auto &size : batch_sizes)
+        {
+            unsigned Nx = size[0] * (size[0] & 1 ? 1 : N_mult);
+            unsigned Ny = size[1];
+            unsigned batch = size[2];
+
+            if (Ny == 1 && big_workgroup)
+            {
+                continue;
+            }
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Forward, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Inverse, options, cache, batch); });
+
+            // Odd sizes go through Bluestein, which only supports forward and inverse complex-to-complex.
+            if (Nx & 1)
+            {
+                continue;
+            }
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, InverseConvolve, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, 2 * Nx, Ny, RealToComplex, Forward, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, 2 * Nx, Ny, ComplexToReal, Inverse, options, cache, batch); });
+
+            if (options.performance.vector_size >= 4)
+            {
+                tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplexDual, Forward, options, cache, batch); });
+            }
+        }
+
+        // Batches of small tiles, where a single work group does the entire 2D transform of a tile.
+        static const unsigned tile_sizes[][3] = {
+            { 32, 32, 16 }, { 64, 64, 4 }, { 4, 64, 3 }, { 16, 8, 5 },
+        };
+
+        for (auto &size : tile_sizes)
+        {
+            unsigned Nx = size[0];
+            unsigned Ny = size[1];
+            unsigned batch = size[2];
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Forward, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Inverse, options, cache, batch); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, InverseConvolve, options, cache, batch); });
+        }
+
+        // 3D transforms. The volumes are too thin for the big work groups.
+        static const unsigned volume_sizes[][4] = {
+            { 32, 8, 32, 1 }, { 32, 16, 16, 2 }, { 48, 20, 28, 1 },
+        };
+
+        for (auto &size : volume_sizes)
+        {
+            unsigned Nx = size[0] * N_mult;
+            unsigned Ny = size[1];
+            unsigned Nz = size[2];
+            unsigned batch = size[3];
+
+            if (big_workgroup)
+            {
+                continue;
+            }
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Forward, options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, Inverse, options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplex, InverseConvolve, options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, 2 * Nx, Ny, RealToComplex, Forward, options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, 2 * Nx, Ny, ComplexToReal, Inverse, options, cache, batch, Nz); });
+
+            if (options.performance.vector_size >= 4)
+            {
+                tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToComplexDual, Forward, options, cache, batch, Nz); });
+            }
+        }
+
+        // Real transforms with packed N / 2 + 1 sample spectrum rows.
+        // The odd number of columns is never a multiple of the work group size.
+        static const unsigned packed_sizes[][4] = {
+            { 256, 64, 1, 1 }, { 1024, 1, 1, 3 }, { 240, 45, 1, 2 }, { 64, 16, 24, 1 },
+        };
+
+        auto packed_options = options;
+        packed_options.type.packed_spectrum = true;
+
+        for (auto &size : packed_sizes)
+        {
+            unsigned Nx = size[0] * N_mult;
+            unsigned Ny = size[1];
+            unsigned Nz = size[2];
+            unsigned batch = size[3];
+
+            if ((Ny == 1 || Nz > 1) && big_workgroup)
+            {
+                continue;
+            }
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, RealToComplex, Forward, packed_options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToReal, Inverse, packed_options, cache, batch, Nz); });
+
+            // The volume reference does not convolve before the depth transform.
+            if (Nz == 1)
+            {
+                tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToReal, InverseConvolve, packed_options, cache, batch, Nz); });
+            }
+        }
+
+        // Real transforms where a whole-row horizontal pass does the resolve as well.
+        static const unsigned fused_sizes[][4] = {
+            { 512, 64, 1, 1 }, { 2048, 1, 1, 3 }, { 8192, 8, 1, 1 }, { 1024, 8, 8, 1 },
+        };
+
+        auto fused_options = options;
+        fused_options.performance.fused_resolve = true;
+        auto fused_packed_options = fused_options;
+        fused_packed_options.type.packed_spectrum = true;
+
+        for (auto &size : fused_sizes)
+        {
+            unsigned Nx = size[0];
+            unsigned Ny = size[1];
+            unsigned Nz = size[2];
+            unsigned batch = size[3];
+
+            // 8 x 4 work groups need more rows than 8192 x 8 has for the vertical passes.
+            if ((Ny < 64 || Nz > 1) && big_workgroup)
+            {
+                continue;
+            }
+
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, RealToComplex, Forward, fused_options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToReal, Inverse, fused_options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, RealToComplex, Forward, fused_packed_options, cache, batch, Nz); });
+            tests.push_back([=] { run_test_ssbo(context, args, Nx, Ny, ComplexToReal, Inverse, fused_packed_options, cache, batch, Nz); });
+
+            if (Nz == 1 && batch == 1)
+            {
+                enqueue_test(context, tests, args, Nx, Ny, ComplexToReal, InverseConvolve, SSBO, SSBO, fused_options, cache);
+                enqueue_test(context, tests, args, Nx, Ny, RealToComplex, Forward, Image, SSBO, fused_options, cache);
+            }
+        }
     }
 
+    // Plans built with deferred compilation, which only run once all their programs have compiled.
+    tests.push_back([=] {
+        auto deferred_cache = make_shared<ProgramCache>();
+        deferred_cache->set_deferred_compile(true);
+
+        FFTOptions deferred_options;
+        deferred_options.type.normalize = true;
+        vector<unique_ptr<FFT>> plans;
+        plans.emplace_back(new FFT(context, 256, 128, ComplexToComplex, Forward, SSBO, SSBO, deferred_cache, deferred_options));
+        plans.emplace_back(new FFT(context, 512, 64, RealToComplex, Forward, SSBO, SSBO, deferred_cache, deferred_options));
+        plans.emplace_back(new FFT(context, 101, 1, ComplexToComplex, Inverse, SSBO, SSBO, deferred_cache, deferred_options));
+
+        if (!deferred_cache->programs_ready(context))
+        {
+            // An application would do other work here, and poll again later.
+            deferred_cache->wait_for_programs(context);
+        }
+
+        // The programs are in the cache now, so these plans do not compile anything.
+        size_t programs = deferred_cache->cache_size();
+        run_test_ssbo(context, args, 256, 128, ComplexToComplex, Forward, deferred_options, deferred_cache);
+        run_test_ssbo(context, args, 512, 64, RealToComplex, Forward, deferred_options, deferred_cache);
+        run_test_ssbo(context, args, 101, 1, ComplexToComplex, Inverse, deferred_options, deferred_cache);
+        if (deferred_cache->cache_size() != programs)
+        {
+            throw logic_error("Plans with the same options compiled new programs.");
+        }
+    });
+
+    // A deferred compile which fails must not invalidate the programs plans already refer to.
+    tests.push_back([=] {
+        struct FailingContext : RecordingContext
+        {
+            bool end_compile_compute_shader(Program*) override { return false; }
+        };
+        FailingContext failing;
+        auto failing_cache = make_shared<ProgramCache>();
+        failing_cache->set_deferred_compile(true);
+        FFT fft(&failing, 256, 1, ComplexToComplex, Forward, SSBO, SSBO, failing_cache, FFTOptions());
+
+        bool threw = false;
+        try
+        {
+            failing_cache->wait_for_programs(&failing);
+        }
+        catch (const runtime_error &)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            throw logic_error("Expected the failed compile to throw.");
+        }
+
+        auto buffer = failing.create_buffer(nullptr, 256 * 2 * sizeof(float), AccessStreamCopy);
+        threw = false;
+        try
+        {
+            fft.process(failing.request_command_buffer(), buffer.get(), buffer.get());
+        }
+        catch (const runtime_error &)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            throw logic_error("Expected a plan with a failed program to throw.");
+        }
+    });
+
+    // Per-pass profiles, including the sub-transforms of a Bluestein plan.
+    tests.push_back([=] {
+        const unsigned sizes[][2] = { { 256, 128 }, { 101, 1 } };
+        for (auto &size : sizes)
+        {
+            context->log("Profiling %04u x %04u FFT ...\n", size[0], size[1]);
+            FFT fft(context, size[0], size[1], ComplexToComplex, Forward, SSBO, SSBO, cache, FFTOptions());
+            try
+            {
+                fft.set_profiling(true);
+            }
+            catch (const logic_error &)
+            {
+                context->log("Timestamp queries are not supported, skipping.\n");
+                return;
+            }
+
+            size_t buffer_size = size[0] * size[1] * 2 * sizeof(float);
+            auto input = create_input(buffer_size / sizeof(float));
+            auto test_input = context->create_buffer(input.get(), buffer_size, AccessStreamCopy);
+            auto test_output = context->create_buffer(nullptr, buffer_size, AccessStreamRead);
+
+            auto *cmd = context->request_command_buffer();
+            fft.process(cmd, test_output.get(), test_input.get());
+            cmd->barrier(fft.get_output_access(), AccessHostRead);
+            context->submit_command_buffer(cmd);
+            context->wait_idle();
+
+            auto profiles = fft.get_pass_profiles();
+            if (profiles.size() != fft.get_num_passes())
+            {
+                throw logic_error("Expected one profile per pass.");
+            }
+
+            for (auto &profile : profiles)
+            {
+                context->log("\tradix %4u, dispatch (%u, %u, %u), %8u bytes read, %8u bytes written, %8.3f us\n",
+                        profile.radix, profile.dispatch_x, profile.dispatch_y, profile.dispatch_z,
+                        unsigned(profile.bytes_read), unsigned(profile.bytes_written), profile.time * 1e6);
+                if (profile.time < 0.0 || profile.bytes_read == 0 || profile.bytes_written == 0)
+                {
+                    throw logic_error("Invalid pass profile.");
+                }
+            }
+        }
+    });
+
+    // Baked plans, replayed twice, must give the same results as process().
+    tests.push_back([=] {
+        const unsigned sizes[][2] = { { 256, 128 }, { 101, 1 } };
+        for (auto &size : sizes)
+        {
+            FFT fft(context, size[0], size[1], ComplexToComplex, Forward, SSBO, SSBO, cache, FFTOptions());
+
+            size_t buffer_size = size[0] * size[1] * 2 * sizeof(float);
+            auto input = create_input(buffer_size / sizeof(float));
+            auto test_input = context->create_buffer(input.get(), buffer_size, AccessStreamCopy);
+            auto test_output = context->create_buffer(nullptr, buffer_size, AccessStreamRead);
+            auto baked_output = context->create_buffer(nullptr, buffer_size, AccessStreamRead);
+
+            auto list = fft.bake(baked_output.get(), test_input.get());
+
+            auto *cmd = context->request_command_buffer();
+            fft.process(cmd, test_output.get(), test_input.get());
+            cmd->barrier(fft.get_output_access(), AccessShaderStorageRead | AccessShaderStorageWrite);
+            list->replay(cmd);
+            cmd->barrier(fft.get_output_access(), AccessShaderStorageRead | AccessShaderStorageWrite);
+            list->replay(cmd);
+            cmd->barrier(fft.get_output_access(), AccessHostRead);
+            context->submit_command_buffer(cmd);
+            context->wait_idle();
+
+            vector<float> expected(buffer_size / sizeof(float));
+            memcpy(expected.data(), context->map(test_output.get(), 0, buffer_size), buffer_size);
+            context->unmap(test_output.get());
+
+            bool equal = memcmp(expected.data(), context->map(baked_output.get(), 0, buffer_size), buffer_size) == 0;
+            context->unmap(baked_output.get());
+            if (!equal)
+            {
+                throw logic_error("Replayed plan does not match process().");
+            }
+        }
+    });
+
+    // Programs precompiled into a bundle, which backends that do not take SPIR-V reject in favor of compiling.
+    tests.push_back([=] {
+        FFTOptions bundle_options;
+        bundle_options.type.normalize = true;
+
+        auto plan_cache = make_shared<ProgramCache>();
+        FFT plan(context, 256, 128, RealToComplex, Forward, SSBO, SSBO, plan_cache, bundle_options);
+
+        ProgramBundle bundle;
+        for (auto &params : plan_cache->get_parameters())
+        {
+            vector<uint32_t> spirv;
+            if (!compile_glsl_to_spirv(FFT::build_program_source(params).c_str(), spirv))
+            {
+                throw logic_error("Failed to compile program to SPIR-V.");
+            }
+            bundle.add(params, move(spirv));
+        }
+
+        const char *path = "glfft_test_bundle.bin";
+        auto loaded = make_shared<ProgramBundle>();
+        bool saved = bundle.save(path) && loaded->load(path);
+        remove(path);
+        if (!saved || loaded->size() != bundle.size())
+        {
+            throw logic_error("Program bundle did not survive a round trip.");
+        }
+
+        auto bundle_cache = make_shared<ProgramCache>();
+        bundle_cache->set_program_bundle(loaded);
+        run_test_ssbo(context, args, 256, 128, RealToComplex, Forward, bundle_options, bundle_cache);
+    });
+
+#ifdef GLFFT_CLI_GL
+    // Running a plan twice in one command buffer skips the binds which are still current,
+    // which must not change the results.
+    tests.push_back([=] {
+        FFT fft(context, 64, 1, ComplexToComplex, Forward, SSBO, SSBO, cache, FFTOptions());
+
+        size_t buffer_size = 64 * 2 * sizeof(float);
+        auto input = create_input(buffer_size / sizeof(float));
+        auto test_input = context->create_buffer(input.get(), buffer_size, AccessStreamCopy);
+        auto expected_output = context->create_buffer(nullptr, buffer_size, AccessStreamRead);
+        auto test_output = context->create_buffer(nullptr, buffer_size, AccessStreamRead);
+
+        auto *cmd = context->request_command_buffer();
+        fft.process(cmd, expected_output.get(), test_input.get());
+        cmd->barrier(fft.get_output_access(), AccessHostRead);
+        context->submit_command_buffer(cmd);
+
+        auto *gl_cmd = static_cast<GLCommandBuffer*>(context->request_command_buffer());
+        gl_cmd->reset_bind_counters();
+        fft.process(gl_cmd, test_output.get(), test_input.get());
+        gl_cmd->barrier(fft.get_output_access(), AccessShaderStorageRead | AccessShaderStorageWrite);
+        fft.process(gl_cmd, test_output.get(), test_input.get());
+        gl_cmd->barrier(fft.get_output_access(), AccessHostRead);
+        unsigned elided_binds = gl_cmd->get_elided_binds();
+        context->submit_command_buffer(gl_cmd);
+        context->wait_idle();
+
+        if (elided_binds == 0)
+        {
+            throw logic_error("Expected binds of the second run to be elided.");
+        }
+
+        vector<float> expected(buffer_size / sizeof(float));
+        memcpy(expected.data(), context->map(expected_output.get(), 0, buffer_size), buffer_size);
+        context->unmap(expected_output.get());
+
+        bool equal = memcmp(expected.data(), context->map(test_output.get(), 0, buffer_size), buffer_size) == 0;
+        context->unmap(test_output.get());
+        if (!equal)
+        {
+            throw logic_error("Elided binds changed the output.");
+        }
+        context->log("\t%u binds elided.\n", elided_binds);
+    });
+#endif
+
+    tests.push_back(test_cpu_pass_configuration);
+    tests.push_back(test_spirv_work_group_semantics);
+
+    // Plans on a RecordingContext are only traced, check the trace against the plan.
+    tests.push_back([=] {
+        RecordingContext recording;
+        auto recording_cache = make_shared<ProgramCache>();
+        FFT fft(&recording, 256, 128, ComplexToComplex, Forward, SSBO, SSBO, recording_cache, FFTOptions());
+        if (recording.get_shader_sources().size() != recording_cache->cache_size())
+        {
+            throw logic_error("Expected one compiled shader per cached program.");
+        }
+
+        size_t buffer_size = 256 * 128 * 2 * sizeof(float);
+        auto test_input = recording.create_buffer(nullptr, buffer_size, AccessStreamCopy);
+        auto test_output = recording.create_buffer(nullptr, buffer_size, AccessStreamRead);
+
+        auto *cmd = recording.request_command_buffer();
+        fft.process(cmd, test_output.get(), test_input.get());
+        recording.submit_command_buffer(cmd);
+        if (recording.get_submissions().size() != 1)
+        {
+            throw logic_error("Expected one submitted command buffer.");
+        }
+
+        unsigned dispatches = 0, barriers = 0, constants = 0;
+        void *program = nullptr;
+        void *ssbo_in = nullptr;
+        void *ssbo_out = nullptr;
+        for (auto &command : recording.get_submissions().front()->get_commands())
+        {
+            switch (command.type)
+            {
+                case CommandList::CommandBindProgram:
+                    program = command.object;
+                    break;
+
+                case CommandList::CommandBindStorageBuffer:
+                case CommandList::CommandBindStorageBufferRange:
+                    // Bindings 0 and 1 are the input and output of a pass, see the bindings in glfft.cpp.
+                    if (command.binding == 0)
+                    {
+                        ssbo_in = command.object;
+                    }
+                    else if (command.binding == 1)
+                    {
+                        ssbo_out = command.object;
+                    }
+                    break;
+
+                case CommandList::CommandPushConstantData:
+                    if (command.size == 0 || command.size > CommandBuffer::MaxConstantDataSize)
+                    {
+                        throw logic_error("Invalid push constant payload.");
+                    }
+                    constants++;
+                    break;
+
+                case CommandList::CommandDispatch:
+                    if (!program || !ssbo_in || !ssbo_out || command.x == 0 || command.y == 0 || command.z == 0)
+                    {
+                        throw logic_error("Dispatch without a complete pipeline.");
+                    }
+                    if (dispatches == 0 && ssbo_in != test_input.get())
+                    {
+                        throw logic_error("First pass does not read the input.");
+                    }
+                    dispatches++;
+                    break;
+
+                case CommandList::CommandBarrierAccess:
+                    barriers++;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        if (dispatches != fft.get_num_passes() || constants != dispatches || barriers + 1 != dispatches)
+        {
+            throw logic_error("Trace does not match the passes of the plan.");
+        }
+        if (ssbo_out != test_output.get())
+        {
+            throw logic_error("Last pass does not write the output.");
+        }
+    });
+
+    // Whole-row passes must fit the work group size limits of the context, e.g. 64 in Z on many GPUs.
+    tests.push_back([=] {
+        RecordingContext recording(256, 0, 64);
+        FFT fft(&recording, 4096, 1, ComplexToComplex, Forward, SSBO, SSBO, make_shared<ProgramCache>(), FFTOptions());
+        for (auto &source : recording.get_shader_sources())
+        {
+            size_t pos = source.find("local_size_z = ");
+            if (pos == string::npos || stoul(source.substr(pos + strlen("local_size_z = "))) > 64)
+            {
+                throw logic_error("Work group exceeds the Z limit of the context.");
+            }
+        }
+    });
+
     context->log("Enqueued %u tests!\n", unsigned(tests.size()));
 
     unsigned successful_tests = 0;
@@ -0,0 +1,151 @@
+/* Copyright (C) 2015 Hans-Kristian Arntzen <maister@archlinux.us>
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "glfft_vulkan_interface.hpp"
+#include "glfft_context.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace GLFFT;
+using namespace std;
+
+// Headless Vulkan 1.1 device, e.g. lavapipe on machines without a GPU.
+// GLFFT_VULKAN_DEVICE selects a physical device by index, or by part of its name.
+// Validation layers can be enabled through the loader with VK_INSTANCE_LAYERS.
+
+struct VulkanContextHeadless : VulkanContext
+{
+    VulkanContextHeadless(VkInstance instance, VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family)
+        : VulkanContext(gpu, device, queue, queue_family), instance(instance)
+    {
+    }
+
+    ~VulkanContextHeadless()
+    {
+        VkDevice device = get_device();
+        teardown();
+        vkDestroyDevice(device, nullptr);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    VkInstance instance;
+};
+
+static VkPhysicalDevice get_physical_device(VkInstance instance)
+{
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, nullptr);
+    vector<VkPhysicalDevice> gpus(count);
+    vkEnumeratePhysicalDevices(instance, &count, gpus.data());
+
+    const char *device = getenv("GLFFT_VULKAN_DEVICE");
+    if (!device)
+    {
+        return count ? gpus.front() : VK_NULL_HANDLE;
+    }
+
+    char *end = nullptr;
+    unsigned index = unsigned(strtoul(device, &end, 0));
+    if (end != device && *end == '\0')
+    {
+        return index < count ? gpus[index] : VK_NULL_HANDLE;
+    }
+
+    // Otherwise, the first device with the string in its name, e.g. "llvmpipe" for lavapipe.
+    for (auto gpu : gpus)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(gpu, &properties);
+        if (strstr(properties.deviceName, device))
+        {
+            return gpu;
+        }
+    }
+    return VK_NULL_HANDLE;
+}
+
+unique_ptr<Context> GLFFT::create_cli_context()
+{
+    VkApplicationInfo app = {};
+    app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app.pApplicationName = "GLFFT";
+    app.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instance_info = {};
+    instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pApplicationInfo = &app;
+
+    VkInstance instance;
+    if (vkCreateInstance(&instance_info, nullptr, &instance) != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create Vulkan instance.\n");
+        return nullptr;
+    }
+
+    VkPhysicalDevice gpu = get_physical_device(instance);
+    if (gpu == VK_NULL_HANDLE)
+    {
+        fprintf(stderr, "Found no Vulkan device.\n");
+        vkDestroyInstance(instance, nullptr);
+        return nullptr;
+    }
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, nullptr);
+    vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, families.data());
+
+    uint32_t queue_family = 0;
+    while (queue_family < family_count && !(families[queue_family].queueFlags & VK_QUEUE_COMPUTE_BIT))
+    {
+        queue_family++;
+    }
+
+    if (queue_family == family_count)
+    {
+        fprintf(stderr, "Vulkan device has no compute queue.\n");
+        vkDestroyInstance(instance, nullptr);
+        return nullptr;
+    }
+
+    static const float priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+
+    VkDevice device;
+    if (vkCreateDevice(gpu, &device_info, nullptr, &device) != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create Vulkan device.\n");
+        vkDestroyInstance(instance, nullptr);
+        return nullptr;
+    }
+
+    VkQueue queue;
+    vkGetDeviceQueue(device, queue_family, 0, &queue);
+    return unique_ptr<Context>(new VulkanContextHeadless(instance, gpu, device, queue, queue_family));
+}